@@ -0,0 +1,78 @@
+#!/usr/bin/env bash
+
+# This script measures how the training throughput of balsa_train degrades as
+# the available memory shrinks. It generates a data set, and trains a forest on
+# it with the point file memory-mapped (-m) and the sorted feature indices
+# stored in scratch files (-sd), first without a memory limit, and then under a
+# series of decreasing memory limits. The limits are enforced with a systemd
+# scope (cgroups), so the operating system has to page the data set and the
+# indices in and out of the available memory. This script looks for Balsa
+# command-line tools in the current directory, so it can be run from the
+# build/Sources/ directory.
+#
+# The size of the experiment can be set through environment variables, e.g.:
+#
+#   POINTCOUNT=20000000 MEMORYLIMITS="4G 2G 1G" ./outofcorebenchmark.sh
+
+# Add the current directory to the path, in case this script is run from the build directory without installing.
+PATH=$PATH:.
+
+POINTCOUNT=${POINTCOUNT:-2000000}
+TREECOUNT=${TREECOUNT:-4}
+THREADCOUNT=${THREADCOUNT:-4}
+ENGINE=${ENGINE:-shared}
+MEMORYLIMITS=${MEMORYLIMITS:-"512M 256M 128M 64M"}
+SCRATCHDIR=${SCRATCHDIR:-.}
+
+# Create a test set generation script with 16 features.
+echo ":: Generating a test data generator script..."
+echo
+cat << EOF > outofcoregenscript.txt
+multisource(16)
+{
+    source(50)
+    {
+        gaussian(0, 1); gaussian(0, 1); gaussian(0, 1); gaussian(0, 1);
+        gaussian(0, 1); gaussian(0, 1); gaussian(0, 1); gaussian(0, 1);
+        gaussian(0, 1); gaussian(0, 1); gaussian(0, 1); gaussian(0, 1);
+        gaussian(0, 1); gaussian(0, 1); gaussian(0, 1); gaussian(0, 1);
+    }
+    source(50)
+    {
+        gaussian(1, 2); gaussian(1, 2); gaussian(1, 2); gaussian(1, 2);
+        gaussian(1, 2); gaussian(1, 2); gaussian(1, 2); gaussian(1, 2);
+        gaussian(1, 2); gaussian(1, 2); gaussian(1, 2); gaussian(1, 2);
+        gaussian(1, 2); gaussian(1, 2); gaussian(1, 2); gaussian(1, 2);
+    }
+}
+EOF
+
+# Generate a training set.
+echo ":: Generating ${POINTCOUNT} training points..."
+balsa_generate -p ${POINTCOUNT} -s 0 outofcoregenscript.txt outofcore-data.balsa outofcore-labels.balsa
+echo
+
+# Train once, and print the wall clock time and the throughput in points per second per tree.
+function train()
+{
+    local START=$(date +%s.%N)
+    "$@" balsa_train -t ${THREADCOUNT} -c ${TREECOUNT} -s 0 -e ${ENGINE} -m -sd ${SCRATCHDIR} outofcore-data.balsa outofcore-labels.balsa outofcore-model.balsa > /dev/null || return 1
+    local END=$(date +%s.%N)
+    echo "${START} ${END}" | awk -v points=${POINTCOUNT} -v trees=${TREECOUNT} '{ printf "%8.2f s %14.0f points/s\n", $2 - $1, points * trees / ( $2 - $1 ) }'
+}
+
+echo ":: Training without a memory limit..."
+printf "%-12s " "unlimited"
+train
+echo
+
+# Train under each memory limit, if memory limits can be enforced on this system.
+if ! systemd-run --user --scope --quiet -p MemoryMax=1G true 2> /dev/null; then
+    echo ":: Memory limits cannot be enforced on this system (systemd-run failed), skipping."
+    exit 0
+fi
+echo ":: Training under memory limits..."
+for LIMIT in ${MEMORYLIMITS}; do
+    printf "%-12s " "${LIMIT}"
+    train systemd-run --user --scope --quiet -p MemoryMax=${LIMIT} -p MemorySwapMax=0 || echo "failed"
+done
@@ -0,0 +1,103 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+namespace balsa
+{
+
+/**
+ * A growable array of fixed-width slots, that is allocated in large chunks.
+ *
+ * Unlike a std::vector, the arena never moves a slot once it has been
+ * allocated, so pointers to slots remain valid while slots are added. Unlike a
+ * std::deque, it allocates many slots at a time, so adding a slot rarely
+ * calls the allocator. Slots cannot be released individually; all slots are
+ * released at once when the arena is reset or destroyed.
+ *
+ * The arena is not thread safe: slots may be allocated and looked up by index
+ * by one thread at a time. Pointers to slots can be used by any thread.
+ */
+template <typename T>
+class SlotArena
+{
+public:
+
+    /**
+     * Constructor.
+     * \param slotWidth The number of elements per slot.
+     * \param slotsPerChunk The number of slots that are allocated at a time.
+     */
+    explicit SlotArena( std::size_t slotWidth = 1, std::size_t slotsPerChunk = 1024 ):
+    m_slotWidth( slotWidth ),
+    m_slotsPerChunk( slotsPerChunk ),
+    m_lastChunkSlotCount( 0 )
+    {
+        assert( slotsPerChunk > 0 );
+    }
+
+    SlotArena( const SlotArena & ) = delete;
+    SlotArena & operator=( const SlotArena & ) = delete;
+
+    /**
+     * Allocate a slot. Its elements are value-initialized.
+     * \return A pointer to the first element of the slot, that remains valid until the arena is reset.
+     */
+    T * allocate()
+    {
+        if ( m_chunks.empty() || m_lastChunkSlotCount == m_slotsPerChunk )
+        {
+            m_chunks.push_back( std::make_unique<T[]>( m_slotWidth * m_slotsPerChunk ) );
+            m_lastChunkSlotCount = 0;
+        }
+        return m_chunks.back().get() + m_slotWidth * m_lastChunkSlotCount++;
+    }
+
+    /**
+     * Returns a pointer to the first element of a slot, by allocation order.
+     */
+    T * operator[]( std::size_t slot ) const
+    {
+        assert( slot < size() );
+        return m_chunks[slot / m_slotsPerChunk].get() + m_slotWidth * ( slot % m_slotsPerChunk );
+    }
+
+    /**
+     * Returns the number of allocated slots.
+     */
+    std::size_t size() const
+    {
+        return m_chunks.empty() ? 0 : ( m_chunks.size() - 1 ) * m_slotsPerChunk + m_lastChunkSlotCount;
+    }
+
+    /**
+     * Returns the number of elements per slot.
+     */
+    std::size_t getSlotWidth() const
+    {
+        return m_slotWidth;
+    }
+
+    /**
+     * Release all slots at once, and change the slot width.
+     */
+    void reset( std::size_t slotWidth )
+    {
+        m_chunks             = std::vector<std::unique_ptr<T[]>>();
+        m_lastChunkSlotCount = 0;
+        m_slotWidth          = slotWidth;
+    }
+
+private:
+
+    std::size_t                       m_slotWidth;
+    std::size_t                       m_slotsPerChunk;
+    std::size_t                       m_lastChunkSlotCount;
+    std::vector<std::unique_ptr<T[]>> m_chunks;
+};
+
+} // namespace balsa
+
+#endif // ARENA_H
@@ -9,6 +9,7 @@
 #include "config.h"
 #include "datatypes.h"
 #include "exceptions.h"
+#include "fileio.h"
 #include "randomforestclassifier.h"
 #include "table.h"
 #include "timing.h"
@@ -23,7 +24,8 @@ public:
 
     Options():
     threadCount( 1 ),
-    maxPreload( 1 )
+    maxPreload( 1 ),
+    quickScorer( false )
     {
     }
 
@@ -39,6 +41,9 @@ public:
            << "   -t <thread count>   : Number of threads (default: 1)." << std::endl
            << "   -p <preload count>  : Number of trees to preload (default: 1)." << std::endl
            << "   -cw <label> <weight>: Sets class weight (see below). (default: 1)." << std::endl
+           << "   -qs                 : Classify with the QuickScorer algorithm, which loads" << std::endl
+           << "                         all trees, and can be faster for large forests of" << std::endl
+           << "                         shallow trees (at most 1024 leaves per tree)." << std::endl
            << std::endl
            << "The class/label for each point is determined by counting the votes of a set of" << std::endl
            << "independently trained, randomized decision trees. The user can provide a class" << std::endl
@@ -85,6 +90,10 @@ public:
                 if ( !( args >> weight ) ) throw ParseError( "Missing weight parameter to -cw option." );
                 options.m_classWeights.push_back( std::tuple<unsigned int, float>( label, weight ) );
             }
+            else if ( token == "-qs" )
+            {
+                options.quickScorer = true;
+            }
             else
             {
                 throw ParseError( std::string( "Unknown option: " ) + token );
@@ -113,6 +122,7 @@ public:
     std::vector<std::string>                     dataFiles;
     unsigned int                                 threadCount;
     unsigned int                                 maxPreload;
+    bool                                         quickScorer;
     std::vector<std::tuple<unsigned int, float>> m_classWeights;
 };
 
@@ -128,6 +138,26 @@ std::string createOutputFileName( const std::string & inputFilePath )
     return outFile;
 }
 
+/**
+ * Classify a data set that has just been loaded, and add the durations of
+ * loading and classifying it to the totals.
+ * \param watch The stop watch that was started before loading the data set.
+ */
+template <typename FeatureType>
+Table<Label> classifyDataSet( const RandomForestClassifier & classifier, const Table<FeatureType> & dataSet, StopWatch & watch, StopWatch::Seconds & dataLoadTime, StopWatch::Seconds & classificationTime )
+{
+    std::cout << "Dataset loaded: " << dataSet.getColumnCount() << " features x " << dataSet.getRowCount() << " points." << std::endl;
+    dataLoadTime += watch.getElapsedTime();
+
+    // Classify the data.
+    watch.start();
+    Table<Label> labels( dataSet.getRowCount(), 1 );
+    classifier.classify( dataSet.begin(), dataSet.end(), labels.begin() );
+    watch.stop();
+    classificationTime += watch.getElapsedTime();
+    return labels;
+}
+
 } // namespace
 
 int main( int argc, char ** argv )
@@ -143,6 +173,7 @@ int main( int argc, char ** argv )
         for ( auto & f : options.dataFiles ) std::cout << ' ' << f << std::endl;
         std::cout << "Threads    : " << options.threadCount << std::endl;
         std::cout << "Preload    : " << options.maxPreload << std::endl;
+        std::cout << "QuickScorer: " << ( options.quickScorer ? "yes" : "no" ) << std::endl;
         std::cout << std::endl;
         assert( options.threadCount > 0 );
 
@@ -161,26 +192,33 @@ int main( int argc, char ** argv )
         }
         classifier.setClassWeights( weights );
 
+        // Convert the forest for the QuickScorer algorithm.
+        if ( options.quickScorer ) classifier.enableQuickScorer();
+
         // Load and classify all files, measuring the duration.
         StopWatch::Seconds dataLoadTime       = 0;
         StopWatch::Seconds classificationTime = 0;
         StopWatch::Seconds labelStoreTime     = 0;
         for ( auto & dataFile : options.dataFiles )
         {
-            // Load the data.
+            // Load the data, in its own feature type if it is supported, and classify it.
             StopWatch watch;
             std::cout << "Ingesting data..." << std::endl;
             watch.start();
-            auto dataSet = readTableAs<double>( dataFile );
-            std::cout << "Dataset loaded: " << dataSet.getColumnCount() << " features x " << dataSet.getRowCount() << " points." << std::endl;
-            dataLoadTime += watch.getElapsedTime();
-
-            // Classify the data.
-            watch.start();
-            Table<Label> labels( dataSet.getRowCount(), 1 );
-            classifier.classify( dataSet.begin(), dataSet.end(), labels.begin() );
-            watch.stop();
-            classificationTime += watch.getElapsedTime();
+            BalsaFileParser parser( dataFile );
+            Table<Label>    labels( 1 );
+            if ( parser.atTableOfType<float>() )
+                labels = classifyDataSet( classifier, parser.parseTable<float>(), watch, dataLoadTime, classificationTime );
+            else if ( parser.atTableOfType<double>() )
+                labels = classifyDataSet( classifier, parser.parseTable<double>(), watch, dataLoadTime, classificationTime );
+            else if ( parser.atTableOfType<uint8_t>() )
+                labels = classifyDataSet( classifier, parser.parseTable<uint8_t>(), watch, dataLoadTime, classificationTime );
+            else if ( parser.atTableOfType<uint16_t>() )
+                labels = classifyDataSet( classifier, parser.parseTable<uint16_t>(), watch, dataLoadTime, classificationTime );
+            else if ( parser.atTableOfType<int16_t>() )
+                labels = classifyDataSet( classifier, parser.parseTable<int16_t>(), watch, dataLoadTime, classificationTime );
+            else
+                labels = classifyDataSet( classifier, parser.parseTableAs<double>(), watch, dataLoadTime, classificationTime );
 
             // Store the labels.
             watch.start();
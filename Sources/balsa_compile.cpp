@@ -0,0 +1,114 @@
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "classifierfilestream.h"
+#include "exceptions.h"
+#include "modelcompiler.h"
+
+using namespace balsa;
+
+namespace
+{
+class Options
+{
+public:
+
+    Options()
+    {
+    }
+
+    static std::string getUsage()
+    {
+        std::stringstream ss;
+        ss << "Usage:" << std::endl
+           << std::endl
+           << "   balsa_compile [options] <model file> <source file>" << std::endl
+           << std::endl
+           << " Options:" << std::endl
+           << std::endl
+           << "   -p <prefix>         : Prefix for the names of the generated functions" << std::endl
+           << "                         (default: none)." << std::endl
+           << std::endl
+           << "Writes a C++ source file that classifies points with the trees of the model," << std::endl
+           << "for models that are used so often that compiling them pays off. The source" << std::endl
+           << "file exposes the C functions classify(), classifyAndVote(), getClassCount()," << std::endl
+           << "getFeatureCount() and getTreeCount(), which take single-precision points." << std::endl
+           << "Build it as a shared object (e.g. c++ -O2 -shared -fPIC -o model.so" << std::endl
+           << "model.cpp), and load it with balsa::CompiledClassifier. It casts exactly the" << std::endl
+           << "same votes as the model." << std::endl;
+        return ss.str();
+    }
+
+    static Options parseOptions( int argc, char ** argv )
+    {
+        // Put all arguments in a stringstream.
+        std::stringstream args;
+        for ( int i = 0; i < argc; ++i ) args << ' ' << argv[i];
+
+        // Discard the executable name.
+        std::string token;
+        args >> token;
+        token = "";
+
+        // Parse all flags.
+        Options options;
+        while ( args >> token )
+        {
+            // Stop if the token is not a flag.
+            assert( token.size() );
+            if ( token[0] != '-' ) break;
+
+            // Parse the '-p <prefix>' option.
+            if ( token == "-p" )
+            {
+                if ( !( args >> options.symbolPrefix ) ) throw ParseError( "Missing parameter to -p option." );
+            }
+            else
+            {
+                throw ParseError( std::string( "Unknown option: " ) + token );
+            }
+        }
+
+        // Parse the file names.
+        if ( token.size() == 0 ) throw ParseError( getUsage() );
+        options.modelFile = token;
+        if ( !( args >> options.sourceFile ) ) throw ParseError( getUsage() );
+
+        // Return results.
+        return options;
+    }
+
+    std::string modelFile;
+    std::string sourceFile;
+    std::string symbolPrefix;
+};
+
+} // namespace
+
+int main( int argc, char ** argv )
+{
+    try
+    {
+        // Parse the command-line arguments.
+        Options options = Options::parseOptions( argc, argv );
+
+        // Compile the trees one by one, so that only one of them is in memory at a time.
+        ClassifierFileInputStream classifierStream( options.modelFile, 1 );
+        std::ofstream             out( options.sourceFile );
+        if ( !out.good() ) throw SupplierError( "Could not open file for writing." );
+        compileModel( classifierStream, out, options.symbolPrefix, options.modelFile );
+        out.close();
+        if ( !out ) throw SupplierError( "Could not write the source file." );
+    }
+    catch ( Exception & e )
+    {
+        std::cerr << e.getMessage() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Finish.
+    return EXIT_SUCCESS;
+}
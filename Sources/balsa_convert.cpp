@@ -1,7 +1,9 @@
 #include <cassert>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <string>
 
@@ -19,7 +21,8 @@ class Options
 {
 public:
 
-    Options()
+    Options():
+    typeName( "double" )
     {
     }
 
@@ -28,9 +31,15 @@ public:
         std::stringstream ss;
         ss << "Usage:" << std::endl
            << std::endl
-           << "   balsa_convert <csv file> <output file>" << std::endl
+           << "   balsa_convert [options] <csv file> <output file>" << std::endl
            << std::endl
-           << "Converts comma separated values (CSV) to double precision Balsa input files.";
+           << " Options:" << std::endl
+           << std::endl
+           << "   -t <type>         : Element type of the output file: 'double' (default)," << std::endl
+           << "                       'float', 'uint8', 'uint16' or 'int16'. Values must be" << std::endl
+           << "                       representable in the integer types." << std::endl
+           << std::endl
+           << "Converts comma separated values (CSV) to Balsa input files.";
         return ss.str();
     }
 
@@ -52,7 +61,17 @@ public:
             // Stop if the token is not a flag.
             assert( token.size() );
             if ( token[0] != '-' ) break;
-            throw ParseError( std::string( "Unknown option: " ) + token );
+
+            // Parse the flag.
+            if ( token == "-t" )
+            {
+                if ( !( args >> options.typeName ) ) throw ParseError( "Missing parameter to -t option." );
+            }
+            else
+            {
+                throw ParseError( std::string( "Unknown option: " ) + token );
+            }
+            token = "";
         }
 
         // Parse the filenames.
@@ -66,10 +85,31 @@ public:
         return options;
     }
 
+    std::string typeName;
     std::string csvFile;
     std::string outputFile;
 };
 
+/**
+ * Convert a table to the specified element type, and write it.
+ */
+template <typename ScalarType>
+void writeTableAs( const Table<double> & table, BalsaFileWriter & fileWriter )
+{
+    Table<ScalarType> result( table.getRowCount(), table.getColumnCount() );
+    for ( std::size_t row = 0; row < table.getRowCount(); ++row )
+    {
+        for ( std::size_t column = 0; column < table.getColumnCount(); ++column )
+        {
+            auto value = table( row, column );
+            if ( std::is_integral<ScalarType>::value && !( value >= std::numeric_limits<ScalarType>::min() && value <= std::numeric_limits<ScalarType>::max() && value == std::trunc( value ) ) )
+                throw ClientError( "Value cannot be converted to the output type: " + std::to_string( value ) );
+            result( row, column ) = static_cast<ScalarType>( value );
+        }
+    }
+    fileWriter.writeTable( result );
+}
+
 } // namespace
 
 int main( int argc, char ** argv )
@@ -86,7 +126,18 @@ int main( int argc, char ** argv )
 
         // Write the output file.
         BalsaFileWriter fileWriter( options.outputFile, "balsa_convert", balsa_VERSION_MAJOR, balsa_VERSION_MINOR, balsa_VERSION_PATCH );
-        fileWriter.writeTable( table );
+        if ( options.typeName == "double" )
+            fileWriter.writeTable( table );
+        else if ( options.typeName == "float" )
+            writeTableAs<float>( table, fileWriter );
+        else if ( options.typeName == "uint8" )
+            writeTableAs<uint8_t>( table, fileWriter );
+        else if ( options.typeName == "uint16" )
+            writeTableAs<uint16_t>( table, fileWriter );
+        else if ( options.typeName == "int16" )
+            writeTableAs<int16_t>( table, fileWriter );
+        else
+            throw ClientError( "Unknown output type: " + options.typeName );
     }
     catch ( Exception & e )
     {
@@ -85,22 +85,7 @@ int main( int argc, char ** argv )
         EnsembleFileOutputStream out( options.outputFile, "balsa_merge", balsa_VERSION_MAJOR, balsa_VERSION_MINOR, balsa_VERSION_PATCH );
 
         // Append all input models to the merged file.
-        unsigned int classCount   = 0;
-        unsigned int featureCount = 0;
-        for ( auto & modelFile : options.modelFiles )
-        {
-            // Open the input file and make sure the model is compatible with what was merged earlier.
-            ClassifierFileInputStream in( modelFile );
-            if ( classCount != 0 && in.getClassCount() != classCount )
-                throw ClientError( "The class count of the model '" + modelFile + "' differs from the earlier input files." );
-            if ( featureCount != 0 && in.getFeatureCount() != featureCount )
-                throw ClientError( "The feature count of the model '" + modelFile + "' differs from the earlier input files." );
-            classCount   = in.getClassCount();
-            featureCount = in.getFeatureCount();
-
-            // Append all submodels to the output file.
-            while ( auto submodel = in.next() ) out.write( *submodel );
-        }
+        mergeModelFiles( options.modelFiles, out );
 
         // Close the merged file.
         out.close();
@@ -143,6 +143,12 @@ class PrintDispatcher: public ClassifierVisitor
 {
 public:
 
+    void visit( const CompiledClassifier & classifier )
+    {
+        (void) classifier;
+        assert( false );
+    }
+
     void visit( const EnsembleClassifier & classifier )
     {
         (void) classifier;
@@ -158,6 +164,21 @@ public:
     {
         std::cout << classifier;
     }
+
+    void visit( const DecisionTreeClassifier<uint8_t> & classifier )
+    {
+        std::cout << classifier;
+    }
+
+    void visit( const DecisionTreeClassifier<uint16_t> & classifier )
+    {
+        std::cout << classifier;
+    }
+
+    void visit( const DecisionTreeClassifier<int16_t> & classifier )
+    {
+        std::cout << classifier;
+    }
 };
 
 } // namespace
@@ -212,6 +233,15 @@ int main( int argc, char ** argv )
                 auto            classifier = parser.parseClassifier();
                 classifier->visit( printer );
             }
+            else if ( parser.atFeatureIndex() )
+            {
+                // The sorted lists of a feature index are not printed, only its description.
+                std::size_t        valuesOffset   = 0;
+                std::size_t        pointIDsOffset = 0;
+                FeatureIndexHeader header         = parser.skipFeatureIndex( valuesOffset, pointIDsOffset );
+                std::cout << "FEATURE INDEX '" << header.key << "', " << header.featureCount << " features, " << header.pointCount << " points, "
+                          << getFeatureTypeName( header.featureTypeID ) << " values." << std::endl;
+            }
             else if ( parser.atTable() )
             {
                 // Parse and print the table.
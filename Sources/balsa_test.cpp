@@ -1,13 +1,27 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <numeric>
+#include <random>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "compiledclassifier.h"
 #include "datagenerator.h"
 #include "datatypes.h"
+#include "featureindex.h"
+#include "messagequeue.h"
+#include "modelcompiler.h"
 #include "randomforestclassifier.h"
 #include "randomforesttrainer.h"
 #include "table.h"
@@ -42,6 +56,277 @@ private:
     std::filesystem::path m_path;
 };
 
+/**
+ * Returns true iff the two specified files have identical contents.
+ */
+bool haveEqualContents( const std::string & filename1, const std::string & filename2 )
+{
+    std::ifstream file1( filename1, std::ios::binary );
+    std::ifstream file2( filename2, std::ios::binary );
+    std::string   contents1( ( std::istreambuf_iterator<char>( file1 ) ), std::istreambuf_iterator<char>() );
+    std::string   contents2( ( std::istreambuf_iterator<char>( file2 ) ), std::istreambuf_iterator<char>() );
+    return contents1 == contents2;
+}
+
+/**
+ * A classifier stream that passes on the classifiers of another stream, but
+ * throws an exception instead of returning the classifier at a given position.
+ */
+class FailingClassifierStream: public ClassifierInputStream
+{
+public:
+
+    FailingClassifierStream( ClassifierInputStream & stream, unsigned int failurePosition ):
+    m_stream( stream ),
+    m_failurePosition( failurePosition ),
+    m_position( 0 )
+    {
+    }
+
+    unsigned int getClassCount() const
+    {
+        return m_stream.getClassCount();
+    }
+
+    unsigned int getFeatureCount() const
+    {
+        return m_stream.getFeatureCount();
+    }
+
+    void rewind()
+    {
+        m_stream.rewind();
+        m_position = 0;
+    }
+
+    Classifier::SharedPointer next()
+    {
+        if ( m_position++ == m_failurePosition ) throw SupplierError( "Failed to read a classifier." );
+        return m_stream.next();
+    }
+
+    void setFailurePosition( unsigned int failurePosition )
+    {
+        m_failurePosition = failurePosition;
+    }
+
+private:
+
+    ClassifierInputStream & m_stream;
+    unsigned int            m_failurePosition;
+    unsigned int            m_position;
+};
+
+/**
+ * A classifier output stream that discards the classifiers, and throws an
+ * exception instead of writing the classifier at a given position.
+ */
+class FailingClassifierOutputStream: public ClassifierOutputStream
+{
+public:
+
+    FailingClassifierOutputStream( unsigned int failurePosition ):
+    m_failurePosition( failurePosition ),
+    m_writeCount( 0 )
+    {
+    }
+
+    unsigned int getWriteCount() const
+    {
+        return m_writeCount;
+    }
+
+private:
+
+    void onWrite( const Classifier & )
+    {
+        if ( m_writeCount++ == m_failurePosition ) throw SupplierError( "Failed to write a classifier." );
+    }
+
+    unsigned int m_failurePosition;
+    unsigned int m_writeCount;
+};
+
+/**
+ * Generate a data set of points on three concentric rings in two dimensions,
+ * labeled by their ring.
+ */
+template <typename FeatureType>
+std::pair<Table<FeatureType>, Table<Label>> makeConcentricRings( std::size_t pointCount )
+{
+    typename SingleSourceGenerator<FeatureType>::SharedPointer ring0( new SingleSourceGenerator<FeatureType>() );
+    typename SingleSourceGenerator<FeatureType>::SharedPointer ring1( new SingleSourceGenerator<FeatureType>() );
+    typename SingleSourceGenerator<FeatureType>::SharedPointer ring2( new SingleSourceGenerator<FeatureType>() );
+    ring0->addFeatureGenerator( typename FeatureGenerator<FeatureType>::SharedPointer( new AnnulusFeatureGenerator<FeatureType>( 0.0, 2.0 ) ) );
+    ring1->addFeatureGenerator( typename FeatureGenerator<FeatureType>::SharedPointer( new AnnulusFeatureGenerator<FeatureType>( 2.25, 3.25 ) ) );
+    ring2->addFeatureGenerator( typename FeatureGenerator<FeatureType>::SharedPointer( new AnnulusFeatureGenerator<FeatureType>( 3.5, 7.0 ) ) );
+    MultiSourceGenerator<FeatureType> generator( 0, 2 );
+    generator.addSource( 1, ring0 );
+    generator.addSource( 1, ring1 );
+    generator.addSource( 1, ring2 );
+    std::pair<Table<FeatureType>, Table<Label>> dataSet( Table<FeatureType>( 2 ), Table<Label>( 1 ) );
+    generator.generate( pointCount, dataSet.first, dataSet.second );
+    return dataSet;
+}
+
+/**
+ * Generate a data set of points on a 2-D checkerboard of cellCount by
+ * cellCount unit squares, labeled by the color of their square.
+ */
+template <typename FeatureType>
+std::pair<Table<FeatureType>, Table<Label>> makeCheckerboard( std::size_t pointCount, unsigned int cellCount )
+{
+    typename CheckerboardFeatureGenerator<FeatureType>::SharedPointer black( new CheckerboardFeatureGenerator<FeatureType>( CheckerboardFeatureGenerator<FeatureType>::Color::BLACK ) );
+    black->addDimension( cellCount, 1.0 );
+    black->addDimension( cellCount, 1.0 );
+    typename CheckerboardFeatureGenerator<FeatureType>::SharedPointer white( new CheckerboardFeatureGenerator<FeatureType>( CheckerboardFeatureGenerator<FeatureType>::Color::WHITE ) );
+    white->addDimension( cellCount, 1.0 );
+    white->addDimension( cellCount, 1.0 );
+    typename SingleSourceGenerator<FeatureType>::SharedPointer blackSource( new SingleSourceGenerator<FeatureType>() );
+    blackSource->addFeatureGenerator( black );
+    typename SingleSourceGenerator<FeatureType>::SharedPointer whiteSource( new SingleSourceGenerator<FeatureType>() );
+    whiteSource->addFeatureGenerator( white );
+    MultiSourceGenerator<FeatureType> generator( 0, 2 );
+    generator.addSource( 1, blackSource );
+    generator.addSource( 1, whiteSource );
+    std::pair<Table<FeatureType>, Table<Label>> dataSet( Table<FeatureType>( 2 ), Table<Label>( 1 ) );
+    generator.generate( pointCount, dataSet.first, dataSet.second );
+    return dataSet;
+}
+
+/**
+ * Generate a data set of points with integer feature values between 0 and 99.
+ * The label of each point is determined by a function of the point and the
+ * random number generator, which it can use to add noise to the labels.
+ */
+template <typename FeatureType>
+std::pair<Table<FeatureType>, Table<Label>> makeNoisyDataSet( unsigned int featureCount, std::size_t pointCount, unsigned int seed, std::function<Label( const FeatureType *, std::mt19937 & )> labelFunction )
+{
+    std::mt19937                                rng( seed );
+    std::pair<Table<FeatureType>, Table<Label>> dataSet( Table<FeatureType>( featureCount ), Table<Label>( 1 ) );
+    std::vector<FeatureType>                    point( featureCount );
+    for ( std::size_t i = 0; i < pointCount; ++i )
+    {
+        for ( auto & value : point ) value = std::uniform_int_distribution<int>( 0, 99 )( rng );
+        Label label = labelFunction( point.data(), rng );
+        dataSet.first.append( point.begin(), point.end() );
+        dataSet.second.append( &label, &label + 1 );
+    }
+    return dataSet;
+}
+
+template <typename FeatureType>
+bool testFeatureIndex()
+{
+    // Create a single-feature data set with special values and duplicates.
+    const FeatureType infinity = std::numeric_limits<FeatureType>::infinity();
+    const FeatureType tiny     = std::numeric_limits<FeatureType>::denorm_min();
+    FeatureType       points[] = { 3, -0.0, -infinity, 0.0, tiny, -2.5, 3, infinity, -tiny, -0.0, 1e30f, -1e30f, 0.5 };
+    Label             labels[] = { 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0 };
+    const std::size_t count    = sizeof( points ) / sizeof( points[0] );
+
+    // The expected order: by value, and by point ID for equal values (negative zero equals positive zero).
+    std::vector<DataPointID> expected( count );
+    std::iota( expected.begin(), expected.end(), 0 );
+    std::stable_sort( expected.begin(), expected.end(), [&points]( DataPointID a, DataPointID b ) { return points[a] < points[b]; } );
+
+    // Build the index sequentially and concurrently, and compare it to the expected order.
+    WorkerPool pool( 2 );
+    for ( WorkerPool * workerPool : { static_cast<WorkerPool *>( nullptr ), &pool } )
+    {
+        FeatureIndex<FeatureType> index( points, labels, 1, count, workerPool );
+        if ( !std::equal( expected.begin(), expected.end(), index.getPointIDs( 0 ) ) ) return false;
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            if ( !( index.getValues( 0 )[i] == points[expected[i]] ) ) return false;
+        }
+    }
+
+    // Ensure values that are not a number are rejected.
+    points[7] = std::numeric_limits<FeatureType>::quiet_NaN();
+    try
+    {
+        FeatureIndex<FeatureType> index( points, labels, 1, count, &pool );
+        return false;
+    }
+    catch ( ClientError & )
+    {
+    }
+    return true;
+}
+
+template <unsigned int threadCount>
+bool testWorkerPool()
+{
+    // Submit tasks that submit child tasks, down to a fixed depth, and count the leaves.
+    const unsigned int                  depth = 8;
+    WorkerPool                          pool( threadCount );
+    std::atomic<unsigned int>           leafCount( 0 );
+    std::function<void( unsigned int )> spawn = [&]( unsigned int level ) {
+        if ( level == depth )
+        {
+            ++leafCount;
+            return;
+        }
+        pool.submit( [&spawn, level]() { spawn( level + 1 ); } );
+        pool.submit( [&spawn, level]() { spawn( level + 1 ); } );
+    };
+
+    // Ensure the caller only stops waiting once all tasks and their children have finished.
+    for ( unsigned int run = 0; run < 100; ++run )
+    {
+        leafCount = 0;
+        pool.submit( [&spawn]() { spawn( 0 ); } );
+        pool.wait();
+        if ( leafCount != 1u << depth ) return false;
+    }
+    return true;
+}
+
+/**
+ * Returns true iff the two specified feature indices have identical point lists.
+ */
+template <typename FeatureType>
+bool haveEqualPointLists( const FeatureIndex<FeatureType> & index1, const FeatureIndex<FeatureType> & index2 )
+{
+    if ( index1.getFeatureCount() != index2.getFeatureCount() || index1.getPointCount() != index2.getPointCount() ) return false;
+    for ( FeatureID feature = 0; feature < index1.getFeatureCount(); ++feature )
+    {
+        if ( !std::equal( index1.getValues( feature ), index1.getValues( feature ) + index1.getPointCount(), index2.getValues( feature ) ) ) return false;
+        if ( !std::equal( index1.getPointIDs( feature ), index1.getPointIDs( feature ) + index1.getPointCount(), index2.getPointIDs( feature ) ) ) return false;
+    }
+    return true;
+}
+
+template <typename FeatureType>
+bool testIndexFile()
+{
+    // Create a data set with three features.
+    const unsigned int       featureCount = 3;
+    const unsigned int       pointCount   = 1000;
+    std::mt19937             rng( 1234 );
+    std::vector<FeatureType> points( featureCount * pointCount );
+    std::vector<Label>       labels( pointCount );
+    for ( auto & value : points ) value = std::uniform_int_distribution<int>( -50, 50 )( rng ) / FeatureType( 8 );
+    for ( auto & label : labels ) label = std::uniform_int_distribution<int>( 0, 2 )( rng );
+
+    // Build the index without an index file, and with an index file, which does not exist yet.
+    NamedTemporaryFile        indexFile( "balsa_test_index_file.tmp" );
+    FeatureIndex<FeatureType> reference( points.begin(), labels.begin(), featureCount, pointCount );
+    FeatureIndex<FeatureType> written( points.begin(), labels.begin(), featureCount, pointCount, nullptr, std::string(), indexFile, "key" );
+    if ( written.isMapped() || !haveEqualPointLists( reference, written ) ) return false;
+
+    // Ensure the index is mapped from the file when the key matches, and that copies of it are not mapped.
+    FeatureIndex<FeatureType> mapped( points.begin(), labels.begin(), featureCount, pointCount, nullptr, std::string(), indexFile, "key" );
+    FeatureIndex<FeatureType> copy( mapped );
+    if ( !mapped.isMapped() || !haveEqualPointLists( reference, mapped ) ) return false;
+    if ( copy.isMapped() || !haveEqualPointLists( reference, copy ) ) return false;
+
+    // Ensure the index is built again when the key differs.
+    FeatureIndex<FeatureType> rebuilt( points.begin(), labels.begin(), featureCount, pointCount, nullptr, std::string(), indexFile, "other key" );
+    return !rebuilt.isMapped() && haveEqualPointLists( reference, rebuilt );
+}
+
 template <typename FeatureType>
 bool testCross2x2()
 {
@@ -110,28 +395,14 @@ bool testCheckerboard()
 template <typename FeatureType>
 bool testConcentricRings()
 {
-    // Construct a multi-source model with three concentric rings.
-    typename SingleSourceGenerator<FeatureType>::SharedPointer ring0( new SingleSourceGenerator<FeatureType>() );
-    typename SingleSourceGenerator<FeatureType>::SharedPointer ring1( new SingleSourceGenerator<FeatureType>() );
-    typename SingleSourceGenerator<FeatureType>::SharedPointer ring2( new SingleSourceGenerator<FeatureType>() );
-    ring0->addFeatureGenerator( typename FeatureGenerator<FeatureType>::SharedPointer( new AnnulusFeatureGenerator<FeatureType>( 0.0, 2.0 ) ) );
-    ring1->addFeatureGenerator( typename FeatureGenerator<FeatureType>::SharedPointer( new AnnulusFeatureGenerator<FeatureType>( 2.25, 3.25 ) ) );
-    ring2->addFeatureGenerator( typename FeatureGenerator<FeatureType>::SharedPointer( new AnnulusFeatureGenerator<FeatureType>( 3.5, 7.0 ) ) );
-    MultiSourceGenerator<FeatureType> generator( 0, 2 );
-    generator.addSource( 1, ring0 );
-    generator.addSource( 1, ring1 );
-    generator.addSource( 1, ring2 );
-
-    // Generate a data- and label set.
-    Table<FeatureType> points( 2 );
-    Table<Label>       truth( 1 );
-    generator.generate( 10000, points, truth );
+    // Generate points on three concentric rings.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 10000 );
 
     // Train a single decision tree.
     NamedTemporaryFile modelFile( "balsa_test_concentric_rings.tmp" );
     {
         EnsembleFileOutputStream                                        outputStream( modelFile );
-        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, generator.getFeatureCount(), std::numeric_limits<unsigned int>::max(), 1.0, 1, 1 );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, points.getColumnCount(), std::numeric_limits<unsigned int>::max(), 1.0, 1, 1 );
         trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
     }
 
@@ -144,6 +415,815 @@ bool testConcentricRings()
     return labels == truth;
 }
 
+template <typename FeatureType>
+bool testParallelSplitSearch()
+{
+    // Generate points on a 2-D checkerboard.
+    auto [points, truth] = makeCheckerboard<FeatureType>( 20000, 8 );
+
+    // Train the same forest without and with split search threads. Consider
+    // only one of the features per split, so that the search for a fallback
+    // split among the skipped features is exercised as well.
+    NamedTemporaryFile sequentialModelFile( "balsa_test_sequential_split_search.tmp" );
+    NamedTemporaryFile parallelModelFile( "balsa_test_parallel_split_search.tmp" );
+    for ( unsigned int splitThreadCount : { 0, 3 } )
+    {
+        getMasterSeedSequence().seed( 1234 );
+        EnsembleFileOutputStream                                        outputStream( splitThreadCount ? parallelModelFile : sequentialModelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+        trainer.setSplitThreadCount( splitThreadCount );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Ensure both models are identical.
+    return haveEqualContents( sequentialModelFile, parallelModelFile );
+}
+
+template <typename FeatureType>
+bool testConcurrentGrowth()
+{
+    // Generate points on three concentric rings.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 20000 );
+
+    // Grow one tree a leaf at a time, and a copy with its leaves grown
+    // concurrently by a pool of threads. The trees must be identical.
+    typedef IndexedDecisionTree<typename Table<FeatureType>::ConstIterator, typename Table<Label>::ConstIterator> TreeType;
+    TreeType                         sapling( points.begin(), truth.begin(), points.getColumnCount(), points.getRowCount(), 1 );
+    typename TreeType::SharedPointer sequentialTree( new TreeType( sapling ) );
+    typename TreeType::SharedPointer concurrentTree( new TreeType( sapling ) );
+    sequentialTree->seed( 4321 );
+    sequentialTree->grow();
+    concurrentTree->seed( 4321 );
+    concurrentTree->setWorkerPool( WorkerPool::SharedPointer( new WorkerPool( 3 ) ) );
+    MessageQueue<bool> grown;
+    concurrentTree->growConcurrently( [&grown]() { grown.send( true ); } );
+    grown.receive();
+    NamedTemporaryFile sequentialModelFile( "balsa_test_sequential_growth.tmp" );
+    NamedTemporaryFile concurrentModelFile( "balsa_test_concurrent_growth.tmp" );
+    {
+        EnsembleFileOutputStream sequentialStream( sequentialModelFile );
+        EnsembleFileOutputStream concurrentStream( concurrentModelFile );
+        sequentialStream.write( *sequentialTree->getDecisionTree() );
+        concurrentStream.write( *concurrentTree->getDecisionTree() );
+    }
+    return haveEqualContents( sequentialModelFile, concurrentModelFile );
+}
+
+template <typename FeatureType>
+bool testGrowthLimits()
+{
+    // Generate points on three concentric rings.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 10000 );
+
+    // Grow a tree with a leaf budget sequentially, and a copy concurrently.
+    // Both must use up the budget exactly, and be identical.
+    typedef IndexedDecisionTree<typename Table<FeatureType>::ConstIterator, typename Table<Label>::ConstIterator> TreeType;
+    TreeType                         sapling( points.begin(), truth.begin(), points.getColumnCount(), points.getRowCount(), 1 );
+    typename TreeType::SharedPointer sequentialTree( new TreeType( sapling ) );
+    typename TreeType::SharedPointer concurrentTree( new TreeType( sapling ) );
+    for ( auto & tree : { sequentialTree, concurrentTree } )
+    {
+        tree->seed( 4321 );
+        tree->setGrowthLimits( 16, 0, 1 );
+    }
+    sequentialTree->grow();
+    concurrentTree->setWorkerPool( WorkerPool::SharedPointer( new WorkerPool( 3 ) ) );
+    MessageQueue<bool> grown;
+    concurrentTree->growConcurrently( [&grown]() { grown.send( true ); } );
+    grown.receive();
+    if ( sequentialTree->getNodeCount() != 31 || concurrentTree->getNodeCount() != 31 ) return false;
+    NamedTemporaryFile sequentialModelFile( "balsa_test_sequential_budget.tmp" );
+    NamedTemporaryFile concurrentModelFile( "balsa_test_concurrent_budget.tmp" );
+    {
+        EnsembleFileOutputStream sequentialStream( sequentialModelFile );
+        EnsembleFileOutputStream concurrentStream( concurrentModelFile );
+        sequentialStream.write( *sequentialTree->getDecisionTree() );
+        concurrentStream.write( *concurrentTree->getDecisionTree() );
+    }
+    if ( !haveEqualContents( sequentialModelFile, concurrentModelFile ) ) return false;
+
+    // A node budget of 2L - 1 nodes gives the same tree as a budget of L leaves.
+    TreeType nodeBudgetTree( sapling );
+    nodeBudgetTree.seed( 4321 );
+    nodeBudgetTree.setGrowthLimits( 0, 31, 1 );
+    nodeBudgetTree.grow();
+    NamedTemporaryFile nodeBudgetModelFile( "balsa_test_node_budget.tmp" );
+    {
+        EnsembleFileOutputStream nodeBudgetStream( nodeBudgetModelFile );
+        nodeBudgetStream.write( *nodeBudgetTree.getDecisionTree() );
+    }
+    if ( !haveEqualContents( sequentialModelFile, nodeBudgetModelFile ) ) return false;
+
+    // With at least 500 of the 10000 points per leaf, a tree has at most 20 leaves.
+    TreeType minimumLeafSizeTree( sapling );
+    minimumLeafSizeTree.seed( 4321 );
+    minimumLeafSizeTree.setGrowthLimits( 0, 0, 500 );
+    minimumLeafSizeTree.grow();
+    if ( minimumLeafSizeTree.getNodeCount() < 3 || minimumLeafSizeTree.getNodeCount() > 39 ) return false;
+
+    // A root that cannot be split into two leaves of the minimum size is not split.
+    TreeType unsplittableTree( sapling );
+    unsplittableTree.setGrowthLimits( 0, 0, 5001 );
+    unsplittableTree.grow();
+    return unsplittableTree.getNodeCount() == 1;
+}
+
+template <typename FeatureType>
+bool testHistogramEngine()
+{
+    // Generate points on a 2-D checkerboard.
+    auto [points, truth] = makeCheckerboard<FeatureType>( 10000, 16 );
+
+    // Snap the points to a grid that is aligned with the cell boundaries. This
+    // leaves 128 distinct values per feature, so each value gets its own
+    // histogram bin.
+    for ( auto & value : points ) value = std::floor( value * 8 ) / 8;
+
+    // Train a single decision tree using the histogram engine.
+    NamedTemporaryFile modelFile( "balsa_test_histogram_engine.tmp" );
+    {
+        EnsembleFileOutputStream                                        outputStream( modelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, points.getColumnCount(), std::numeric_limits<unsigned int>::max(), 1.0, 1, 1 );
+        trainer.setTrainingEngine( TrainingEngine::HISTOGRAM );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Classify the training data.
+    Table<Label>           labels( points.getRowCount(), 1 );
+    RandomForestClassifier classifier( modelFile, 0, 0 );
+    classifier.classify( points.begin(), points.end(), labels.begin() );
+
+    // Ensure the classification result matches the ground truth exactly.
+    if ( labels != truth ) return false;
+
+    // Train the same forest with the exact engine and the histogram engine.
+    // Consider only one of the features per split, so that the features are
+    // selected by the seeds of the nodes.
+    NamedTemporaryFile exactModelFile( "balsa_test_histogram_exact_engine.tmp" );
+    NamedTemporaryFile histogramModelFile( "balsa_test_histogram_histogram_engine.tmp" );
+    for ( auto engine : { TrainingEngine::EXACT, TrainingEngine::HISTOGRAM } )
+    {
+        getMasterSeedSequence().seed( 7 );
+        EnsembleFileOutputStream                                        outputStream( engine == TrainingEngine::EXACT ? exactModelFile : histogramModelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+        trainer.setTrainingEngine( engine );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Ensure both models are identical.
+    return haveEqualContents( exactModelFile, histogramModelFile );
+}
+
+template <typename FeatureType>
+bool testSharedIndexEngine()
+{
+    // Generate points on three concentric rings.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 10000 );
+
+    // Train the same forest with the exact engine and the shared index
+    // engine. Consider only one of the features per split, so that the
+    // search for a fallback split among the skipped features is exercised.
+    NamedTemporaryFile exactModelFile( "balsa_test_exact_engine.tmp" );
+    NamedTemporaryFile sharedModelFile( "balsa_test_shared_index_engine.tmp" );
+    for ( auto engine : { TrainingEngine::EXACT, TrainingEngine::SHARED_INDEX } )
+    {
+        getMasterSeedSequence().seed( 4321 );
+        EnsembleFileOutputStream                                        outputStream( engine == TrainingEngine::EXACT ? exactModelFile : sharedModelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+        trainer.setTrainingEngine( engine );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Ensure both models are identical.
+    return haveEqualContents( exactModelFile, sharedModelFile );
+}
+
+template <typename FeatureType>
+bool testExtraTreesEngine()
+{
+    // Generate points on three concentric rings.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 10000 );
+
+    // Train a small forest of fully grown trees with the extra trees engine.
+    // Consider only one of the features per split, so that the search for a
+    // fallback split among the skipped features is exercised.
+    NamedTemporaryFile modelFile( "balsa_test_extra_trees_engine.tmp" );
+    {
+        EnsembleFileOutputStream                                        outputStream( modelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 2 );
+        trainer.setTrainingEngine( TrainingEngine::EXTRA_TREES );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Classify the training data.
+    Table<Label>           labels( points.getRowCount(), 1 );
+    RandomForestClassifier classifier( modelFile, 0, 0 );
+    classifier.classify( points.begin(), points.end(), labels.begin() );
+
+    // Fully grown trees separate all training points, even though the split
+    // locations are random, so the result must match the ground truth exactly.
+    return labels == truth;
+}
+
+template <typename FeatureType>
+bool testRowSampling()
+{
+    // Generate points on a 2-D checkerboard.
+    auto [points, truth] = makeCheckerboard<FeatureType>( 10000, 4 );
+
+    // Grow one tree on all points, and one on a sample in which every point
+    // occurs twice. Doubling all weights does not change the relative
+    // impurity of any split, so both trees must be identical.
+    typedef IndexedDecisionTree<typename Table<FeatureType>::ConstIterator, typename Table<Label>::ConstIterator> TreeType;
+    TreeType                       sapling( points.begin(), truth.begin(), points.getColumnCount(), points.getRowCount(), 1 );
+    std::vector<PointMultiplicity> multiplicities( points.getRowCount(), 2 );
+    TreeType                       fullTree( sapling );
+    TreeType                       weightedTree( sapling, multiplicities );
+    fullTree.seed( 42 );
+    weightedTree.seed( 42 );
+    fullTree.grow();
+    weightedTree.grow();
+    NamedTemporaryFile fullModelFile( "balsa_test_unsampled_tree.tmp" );
+    NamedTemporaryFile weightedModelFile( "balsa_test_weighted_tree.tmp" );
+    {
+        EnsembleFileOutputStream fullStream( fullModelFile );
+        EnsembleFileOutputStream weightedStream( weightedModelFile );
+        fullStream.write( *fullTree.getDecisionTree() );
+        weightedStream.write( *weightedTree.getDecisionTree() );
+    }
+    if ( !haveEqualContents( fullModelFile, weightedModelFile ) ) return false;
+
+    // Train forests on samples of half the points, without and with replacement.
+    for ( bool withReplacement : { false, true } )
+    {
+        NamedTemporaryFile modelFile( "balsa_test_row_sampling.tmp" );
+        {
+            getMasterSeedSequence().seed( 2468 );
+            EnsembleFileOutputStream                                        outputStream( modelFile );
+            RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 15, 2 );
+            trainer.setRowSampling( 0.5, withReplacement );
+            trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+        }
+
+        // Classify the training data.
+        Table<Label>           labels( points.getRowCount(), 1 );
+        RandomForestClassifier classifier( modelFile, 0, 0 );
+        classifier.classify( points.begin(), points.end(), labels.begin() );
+
+        // Ensure the forest still classifies nearly all points correctly, even though each tree saw only half of them.
+        std::size_t correctCount = 0;
+        for ( std::size_t i = 0; i < points.getRowCount(); ++i ) correctCount += labels( i, 0 ) == truth( i, 0 );
+        if ( correctCount < 0.99 * points.getRowCount() ) return false;
+    }
+    return true;
+}
+
+template <typename FeatureType>
+bool testMappedTraining()
+{
+    // Generate points on three concentric rings, and write the points to a file.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 5000 );
+    NamedTemporaryFile pointFile( "balsa_test_mapped_points.tmp" );
+    writeTable( points, pointFile );
+
+    // Map the point file, and ensure it contains the same points.
+    MappedTable<FeatureType> mappedPoints( pointFile );
+    if ( mappedPoints.getRowCount() != points.getRowCount() || mappedPoints.getColumnCount() != points.getColumnCount() ) return false;
+    if ( !std::equal( points.begin(), points.end(), mappedPoints.begin(), mappedPoints.end() ) ) return false;
+
+    // Train a forest on the points in memory, and on the mapped points with
+    // the indices in scratch files, using both engines that use sorted
+    // indices. Ensure all models are identical.
+    NamedTemporaryFile referenceModelFile( "balsa_test_reference_model.tmp" );
+    {
+        getMasterSeedSequence().seed( 1357 );
+        EnsembleFileOutputStream                                        outputStream( referenceModelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+    for ( auto engine : { TrainingEngine::EXACT, TrainingEngine::SHARED_INDEX } )
+    {
+        NamedTemporaryFile mappedModelFile( "balsa_test_mapped_model.tmp" );
+        {
+            getMasterSeedSequence().seed( 1357 );
+            EnsembleFileOutputStream                                              outputStream( mappedModelFile );
+            RandomForestTrainer<typename MappedTable<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+            trainer.setTrainingEngine( engine );
+            trainer.setScratchDirectory( std::filesystem::temp_directory_path() );
+            trainer.train( mappedPoints.begin(), mappedPoints.end(), mappedPoints.getColumnCount(), truth.begin() );
+        }
+        if ( !haveEqualContents( referenceModelFile, mappedModelFile ) ) return false;
+    }
+    return true;
+}
+
+template <typename FeatureType>
+bool testShardedTraining()
+{
+    // Generate points on three concentric rings.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 2000 );
+
+    // Train a forest in one run.
+    typedef RandomForestTrainer<typename Table<FeatureType>::ConstIterator> TrainerType;
+    NamedTemporaryFile                                                      referenceModelFile( "balsa_test_unsharded_model.tmp" );
+    {
+        getMasterSeedSequence().seed( 9753 );
+        EnsembleFileOutputStream outputStream( referenceModelFile );
+        TrainerType              trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 7, 1 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Train the same forest in three shards, and merge their models. Ensure the result is identical.
+    NamedTemporaryFile       shardModelFiles[] = { NamedTemporaryFile( "balsa_test_shard_model0.tmp" ), NamedTemporaryFile( "balsa_test_shard_model1.tmp" ), NamedTemporaryFile( "balsa_test_shard_model2.tmp" ) };
+    std::vector<std::string> shardModelFilenames( std::begin( shardModelFiles ), std::end( shardModelFiles ) );
+    for ( unsigned int shard = 0; shard < 3; ++shard )
+    {
+        getMasterSeedSequence().seed( 9753 );
+        EnsembleFileOutputStream outputStream( shardModelFiles[shard] );
+        TrainerType              trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 7, 1 );
+        trainer.setShard( shard, 3 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+    NamedTemporaryFile mergedModelFile( "balsa_test_merged_model.tmp" );
+    {
+        EnsembleFileOutputStream outputStream( mergedModelFile );
+        mergeModelFiles( shardModelFilenames, outputStream );
+    }
+    return haveEqualContents( referenceModelFile, mergedModelFile );
+}
+
+template <typename FeatureType>
+bool testAppendTraining()
+{
+    // Generate points on three concentric rings.
+    auto [points, truth] = makeConcentricRings<FeatureType>( 2000 );
+
+    // Train a forest in one run.
+    typedef RandomForestTrainer<typename Table<FeatureType>::ConstIterator> TrainerType;
+    NamedTemporaryFile                                                      referenceModelFile( "balsa_test_single_run_model.tmp" );
+    {
+        getMasterSeedSequence().seed( 8642 );
+        EnsembleFileOutputStream outputStream( referenceModelFile );
+        TrainerType              trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 7, 1 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Train the first trees of the same forest, and append the remaining trees to the model. Ensure the result is identical.
+    NamedTemporaryFile appendedModelFile( "balsa_test_appended_model.tmp" );
+    {
+        getMasterSeedSequence().seed( 8642 );
+        EnsembleFileOutputStream outputStream( appendedModelFile );
+        TrainerType              trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+    {
+        getMasterSeedSequence().seed( 8642 );
+        EnsembleFileAppendStream outputStream( appendedModelFile );
+        if ( outputStream.getClassifierCount() != 4 ) return false;
+        TrainerType trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 3, 1 );
+        trainer.setFirstTreeIndex( outputStream.getClassifierCount() );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+
+        // Ensure the model can be read before the stream is closed, as after an interrupted run.
+        ClassifierFileInputStream inputStream( appendedModelFile );
+        unsigned int              classifierCount = 0;
+        while ( inputStream.next() ) ++classifierCount;
+        if ( classifierCount != 7 ) return false;
+    }
+    return haveEqualContents( referenceModelFile, appendedModelFile );
+}
+
+template <typename FeatureType>
+bool testIntegerFeatures()
+{
+    // Create a 2-D checkerboard of 4x4 squares on an integer grid, which
+    // includes negative coordinates if the feature type is signed.
+    const int          offset = std::is_signed<FeatureType>::value ? -16 : 0;
+    Table<FeatureType> points( 2 );
+    Table<float>       floatPoints( 2 );
+    Table<Label>       truth( 1 );
+    for ( int x = 0; x < 32; ++x )
+    {
+        for ( int y = 0; y < 32; ++y )
+        {
+            FeatureType point[]      = { FeatureType( x + offset ), FeatureType( y + offset ) };
+            float       floatPoint[] = { float( x + offset ), float( y + offset ) };
+            Label       label        = ( x / 4 + y / 4 ) % 2;
+            points.append( point, point + 2 );
+            floatPoints.append( floatPoint, floatPoint + 2 );
+            truth.append( &label, &label + 1 );
+        }
+    }
+
+    // Train a forest with each engine, and ensure that it classifies the
+    // training data exactly, after a round trip through a model file.
+    for ( auto engine : { TrainingEngine::EXACT, TrainingEngine::HISTOGRAM, TrainingEngine::SHARED_INDEX, TrainingEngine::EXTRA_TREES } )
+    {
+        NamedTemporaryFile modelFile( "balsa_test_integer_model.tmp" );
+        {
+            getMasterSeedSequence().seed( 4321 );
+            EnsembleFileOutputStream                                        outputStream( modelFile );
+            RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 2, std::numeric_limits<unsigned int>::max(), 1.0, 4, 2 );
+            trainer.setTrainingEngine( engine );
+            trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+        }
+        RandomForestClassifier classifier( modelFile, 0, 0 );
+        Table<Label>           labels( points.getRowCount(), 1 );
+        classifier.classify( points.begin(), points.end(), labels.begin() );
+        if ( !std::equal( labels.begin(), labels.end(), truth.begin() ) ) return false;
+    }
+
+    // Ensure that a single exact tree splits the integer points like a tree
+    // that is trained on the same points as floats.
+    Table<Label> labels( points.getRowCount(), 1 );
+    Table<Label> floatLabels( points.getRowCount(), 1 );
+    for ( bool useFloats : { false, true } )
+    {
+        NamedTemporaryFile modelFile( "balsa_test_integer_model.tmp" );
+        {
+            getMasterSeedSequence().seed( 4321 );
+            EnsembleFileOutputStream outputStream( modelFile );
+            if ( useFloats )
+            {
+                RandomForestTrainer<typename Table<float>::ConstIterator> trainer( outputStream, 1, 3, 1.0, 1, 1 );
+                trainer.train( floatPoints.begin(), floatPoints.end(), floatPoints.getColumnCount(), truth.begin() );
+            }
+            else
+            {
+                RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, 3, 1.0, 1, 1 );
+                trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+            }
+        }
+        RandomForestClassifier classifier( modelFile, 0, 0 );
+        classifier.classify( points.begin(), points.end(), ( useFloats ? floatLabels : labels ).begin() );
+    }
+    return std::equal( labels.begin(), labels.end(), floatLabels.begin() );
+}
+
+template <typename FeatureType>
+bool testWideFeatures()
+{
+    // Create a 2-D checkerboard of 4x4 squares on an integer grid, embedded
+    // in two features with IDs beyond 255 of a 300-feature data set. All
+    // other features are constant, so only these two can be split on.
+    const unsigned int       featureCount = 300;
+    const FeatureID          featureX     = 280;
+    const FeatureID          featureY     = 290;
+    Table<FeatureType>       points( featureCount );
+    Table<Label>             truth( 1 );
+    std::vector<FeatureType> point( featureCount, 0 );
+    for ( int x = 0; x < 32; ++x )
+    {
+        for ( int y = 0; y < 32; ++y )
+        {
+            point[featureX] = x;
+            point[featureY] = y;
+            Label label     = ( x / 4 + y / 4 ) % 2;
+            points.append( point.begin(), point.end() );
+            truth.append( &label, &label + 1 );
+        }
+    }
+
+    // Train the same forest with the exact engine and the shared index
+    // engine, considering one feature per split, so that nearly every split
+    // is found by the search among the skipped features.
+    NamedTemporaryFile exactModelFile( "balsa_test_wide_exact.tmp" );
+    NamedTemporaryFile sharedModelFile( "balsa_test_wide_shared.tmp" );
+    for ( auto engine : { TrainingEngine::EXACT, TrainingEngine::SHARED_INDEX } )
+    {
+        getMasterSeedSequence().seed( 4321 );
+        EnsembleFileOutputStream                                        outputStream( engine == TrainingEngine::EXACT ? exactModelFile : sharedModelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 1, std::numeric_limits<unsigned int>::max(), 1.0, 4, 2 );
+        trainer.setTrainingEngine( engine );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+    if ( !haveEqualContents( exactModelFile, sharedModelFile ) ) return false;
+
+    // Ensure that the wide feature IDs survive the round trip through the
+    // model file, by classifying the training data exactly.
+    RandomForestClassifier classifier( exactModelFile, 0, 0 );
+    Table<Label>           labels( points.getRowCount(), 1 );
+    classifier.classify( points.begin(), points.end(), labels.begin() );
+    return labels == truth;
+}
+
+template <typename FeatureType>
+bool testLargePointIDs()
+{
+    // Create a noisy data set with three features and three classes.
+    const unsigned int featureCount = 3;
+    const unsigned int pointCount   = 2000;
+    auto [points, truth]            = makeNoisyDataSet<FeatureType>( featureCount, pointCount, 5678, []( const FeatureType * point, std::mt19937 & rng ) {
+        return Label( ( point[0] + point[1] > 100 ) + ( point[2] > 50 && std::uniform_int_distribution<int>( 0, 3 )( rng ) > 0 ) );
+    } );
+
+    // Ensure each engine grows the same forest with 64-bit point IDs as with
+    // the default 32-bit point IDs. Use one trainer thread, so that the trees
+    // are written in the same order.
+    typedef typename Table<FeatureType>::ConstIterator FeatureIterator;
+    typedef typename Table<Label>::ConstIterator       LabelIterator;
+    for ( auto engine : { TrainingEngine::EXACT, TrainingEngine::HISTOGRAM, TrainingEngine::SHARED_INDEX, TrainingEngine::EXTRA_TREES } )
+    {
+        NamedTemporaryFile defaultModelFile( "balsa_test_default_ids.tmp" );
+        NamedTemporaryFile largeModelFile( "balsa_test_large_ids.tmp" );
+        {
+            getMasterSeedSequence().seed( 4321 );
+            EnsembleFileOutputStream                                         outputStream( defaultModelFile );
+            RandomForestTrainer<FeatureIterator, LabelIterator, DataPointID> trainer( outputStream, 2, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+            trainer.setTrainingEngine( engine );
+            trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+        }
+        {
+            getMasterSeedSequence().seed( 4321 );
+            EnsembleFileOutputStream                                              outputStream( largeModelFile );
+            RandomForestTrainer<FeatureIterator, LabelIterator, LargeDataPointID> trainer( outputStream, 2, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+            trainer.setTrainingEngine( engine );
+            trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+        }
+        if ( !haveEqualContents( defaultModelFile, largeModelFile ) ) return false;
+    }
+
+    // Ensure an index file with 64-bit point IDs is mapped by an index with
+    // 64-bit point IDs only, and not mistaken for one with 32-bit point IDs.
+    NamedTemporaryFile                          indexFile( "balsa_test_large_index_file.tmp" );
+    FeatureIndex<FeatureType, LargeDataPointID> written( points.begin(), truth.begin(), featureCount, pointCount, nullptr, std::string(), indexFile, "key" );
+    FeatureIndex<FeatureType, LargeDataPointID> mapped( points.begin(), truth.begin(), featureCount, pointCount, nullptr, std::string(), indexFile, "key" );
+    if ( written.isMapped() || !mapped.isMapped() ) return false;
+    for ( FeatureID feature = 0; feature < featureCount; ++feature )
+    {
+        if ( !std::equal( written.getPointIDs( feature ), written.getPointIDs( feature ) + pointCount, mapped.getPointIDs( feature ) ) ) return false;
+    }
+    FeatureIndex<FeatureType, DataPointID> narrow( points.begin(), truth.begin(), featureCount, pointCount, nullptr, std::string(), indexFile, "key" );
+    if ( narrow.isMapped() ) return false;
+    for ( FeatureID feature = 0; feature < featureCount; ++feature )
+    {
+        if ( !std::equal( narrow.getPointIDs( feature ), narrow.getPointIDs( feature ) + pointCount, mapped.getPointIDs( feature ) ) ) return false;
+    }
+    return true;
+}
+
+template <typename FeatureType>
+bool testBatchSizes()
+{
+    // Create a data set with four features, of which the labels depend on three.
+    const unsigned int featureCount = 4;
+    const unsigned int pointCount   = 1000;
+    auto [points, truth]            = makeNoisyDataSet<FeatureType>( featureCount, pointCount, 8765, []( const FeatureType * point, std::mt19937 & ) {
+        return Label( ( point[0] < 30 ) + 2 * ( point[1] + point[3] > 90 ) );
+    } );
+
+    // Train a forest of trees that fit the data exactly.
+    NamedTemporaryFile modelFile( "balsa_test_batch_sizes.tmp" );
+    {
+        EnsembleFileOutputStream                                        outputStream( modelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 2, std::numeric_limits<unsigned int>::max(), 1.0, 4, 1 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), truth.begin() );
+    }
+
+    // Ensure the points are classified exactly, whether they are classified in one batch, or in batches that do not line up
+    // with the groups of points that are walked through the trees together.
+    RandomForestClassifier classifier( modelFile, 0, 0 );
+    for ( std::size_t batchSize : { std::size_t( pointCount ), std::size_t( 1 ), std::size_t( 15 ), std::size_t( 16 ), std::size_t( 17 ), std::size_t( 333 ) } )
+    {
+        Table<Label> labels( pointCount, 1 );
+        for ( std::size_t first = 0; first < pointCount; first += batchSize )
+        {
+            std::size_t last = std::min<std::size_t>( first + batchSize, pointCount );
+            classifier.classify( points.begin() + first * featureCount, points.begin() + last * featureCount, labels.begin() + first );
+        }
+        if ( !( labels == truth ) ) return false;
+    }
+    return true;
+}
+
+template <typename FeatureType>
+bool testQuickScorer()
+{
+    // Create a data set with noisy labels, so that the trees grow to their maximum depth.
+    const unsigned int featureCount = 6;
+    const unsigned int pointCount   = 2000;
+    auto [points, labels]           = makeNoisyDataSet<FeatureType>( featureCount, pointCount, 2468, []( const FeatureType * point, std::mt19937 & rng ) {
+        return Label( ( point[0] + point[1] < 100 ) + std::uniform_int_distribution<int>( 0, 1 )( rng ) );
+    } );
+
+    // Points with missing values go to the right in every tree.
+    Table<FeatureType> testPoints = points;
+    if constexpr ( std::is_floating_point<FeatureType>::value )
+        for ( std::size_t i = 0; i < pointCount; i += 7 ) *( testPoints.begin() + i ) = std::numeric_limits<FeatureType>::quiet_NaN();
+
+    // Train forests of trees with up to 16 leaves (one bitvector word), and up to 256 leaves (four words).
+    for ( unsigned int maxDepth : { 4u, 8u } )
+    {
+        NamedTemporaryFile modelFile( "balsa_test_quick_scorer.tmp" );
+        {
+            EnsembleFileOutputStream                                        outputStream( modelFile );
+            RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 3, maxDepth, 1.0, 12, 2 );
+            trainer.train( points.begin(), points.end(), points.getColumnCount(), labels.begin() );
+        }
+
+        // Ensure the QuickScorer casts exactly the same votes as the trees, in any batch size, with and without worker threads.
+        for ( unsigned int workerThreads : { 0u, 3u } )
+        {
+            RandomForestClassifier classifier( modelFile, workerThreads, 0 );
+            RandomForestClassifier quickScorer( modelFile, workerThreads, 0 );
+            quickScorer.enableQuickScorer();
+            for ( std::size_t batchSize : { std::size_t( pointCount ), std::size_t( 1 ), std::size_t( 13 ) } )
+            {
+                for ( std::size_t first = 0; first < pointCount; first += batchSize )
+                {
+                    std::size_t last       = std::min<std::size_t>( first + batchSize, pointCount );
+                    auto        batchStart = testPoints.begin() + first * featureCount;
+                    auto        batchEnd   = testPoints.begin() + last * featureCount;
+                    VoteTable   treeVotes( last - first, classifier.getClassCount() );
+                    VoteTable   quickScorerVotes( last - first, classifier.getClassCount() );
+                    if ( classifier.classifyAndVote( batchStart, batchEnd, treeVotes ) != quickScorer.classifyAndVote( batchStart, batchEnd, quickScorerVotes ) ) return false;
+                    if ( treeVotes != quickScorerVotes ) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template <typename FeatureType>
+bool testCompiledClassifier()
+{
+    // Create a data set with noisy labels, and with fractions and infinities for floating-point features, so that the trees
+    // are deep, and have split values of all kinds.
+    const unsigned int featureCount = 4;
+    const unsigned int pointCount   = 1000;
+    auto [points, labels]           = makeNoisyDataSet<FeatureType>( featureCount, pointCount, 1357, []( const FeatureType * point, std::mt19937 & rng ) {
+        return Label( ( point[0] < point[1] ) + std::uniform_int_distribution<int>( 0, 1 )( rng ) );
+    } );
+    if constexpr ( std::is_floating_point<FeatureType>::value )
+    {
+        for ( auto & value : points ) value /= 7;
+        for ( std::size_t i = 0; i < pointCount; i += 50 ) *( points.begin() + i * featureCount + i % featureCount ) = ( i % 100 ? 1 : -1 ) * std::numeric_limits<FeatureType>::infinity();
+    }
+
+    // Train a forest.
+    NamedTemporaryFile modelFile( "balsa_test_compiled_classifier.tmp" );
+    {
+        EnsembleFileOutputStream                                        outputStream( modelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 2, std::numeric_limits<unsigned int>::max(), 1.0, 6, 2 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), labels.begin() );
+    }
+
+    // Compile the forest into a shared object.
+    const std::string  name = "balsa_test_compiled_classifier_" + getFeatureTypeName( getFeatureTypeID<FeatureType>() );
+    NamedTemporaryFile sourceFile( name + ".cpp" );
+    NamedTemporaryFile sharedObjectFile( std::filesystem::absolute( name + ".so" ) );
+    {
+        ClassifierFileInputStream classifierStream( modelFile );
+        std::ofstream             source( sourceFile );
+        compileModel( classifierStream, source, "test_", "balsa_test" );
+    }
+    std::string command = std::string( BALSA_TEST_COMPILER ) + " -O1 -Wall -Wextra -Werror -shared -fPIC -o " + std::string( sharedObjectFile ) + " " + std::string( sourceFile );
+    if ( std::system( command.c_str() ) != 0 ) return false;
+
+    // Ensure the compiled forest casts exactly the same votes as the trees, for single-precision points with missing values.
+    Table<float> testPoints( featureCount );
+    testPoints.append( points.begin(), points.end() );
+    for ( std::size_t i = 0; i < pointCount; i += 9 ) *( testPoints.begin() + i ) = std::numeric_limits<float>::quiet_NaN();
+    RandomForestClassifier classifier( modelFile, 0, 0 );
+    CompiledClassifier     compiled( sharedObjectFile, "test_" );
+    if ( compiled.getClassCount() != classifier.getClassCount() || compiled.getFeatureCount() != featureCount ) return false;
+    VoteTable treeVotes( pointCount, classifier.getClassCount() );
+    VoteTable compiledVotes( pointCount, classifier.getClassCount() );
+    if ( classifier.classifyAndVote( testPoints.begin(), testPoints.end(), treeVotes ) != compiled.classifyAndVote( testPoints.begin(), testPoints.end(), compiledVotes ) ) return false;
+    if ( treeVotes != compiledVotes ) return false;
+
+    // Ensure the labels are the same as well.
+    Table<Label> treeLabels( pointCount, 1 );
+    Table<Label> compiledLabels( pointCount, 1 );
+    classifier.classify( testPoints.begin(), testPoints.end(), treeLabels.begin() );
+    compiled.classify( testPoints.begin(), testPoints.end(), compiledLabels.begin() );
+    if ( treeLabels != compiledLabels ) return false;
+
+    // Ensure the labels are the same if they are not written to contiguous memory, and if integer points are converted.
+    std::vector<Label> appendedLabels;
+    compiled.classify( testPoints.begin(), testPoints.end(), std::back_inserter( appendedLabels ) );
+    if ( !std::equal( appendedLabels.begin(), appendedLabels.end(), treeLabels.begin(), treeLabels.end() ) ) return false;
+    if constexpr ( std::is_integral<FeatureType>::value )
+    {
+        classifier.classify( points.begin(), points.end(), treeLabels.begin() );
+        compiled.classify( points.begin(), points.end(), compiledLabels.begin() );
+        if ( treeLabels != compiledLabels ) return false;
+    }
+    return true;
+}
+
+template <typename Message>
+bool testMessageQueue()
+{
+    // Fill a queue of capacity one, and send more messages from another thread.
+    const unsigned int        messageCount = 100;
+    MessageQueue<Message>     queue( 1 );
+    std::atomic<unsigned int> sentCount( 0 );
+    queue.send( Message( 0 ) );
+    std::thread sender( [&]() {
+        for ( unsigned int i = 1; i < messageCount; ++i )
+        {
+            queue.send( Message( i ) );
+            ++sentCount;
+        }
+    } );
+
+    // Ensure the sender waits while the queue is full.
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    bool result = sentCount == 0;
+
+    // Ensure every receive makes room for the sender, and the messages arrive in order.
+    for ( unsigned int i = 0; i < messageCount; ++i ) result &= queue.receive() == Message( i );
+    sender.join();
+    return result && sentCount == messageCount - 1;
+}
+
+template <typename FeatureType>
+bool testVotingPool()
+{
+    // Create a data set with noisy labels.
+    const unsigned int featureCount = 4;
+    const unsigned int pointCount   = 1000;
+    auto [points, labels]           = makeNoisyDataSet<FeatureType>( featureCount, pointCount, 9753, []( const FeatureType * point, std::mt19937 & rng ) {
+        return Label( ( point[0] + point[2] < 100 ) + std::uniform_int_distribution<int>( 0, 1 )( rng ) );
+    } );
+
+    // Train more trees than fit in the queue of the voting pool, so that the calling thread applies some of them.
+    NamedTemporaryFile modelFile( "balsa_test_voting_pool.tmp" );
+    {
+        EnsembleFileOutputStream                                        outputStream( modelFile );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 2, 6, 1.0, 40, 2 );
+        trainer.train( points.begin(), points.end(), points.getColumnCount(), labels.begin() );
+    }
+
+    // Ensure the worker threads cast the same votes as a single thread, in batches that grow and shrink.
+    RandomForestClassifier classifier( modelFile, 0, 0 );
+    RandomForestClassifier pooledClassifier( modelFile, 3, 0 );
+    for ( std::size_t batchSize : { std::size_t( 17 ), std::size_t( pointCount ), std::size_t( 1 ), std::size_t( 333 ) } )
+    {
+        for ( std::size_t first = 0; first < pointCount; first += batchSize )
+        {
+            std::size_t last       = std::min<std::size_t>( first + batchSize, pointCount );
+            auto        batchStart = points.begin() + first * featureCount;
+            auto        batchEnd   = points.begin() + last * featureCount;
+            VoteTable   votes( last - first, classifier.getClassCount() );
+            VoteTable   pooledVotes( last - first, classifier.getClassCount() );
+            if ( classifier.classifyAndVote( batchStart, batchEnd, votes ) != pooledClassifier.classifyAndVote( batchStart, batchEnd, pooledVotes ) ) return false;
+            if ( votes != pooledVotes ) return false;
+        }
+    }
+
+    // Ensure an exception in the calling thread reaches the caller, and leaves the pool usable.
+    ClassifierFileInputStream stream( modelFile );
+    FailingClassifierStream   failingStream( stream, 30 );
+    EnsembleClassifier        failingClassifier( failingStream, 3 );
+    VoteTable                 votes( pointCount, classifier.getClassCount() );
+    VoteTable                 pooledVotes( pointCount, classifier.getClassCount() );
+    try
+    {
+        failingClassifier.classifyAndVote( points.begin(), points.end(), pooledVotes );
+        return false;
+    }
+    catch ( SupplierError & )
+    {
+    }
+    failingStream.setFailurePosition( std::numeric_limits<unsigned int>::max() );
+    pooledVotes = VoteTable( pointCount, classifier.getClassCount() );
+    if ( classifier.classifyAndVote( points.begin(), points.end(), votes ) != failingClassifier.classifyAndVote( points.begin(), points.end(), pooledVotes ) ) return false;
+    return votes == pooledVotes;
+}
+
+template <typename FeatureType>
+bool testTrainingFailure()
+{
+    // Create a data set with noisy labels.
+    const unsigned int featureCount = 4;
+    const unsigned int pointCount   = 1000;
+    auto [points, labels]           = makeNoisyDataSet<FeatureType>( featureCount, pointCount, 3579, []( const FeatureType * point, std::mt19937 & rng ) {
+        return Label( ( point[1] < point[3] ) + std::uniform_int_distribution<int>( 0, 1 )( rng ) );
+    } );
+
+    // Ensure that a failure to write a tree reaches the caller, with trees grown by a worker pool and by worker threads,
+    // and that no tree is written after it.
+    for ( TrainingEngine engine : { TrainingEngine::EXACT, TrainingEngine::HISTOGRAM } )
+    {
+        FailingClassifierOutputStream                                   outputStream( 2 );
+        RandomForestTrainer<typename Table<FeatureType>::ConstIterator> trainer( outputStream, 2, std::numeric_limits<unsigned int>::max(), 1.0, 20, 4 );
+        trainer.setTrainingEngine( engine );
+        try
+        {
+            trainer.train( points.begin(), points.end(), points.getColumnCount(), labels.begin() );
+            return false;
+        }
+        catch ( SupplierError & )
+        {
+        }
+        if ( outputStream.getWriteCount() != 3 ) return false;
+    }
+    return true;
+}
+
 bool execute_test( const std::string & name, bool ( *test )( void ) )
 {
     // Run a single test and return the test result.
@@ -171,12 +1251,59 @@ int main()
     // Run all tests (even if one or more tests fail).
     try
     {
+        result &= execute_test( "testWorkerPool<1>", testWorkerPool<1> );
+        result &= execute_test( "testWorkerPool<4>", testWorkerPool<4> );
+        result &= execute_test( "testFeatureIndex<float>", testFeatureIndex<float> );
+        result &= execute_test( "testFeatureIndex<double>", testFeatureIndex<double> );
+        result &= execute_test( "testIndexFile<float>", testIndexFile<float> );
+        result &= execute_test( "testIndexFile<double>", testIndexFile<double> );
         result &= execute_test( "testCross2x2<float>", testCross2x2<float> );
         result &= execute_test( "testCross2x2<double>", testCross2x2<double> );
         result &= execute_test( "testCheckerboard<float>", testCheckerboard<float> );
         result &= execute_test( "testCheckerboard<double>", testCheckerboard<double> );
         result &= execute_test( "testConcentricRings<float>", testConcentricRings<float> );
         result &= execute_test( "testConcentricRings<double>", testConcentricRings<double> );
+        result &= execute_test( "testParallelSplitSearch<float>", testParallelSplitSearch<float> );
+        result &= execute_test( "testParallelSplitSearch<double>", testParallelSplitSearch<double> );
+        result &= execute_test( "testConcurrentGrowth<float>", testConcurrentGrowth<float> );
+        result &= execute_test( "testConcurrentGrowth<double>", testConcurrentGrowth<double> );
+        result &= execute_test( "testGrowthLimits<float>", testGrowthLimits<float> );
+        result &= execute_test( "testGrowthLimits<double>", testGrowthLimits<double> );
+        result &= execute_test( "testHistogramEngine<float>", testHistogramEngine<float> );
+        result &= execute_test( "testHistogramEngine<double>", testHistogramEngine<double> );
+        result &= execute_test( "testSharedIndexEngine<float>", testSharedIndexEngine<float> );
+        result &= execute_test( "testSharedIndexEngine<double>", testSharedIndexEngine<double> );
+        result &= execute_test( "testExtraTreesEngine<float>", testExtraTreesEngine<float> );
+        result &= execute_test( "testExtraTreesEngine<double>", testExtraTreesEngine<double> );
+        result &= execute_test( "testRowSampling<float>", testRowSampling<float> );
+        result &= execute_test( "testRowSampling<double>", testRowSampling<double> );
+        result &= execute_test( "testMappedTraining<float>", testMappedTraining<float> );
+        result &= execute_test( "testMappedTraining<double>", testMappedTraining<double> );
+        result &= execute_test( "testShardedTraining<float>", testShardedTraining<float> );
+        result &= execute_test( "testShardedTraining<double>", testShardedTraining<double> );
+        result &= execute_test( "testAppendTraining<float>", testAppendTraining<float> );
+        result &= execute_test( "testAppendTraining<double>", testAppendTraining<double> );
+        result &= execute_test( "testIntegerFeatures<uint8_t>", testIntegerFeatures<uint8_t> );
+        result &= execute_test( "testIntegerFeatures<uint16_t>", testIntegerFeatures<uint16_t> );
+        result &= execute_test( "testIntegerFeatures<int16_t>", testIntegerFeatures<int16_t> );
+        result &= execute_test( "testWideFeatures<float>", testWideFeatures<float> );
+        result &= execute_test( "testWideFeatures<double>", testWideFeatures<double> );
+        result &= execute_test( "testLargePointIDs<float>", testLargePointIDs<float> );
+        result &= execute_test( "testLargePointIDs<double>", testLargePointIDs<double> );
+        result &= execute_test( "testBatchSizes<float>", testBatchSizes<float> );
+        result &= execute_test( "testBatchSizes<double>", testBatchSizes<double> );
+        result &= execute_test( "testQuickScorer<float>", testQuickScorer<float> );
+        result &= execute_test( "testQuickScorer<double>", testQuickScorer<double> );
+        result &= execute_test( "testQuickScorer<int16_t>", testQuickScorer<int16_t> );
+        result &= execute_test( "testCompiledClassifier<float>", testCompiledClassifier<float> );
+        result &= execute_test( "testCompiledClassifier<double>", testCompiledClassifier<double> );
+        result &= execute_test( "testCompiledClassifier<int16_t>", testCompiledClassifier<int16_t> );
+        result &= execute_test( "testMessageQueue<int>", testMessageQueue<int> );
+        result &= execute_test( "testMessageQueue<double>", testMessageQueue<double> );
+        result &= execute_test( "testVotingPool<float>", testVotingPool<float> );
+        result &= execute_test( "testVotingPool<double>", testVotingPool<double> );
+        result &= execute_test( "testTrainingFailure<float>", testTrainingFailure<float> );
+        result &= execute_test( "testTrainingFailure<double>", testTrainingFailure<double> );
     }
     catch ( Exception & e )
     {
@@ -1,12 +1,21 @@
-#include <cassert>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <random>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "classifierfilestream.h"
 #include "config.h"
 #include "exceptions.h"
+#include "iteratortools.h"
+#include "memorymapping.h"
 #include "randomforesttrainer.h"
 #include "table.h"
 #include "timing.h"
@@ -23,11 +32,25 @@ public:
     Options():
     maxDepth( std::numeric_limits<unsigned int>::max() ),
     minPurity( 1.0 ),
+    maxLeafCount( 0 ),
+    maxNodeCount( 0 ),
+    minLeafPointCount( 1 ),
     treeCount( 150 ),
     threadCount( 1 ),
+    splitThreadCount( 0 ),
+    engine( TrainingEngine::EXACT ),
+    sampleFraction( 1.0 ),
+    sampleWithReplacement( false ),
     featuresToConsider( 0 ), // Will be chosen internally by trainer if 0.
     seed( std::random_device{}() ),
-    writeDotty( false )
+    mapDataFile( false ),
+    writeDotty( false ),
+    appendToModel( false ),
+    firstTreeIndex( 0 ),
+    shardIndex( 0 ),
+    shardCount( 1 ),
+    shardProcessCount( 0 ),
+    shardCommand( "{command}" )
     {
     }
 
@@ -38,77 +61,213 @@ public:
            << std::endl
            << "   balsa_train [options] <data input file> <label input file> <model output file>" << std::endl
            << std::endl
+           << " The trees use the feature type of the data input file, if it contains floats," << std::endl
+           << " doubles, or 8- or 16-bit unsigned or 16-bit signed integers. Data of other" << std::endl
+           << " types is converted to doubles." << std::endl
+           << std::endl
            << " Options:" << std::endl
            << std::endl
-           << "   -t <thread count>: Number of threads (default: 1)." << std::endl
-           << "   -d <max depth>   : Maximum tree depth (default: +inf)." << std::endl
-           << "   -p <min purity>  : Minimum Gini purity (default: 1)." << std::endl
-           << "   -c <tree count>  : Number of trees (default: 150)." << std::endl
-           << "   -s <random seed> : Random seed (default: a random value)." << std::endl
-           << "   -f <count>       : Number of (randomly selected) features to consider per" << std::endl
-           << "                      split (default: floor(sqrt(feature count))." << std::endl
-           << "   -g               : Generates Graphviz/Dotty files of all trees." << std::endl;
+           << "   -t <thread count> : Number of threads (default: 1)." << std::endl
+           << "   -st <thread count>: Number of additional threads that grow the leaves of" << std::endl
+           << "                       any tree, without adding trees to memory (default: 0)." << std::endl
+           << "   -e <engine>       : Training engine: 'exact' (default), 'histogram'," << std::endl
+           << "                       'shared' or 'extra'. The histogram engine is faster, but" << std::endl
+           << "                       only considers 256 split locations per feature. The" << std::endl
+           << "                       shared engine trains the same trees as the exact engine," << std::endl
+           << "                       but uses much less memory when using multiple threads." << std::endl
+           << "                       The extra engine builds no index, and draws one random" << std::endl
+           << "                       split location per feature (extremely randomized trees)." << std::endl
+           << "   -d <max depth>    : Maximum tree depth (default: +inf)." << std::endl
+           << "   -p <min purity>   : Minimum Gini purity (default: 1)." << std::endl
+           << "   -l <leaf count>   : Maximum number of leaves per tree (default: +inf). The" << std::endl
+           << "                       leaves with the best splits are grown first. Exact" << std::endl
+           << "                       engine only." << std::endl
+           << "   -n <node count>   : Maximum number of nodes per tree (default: +inf). Exact" << std::endl
+           << "                       engine only." << std::endl
+           << "   -lp <point count> : Minimum number of points per leaf (default: 1). Exact" << std::endl
+           << "                       engine only." << std::endl
+           << "   -c <tree count>   : Number of trees (default: 150)." << std::endl
+           << "   -r <fraction>     : Train each tree on a random sample of the points, of" << std::endl
+           << "                       the given relative size (default: 1). Exact engine only." << std::endl
+           << "   -b                : Sample the points with replacement (bootstrapping)." << std::endl
+           << "   -s <random seed>  : Random seed (default: a random value)." << std::endl
+           << "   -f <count>        : Number of (randomly selected) features to consider per" << std::endl
+           << "                       split (default: floor(sqrt(feature count))." << std::endl
+           << "   -m                : Memory-map the data input file instead of loading it." << std::endl
+           << "                       The file must contain one of the feature types above." << std::endl
+           << "   -sd <directory>   : Store the sorted feature indices in scratch files in" << std::endl
+           << "                       the specified directory, instead of in memory." << std::endl
+           << "   -ic <directory>   : Cache the sorted feature indices in index files in the" << std::endl
+           << "                       specified directory. Later runs on the same data file" << std::endl
+           << "                       map the indices from the cache instead of building them." << std::endl
+           << "   -g                : Generates Graphviz/Dotty files of all trees." << std::endl
+           << "   -a                : Append the trees to the ensemble in the existing model" << std::endl
+           << "                       output file, without rewriting its trees. The model" << std::endl
+           << "                       must have the same feature and class counts. The" << std::endl
+           << "                       model stays valid between trees, but is left damaged" << std::endl
+           << "                       if the process is killed while writing a tree." << std::endl
+           << "   --first-tree <n>  : Give the trees the random seeds of trees n, n+1, ... of" << std::endl
+           << "                       a single run (default: 0, or the number of trees in the" << std::endl
+           << "                       model when appending)." << std::endl
+           << "   --shard <i>/<n>   : Train only shard i (counting from 0) of n shards of the" << std::endl
+           << "                       trees. Merging the models of all shards (with the same" << std::endl
+           << "                       random seed) in order gives the same forest as training" << std::endl
+           << "                       all trees with one thread." << std::endl
+           << "   --shards <n>      : Launch n shard processes, wait for them to finish, and" << std::endl
+           << "                       merge their models into the model output file." << std::endl
+           << "   --shard-command <template>" << std::endl
+           << "                     : Shell command that runs a shard process (default:" << std::endl
+           << "                       '{command}'). The placeholder {command} is replaced by" << std::endl
+           << "                       the quoted shard command line, and {shard} by the shard" << std::endl
+           << "                       index, e.g. 'ssh node{shard} {command}'." << std::endl;
         return ss.str();
     }
 
     static Options parseOptions( int argc, char ** argv )
     {
-        // Put all arguments in a stringstream.
-        std::stringstream args;
-        for ( int i = 0; i < argc; ++i ) args << ' ' << argv[i];
+        // Collect the arguments, so parameters that contain spaces remain intact.
+        Options                  options;
+        std::vector<std::string> args( argv, argv + argc );
+        std::size_t              argIndex = 1;
+        options.executable                = args[0];
 
-        // Discard the executable name.
-        std::string token;
-        args >> token;
-        token = "";
+        // Returns the parameter of an option.
+        auto nextParameter = [&]( const std::string & option ) -> std::string
+        {
+            if ( argIndex >= args.size() ) throw ParseError( "Missing parameter to " + option + " option." );
+            return args[argIndex++];
+        };
 
-        // Parse all flags.
-        Options options;
-        while ( args >> token )
+        // Parses the parameter of an option into a value.
+        auto parseParameter = [&]( const std::string & option, auto & value )
         {
-            // Stop if the token is not a flag.
-            assert( token.size() );
-            if ( token[0] != '-' ) break;
+            std::stringstream ss( nextParameter( option ) );
+            if ( !( ss >> value ) ) throw ParseError( "Invalid parameter to " + option + " option." );
+        };
 
+        // Parse all flags, and stop at the first argument that is not a flag.
+        while ( argIndex < args.size() && args[argIndex].size() && args[argIndex][0] == '-' )
+        {
+            auto optionIndex = argIndex;
+            auto token       = args[argIndex++];
             if ( token == "-t" )
             {
-                if ( !( args >> options.threadCount ) ) throw ParseError( "Missing parameter to -t option." );
+                parseParameter( token, options.threadCount );
+            }
+            else if ( token == "-st" )
+            {
+                parseParameter( token, options.splitThreadCount );
+            }
+            else if ( token == "-e" )
+            {
+                std::string engine = nextParameter( token );
+                if ( engine == "exact" ) options.engine = TrainingEngine::EXACT;
+                else if ( engine == "histogram" ) options.engine = TrainingEngine::HISTOGRAM;
+                else if ( engine == "shared" ) options.engine = TrainingEngine::SHARED_INDEX;
+                else if ( engine == "extra" ) options.engine = TrainingEngine::EXTRA_TREES;
+                else throw ParseError( std::string( "Unknown training engine: " ) + engine );
             }
             else if ( token == "-d" )
             {
-                if ( !( args >> options.maxDepth ) ) throw ParseError( "Missing parameter to -d option." );
+                parseParameter( token, options.maxDepth );
             }
             else if ( token == "-p" )
             {
-                if ( !( args >> options.minPurity ) ) throw ParseError( "Missing parameter to -p option." );
+                parseParameter( token, options.minPurity );
+            }
+            else if ( token == "-l" )
+            {
+                parseParameter( token, options.maxLeafCount );
+            }
+            else if ( token == "-n" )
+            {
+                parseParameter( token, options.maxNodeCount );
+            }
+            else if ( token == "-lp" )
+            {
+                parseParameter( token, options.minLeafPointCount );
             }
             else if ( token == "-c" )
             {
-                if ( !( args >> options.treeCount ) ) throw ParseError( "Missing parameter to -c option." );
+                parseParameter( token, options.treeCount );
+            }
+            else if ( token == "-r" )
+            {
+                parseParameter( token, options.sampleFraction );
+            }
+            else if ( token == "-b" )
+            {
+                options.sampleWithReplacement = true;
             }
             else if ( token == "-s" )
             {
-                if ( !( args >> options.seed ) ) throw ParseError( "Missing parameter to -s option." );
+                parseParameter( token, options.seed );
+                continue; // Shard processes get the seed explicitly.
             }
             else if ( token == "-f" )
             {
-                if ( !( args >> options.featuresToConsider ) ) throw ParseError( "Missing parameter to -f option." );
+                parseParameter( token, options.featuresToConsider );
+            }
+            else if ( token == "-m" )
+            {
+                options.mapDataFile = true;
+            }
+            else if ( token == "-sd" )
+            {
+                options.scratchDirectory = nextParameter( token );
+            }
+            else if ( token == "-ic" )
+            {
+                options.indexCacheDirectory = nextParameter( token );
             }
             else if ( token == "-g" )
             {
                 options.writeDotty = true;
             }
+            else if ( token == "-a" )
+            {
+                options.appendToModel = true;
+                continue; // Shard processes write new models, which are appended by this process.
+            }
+            else if ( token == "--first-tree" )
+            {
+                parseParameter( token, options.firstTreeIndex );
+                continue; // Shard processes get the first tree index explicitly.
+            }
+            else if ( token == "--shard" )
+            {
+                std::stringstream ss( nextParameter( token ) );
+                char              separator = 0;
+                if ( !( ss >> options.shardIndex >> separator >> options.shardCount ) || separator != '/' )
+                    throw ParseError( "Invalid parameter to --shard option (expected <index>/<count>)." );
+                if ( options.shardCount == 0 || options.shardIndex >= options.shardCount )
+                    throw ParseError( "Invalid parameter to --shard option (the shard index must be less than the shard count)." );
+                continue;
+            }
+            else if ( token == "--shards" )
+            {
+                parseParameter( token, options.shardProcessCount );
+                continue;
+            }
+            else if ( token == "--shard-command" )
+            {
+                options.shardCommand = nextParameter( token );
+                continue;
+            }
             else
             {
                 throw ParseError( std::string( "Unknown option: " ) + token );
             }
+
+            // Pass the option on to the shard processes, if this process launches them.
+            options.shardArguments.insert( options.shardArguments.end(), args.begin() + optionIndex, args.begin() + argIndex );
         }
 
         // Parse the filenames.
-        if ( token.size() == 0 ) throw ParseError( getUsage() );
-        options.dataFile = token;
-        if ( !( args >> options.labelFile ) ) throw ParseError( getUsage() );
-        if ( !( args >> options.outputFile ) ) throw ParseError( getUsage() );
+        if ( args.size() - argIndex < 3 ) throw ParseError( getUsage() );
+        options.dataFile   = args[argIndex++];
+        options.labelFile  = args[argIndex++];
+        options.outputFile = args[argIndex++];
 
         // Return  results.
         return options;
@@ -119,12 +278,261 @@ public:
     std::string                     outputFile;
     unsigned int                    maxDepth;
     double                          minPurity;
+    std::size_t                     maxLeafCount;
+    std::size_t                     maxNodeCount;
+    std::size_t                     minLeafPointCount;
     unsigned int                    treeCount;
     unsigned int                    threadCount;
+    unsigned int                    splitThreadCount;
+    TrainingEngine                  engine;
+    double                          sampleFraction;
+    bool                            sampleWithReplacement;
     unsigned int                    featuresToConsider;
     std::random_device::result_type seed;
+    bool                            mapDataFile;
+    std::string                     scratchDirectory;
+    std::string                     indexCacheDirectory;
     bool                            writeDotty;
+    bool                            appendToModel;
+    unsigned int                    firstTreeIndex;
+    unsigned int                    shardIndex;
+    unsigned int                    shardCount;
+    unsigned int                    shardProcessCount;
+    std::string                     shardCommand;
+    std::string                     executable;
+    std::vector<std::string>        shardArguments;
 };
+
+/**
+ * Returns the command-line name of a training engine.
+ */
+std::string getEngineName( TrainingEngine engine )
+{
+    switch ( engine )
+    {
+    case TrainingEngine::EXACT:
+        return "exact";
+    case TrainingEngine::HISTOGRAM:
+        return "histogram";
+    case TrainingEngine::SHARED_INDEX:
+        return "shared";
+    case TrainingEngine::EXTRA_TREES:
+        return "extra";
+    }
+    return "unknown";
+}
+
+/**
+ * Create a new model output file.
+ */
+std::unique_ptr<ClassifierOutputStream> createModel( const std::string & filename )
+{
+    return std::unique_ptr<ClassifierOutputStream>( new EnsembleFileOutputStream( filename, "balsa_train", balsa_VERSION_MAJOR, balsa_VERSION_MINOR, balsa_VERSION_PATCH ) );
+}
+
+/**
+ * Open an existing model file to append trees to, and make sure the trees
+ * trained on the data set will be compatible with the model, before they are
+ * trained.
+ */
+std::unique_ptr<EnsembleFileAppendStream> openModelToAppend( const std::string & filename, unsigned int featureCount, const Table<Label> & labels )
+{
+    std::unique_ptr<EnsembleFileAppendStream> model( new EnsembleFileAppendStream( filename ) );
+    unsigned int                              classCount = labels.getRowCount() ? *std::max_element( labels.begin(), labels.end() ) + 1 : 0;
+    if ( featureCount != model->getFeatureCount() ) throw ClientError( "The data set has a different feature count than the model to append to." );
+    if ( classCount != model->getClassCount() ) throw ClientError( "The data set has a different class count than the model to append to." );
+    return model;
+}
+
+/**
+ * Train a random forest with trees that identify points by IDs of the
+ * specified type, write it to the output stream, and report the timings.
+ */
+template <typename PointIDType, typename DataSet>
+void trainForestWithPointIDs( const Options & options, const DataSet & dataSet, const Table<Label> & labels, StopWatch::Seconds dataLoadTime, ClassifierOutputStream & outputStream, unsigned int firstTreeIndex )
+{
+    StopWatch                                                                                      watch;
+    RandomForestTrainer<typename DataSet::ConstIterator, Table<Label>::ConstIterator, PointIDType> trainer( outputStream, options.featuresToConsider, options.maxDepth, options.minPurity, options.treeCount, options.threadCount, options.writeDotty );
+    trainer.setSplitThreadCount( options.splitThreadCount );
+    trainer.setTrainingEngine( options.engine );
+    trainer.setRowSampling( options.sampleFraction, options.sampleWithReplacement );
+    trainer.setGrowthLimits( options.maxLeafCount, options.maxNodeCount, options.minLeafPointCount );
+    trainer.setScratchDirectory( options.scratchDirectory );
+    trainer.setShard( options.shardIndex, options.shardCount );
+    trainer.setFirstTreeIndex( firstTreeIndex );
+    if ( !options.indexCacheDirectory.empty() )
+    {
+        // Identify the index by the contents of the data file, and by the feature type.
+        typedef std::remove_cv_t<typename iterator_value_type<typename DataSet::ConstIterator>::type> FeatureType;
+        std::stringstream                                                                             key;
+        key << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hashFileContents( options.dataFile ) << '-' << getFeatureTypeName( getFeatureTypeID<FeatureType>() );
+        trainer.setIndexFile( options.indexCacheDirectory + "/balsa-index-" + key.str() + ".balsa", key.str() );
+    }
+    watch.start();
+    trainer.train( dataSet.begin(), dataSet.end(), dataSet.getColumnCount(), labels.begin() );
+    std::cout << "Done (" << watch.stop() << " seconds)." << std::endl;
+    const auto indexBuildTime = trainer.getIndexBuildTime();
+    const auto trainingTime   = watch.getElapsedTime() - indexBuildTime;
+
+    std::cout << "Timings:" << std::endl
+              << "Data Load Time: " << dataLoadTime << std::endl
+              << "Index Build Time: " << indexBuildTime << std::endl
+              << "Training Time: " << trainingTime << std::endl;
+}
+
+/**
+ * Train a random forest on a data set that has been loaded or mapped into
+ * memory, write it to the output file, and report the timings.
+ */
+template <typename DataSet>
+void trainForest( const Options & options, const DataSet & dataSet, const Table<Label> & labels, StopWatch::Seconds dataLoadTime )
+{
+    // Check the data set.
+    if ( labels.getRowCount() != dataSet.getRowCount() ) throw ParseError( "Point file and label file have different row counts." );
+    if ( labels.getColumnCount() != 1 ) throw ParseError( "Invalid label file: table has too many columns." );
+    std::cout << "Dataset loaded: " << dataSet.getRowCount() << " points. (" << dataLoadTime << " seconds)." << std::endl;
+
+    // Train a random forest on the data.
+    std::cout << "Training..." << std::endl;
+    std::unique_ptr<ClassifierOutputStream> outputStream;
+    unsigned int                            firstTreeIndex = options.firstTreeIndex;
+    if ( options.appendToModel )
+    {
+        auto model     = openModelToAppend( options.outputFile, dataSet.getColumnCount(), labels );
+        firstTreeIndex = model->getClassifierCount();
+        outputStream   = std::move( model );
+    }
+    else
+    {
+        outputStream = createModel( options.outputFile );
+    }
+
+    // Use the compact 32-bit point IDs, unless the data set has too many points.
+    if ( dataSet.getRowCount() <= std::numeric_limits<DataPointID>::max() )
+        trainForestWithPointIDs<DataPointID>( options, dataSet, labels, dataLoadTime, *outputStream, firstTreeIndex );
+    else
+        trainForestWithPointIDs<LargeDataPointID>( options, dataSet, labels, dataLoadTime, *outputStream, firstTreeIndex );
+}
+
+/**
+ * Load or map the training data set, if its elements are of the specified
+ * feature type, and train a random forest of trees of that type on it.
+ * \returns False if the data set contains elements of another type.
+ */
+template <typename FeatureType>
+bool trainForestOfType( const Options & options )
+{
+    if ( !BalsaFileParser( options.dataFile ).atTableOfType<FeatureType>() ) return false;
+    StopWatch watch;
+    watch.start();
+    if ( options.mapDataFile )
+    {
+        MappedTable<FeatureType> dataSet( options.dataFile );
+        auto                     labels = readTableAs<Label>( options.labelFile );
+        trainForest( options, dataSet, labels, watch.stop() );
+    }
+    else
+    {
+        auto dataSet = readTable<FeatureType>( options.dataFile );
+        auto labels  = readTableAs<Label>( options.labelFile );
+        trainForest( options, dataSet, labels, watch.stop() );
+    }
+    return true;
+}
+
+/**
+ * Quote a string for the shell, so it is passed on as a single argument.
+ */
+std::string quoteShellArgument( const std::string & argument )
+{
+    std::string quoted = "'";
+    for ( auto c : argument )
+    {
+        if ( c == '\'' ) quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+/**
+ * Replace all occurrences of a placeholder in a string.
+ */
+std::string replaceAll( std::string text, const std::string & placeholder, const std::string & replacement )
+{
+    for ( auto position = text.find( placeholder ); position != std::string::npos; position = text.find( placeholder, position + replacement.size() ) )
+    {
+        text.replace( position, placeholder.size(), replacement );
+    }
+    return text;
+}
+
+/**
+ * Train a random forest in multiple shard processes, which are launched
+ * through the shard command template, and merge their models into the output
+ * file. The output of each shard process is written to a log file next to the
+ * output file, which is kept if the process fails.
+ */
+void trainShards( const Options & options )
+{
+    if ( options.shardProcessCount > options.treeCount ) throw ClientError( "There are more shards than trees." );
+
+    // Check the model to append to first, so an incompatible model is detected before training.
+    // It is only opened for appending once all shards have succeeded.
+    unsigned int firstTreeIndex = options.firstTreeIndex;
+    if ( options.appendToModel )
+    {
+        std::size_t dataOffset = 0;
+        auto        header     = BalsaFileParser( options.dataFile ).skipTable( dataOffset );
+        firstTreeIndex         = openModelToAppend( options.outputFile, header.columnCount, readTableAs<Label>( options.labelFile ) )->getClassifierCount();
+    }
+
+    // Build the shell command of each shard. All shards use the same seed, so the trees get the same seeds as in a single run.
+    std::vector<std::string> shardFiles;
+    std::vector<std::string> logFiles;
+    std::vector<std::string> commands;
+    for ( unsigned int i = 0; i < options.shardProcessCount; ++i )
+    {
+        shardFiles.push_back( options.outputFile + ".shard" + std::to_string( i ) );
+        logFiles.push_back( shardFiles.back() + ".log" );
+        std::vector<std::string> arguments( 1, options.executable );
+        arguments.insert( arguments.end(), options.shardArguments.begin(), options.shardArguments.end() );
+        arguments.insert( arguments.end(), { "-s", std::to_string( options.seed ), "--first-tree", std::to_string( firstTreeIndex ), "--shard", std::to_string( i ) + '/' + std::to_string( options.shardProcessCount ) } );
+        arguments.insert( arguments.end(), { options.dataFile, options.labelFile, shardFiles.back() } );
+        std::string command;
+        for ( auto & argument : arguments ) command += ( command.empty() ? "" : " " ) + quoteShellArgument( argument );
+        command = replaceAll( replaceAll( options.shardCommand, "{shard}", std::to_string( i ) ), "{command}", command );
+        commands.push_back( command + " > " + quoteShellArgument( logFiles.back() ) + " 2>&1" );
+    }
+
+    // Run all shards concurrently.
+    StopWatch watch;
+    std::cout << "Launching " << options.shardProcessCount << " shard processes..." << std::endl;
+    watch.start();
+    std::vector<int>         exitCodes( commands.size(), 0 );
+    std::vector<std::thread> launchers;
+    for ( unsigned int i = 0; i < commands.size(); ++i )
+    {
+        launchers.push_back( std::thread( [&, i]() { exitCodes[i] = std::system( commands[i].c_str() ); } ) );
+    }
+    for ( auto & launcher : launchers ) launcher.join();
+    for ( unsigned int i = 0; i < commands.size(); ++i )
+    {
+        if ( exitCodes[i] != 0 ) throw SupplierError( "Shard " + std::to_string( i ) + " failed, see log file: " + logFiles[i] );
+    }
+    std::cout << "Done (" << watch.stop() << " seconds)." << std::endl;
+
+    // Merge the models of the shards, and clean up.
+    std::unique_ptr<ClassifierOutputStream> outputStream;
+    if ( options.appendToModel ) outputStream.reset( new EnsembleFileAppendStream( options.outputFile ) );
+    else outputStream = createModel( options.outputFile );
+    mergeModelFiles( shardFiles, *outputStream );
+    outputStream->close();
+    for ( unsigned int i = 0; i < commands.size(); ++i )
+    {
+        std::remove( shardFiles[i].c_str() );
+        std::remove( logFiles[i].c_str() );
+    }
+}
 } // namespace
 
 int main( int argc, char ** argv )
@@ -140,37 +548,45 @@ int main( int argc, char ** argv )
         std::cout << "Output File      : " << options.outputFile << std::endl;
         std::cout << "Max. Depth       : " << options.maxDepth << std::endl;
         std::cout << "Min. Purity      : " << options.minPurity << std::endl;
+        std::cout << "Max. Leaves      : " << ( options.maxLeafCount ? std::to_string( options.maxLeafCount ) : "+inf" ) << std::endl;
+        std::cout << "Max. Nodes       : " << ( options.maxNodeCount ? std::to_string( options.maxNodeCount ) : "+inf" ) << std::endl;
+        std::cout << "Min. Leaf Points : " << options.minLeafPointCount << std::endl;
         std::cout << "Tree Count       : " << options.treeCount << std::endl;
         std::cout << "Threads          : " << options.threadCount << std::endl;
+        std::cout << "Split Threads    : " << options.splitThreadCount << std::endl;
+        std::cout << "Engine           : " << getEngineName( options.engine ) << std::endl;
+        std::cout << "Row Sample       : " << options.sampleFraction << ( options.sampleWithReplacement ? " (with replacement)" : "" ) << std::endl;
         std::cout << "Feat. to Consider: " << options.featuresToConsider << std::endl;
         std::cout << "Random Seed      : " << options.seed << std::endl;
+        std::cout << "Map Data File    : " << ( options.mapDataFile ? "yes" : "no" ) << std::endl;
+        std::cout << "Scratch Directory: " << ( options.scratchDirectory.empty() ? "(none)" : options.scratchDirectory ) << std::endl;
+        std::cout << "Index Cache      : " << ( options.indexCacheDirectory.empty() ? "(none)" : options.indexCacheDirectory ) << std::endl;
+        std::cout << "Append to Model  : " << ( options.appendToModel ? "yes" : "no" ) << std::endl;
+        std::cout << "First Tree       : " << options.firstTreeIndex << std::endl;
+        std::cout << "Shard            : " << options.shardIndex << '/' << options.shardCount << std::endl;
+        std::cout << "Shard Processes  : " << options.shardProcessCount << std::endl;
+
+        // Let shard processes do the training, if requested.
+        if ( options.shardProcessCount > 0 )
+        {
+            trainShards( options );
+            return EXIT_SUCCESS;
+        }
 
         // Seed master seed sequence.
         getMasterSeedSequence().seed( options.seed );
 
-        // Load training data set.
-        StopWatch watch;
+        // Load or map the training data set, and train a forest on it, using
+        // the feature type of the data set if possible.
         std::cout << "Ingesting data..." << std::endl;
+        if ( trainForestOfType<float>( options ) || trainForestOfType<double>( options ) ) return EXIT_SUCCESS;
+        if ( trainForestOfType<uint8_t>( options ) || trainForestOfType<uint16_t>( options ) || trainForestOfType<int16_t>( options ) ) return EXIT_SUCCESS;
+        if ( options.mapDataFile ) throw ParseError( "Only point files that contain a supported feature type can be memory-mapped." );
+        StopWatch watch;
         watch.start();
         auto dataSet = readTableAs<double>( options.dataFile );
         auto labels  = readTableAs<Label>( options.labelFile );
-        if ( labels.getRowCount() != dataSet.getRowCount() ) throw ParseError( "Point file and label file have different row counts." );
-        if ( labels.getColumnCount() != 1 ) throw ParseError( "Invalid label file: table has too many columns." );
-        std::cout << "Dataset loaded: " << dataSet.getRowCount() << " points. (" << watch.stop() << " seconds)." << std::endl;
-        const auto dataLoadTime = watch.getElapsedTime();
-
-        // Train a random forest on the data.
-        std::cout << "Training..." << std::endl;
-        EnsembleFileOutputStream outputStream( options.outputFile, "balsa_train", balsa_VERSION_MAJOR, balsa_VERSION_MINOR, balsa_VERSION_PATCH );
-        RandomForestTrainer      trainer( outputStream, options.featuresToConsider, options.maxDepth, options.minPurity, options.treeCount, options.threadCount, options.writeDotty );
-        watch.start();
-        trainer.train( dataSet.begin(), dataSet.end(), dataSet.getColumnCount(), labels.begin() );
-        std::cout << "Done (" << watch.stop() << " seconds)." << std::endl;
-        const auto trainingTime = watch.getElapsedTime();
-
-        std::cout << "Timings:" << std::endl
-                  << "Data Load Time: " << dataLoadTime << std::endl
-                  << "Training Time: " << trainingTime << std::endl;
+        trainForest( options, dataSet, labels, watch.stop() );
     }
     catch ( Exception & e )
     {
@@ -226,6 +226,139 @@ private:
     unsigned int    m_featureCount;
 };
 
+/**
+ * A classifier output stream that appends classifiers to the ensemble in an
+ * existing model file.
+ *
+ * The classifiers that are already in the file are neither loaded nor
+ * rewritten: only the ensemble end marker is moved to the new end of the
+ * file. This makes growing a large model as cheap as training the new trees.
+ * The end marker is rewritten after every classifier, so the file remains a
+ * valid model if the process is interrupted between two classifiers. If it is
+ * interrupted while a classifier is being written, the file is left without
+ * an ensemble end marker, so keep a copy of models that cannot be retrained.
+ */
+class EnsembleFileAppendStream: public ClassifierOutputStream
+{
+public:
+
+    /**
+     * Constructs an open stream that appends to the ensemble in the specified
+     * file.
+     *
+     * \param filename Name of the file to append to.
+     * \throws ParseError if the file does not contain an ensemble, or if the
+     *  ensemble is followed by other objects.
+     */
+    EnsembleFileAppendStream( const std::string & filename ):
+    m_classifierCount( 0 )
+    {
+        // Skip the submodels of the ensemble, to find its end marker.
+        std::size_t endOffset = 0;
+        {
+            BalsaFileParser parser( filename );
+            EnsembleHeader  header = parser.enterEnsemble();
+            m_classCount           = header.classCount;
+            m_featureCount         = header.featureCount;
+            while ( parser.atTree() )
+            {
+                parser.skipClassifier();
+                ++m_classifierCount;
+            }
+            endOffset = parser.getOffset();
+            parser.leaveEnsemble();
+            if ( !parser.atEOF() ) throw ParseError( "The ensemble in the model file is followed by other objects." );
+        }
+
+        // Reopen the file for writing, positioned at the end marker.
+        m_fileWriter.emplace( filename, endOffset );
+    }
+
+    ~EnsembleFileAppendStream()
+    {
+        close();
+    }
+
+    /**
+     * Returns the number of classes distinguished by the ensemble.
+     */
+    unsigned int getClassCount() const
+    {
+        return m_classCount;
+    }
+
+    /**
+     * Returns the number of features the ensemble expects.
+     */
+    unsigned int getFeatureCount() const
+    {
+        return m_featureCount;
+    }
+
+    /**
+     * Returns the number of classifiers in the ensemble, including the ones
+     * written to this stream.
+     */
+    unsigned int getClassifierCount() const
+    {
+        return m_classifierCount;
+    }
+
+private:
+
+    /**
+     * Perform subclass-specific operations when the stream is closed.
+     */
+    void onClose()
+    {
+        m_fileWriter->leaveEnsemble();
+    }
+
+    /**
+     * Perform the actual write in a subclass-specific way.
+     * This is guaranteed to be called only when the stream is still open.
+     * \throws ClientError if the classifier does not have the same class and feature counts as the ensemble.
+     */
+    void onWrite( const Classifier & classifier )
+    {
+        if ( classifier.getClassCount() != m_classCount )
+            throw ClientError( "The class count of the classifier differs from the class count of the ensemble." );
+        if ( classifier.getFeatureCount() != m_featureCount )
+            throw ClientError( "The feature count of the classifier differs from the feature count of the ensemble." );
+        m_fileWriter->writeClassifier( classifier );
+        ++m_classifierCount;
+    }
+
+    std::optional<BalsaFileWriter> m_fileWriter;
+    unsigned int                   m_classCount;
+    unsigned int                   m_featureCount;
+    unsigned int                   m_classifierCount;
+};
+
+/**
+ * Write the submodels of several model files to one output stream, in order.
+ * \throws ClientError if the models do not have the same class and feature counts.
+ */
+inline void mergeModelFiles( const std::vector<std::string> & modelFiles, ClassifierOutputStream & out )
+{
+    unsigned int classCount   = 0;
+    unsigned int featureCount = 0;
+    for ( auto & modelFile : modelFiles )
+    {
+        // Open the input file and make sure the model is compatible with what was merged earlier.
+        ClassifierFileInputStream in( modelFile );
+        if ( classCount != 0 && in.getClassCount() != classCount )
+            throw ClientError( "The class count of the model '" + modelFile + "' differs from the earlier input files." );
+        if ( featureCount != 0 && in.getFeatureCount() != featureCount )
+            throw ClientError( "The feature count of the model '" + modelFile + "' differs from the earlier input files." );
+        classCount   = in.getClassCount();
+        featureCount = in.getFeatureCount();
+
+        // Append all submodels to the output stream.
+        while ( auto submodel = in.next() ) out.write( *submodel );
+    }
+}
+
 } // namespace balsa
 
 #endif // CLASSIFIERFILESTREAM_H
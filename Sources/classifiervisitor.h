@@ -1,10 +1,13 @@
 #ifndef CLASSIFIERVISITOR_H
 #define CLASSIFIERVISITOR_H
 
+#include <cstdint>
+
 namespace balsa
 {
 
 // Forward declarations of all supported classifiers.
+class CompiledClassifier;
 class EnsembleClassifier;
 template <typename FeatureType>
 class DecisionTreeClassifier;
@@ -20,9 +23,13 @@ public:
     {
     }
 
-    virtual void visit( const EnsembleClassifier & classifier )             = 0;
-    virtual void visit( const DecisionTreeClassifier<float> & classifier )  = 0;
-    virtual void visit( const DecisionTreeClassifier<double> & classifier ) = 0;
+    virtual void visit( const CompiledClassifier & classifier )               = 0;
+    virtual void visit( const EnsembleClassifier & classifier )               = 0;
+    virtual void visit( const DecisionTreeClassifier<float> & classifier )    = 0;
+    virtual void visit( const DecisionTreeClassifier<double> & classifier )   = 0;
+    virtual void visit( const DecisionTreeClassifier<uint8_t> & classifier )  = 0;
+    virtual void visit( const DecisionTreeClassifier<uint16_t> & classifier ) = 0;
+    virtual void visit( const DecisionTreeClassifier<int16_t> & classifier )  = 0;
 };
 
 } // namespace balsa
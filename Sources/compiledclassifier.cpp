@@ -0,0 +1,43 @@
+#include <dlfcn.h>
+
+#include "compiledclassifier.h"
+
+namespace balsa
+{
+
+CompiledClassifier::CompiledClassifier( const std::string & sharedObjectFile, const std::string & symbolPrefix ):
+m_library( nullptr )
+{
+    // Load the shared object. Its symbols are kept local, so that several compiled forests can be loaded at once.
+    m_library = dlopen( sharedObjectFile.c_str(), RTLD_NOW | RTLD_LOCAL );
+    if ( !m_library ) throw SupplierError( "Could not load compiled classifier: " + std::string( dlerror() ) );
+
+    // Find the functions of the compiled forest.
+    try
+    {
+        m_classCount      = reinterpret_cast<CountFunction>( findFunction( symbolPrefix + "getClassCount" ) )();
+        m_featureCount    = reinterpret_cast<CountFunction>( findFunction( symbolPrefix + "getFeatureCount" ) )();
+        m_treeCount       = reinterpret_cast<CountFunction>( findFunction( symbolPrefix + "getTreeCount" ) )();
+        m_classify        = reinterpret_cast<ClassifyFunction>( findFunction( symbolPrefix + "classify" ) );
+        m_classifyAndVote = reinterpret_cast<VoteFunction>( findFunction( symbolPrefix + "classifyAndVote" ) );
+    }
+    catch ( ... )
+    {
+        dlclose( m_library );
+        throw;
+    }
+}
+
+CompiledClassifier::~CompiledClassifier()
+{
+    dlclose( m_library );
+}
+
+void * CompiledClassifier::findFunction( const std::string & name ) const
+{
+    void * function = dlsym( m_library, name.c_str() );
+    if ( !function ) throw SupplierError( "Compiled classifier lacks function: " + name );
+    return function;
+}
+
+} // namespace balsa
@@ -0,0 +1,211 @@
+#ifndef COMPILEDCLASSIFIER_H
+#define COMPILEDCLASSIFIER_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "classifier.h"
+#include "classifiervisitor.h"
+#include "datatypes.h"
+#include "exceptions.h"
+#include "iteratortools.h"
+#include "table.h"
+
+namespace balsa
+{
+
+/**
+ * A Classifier that runs a forest that has been compiled to machine code. The
+ * forest is a shared object, built from the C++ source that balsa_compile
+ * generates for a model file (see modelcompiler.h). It casts exactly the same
+ * votes as the trees of the model file.
+ *
+ * The compiled forest classifies points with single-precision features, which
+ * are passed on without copying if they are stored contiguously (in an array,
+ * a vector or a Table). Points with integer features of up to 16 bits are
+ * converted to single precision in a buffer that is reused, which is exact.
+ * Double-precision points are rejected with a ClientError, because converting
+ * them to single precision could change their classification.
+ */
+class CompiledClassifier: public Classifier
+{
+public:
+
+    typedef std::shared_ptr<CompiledClassifier>       SharedPointer;
+    typedef std::shared_ptr<const CompiledClassifier> ConstSharedPointer;
+
+    /**
+     * Loads a compiled forest.
+     * \param sharedObjectFile The path of the shared object.
+     * \param symbolPrefix The prefix of the names of the functions in the
+     *  shared object (see the -p option of balsa_compile).
+     * \throws SupplierError if the shared object can not be loaded, or if it
+     *  lacks one of the functions.
+     */
+    CompiledClassifier( const std::string & sharedObjectFile, const std::string & symbolPrefix = "" );
+
+    /**
+     * Copy constructor (deleted). The shared object is loaded only once.
+     */
+    CompiledClassifier( const CompiledClassifier & ) = delete;
+
+    /**
+     * Destructor; unloads the shared object.
+     */
+    ~CompiledClassifier();
+
+    /**
+     * Returns the number of classes distinguished by the classifier.
+     */
+    unsigned int getClassCount() const
+    {
+        return m_classCount;
+    }
+
+    /**
+     * Returns the number of features the classifier expects.
+     */
+    unsigned int getFeatureCount() const
+    {
+        return m_featureCount;
+    }
+
+    /**
+     * Returns the number of trees in the compiled forest.
+     */
+    unsigned int getTreeCount() const
+    {
+        return m_treeCount;
+    }
+
+    /**
+     * Accept a visitor.
+     */
+    void visit( ClassifierVisitor & visitor ) const
+    {
+        visitor.visit( *this );
+    }
+
+    /**
+     * Bulk-classifies a sequence of data points. Each point gets the label
+     * with the most votes, or the lowest of those labels in case of a tie.
+     */
+    template <typename FeatureIterator, typename LabelOutputIterator>
+    void classify( FeatureIterator pointsStart, FeatureIterator pointsEnd, LabelOutputIterator labelsStart ) const
+    {
+        // Statically check that the label output iterator points to Labels.
+        typedef std::remove_cv_t<typename iterator_value_type<LabelOutputIterator>::type> LabelType;
+        static_assert( std::is_same<LabelType, Label>::value, "The labelStart iterator must point to instances of type Label." );
+
+        // Let the compiled forest classify the points, and write the labels directly if they are stored contiguously.
+        std::size_t   pointCount = 0;
+        const float * points     = getPoints( pointsStart, pointsEnd, pointCount );
+        if ( pointCount == 0 ) return;
+        if constexpr ( isContiguous<LabelOutputIterator, Label>() )
+        {
+            m_classify( points, pointCount, &*labelsStart );
+        }
+        else
+        {
+            static thread_local std::vector<Label> labels;
+            labels.resize( pointCount );
+            m_classify( points, pointCount, labels.data() );
+            std::copy( labels.begin(), labels.end(), labelsStart );
+        }
+    }
+
+    /**
+     * Bulk-classifies a set of points, adding a vote (+1) to the vote table
+     * for the label that each tree assigns to each point.
+     * \param pointsStart An iterator that points to the first feature value of
+     *  the first point.
+     * \param pointsEnd An iterator that points to the end of the block of
+     *  point data.
+     * \param table A table for counting votes.
+     * \pre The column count of the vote table must match the number of
+     *  classes, the row count must match the number of points.
+     */
+    template <typename FeatureIterator>
+    unsigned int classifyAndVote( FeatureIterator pointsStart, FeatureIterator pointsEnd, VoteTable & table ) const
+    {
+        std::size_t   pointCount = 0;
+        const float * points     = getPoints( pointsStart, pointsEnd, pointCount );
+        assert( table.getRowCount() == pointCount && table.getColumnCount() == m_classCount );
+        if ( pointCount > 0 ) m_classifyAndVote( points, pointCount, &table( 0, 0 ) );
+        return m_treeCount;
+    }
+
+private:
+
+    typedef unsigned int ( *CountFunction )();
+    typedef void ( *ClassifyFunction )( const float *, std::size_t, uint8_t * );
+    typedef void ( *VoteFunction )( const float *, std::size_t, uint32_t * );
+
+    /**
+     * Returns the address of a function in the shared object.
+     * \throws SupplierError if the shared object lacks the function.
+     */
+    void * findFunction( const std::string & name ) const;
+
+    /**
+     * Returns true iff the elements that an iterator points to are stored
+     * contiguously, like those of an array or a vector.
+     */
+    template <typename Iterator, typename ValueType>
+    static constexpr bool isContiguous()
+    {
+        return std::is_pointer<Iterator>::value || std::is_same<Iterator, typename std::vector<ValueType>::iterator>::value || std::is_same<Iterator, typename std::vector<ValueType>::const_iterator>::value;
+    }
+
+    /**
+     * Returns a pointer to the points as a block of single-precision values,
+     * which is either the input itself, or a thread-local buffer to which the
+     * points are converted.
+     * \param pointCount Receives the number of points.
+     */
+    template <typename FeatureIterator>
+    const float * getPoints( FeatureIterator pointsStart, FeatureIterator pointsEnd, std::size_t & pointCount ) const
+    {
+        // Check that the points convert to single precision exactly. This is not checked statically, because the
+        // classifier can be visited with points of any type.
+        typedef std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type> FeatureIteratedType;
+        static_assert( std::is_arithmetic<FeatureIteratedType>::value, "Features must be of an integral or floating point type." );
+        if constexpr ( !( std::is_same<FeatureIteratedType, float>::value || ( std::is_integral<FeatureIteratedType>::value && sizeof( FeatureIteratedType ) <= 2 ) ) )
+            throw ClientError( "Compiled classifiers take float features, or integer features of at most 16 bits." );
+
+        // Check the dimensions of the input data.
+        auto entryCount = std::distance( pointsStart, pointsEnd );
+        assert( m_featureCount > 0 );
+        if ( entryCount % m_featureCount ) throw ClientError( "Malformed dataset." );
+        pointCount = entryCount / m_featureCount;
+        if ( pointCount == 0 ) return nullptr;
+
+        // Pass contiguous single-precision points on as they are, and convert all others.
+        if constexpr ( std::is_same<FeatureIteratedType, float>::value && isContiguous<FeatureIterator, float>() )
+        {
+            return &*pointsStart;
+        }
+        else
+        {
+            static thread_local std::vector<float> buffer;
+            buffer.assign( pointsStart, pointsEnd );
+            return buffer.data();
+        }
+    }
+
+    void *           m_library;
+    unsigned int     m_classCount;
+    unsigned int     m_featureCount;
+    unsigned int     m_treeCount;
+    ClassifyFunction m_classify;
+    VoteFunction     m_classifyAndVote;
+};
+
+} // namespace balsa
+
+#endif // COMPILEDCLASSIFIER_H
@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <sstream>
+#include <type_traits>
 #include <valarray>
 #include <vector>
 
@@ -77,6 +78,28 @@ public:
         --m_total;
     }
 
+    /**
+     * Add a number of points with the same label to the table.
+     * \pre label < exclusiveUpperLimit (constructor parameter).
+     */
+    void increment( Label label, std::size_t count )
+    {
+        assert( label < m_data.size() );
+        m_data[label] += count;
+        m_total += count;
+    }
+
+    /**
+     * Remove a number of points with the same label from the table.
+     * \pre getCount( label ) >= count
+     */
+    void decrement( Label label, std::size_t count )
+    {
+        assert( m_data[label] >= count );
+        m_data[label] -= count;
+        m_total -= count;
+    }
+
     /**
      * Returns the stored count of a particular label.
      */
@@ -106,12 +129,22 @@ public:
      * Calculate the Gini impurity of the dataset, based on the stored label counts.
      * \pre The table may not be empty.
      */
-    template <typename FloatType>
+    template <typename FloatType, typename SquaredCountType = std::size_t>
     FloatType giniImpurity() const
     {
         assert( m_total > 0 );
-        auto squaredCounts = m_data * m_data;
-        return FloatType( 1.0 ) - static_cast<FloatType>( squaredCounts.sum() ) / ( m_total * m_total );
+        return FloatType( 1.0 ) - static_cast<FloatType>( getSquaredCountSum<SquaredCountType>() ) / ( SquaredCountType( m_total ) * m_total );
+    }
+
+    /**
+     * Returns the sum of the squares of all counts.
+     */
+    template <typename SquaredCountType = std::size_t>
+    SquaredCountType getSquaredCountSum() const
+    {
+        SquaredCountType sum = 0;
+        for ( auto count : m_data ) sum += SquaredCountType( count ) * count;
+        return sum;
     }
 
     /**
@@ -157,6 +190,157 @@ private:
     std::size_t                m_total;
 };
 
+/**
+ * A read-only view of label counts that are stored elsewhere, e.g. in a slot
+ * of an arena (see SlotArena). It answers the same queries as a
+ * LabelFrequencyTable, but it does not own or allocate any memory.
+ */
+template <typename StoredCountType = uint32_t>
+class LabelCountView
+{
+public:
+
+    /**
+     * The type of the stored counts.
+     */
+    typedef StoredCountType CountType;
+
+    /**
+     * Constructs an empty view.
+     */
+    LabelCountView():
+    m_counts( nullptr ),
+    m_size( 0 ),
+    m_total( 0 )
+    {
+    }
+
+    /**
+     * Constructor.
+     * \param counts The count of each label, which must outlive the view.
+     * \param size The number of counted labels.
+     * \param total The total of all counts.
+     */
+    LabelCountView( const CountType * counts, std::size_t size, std::size_t total ):
+    m_counts( counts ),
+    m_size( size ),
+    m_total( total )
+    {
+    }
+
+    /**
+     * Returns the stored count of a particular label.
+     */
+    std::size_t getCount( Label label ) const
+    {
+        assert( label < m_size );
+        return m_counts[label];
+    }
+
+    /**
+     * Returns the total of all counts.
+     */
+    std::size_t getTotal() const
+    {
+        return m_total;
+    }
+
+    /**
+     * Returns the number of distinct, consecutive label values that are counted.
+     */
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * Calculate the Gini impurity of the counted points.
+     * \pre The total may not be zero.
+     */
+    template <typename FloatType, typename SquaredCountType = std::size_t>
+    FloatType giniImpurity() const
+    {
+        assert( m_total > 0 );
+        return FloatType( 1.0 ) - static_cast<FloatType>( getSquaredCountSum<SquaredCountType>() ) / ( SquaredCountType( m_total ) * m_total );
+    }
+
+    /**
+     * Returns the sum of the squares of all counts.
+     */
+    template <typename SquaredCountType = std::size_t>
+    SquaredCountType getSquaredCountSum() const
+    {
+        SquaredCountType sum = 0;
+        for ( std::size_t l = 0; l < m_size; ++l ) sum += SquaredCountType( m_counts[l] ) * m_counts[l];
+        return sum;
+    }
+
+    /**
+     * Returns the lowest label with the highest count.
+     */
+    Label getMostFrequentLabel() const
+    {
+        return static_cast<Label>( std::max_element( m_counts, m_counts + m_size ) - m_counts );
+    }
+
+    /**
+     * Return a textual representation for debugging purposes.
+     */
+    const std::string asText() const
+    {
+        std::stringstream ss;
+        if ( m_size == 0 ) return "(No entries)";
+        ss << m_counts[0];
+        for ( std::size_t l = 1; l < m_size; ++l ) ss << " " << m_counts[l];
+        return ss.str();
+    }
+
+private:
+
+    const CountType * m_counts;
+    std::size_t       m_size;
+    std::size_t       m_total;
+};
+
+/**
+ * The floating-point type used to calculate the impurity of splits on features
+ * of the specified type: the feature type itself if it is a floating-point
+ * type, otherwise (for integer features) double.
+ */
+template <typename FeatureType>
+using ImpurityTypeOf = std::conditional_t<std::is_floating_point<FeatureType>::value, FeatureType, double>;
+
+/**
+ * A 128-bit unsigned integer type (a GCC and Clang extension).
+ */
+__extension__ typedef unsigned __int128 UInt128;
+
+/**
+ * The unsigned integer type used to sum the squared label counts of sets of
+ * points that are identified by the specified point ID type. The squares of
+ * counts of 2^32 or more points do not fit in 64 bits.
+ */
+template <typename PointIDType>
+using SquaredCountTypeOf = std::conditional_t<( sizeof( PointIDType ) <= 4 ), std::size_t, UInt128>;
+
+/**
+ * Calculate the weighted average of the Gini impurities of both sides of a
+ * split, from the number of points and the sum of the squared label counts of
+ * each side. The result is identical to the weighted average of the
+ * giniImpurity() of the label frequency tables of both sides, but it can be
+ * calculated in constant time.
+ * \pre Both sides must contain at least one point.
+ */
+template <typename FloatType, typename SquaredCountType = std::size_t>
+FloatType splitGiniImpurity( SquaredCountType leftSquaredCounts, std::size_t leftCount, SquaredCountType rightSquaredCounts, std::size_t rightCount )
+{
+    assert( leftCount > 0 && rightCount > 0 );
+    auto totalCount    = leftCount + rightCount;
+    auto leftImpurity  = FloatType( 1.0 ) - static_cast<FloatType>( leftSquaredCounts ) / ( SquaredCountType( leftCount ) * leftCount );
+    auto rightImpurity = FloatType( 1.0 ) - static_cast<FloatType>( rightSquaredCounts ) / ( SquaredCountType( rightCount ) * rightCount );
+    return ( leftImpurity * leftCount + rightImpurity * rightCount ) / totalCount;
+}
+
 /**
  * An axis-aligned division between two sets of points in a multidimensional
  * feature-space. N.B. the split feature value is an exclusive upper bound.
@@ -9,8 +9,9 @@ namespace balsa
 
 /**
  * The integer type used to identify a feature dimension in a data point or data set.
+ * N.B. data points may therefore have at most 65535 features.
  */
-typedef uint8_t FeatureID;
+typedef uint16_t FeatureID;
 
 /**
  * The integer type used as a label type in classification problems.
@@ -18,10 +19,25 @@ typedef uint8_t FeatureID;
 typedef uint8_t Label;
 
 /**
- * The integer type used to identify one point in a data set.
+ * The integer type used to identify one point in a data set. This is the
+ * default, compact point ID type of the training engines, which limits them to
+ * data sets of less than 2^32 points.
  */
 typedef uint32_t DataPointID;
 
+/**
+ * The integer type used to identify one point in a data set of 2^32 or more
+ * points. The training engines, FeatureIndex and RandomForestTrainer take the
+ * point ID type as a template parameter; data sets of 2^32 or more points must
+ * use this type, and RandomForestTrainer rejects them otherwise.
+ */
+typedef uint64_t LargeDataPointID;
+
+/**
+ * The integer type used to count how many times a data point occurs in a sample of a data set.
+ */
+typedef uint32_t PointMultiplicity;
+
 /**
  * The integer type used to identify a node in a decision tree.
  */
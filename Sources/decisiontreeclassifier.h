@@ -3,7 +3,7 @@
 
 #include <algorithm>
 #include <iterator>
-#include <numeric>
+#include <vector>
 
 #include "classifier.h"
 #include "classifiervisitor.h"
@@ -21,8 +21,8 @@ class BalsaFileParser;
 class BalsaFileWriter;
 
 // Forward declaration.
-template <typename FeatureIterator, typename LabelIterator>
-class IndexedDecisionTree;
+template <typename Tree, typename FeatureType>
+class GrowableTree;
 
 /**
  * A Classifier based on an internal decision tree.
@@ -61,6 +61,58 @@ public:
         visitor.visit( *this );
     }
 
+    /**
+     * Returns the number of nodes in the tree. The root node has ID 0.
+     */
+    NodeID getNodeCount() const
+    {
+        return static_cast<NodeID>( m_nodes.size() );
+    }
+
+    /**
+     * Returns true iff the node with the specified ID is a leaf node.
+     */
+    bool isLeaf( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID].m_leftChildID == 0;
+    }
+
+    /**
+     * Returns the ID of the left child of an interior node. The right child
+     * has the next ID. Returns 0 for leaf nodes.
+     */
+    NodeID getLeftChildID( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID].m_leftChildID;
+    }
+
+    /**
+     * Returns the ID of the feature that an interior node splits on. Points go
+     * to the left child iff their value of the feature is less than the split
+     * value.
+     */
+    FeatureID getSplitFeatureID( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID].m_splitFeatureID;
+    }
+
+    /**
+     * Returns the split value of an interior node.
+     */
+    FeatureType getSplitValue( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID].m_splitValue;
+    }
+
+    /**
+     * Returns the label of a node. Only the labels of leaf nodes are used for
+     * classification.
+     */
+    Label getLabel( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID].m_label;
+    }
+
     /**
      * Bulk-classifies a sequence of data points.
      */
@@ -90,7 +142,7 @@ public:
         classifyAndVote( pointsStart, pointsEnd, voteCounts );
 
         // Generate the labels.
-        for ( unsigned int point = 0; point < pointCount; ++point )
+        for ( std::size_t point = 0; point < std::size_t( pointCount ); ++point )
             *labelsStart++ = static_cast<Label>( voteCounts.getColumnOfRowMaximum( point ) );
     }
 
@@ -120,12 +172,8 @@ public:
         // Determine the number of points in the input data.
         auto pointCount = entryCount / m_featureCount;
 
-        // Create a list containing all datapoint IDs (0, 1, 2, etc.).
-        std::vector<DataPointID> pointIDs( pointCount );
-        std::iota( pointIDs.begin(), pointIDs.end(), 0 );
-
-        // Recursively partition the list of point IDs according to the interior node criteria, and classify them by the leaf node labels.
-        recursiveClassifyVote( pointIDs.begin(), pointIDs.end(), pointsStart, table, NodeID( 0 ) );
+        // Walk the points through the tree, in groups.
+        classifyAndVoteInLockstep( pointsStart, pointCount, table );
 
         // Return the number of classifiers that voted.
         return 1;
@@ -133,43 +181,101 @@ public:
 
 private:
 
+    /**
+     * A node of the tree, packed into a single record of 8 to 16 bytes
+     * (depending on the feature type), so that visiting a node touches only
+     * one cache line. The children of an interior node are always stored next
+     * to each other: the right child directly follows the left child. Leaf
+     * nodes have a left child ID of 0. The label of an interior node is not
+     * used for classification, but it is kept for the model file.
+     */
+    struct Node
+    {
+        NodeID      m_leftChildID;
+        FeatureID   m_splitFeatureID;
+        Label       m_label;
+        FeatureType m_splitValue;
+    };
+
+    static_assert( sizeof( Node ) <= 16, "Nodes should be packed into at most 16 bytes." );
+
+    /**
+     * The number of points that are walked through the tree in lockstep.
+     */
+    static constexpr std::size_t LOCKSTEP_GROUP_SIZE = 16;
+
     DecisionTreeClassifier( unsigned int classCount, unsigned int featureCount ):
     m_classCount( classCount ),
     m_featureCount( featureCount )
     {
     }
 
-    template <typename FeatureIterator>
-    void recursiveClassifyVote( std::vector<DataPointID>::iterator pointIDsStart, std::vector<DataPointID>::iterator pointIDsEnd, FeatureIterator pointsStart, VoteTable & voteTable, NodeID currentNodeID ) const
+    /**
+     * Stores the node with the specified ID.
+     * \pre The nodes have been allocated, and the right child of an interior
+     *  node directly follows its left child.
+     */
+    void setNode( NodeID nodeID, NodeID leftChildID, NodeID rightChildID, FeatureID splitFeatureID, FeatureType splitValue, Label label )
     {
-        // If the current node is an interior node, split the points along the split value, and classify both halves.
-        if ( m_leftChildID( currentNodeID, 0 ) > 0 )
-        {
-            // Extract the split limit and split dimension of this node.
-            auto splitValue = m_splitValue( currentNodeID, 0 );
-            auto featureID  = m_splitFeatureID( currentNodeID, 0 );
-
-            // Split the point IDs in two halves: points that lie below the split value, and points that lie on or above the feature split value.
-            auto featureCount      = m_featureCount;
-            auto pointIsBelowLimit = [&pointsStart, featureCount, splitValue, featureID]( const unsigned int & pointID )
-            {
-                return pointsStart[featureCount * pointID + featureID] < splitValue;
-            };
-            auto secondHalf = std::partition( pointIDsStart, pointIDsEnd, pointIsBelowLimit );
+        assert( leftChildID ? rightChildID == leftChildID + 1 : rightChildID == 0 );
+        (void) rightChildID;
+        Node & node           = m_nodes[nodeID];
+        node.m_leftChildID    = leftChildID;
+        node.m_splitFeatureID = splitFeatureID;
+        node.m_label          = label;
+        node.m_splitValue     = splitValue;
+    }
 
-            // Recursively classify-vote both halves.
-            recursiveClassifyVote( pointIDsStart, secondHalf, pointsStart, voteTable, m_leftChildID( currentNodeID, 0 ) );
-            recursiveClassifyVote( secondHalf, pointIDsEnd, pointsStart, voteTable, m_rightChildID( currentNodeID, 0 ) );
-        }
+    /**
+     * Hints the processor to fetch the cache line at the specified address.
+     */
+    static void prefetch( const void * address )
+    {
+#if defined( __GNUC__ )
+        __builtin_prefetch( address );
+#else
+        (void) address;
+#endif
+    }
 
-        // If the current node is a leaf node, cast a vote for the node-label for each point.
-        else
+    /**
+     * Classifies the points by walking groups of LOCKSTEP_GROUP_SIZE points
+     * through the tree together, one level per step. Each step selects the
+     * child of every point in the group without branching, and prefetches the
+     * children of the next node, so that the memory accesses of the points in
+     * a group overlap. This needs no scratch memory, so it is just as fast
+     * for small batches as for large ones.
+     */
+    template <typename FeatureIterator>
+    void classifyAndVoteInLockstep( FeatureIterator pointsStart, std::size_t pointCount, VoteTable & table ) const
+    {
+        const Node *      nodes        = m_nodes.data();
+        const std::size_t featureCount = m_featureCount;
+        for ( std::size_t groupStart = 0; groupStart < pointCount; groupStart += LOCKSTEP_GROUP_SIZE )
         {
-            auto label = m_label( currentNodeID, 0 );
-            for ( auto it( pointIDsStart ), end( pointIDsEnd ); it != end; ++it )
+            // Start all points of the group at the root.
+            const std::size_t groupSize   = std::min( LOCKSTEP_GROUP_SIZE, pointCount - groupStart );
+            FeatureIterator   groupPoints = pointsStart + groupStart * featureCount;
+            NodeID            nodeIDs[LOCKSTEP_GROUP_SIZE];
+            std::fill_n( nodeIDs, groupSize, NodeID( 0 ) );
+
+            // Move every point that is not in a leaf yet to the left or right child of its node, until all points are in leaves.
+            for ( bool moved = true; moved; )
             {
-                ++voteTable( *it, label );
+                moved = false;
+                for ( std::size_t point = 0; point < groupSize; ++point )
+                {
+                    const Node & node = nodes[nodeIDs[point]];
+                    if ( node.m_leftChildID == 0 ) continue;
+                    prefetch( nodes + node.m_leftChildID );
+                    bool goesRight = !( groupPoints[point * featureCount + node.m_splitFeatureID] < node.m_splitValue );
+                    nodeIDs[point] = node.m_leftChildID + goesRight;
+                    moved          = true;
+                }
             }
+
+            // Cast a vote for the label of the leaf of each point.
+            for ( std::size_t point = 0; point < groupSize; ++point ) ++table( groupStart + point, nodes[nodeIDs[point]].m_label );
         }
     }
 
@@ -178,18 +284,14 @@ private:
     friend class BalsaFileWriter;
 
     template <typename T, typename U>
-    friend class IndexedDecisionTree;
+    friend class GrowableTree;
 
     template <typename T>
     friend std::ostream & operator<<( std::ostream & out, const DecisionTreeClassifier<T> & tree );
 
-    unsigned int       m_classCount;
-    unsigned int       m_featureCount;
-    Table<NodeID>      m_leftChildID;
-    Table<NodeID>      m_rightChildID;
-    Table<FeatureID>   m_splitFeatureID;
-    Table<FeatureType> m_splitValue;
-    Table<Label>       m_label;
+    unsigned int      m_classCount;
+    unsigned int      m_featureCount;
+    std::vector<Node> m_nodes;
 };
 
 /**
@@ -203,12 +305,14 @@ std::ostream & operator<<( std::ostream & out, const DecisionTreeClassifier<Feat
 
     // Print the values.
     std::cout << "N:   L:   R:   F:   V:              L:" << std::endl;
-    for ( unsigned int row = 0; row < tree.m_leftChildID.getRowCount(); ++row )
+    for ( std::size_t row = 0; row < tree.m_nodes.size(); ++row )
     {
+        const auto & node         = tree.m_nodes[row];
+        NodeID       rightChildID = node.m_leftChildID ? node.m_leftChildID + 1 : 0;
         std::cout << std::left << std::setw( 4 ) << row << " "
-                  << std::left << std::setw( 4 ) << tree.m_leftChildID( row, 0 ) << " " << std::setw( 4 ) << tree.m_rightChildID( row, 0 ) << " "
-                  << std::left << std::setw( 4 ) << static_cast<int>( tree.m_splitFeatureID( row, 0 ) ) << " " << std::setw( 4 ) << std::setw( 16 ) << tree.m_splitValue( row, 0 )
-                  << std::left << std::setw( 4 ) << int( tree.m_label( row, 0 ) ) << std::endl;
+                  << std::left << std::setw( 4 ) << node.m_leftChildID << " " << std::setw( 4 ) << rightChildID << " "
+                  << std::left << std::setw( 4 ) << static_cast<int>( node.m_splitFeatureID ) << " " << std::setw( 4 ) << std::setw( 16 ) << +node.m_splitValue
+                  << std::left << std::setw( 4 ) << int( node.m_label ) << std::endl;
     }
 
     return out;
@@ -3,15 +3,16 @@
 
 #include <cassert>
 #include <iostream>
-#include <thread>
 
 #include "classifier.h"
 #include "classifierstream.h"
+#include "compiledclassifier.h"
 #include "datatypes.h"
 #include "decisiontreeclassifier.h"
 #include "exceptions.h"
 #include "iteratortools.h"
-#include "messagequeue.h"
+#include "quickscorer.h"
+#include "votingpool.h"
 
 namespace balsa
 {
@@ -31,9 +32,13 @@ public:
     {
     }
 
+    void visit( const CompiledClassifier & classifier );
     void visit( const EnsembleClassifier & classifier );
     void visit( const DecisionTreeClassifier<float> & classifier );
     void visit( const DecisionTreeClassifier<double> & classifier );
+    void visit( const DecisionTreeClassifier<uint8_t> & classifier );
+    void visit( const DecisionTreeClassifier<uint16_t> & classifier );
+    void visit( const DecisionTreeClassifier<int16_t> & classifier );
 
 private:
 
@@ -57,9 +62,13 @@ public:
     {
     }
 
+    void visit( const CompiledClassifier & classifier );
     void visit( const EnsembleClassifier & classifier );
     void visit( const DecisionTreeClassifier<float> & classifier );
     void visit( const DecisionTreeClassifier<double> & classifier );
+    void visit( const DecisionTreeClassifier<uint8_t> & classifier );
+    void visit( const DecisionTreeClassifier<uint16_t> & classifier );
+    void visit( const DecisionTreeClassifier<int16_t> & classifier );
 
 private:
 
@@ -78,13 +87,15 @@ public:
     /**
      * Creates an ensemble classifier.
      * \param classifierStream A resettable stream of classifiers to apply.
-     * \param maxWorkerThreads The maximum number of threads that may be created in addition to the main thread.
+     * \param maxWorkerThreads The maximum number of threads that may be created in addition to the main thread. The
+     *  threads are created once, and are kept for all classifications.
      */
     EnsembleClassifier( ClassifierInputStream & classifierStream, unsigned int maxWorkerThreads = 0 ):
     m_classifierStreamPtr( &classifierStream ),
     m_maxWorkerThreads( maxWorkerThreads ),
     m_classWeights( classifierStream.getClassCount(), 1.0 )
     {
+        if ( maxWorkerThreads > 0 ) m_votingPool = std::make_shared<VotingPool>( maxWorkerThreads );
     }
 
     /**
@@ -124,6 +135,19 @@ public:
         m_classWeights = classWeights;
     }
 
+    /**
+     * Converts all classifiers of the stream into a QuickScorer (see
+     * quickscorer.h), which is used instead of the stream by all subsequent
+     * classifications. This keeps the whole forest in memory, and is usually
+     * much faster for forests of many shallow trees. The votes do not change.
+     * \throws ClientError if the classifiers are not decision trees of the
+     *  same feature type, or if a tree has too many leaves.
+     */
+    void enableQuickScorer()
+    {
+        m_quickScorer = QuickScorerFactory::build( *m_classifierStreamPtr );
+    }
+
     /**
      * Bulk-classifies a sequence of data points.
      */
@@ -150,7 +174,7 @@ public:
         classifyAndVote( pointsStart, pointsEnd, voteCounts );
 
         // Generate the labels.
-        for ( unsigned int point = 0; point < pointCount; ++point )
+        for ( std::size_t point = 0; point < std::size_t( pointCount ); ++point )
             *labelsStart++ = static_cast<Label>( voteCounts.getColumnOfWeightedRowMaximum( point, m_classWeights ) );
     }
 
@@ -172,6 +196,10 @@ public:
         typedef std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type> FeatureIteratedType;
         static_assert( std::is_arithmetic<FeatureIteratedType>::value, "Features must be of an integral or floating point type." );
 
+        // Let the QuickScorer classify the points, if it has been enabled.
+        if ( m_quickScorer )
+            return std::visit( [&]( const auto & scorer ) { return scorer.classifyAndVote( pointsStart, pointsEnd, table, m_votingPool.get() ); }, *m_quickScorer );
+
         // Dispatch to single- or multithreaded implementation.
         if ( m_maxWorkerThreads > 0 )
             return classifyAndVoteMultiThreaded( pointsStart, pointsEnd, table );
@@ -207,95 +235,35 @@ protected:
         m_classifierStreamPtr = &classifierStream;
         m_maxWorkerThreads    = maxWorkerThreads;
         m_classWeights.resize( m_classifierStreamPtr->getClassCount(), 1.0 );
+        if ( maxWorkerThreads > 0 ) m_votingPool = std::make_shared<VotingPool>( maxWorkerThreads );
     }
 
 private:
 
     /**
-     * A job for the worker thread.
-     */
-    class WorkerJob
-    {
-    public:
-
-        WorkerJob( Classifier::ConstSharedPointer classifier ):
-        m_classifier( classifier )
-        {
-        }
-
-        // Pointer to the tree that must be applied. Null indicates the end of processing, causing the worker to finish.
-        Classifier::ConstSharedPointer m_classifier;
-    };
-
-    /**
-     * A thread that runs classifyAndVote on a thread-local vote table.
+     * Lets a classifier vote on a batch of points, for the voting pool.
      */
     template <typename FeatureIterator>
-    class WorkerThread
+    class PointVoter: public VotingPool::Voter
     {
     public:
 
-        typedef std::shared_ptr<WorkerThread> SharedPointer;
-
-        WorkerThread( MessageQueue<WorkerJob> & jobQueue, unsigned int classCount, unsigned int featureCount, FeatureIterator pointsStart, FeatureIterator pointsEnd ):
-        m_running( false ),
-        m_jobQueue( jobQueue ),
+        PointVoter( FeatureIterator pointsStart, FeatureIterator pointsEnd ):
         m_pointsStart( pointsStart ),
-        m_pointsEnd( pointsEnd ),
-        m_voteCounts( 0, 0 ) // Overwrite this below.
+        m_pointsEnd( pointsEnd )
         {
-            // Check the dimensions of the input data.
-            auto entryCount = std::distance( pointsStart, pointsEnd );
-            assert( featureCount > 0 );
-            assert( ( entryCount % featureCount ) == 0 );
-
-            // Determine the number of points in the input data.
-            auto pointCount = entryCount / featureCount;
-
-            // Create a table for the label votes.
-            m_voteCounts = VoteTable( pointCount, classCount );
         }
 
-        void start()
+        void vote( const Classifier & classifier, VoteTable & table ) const
         {
-            // Launch a thread to process incoming jobs from the job queue.
-            assert( !m_running );
-            m_running = true;
-            m_thread  = std::thread( &EnsembleClassifier::WorkerThread<FeatureIterator>::processJobs, this );
-        }
-
-        void join()
-        {
-            // Wait for the thread to join.
-            if ( !m_running ) return;
-            m_thread.join();
-            m_running = false;
-        }
-
-        const VoteTable & getVoteCounts() const
-        {
-            return m_voteCounts;
+            ClassifyAndVoteDispatcher voter( m_pointsStart, m_pointsEnd, table );
+            classifier.visit( voter );
         }
 
     private:
 
-        void processJobs()
-        {
-            // Process incoming jobs until the null job is received.
-            for ( WorkerJob job( m_jobQueue.receive() ); job.m_classifier; job = m_jobQueue.receive() )
-            {
-                // Let the classifier vote on the data. Accumulate votes in the thread-private vote table.
-                ClassifyAndVoteDispatcher voter( m_pointsStart, m_pointsEnd, m_voteCounts );
-                job.m_classifier->visit( voter );
-            }
-        }
-
-        bool                      m_running;
-        MessageQueue<WorkerJob> & m_jobQueue;
-        FeatureIterator           m_pointsStart;
-        FeatureIterator           m_pointsEnd;
-        VoteTable                 m_voteCounts;
-        std::thread               m_thread;
+        FeatureIterator m_pointsStart;
+        FeatureIterator m_pointsEnd;
     };
 
     template <typename FeatureIterator>
@@ -319,44 +287,24 @@ private:
     template <typename FeatureIterator>
     unsigned int classifyAndVoteMultiThreaded( FeatureIterator pointsStart, FeatureIterator pointsEnd, VoteTable & table ) const
     {
-        // Reset the stream of classifiers.
-        m_classifierStreamPtr->rewind();
-
-        // Create message queues for communicating with the worker threads.
-        MessageQueue<WorkerJob> jobQueue;
-
-        // Create the workers.
-        std::vector<typename WorkerThread<FeatureIterator>::SharedPointer> workers;
-        const unsigned int classCount = m_classifierStreamPtr->getClassCount();
-        const unsigned int featureCount = m_classifierStreamPtr->getFeatureCount();
-        for ( unsigned int i = 0; i < m_maxWorkerThreads; ++i )
-            workers.push_back( typename WorkerThread<FeatureIterator>::SharedPointer( new WorkerThread<FeatureIterator>( jobQueue, classCount, featureCount, pointsStart, pointsEnd ) ) );
-
-        // Start all the workers.
-        for ( auto & worker : workers ) worker->start();
-
-        // Reset the stream of classifiers, and apply each classifier that comes out of it.
-        unsigned int voterCount = 0;
-        for ( auto classifier = m_classifierStreamPtr->next(); classifier; classifier = m_classifierStreamPtr->next(), ++voterCount ) jobQueue.send( WorkerJob( classifier ) );
-
-        // Send stop messages for all workers.
-        for ( auto i = workers.size(); i > 0; --i ) jobQueue.send( WorkerJob( nullptr ) );
-
-        // Wait for all the workers to join.
-        for ( auto & worker : workers ) worker->join();
-
-        // Add the votes accumulated by the workers to the output total.
-        for ( auto & worker : workers ) table += worker->getVoteCounts();
-
-        // Return the number of classifiers that have voted.
-        return voterCount;
+        // Let the worker threads of the pool, and this thread, apply the classifiers.
+        assert( m_votingPool );
+        return m_votingPool->classifyAndVote( *m_classifierStreamPtr, PointVoter<FeatureIterator>( pointsStart, pointsEnd ), table );
     }
 
-    ClassifierInputStream * m_classifierStreamPtr;
-    unsigned int            m_maxWorkerThreads;
-    std::vector<float>      m_classWeights;
+    ClassifierInputStream *               m_classifierStreamPtr;
+    unsigned int                          m_maxWorkerThreads;
+    std::vector<float>                    m_classWeights;
+    std::shared_ptr<const AnyQuickScorer> m_quickScorer;
+    VotingPool::SharedPointer             m_votingPool;
 };
 
+template <typename FeatureIterator, typename LabelOutputIterator>
+void ClassifyDispatcher<FeatureIterator, LabelOutputIterator>::visit( const CompiledClassifier & classifier )
+{
+    classifier.classify( m_featureStart, m_featureEnd, m_labelStart );
+}
+
 template <typename FeatureIterator, typename LabelOutputIterator>
 void ClassifyDispatcher<FeatureIterator, LabelOutputIterator>::visit( const EnsembleClassifier & classifier )
 {
@@ -377,6 +325,30 @@ void ClassifyDispatcher<FeatureIterator, LabelOutputIterator>::visit( const Deci
     classifier.classify( m_featureStart, m_featureEnd, m_labelStart );
 }
 
+template <typename FeatureIterator, typename LabelOutputIterator>
+void ClassifyDispatcher<FeatureIterator, LabelOutputIterator>::visit( const DecisionTreeClassifier<uint8_t> & classifier )
+{
+    classifier.classify( m_featureStart, m_featureEnd, m_labelStart );
+}
+
+template <typename FeatureIterator, typename LabelOutputIterator>
+void ClassifyDispatcher<FeatureIterator, LabelOutputIterator>::visit( const DecisionTreeClassifier<uint16_t> & classifier )
+{
+    classifier.classify( m_featureStart, m_featureEnd, m_labelStart );
+}
+
+template <typename FeatureIterator, typename LabelOutputIterator>
+void ClassifyDispatcher<FeatureIterator, LabelOutputIterator>::visit( const DecisionTreeClassifier<int16_t> & classifier )
+{
+    classifier.classify( m_featureStart, m_featureEnd, m_labelStart );
+}
+
+template <typename FeatureIterator>
+void ClassifyAndVoteDispatcher<FeatureIterator>::visit( const CompiledClassifier & classifier )
+{
+    classifier.classifyAndVote( m_featureStart, m_featureEnd, m_voteTable );
+}
+
 template <typename FeatureIterator>
 void ClassifyAndVoteDispatcher<FeatureIterator>::visit( const EnsembleClassifier & classifier )
 {
@@ -397,6 +369,24 @@ void ClassifyAndVoteDispatcher<FeatureIterator>::visit( const DecisionTreeClassi
     classifier.classifyAndVote( m_featureStart, m_featureEnd, m_voteTable );
 }
 
+template <typename FeatureIterator>
+void ClassifyAndVoteDispatcher<FeatureIterator>::visit( const DecisionTreeClassifier<uint8_t> & classifier )
+{
+    classifier.classifyAndVote( m_featureStart, m_featureEnd, m_voteTable );
+}
+
+template <typename FeatureIterator>
+void ClassifyAndVoteDispatcher<FeatureIterator>::visit( const DecisionTreeClassifier<uint16_t> & classifier )
+{
+    classifier.classifyAndVote( m_featureStart, m_featureEnd, m_voteTable );
+}
+
+template <typename FeatureIterator>
+void ClassifyAndVoteDispatcher<FeatureIterator>::visit( const DecisionTreeClassifier<int16_t> & classifier )
+{
+    classifier.classifyAndVote( m_featureStart, m_featureEnd, m_voteTable );
+}
+
 } // namespace balsa
 
 #endif // ENSEMBLECLASSIFIER_H
@@ -0,0 +1,549 @@
+#ifndef FEATUREINDEX_H
+#define FEATUREINDEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "datatypes.h"
+#include "exceptions.h"
+#include "fileio.h"
+#include "memorymapping.h"
+#include "workerpool.h"
+
+namespace balsa
+{
+
+/**
+ * Lists of all points of a data set, sorted by the value of each feature.
+ *
+ * The index is stored as separate arrays: one array of feature values and one
+ * array of point IDs per feature, and a single array with the label of each
+ * point. Scanning a feature for splits only streams through the values, and
+ * rearranging the index only moves values and point IDs.
+ *
+ * Points with equal feature values are ordered by point ID, so the index does
+ * not depend on the sorting algorithm or on the number of threads used to
+ * build it. The features are sorted with a radix sort. The data set is read
+ * only once, sequentially, so it can be a memory-mapped file that is larger
+ * than the available RAM. The index itself can be stored in scratch files as
+ * well, and so can the buffers used for sorting.
+ *
+ * Building the index is expensive, so it can be persisted in an index file,
+ * together with a key that identifies the data set. Later indices of the same
+ * data set are then mapped from the index file rather than built. A mapped
+ * index is read-only, but copies of it can be rearranged.
+ *
+ * An index can also cover a sample of the points of another index, in which
+ * points may occur more than once. Such an index is derived from the other
+ * index by filtering, and stores each sampled point once, with its
+ * multiplicity as a weight.
+ */
+template <typename FeatureType, typename PointIDType = DataPointID>
+class FeatureIndex
+{
+public:
+
+    static_assert( std::is_integral<PointIDType>::value && std::is_unsigned<PointIDType>::value, "Point IDs must be unsigned integers." );
+
+    /**
+     * Temporary storage for stablePartition(). Threads that partition the
+     * index concurrently each need their own buffer.
+     */
+    class PartitionBuffer
+    {
+        friend class FeatureIndex;
+
+        std::vector<FeatureType> m_values;
+        std::vector<PointIDType> m_pointIDs;
+    };
+
+    /**
+     * Builds the index.
+     * \param dataPoints Iterator to the first feature of the first point (row-major).
+     * \param labels Iterator to the label of the first point.
+     * \param featureCount The number of features per point.
+     * \param pointCount The number of points.
+     * \param workerPool Optional pool of threads that help sorting the features concurrently.
+     * \param scratchDirectory Directory in which the index is stored in scratch files. If empty (the default), the index is stored on the heap.
+     * \param indexFile The index file from which the index is mapped if it was written with the same key, and to which it is written otherwise. If empty (the default), the index is always built, and not written.
+     * \param indexKey Identifies the data set in the index file, e.g. a hash of its contents.
+     */
+    template <typename FeatureIterator, typename LabelIterator>
+    FeatureIndex( FeatureIterator dataPoints, LabelIterator labels, unsigned int featureCount, std::size_t pointCount, WorkerPool * workerPool = nullptr, const std::string & scratchDirectory = std::string(), const std::string & indexFile = std::string(), const std::string & indexKey = std::string() ):
+    m_featureCount( featureCount ),
+    m_pointCount( pointCount ),
+    m_values( ScratchAllocator<FeatureType>( scratchDirectory ) ),
+    m_pointIDs( ScratchAllocator<PointIDType>( scratchDirectory ) ),
+    m_labels( labels, labels + pointCount ),
+    m_mappedValues( nullptr ),
+    m_mappedPointIDs( nullptr )
+    {
+        // Map the index from the index file instead of building it, if possible.
+        if ( !indexFile.empty() && mapIndexFile( indexFile, indexKey ) ) return;
+        m_values.resize( std::size_t( featureCount ) * pointCount );
+        m_pointIDs.resize( std::size_t( featureCount ) * pointCount );
+
+        // Copy the features of the points to the value lists, one block of points at a time.
+        std::size_t blockCount = ( std::size_t( pointCount ) + TRANSPOSE_BLOCK_SIZE - 1 ) / TRANSPOSE_BLOCK_SIZE;
+        auto        copyBlock  = [&]( std::size_t block )
+        {
+            std::size_t blockEnd = std::min( ( block + 1 ) * TRANSPOSE_BLOCK_SIZE, std::size_t( pointCount ) );
+            for ( std::size_t point = block * TRANSPOSE_BLOCK_SIZE; point < blockEnd; ++point )
+            {
+                auto pointFeatures = dataPoints + point * featureCount;
+                for ( FeatureID feature = 0; feature < featureCount; ++feature ) m_values[feature * std::size_t( pointCount ) + point] = pointFeatures[feature];
+            }
+        };
+
+        // Sort the features independently. Exceptions cannot cross thread boundaries, so invalid values are
+        // reported through a flag. Each thread takes a free sort buffer, and creates one only if all buffers are
+        // in use by other threads, so the buffers are allocated once per thread rather than once per feature.
+        std::atomic<bool>                        foundNaN( false );
+        std::mutex                               sortBufferMutex;
+        std::vector<std::unique_ptr<SortBuffer>> sortBuffers;
+        auto                                     sortFeature = [&]( std::size_t feature )
+        {
+            std::unique_ptr<SortBuffer> sortBuffer;
+            {
+                std::lock_guard<std::mutex> lock( sortBufferMutex );
+                if ( !sortBuffers.empty() )
+                {
+                    sortBuffer = std::move( sortBuffers.back() );
+                    sortBuffers.pop_back();
+                }
+            }
+            if ( !sortBuffer ) sortBuffer = std::make_unique<SortBuffer>( pointCount, m_values.get_allocator() );
+            if ( !buildSingleFeatureIndex( feature, *sortBuffer ) ) foundNaN = true;
+            std::lock_guard<std::mutex> lock( sortBufferMutex );
+            sortBuffers.push_back( std::move( sortBuffer ) );
+        };
+        if ( workerPool )
+        {
+            workerPool->parallelFor( blockCount, copyBlock );
+            workerPool->parallelFor( featureCount, sortFeature );
+        }
+        else
+        {
+            for ( std::size_t block = 0; block < blockCount; ++block ) copyBlock( block );
+            for ( FeatureID feature = 0; feature < featureCount; ++feature ) sortFeature( feature );
+        }
+        if ( foundNaN ) throw ClientError( "Feature value is not a number." );
+
+        // Persist the index for later use.
+        if ( !indexFile.empty() ) writeIndexFile( indexFile, indexKey );
+    }
+
+    /**
+     * Copy constructor. The copy stores its own point lists, also if the
+     * lists of the original are mapped from an index file, so the copy can
+     * be rearranged.
+     */
+    FeatureIndex( const FeatureIndex & other ):
+    m_featureCount( other.m_featureCount ),
+    m_pointCount( other.m_pointCount ),
+    m_values( other.getAllValues(), other.getAllValues() + other.getEntryCount(), other.m_values.get_allocator() ),
+    m_pointIDs( other.getAllPointIDs(), other.getAllPointIDs() + other.getEntryCount(), other.m_pointIDs.get_allocator() ),
+    m_labels( other.m_labels ),
+    m_weights( other.m_weights ),
+    m_mappedValues( nullptr ),
+    m_mappedPointIDs( nullptr )
+    {
+    }
+
+    /**
+     * Assignment operator (deleted).
+     */
+    FeatureIndex & operator=( const FeatureIndex & ) = delete;
+
+    /**
+     * Builds the index of a sample of the points in another index. The point
+     * lists of the other index are filtered, so no sorting is necessary.
+     * \param source The index of the complete data set.
+     * \param multiplicities The number of times each point occurs in the sample, by point ID. Points that occur zero times are left out.
+     */
+    FeatureIndex( const FeatureIndex & source, const std::vector<PointMultiplicity> & multiplicities ):
+    m_featureCount( source.m_featureCount ),
+    m_pointCount( multiplicities.size() - std::count( multiplicities.begin(), multiplicities.end(), 0 ) ),
+    m_values( std::size_t( m_featureCount ) * m_pointCount, source.m_values.get_allocator() ),
+    m_pointIDs( std::size_t( m_featureCount ) * m_pointCount, source.m_pointIDs.get_allocator() ),
+    m_labels( source.m_labels ),
+    m_mappedValues( nullptr ),
+    m_mappedPointIDs( nullptr )
+    {
+        assert( multiplicities.size() == source.m_labels.size() );
+        assert( source.m_weights.empty() );
+
+        // Copy the sampled points of each feature, in order.
+        for ( FeatureID feature = 0; feature < m_featureCount; ++feature )
+        {
+            auto        sourceValues   = source.getValues( feature );
+            auto        sourcePointIDs = source.getPointIDs( feature );
+            auto        values         = getMutableValues( feature );
+            auto        pointIDs       = getMutablePointIDs( feature );
+            std::size_t count          = 0;
+            for ( std::size_t i = 0; i < source.m_pointCount; ++i )
+            {
+                if ( multiplicities[sourcePointIDs[i]] == 0 ) continue;
+                values[count]   = sourceValues[i];
+                pointIDs[count] = sourcePointIDs[i];
+                ++count;
+            }
+            assert( count == m_pointCount );
+        }
+
+        // Only keep the multiplicities if some point occurs more than once.
+        if ( std::any_of( multiplicities.begin(), multiplicities.end(), []( PointMultiplicity m ) { return m > 1; } ) ) m_weights = multiplicities;
+    }
+
+    /**
+     * Returns the number of features per point.
+     */
+    unsigned int getFeatureCount() const
+    {
+        return m_featureCount;
+    }
+
+    /**
+     * Returns the number of (distinct) points in the index.
+     */
+    std::size_t getPointCount() const
+    {
+        return m_pointCount;
+    }
+
+    /**
+     * Returns the sorted values of a feature.
+     */
+    const FeatureType * getValues( FeatureID feature ) const
+    {
+        assert( feature < m_featureCount );
+        return getAllValues() + std::size_t( feature ) * m_pointCount;
+    }
+
+    /**
+     * Returns the IDs of the points, in the same order as the values returned by getValues().
+     */
+    const PointIDType * getPointIDs( FeatureID feature ) const
+    {
+        assert( feature < m_featureCount );
+        return getAllPointIDs() + std::size_t( feature ) * m_pointCount;
+    }
+
+    /**
+     * Returns the labels of all points, by point ID.
+     */
+    const Label * getLabels() const
+    {
+        return m_labels.data();
+    }
+
+    /**
+     * Returns the number of times each point occurs in the index, by point ID,
+     * or a null pointer if every point in the index occurs once.
+     */
+    const PointMultiplicity * getWeights() const
+    {
+        return m_weights.empty() ? nullptr : m_weights.data();
+    }
+
+    /**
+     * Returns true iff the point lists are mapped from an index file, and so
+     * cannot be rearranged.
+     */
+    bool isMapped() const
+    {
+        return m_indexFile != nullptr;
+    }
+
+    /**
+     * Rearrange a range of a feature's point list, such that all points for
+     * which the predicate is true come first. The relative order of the points
+     * in both parts is preserved, so both parts remain sorted.
+     * \param feature The feature whose point list will be rearranged.
+     * \param offset The position of the first point of the range.
+     * \param count The number of points in the range.
+     * \param goesLeft A predicate that is called with the ID of each point.
+     * \param buffer The buffer in which the other points are kept temporarily.
+     * \return The number of points for which the predicate is true.
+     * \pre The index is not mapped from an index file.
+     */
+    template <typename Predicate>
+    std::size_t stablePartition( FeatureID feature, std::size_t offset, std::size_t count, Predicate goesLeft, PartitionBuffer & buffer )
+    {
+        // Move the points that go left towards the start of the range, and the others to the buffer.
+        auto values   = getMutableValues( feature ) + offset;
+        auto pointIDs = getMutablePointIDs( feature ) + offset;
+        if ( buffer.m_values.size() < count )
+        {
+            buffer.m_values.resize( count );
+            buffer.m_pointIDs.resize( count );
+        }
+        std::size_t leftCount  = 0;
+        std::size_t rightCount = 0;
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            auto value   = values[i];
+            auto pointID = pointIDs[i];
+            if ( goesLeft( pointID ) )
+            {
+                values[leftCount]   = value;
+                pointIDs[leftCount] = pointID;
+                ++leftCount;
+            }
+            else
+            {
+                buffer.m_values[rightCount]   = value;
+                buffer.m_pointIDs[rightCount] = pointID;
+                ++rightCount;
+            }
+        }
+
+        // Append the other points.
+        std::copy( buffer.m_values.begin(), buffer.m_values.begin() + rightCount, values + leftCount );
+        std::copy( buffer.m_pointIDs.begin(), buffer.m_pointIDs.begin() + rightCount, pointIDs + leftCount );
+        return leftCount;
+    }
+
+private:
+
+    /**
+     * The number of points per block that is copied from the data set to the
+     * value lists, before the value lists are sorted.
+     */
+    static constexpr std::size_t TRANSPOSE_BLOCK_SIZE = 4096;
+
+    /**
+     * A list that is stored in a scratch file or on the heap.
+     */
+    template <typename T>
+    using ScratchVector = std::vector<T, ScratchAllocator<T>>;
+
+    /**
+     * An unsigned integer type that is as wide as the feature type.
+     */
+    typedef std::conditional_t<sizeof( FeatureType ) <= 4, uint32_t, uint64_t> SortKey;
+
+    /**
+     * Temporary storage for buildSingleFeatureIndex(), which is stored in a
+     * scratch file or on the heap, like the index itself. Threads that sort
+     * features concurrently each need their own buffer.
+     */
+    struct SortBuffer
+    {
+        SortBuffer( std::size_t pointCount, const ScratchAllocator<FeatureType> & allocator ):
+        m_values( pointCount, FeatureType(), allocator ),
+        m_pointIDs( pointCount, PointIDType(), ScratchAllocator<PointIDType>( allocator ) )
+        {
+        }
+
+        ScratchVector<FeatureType> m_values;
+        ScratchVector<PointIDType> m_pointIDs;
+    };
+
+    /**
+     * Sort the points by the value of one feature, and store the result. The
+     * values must be stored in the value list of the feature in point order.
+     * The point lists of the feature are one of the two buffers of the radix
+     * sort, and the sort buffer is the other.
+     * \return False iff the feature has values that are not a number.
+     */
+    bool buildSingleFeatureIndex( FeatureID feature, SortBuffer & sortBuffer )
+    {
+        // Number the points, and check the validity of the values on the fly.
+        auto values   = getMutableValues( feature );
+        auto pointIDs = getMutablePointIDs( feature );
+        bool foundNaN = false;
+        for ( PointIDType point = 0; point < m_pointCount; ++point )
+        {
+            if constexpr ( std::is_floating_point<FeatureType>::value )
+            {
+                // Store negative zero as positive zero, since both have the same sort key.
+                foundNaN |= std::isnan( values[point] );
+                if ( values[point] == 0 ) values[point] = 0;
+            }
+            pointIDs[point] = point;
+        }
+        if ( foundNaN ) return false;
+
+        // Sort the values and point IDs.
+        radixSort( values, pointIDs, sortBuffer.m_values.data(), sortBuffer.m_pointIDs.data(), m_pointCount );
+        return true;
+    }
+
+    /**
+     * Convert a feature value to an unsigned integer with the same ordering.
+     * Negative zero is mapped to the same key as positive zero.
+     */
+    static SortKey toSortKey( FeatureType value )
+    {
+        if constexpr ( std::is_floating_point<FeatureType>::value )
+        {
+            static_assert( sizeof( FeatureType ) == sizeof( SortKey ), "Unsupported floating point type." );
+            const SortKey signBit = SortKey( 1 ) << ( 8 * sizeof( SortKey ) - 1 );
+            if ( value == 0 ) value = 0;
+            SortKey bits;
+            std::memcpy( &bits, &value, sizeof( bits ) );
+            return ( bits & signBit ) ? ~bits : ( bits | signBit );
+        }
+        else
+        {
+            // Flip the sign bit of signed values, so negative values come first.
+            typedef std::make_unsigned_t<FeatureType> UnsignedType;
+            const UnsignedType signBit = std::is_signed<FeatureType>::value ? UnsignedType( UnsignedType( 1 ) << ( 8 * sizeof( FeatureType ) - 1 ) ) : UnsignedType( 0 );
+            return SortKey( UnsignedType( UnsignedType( value ) ^ signBit ) );
+        }
+    }
+
+    /**
+     * Sort a list of values and the associated point IDs by sort key (see
+     * toSortKey()) with a least significant digit radix sort, using 11-bit
+     * digits. The sort is stable. The buffers must have room for the same
+     * number of values and point IDs.
+     */
+    static void radixSort( FeatureType * values, PointIDType * pointIDs, FeatureType * bufferValues, PointIDType * bufferPointIDs, std::size_t count )
+    {
+        constexpr unsigned int DIGIT_BITS   = 11;
+        constexpr unsigned int DIGIT_VALUES = 1 << DIGIT_BITS;
+        constexpr unsigned int DIGIT_COUNT  = ( 8 * sizeof( SortKey ) + DIGIT_BITS - 1 ) / DIGIT_BITS;
+        constexpr SortKey      DIGIT_MASK   = DIGIT_VALUES - 1;
+
+        // Count the occurrences of all digit values at all digit positions in one pass.
+        std::vector<std::size_t> counts( DIGIT_COUNT * DIGIT_VALUES, 0 );
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            SortKey key = toSortKey( values[i] );
+            for ( unsigned int digit = 0; digit < DIGIT_COUNT; ++digit ) ++counts[digit * DIGIT_VALUES + ( ( key >> ( DIGIT_BITS * digit ) ) & DIGIT_MASK )];
+        }
+
+        // Distribute the points by each digit in turn, starting with the least significant one, alternating
+        // between the point lists and the buffers.
+        FeatureType *            sourceValues   = values;
+        PointIDType *            sourcePointIDs = pointIDs;
+        FeatureType *            targetValues   = bufferValues;
+        PointIDType *            targetPointIDs = bufferPointIDs;
+        std::vector<std::size_t> offsets( DIGIT_VALUES );
+        for ( unsigned int digit = 0; digit < DIGIT_COUNT; ++digit )
+        {
+            // Skip digits that have the same value for all keys.
+            auto digitCounts = counts.begin() + digit * DIGIT_VALUES;
+            if ( std::find( digitCounts, digitCounts + DIGIT_VALUES, count ) != digitCounts + DIGIT_VALUES ) continue;
+
+            // Determine where the points with each digit value go.
+            std::size_t offset = 0;
+            for ( unsigned int value = 0; value < DIGIT_VALUES; ++value )
+            {
+                offsets[value] = offset;
+                offset += digitCounts[value];
+            }
+
+            // Move the points.
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                auto destination            = offsets[( toSortKey( sourceValues[i] ) >> ( DIGIT_BITS * digit ) ) & DIGIT_MASK]++;
+                targetValues[destination]   = sourceValues[i];
+                targetPointIDs[destination] = sourcePointIDs[i];
+            }
+            std::swap( sourceValues, targetValues );
+            std::swap( sourcePointIDs, targetPointIDs );
+        }
+
+        // If the last pass left the sorted points in the buffers, copy them back.
+        if ( sourceValues != values )
+        {
+            std::copy( sourceValues, sourceValues + count, values );
+            std::copy( sourcePointIDs, sourcePointIDs + count, pointIDs );
+        }
+    }
+
+    /**
+     * Map the point lists from an index file, if the file exists and was
+     * written for the same key and index dimensions.
+     * \return True iff the point lists were mapped.
+     */
+    bool mapIndexFile( const std::string & filename, const std::string & key )
+    {
+        if ( !std::ifstream( filename ).good() ) return false;
+        BalsaFileParser parser( filename );
+        if ( !parser.atFeatureIndex() ) throw ParseError( "The file is not an index file: " + filename );
+        std::size_t        valuesOffset   = 0;
+        std::size_t        pointIDsOffset = 0;
+        FeatureIndexHeader header         = parser.skipFeatureIndex( valuesOffset, pointIDsOffset );
+        if ( header.key != key || header.featureTypeID != getFeatureTypeID<FeatureType>() || header.featureCount != m_featureCount || header.pointCount != m_pointCount || header.pointIDTypeID != getScalarTypeID<PointIDType>() ) return false;
+        m_indexFile.reset( new MappedFile( filename ) );
+        m_mappedValues   = reinterpret_cast<const FeatureType *>( m_indexFile->getData() + valuesOffset );
+        m_mappedPointIDs = reinterpret_cast<const PointIDType *>( m_indexFile->getData() + pointIDsOffset );
+        return true;
+    }
+
+    /**
+     * Write the point lists to an index file. The file is written under a
+     * temporary name first, and then renamed, so concurrent runs never map a
+     * partially written file.
+     */
+    void writeIndexFile( const std::string & filename, const std::string & key ) const
+    {
+        std::string temporaryFilename = filename + ".tmp" + std::to_string( std::random_device{}() );
+        {
+            BalsaFileWriter writer( temporaryFilename );
+            writer.writeFeatureIndex( key, m_featureCount, m_pointCount, getAllValues(), getAllPointIDs() );
+        }
+        if ( std::rename( temporaryFilename.c_str(), filename.c_str() ) != 0 )
+        {
+            std::remove( temporaryFilename.c_str() );
+            throw SupplierError( "Could not write index file: " + filename );
+        }
+    }
+
+    std::size_t getEntryCount() const
+    {
+        return std::size_t( m_featureCount ) * m_pointCount;
+    }
+
+    const FeatureType * getAllValues() const
+    {
+        return m_indexFile ? m_mappedValues : m_values.data();
+    }
+
+    const PointIDType * getAllPointIDs() const
+    {
+        return m_indexFile ? m_mappedPointIDs : m_pointIDs.data();
+    }
+
+    FeatureType * getMutableValues( FeatureID feature )
+    {
+        assert( !isMapped() );
+        return m_values.data() + std::size_t( feature ) * m_pointCount;
+    }
+
+    PointIDType * getMutablePointIDs( FeatureID feature )
+    {
+        assert( !isMapped() );
+        return m_pointIDs.data() + std::size_t( feature ) * m_pointCount;
+    }
+
+    unsigned int                      m_featureCount;
+    std::size_t                       m_pointCount;
+    ScratchVector<FeatureType>        m_values;
+    ScratchVector<PointIDType>        m_pointIDs;
+    std::vector<Label>                m_labels;
+    std::vector<PointMultiplicity>    m_weights;
+    std::shared_ptr<const MappedFile> m_indexFile;
+    const FeatureType *               m_mappedValues;
+    const PointIDType *               m_mappedPointIDs;
+};
+
+} // namespace balsa
+
+#endif // FEATUREINDEX_H
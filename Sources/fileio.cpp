@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <limits>
 #include <map>
 #include <variant>
 
@@ -9,43 +11,56 @@ namespace balsa
 {
 
 /**
- * Balsa file format version.
+ * Balsa file format version. Version 1.1 allows more than 255 features: the
+ * feature counts in ensemble and tree headers may be wider than 8 bits, and
+ * the split feature table of a tree may contain 16-bit feature IDs. Version
+ * 1.2 allows 2^32 or more points: the row counts of tables and the point
+ * counts of feature indices may be 64-bit integers, and so may the point IDs
+ * of feature indices. Files written by this version only use these where
+ * necessary, so other files remain readable by readers of version 1.0.
  */
 constexpr const unsigned char FILE_FORMAT_MAJOR_VERSION = 1;
-constexpr const unsigned char FILE_FORMAT_MINOR_VERSION = 0;
+constexpr const unsigned char FILE_FORMAT_MINOR_VERSION = 2;
 
 /**
  * Marker names.
  */
-const std::string FILE_SIGNATURE          = "blsa";
-const std::string BIG_ENDIAN_MARKER       = "bend";
-const std::string LITTLE_ENDIAN_MARKER    = "lend";
-const std::string ENSEMBLE_START_MARKER   = "ensl";
-const std::string ENSEMBLE_END_MARKER     = "lsne";
-const std::string TREE_START_MARKER       = "tree";
-const std::string TREE_END_MARKER         = "eert";
-const std::string TABLE_START_MARKER      = "tabl";
-const std::string TABLE_END_MARKER        = "lbat";
-const std::string DICTIONARY_START_MARKER = "dict";
-const std::string DICTIONARY_END_MARKER   = "tcid";
+const std::string FILE_SIGNATURE             = "blsa";
+const std::string BIG_ENDIAN_MARKER          = "bend";
+const std::string LITTLE_ENDIAN_MARKER       = "lend";
+const std::string ENSEMBLE_START_MARKER      = "ensl";
+const std::string ENSEMBLE_END_MARKER        = "lsne";
+const std::string TREE_START_MARKER          = "tree";
+const std::string TREE_END_MARKER            = "eert";
+const std::string TABLE_START_MARKER         = "tabl";
+const std::string TABLE_END_MARKER           = "lbat";
+const std::string FEATURE_INDEX_START_MARKER = "fidx";
+const std::string FEATURE_INDEX_END_MARKER   = "xdif";
+const std::string DICTIONARY_START_MARKER    = "dict";
+const std::string DICTIONARY_END_MARKER      = "tcid";
 
 /**
  * Dictionary key names.
  */
-const std::string FILE_HEADER_FILE_MAJOR_VERSION_KEY    = "file_major_version";
-const std::string FILE_HEADER_FILE_MINOR_VERSION_KEY    = "file_minor_version";
-const std::string FILE_HEADER_CREATOR_NAME_KEY          = "creator_name";
-const std::string FILE_HEADER_CREATOR_MINOR_VERSION_KEY = "creator_major_version";
-const std::string FILE_HEADER_CREATOR_MAJOR_VERSION_KEY = "creator_minor_version";
-const std::string FILE_HEADER_CREATOR_PATCH_VERSION_KEY = "creator_patch_version";
-const std::string ENSEMBLE_HEADER_CLASS_COUNT_KEY       = "class_count";
-const std::string ENSEMBLE_HEADER_FEATURE_COUNT_KEY     = "feature_count";
-const std::string TREE_HEADER_CLASS_COUNT_KEY           = ENSEMBLE_HEADER_CLASS_COUNT_KEY;
-const std::string TREE_HEADER_FEATURE_COUNT_KEY         = ENSEMBLE_HEADER_FEATURE_COUNT_KEY;
-const std::string TREE_HEADER_FEATURE_TYPE_ID_KEY       = "feature_type_id";
-const std::string TABLE_HEADER_ROW_COUNT_KEY            = "row_count";
-const std::string TABLE_HEADER_COLUMN_COUNT_KEY         = "column_count";
-const std::string TABLE_HEADER_SCALAR_TYPE_ID_KEY       = "scalar_type_id";
+const std::string FILE_HEADER_FILE_MAJOR_VERSION_KEY        = "file_major_version";
+const std::string FILE_HEADER_FILE_MINOR_VERSION_KEY        = "file_minor_version";
+const std::string FILE_HEADER_CREATOR_NAME_KEY              = "creator_name";
+const std::string FILE_HEADER_CREATOR_MINOR_VERSION_KEY     = "creator_major_version";
+const std::string FILE_HEADER_CREATOR_MAJOR_VERSION_KEY     = "creator_minor_version";
+const std::string FILE_HEADER_CREATOR_PATCH_VERSION_KEY     = "creator_patch_version";
+const std::string ENSEMBLE_HEADER_CLASS_COUNT_KEY           = "class_count";
+const std::string ENSEMBLE_HEADER_FEATURE_COUNT_KEY         = "feature_count";
+const std::string TREE_HEADER_CLASS_COUNT_KEY               = ENSEMBLE_HEADER_CLASS_COUNT_KEY;
+const std::string TREE_HEADER_FEATURE_COUNT_KEY             = ENSEMBLE_HEADER_FEATURE_COUNT_KEY;
+const std::string TREE_HEADER_FEATURE_TYPE_ID_KEY           = "feature_type_id";
+const std::string TABLE_HEADER_ROW_COUNT_KEY                = "row_count";
+const std::string TABLE_HEADER_COLUMN_COUNT_KEY             = "column_count";
+const std::string TABLE_HEADER_SCALAR_TYPE_ID_KEY           = "scalar_type_id";
+const std::string FEATURE_INDEX_HEADER_KEY_KEY              = "key";
+const std::string FEATURE_INDEX_HEADER_FEATURE_COUNT_KEY    = ENSEMBLE_HEADER_FEATURE_COUNT_KEY;
+const std::string FEATURE_INDEX_HEADER_POINT_COUNT_KEY      = "point_count";
+const std::string FEATURE_INDEX_HEADER_FEATURE_TYPE_ID_KEY  = TREE_HEADER_FEATURE_TYPE_ID_KEY;
+const std::string FEATURE_INDEX_HEADER_POINT_ID_TYPE_ID_KEY = "point_id_type_id";
 
 /**
  * An enumeration of recognized platform endianness.
@@ -85,6 +100,12 @@ std::string getTypeName<uint32_t>()
     return "ui32";
 }
 
+template <>
+std::string getTypeName<uint64_t>()
+{
+    return "ui64";
+}
+
 template <>
 std::string getTypeName<int8_t>()
 {
@@ -140,6 +161,8 @@ std::string getTypeName( ScalarTypeID scalarTypeID )
             return getTypeName<uint16_t>();
         case ScalarTypeID::UINT32:
             return getTypeName<uint32_t>();
+        case ScalarTypeID::UINT64:
+            return getTypeName<uint64_t>();
         case ScalarTypeID::INT8:
             return getTypeName<int8_t>();
         case ScalarTypeID::INT16:
@@ -157,6 +180,34 @@ std::string getTypeName( ScalarTypeID scalarTypeID )
     }
 }
 
+/**
+ * Returns the size in bytes of an element of the specified scalar type, as
+ * stored in a file.
+ */
+std::size_t getScalarSize( ScalarTypeID scalarTypeID )
+{
+    switch ( scalarTypeID )
+    {
+        case ScalarTypeID::UINT8:
+        case ScalarTypeID::INT8:
+        case ScalarTypeID::BOOL:
+            return 1;
+        case ScalarTypeID::UINT16:
+        case ScalarTypeID::INT16:
+            return 2;
+        case ScalarTypeID::UINT32:
+        case ScalarTypeID::INT32:
+        case ScalarTypeID::FLOAT:
+            return 4;
+        case ScalarTypeID::UINT64:
+        case ScalarTypeID::DOUBLE:
+            return 8;
+        default:
+            assert( false );
+            return 0;
+    }
+}
+
 /**
  * Returns the scalar type identifier that corresponds to the specified type
  * name.
@@ -166,6 +217,7 @@ ScalarTypeID getScalarTypeID( const std::string & typeName )
     if ( typeName == getTypeName<uint8_t>() ) return ScalarTypeID::UINT8;
     if ( typeName == getTypeName<uint16_t>() ) return ScalarTypeID::UINT16;
     if ( typeName == getTypeName<uint32_t>() ) return ScalarTypeID::UINT32;
+    if ( typeName == getTypeName<uint64_t>() ) return ScalarTypeID::UINT64;
     if ( typeName == getTypeName<int8_t>() ) return ScalarTypeID::INT8;
     if ( typeName == getTypeName<int16_t>() ) return ScalarTypeID::INT16;
     if ( typeName == getTypeName<int32_t>() ) return ScalarTypeID::INT32;
@@ -186,8 +238,34 @@ std::string getTypeName( FeatureTypeID featureTypeID )
             return getTypeName<float>();
         case FeatureTypeID::DOUBLE:
             return getTypeName<double>();
+        case FeatureTypeID::UINT8:
+            return getTypeName<uint8_t>();
+        case FeatureTypeID::UINT16:
+            return getTypeName<uint16_t>();
+        case FeatureTypeID::INT16:
+            return getTypeName<int16_t>();
+        default:
+            assert( false );
+    }
+}
+
+std::string getFeatureTypeName( FeatureTypeID featureTypeID )
+{
+    switch ( featureTypeID )
+    {
+        case FeatureTypeID::FLOAT:
+            return "float";
+        case FeatureTypeID::DOUBLE:
+            return "double";
+        case FeatureTypeID::UINT8:
+            return "uint8";
+        case FeatureTypeID::UINT16:
+            return "uint16";
+        case FeatureTypeID::INT16:
+            return "int16";
         default:
             assert( false );
+            return "";
     }
 }
 
@@ -199,6 +277,9 @@ FeatureTypeID getFeatureTypeID( const std::string & typeName )
 {
     if ( typeName == getTypeName<float>() ) return FeatureTypeID::FLOAT;
     if ( typeName == getTypeName<double>() ) return FeatureTypeID::DOUBLE;
+    if ( typeName == getTypeName<uint8_t>() ) return FeatureTypeID::UINT8;
+    if ( typeName == getTypeName<uint16_t>() ) return FeatureTypeID::UINT16;
+    if ( typeName == getTypeName<int16_t>() ) return FeatureTypeID::INT16;
     throw ParseError( "Unknown feature type: '" + typeName + "'." );
 }
 
@@ -230,8 +311,8 @@ std::string deserializeString( std::istream & stream )
  */
 class Dictionary
 {
-    typedef std::string                                                                                           KeyType;
-    typedef std::variant<uint8_t, uint16_t, uint32_t, int8_t, int16_t, int32_t, float, double, bool, std::string> ValueType;
+    typedef std::string                                                                                                     KeyType;
+    typedef std::variant<uint8_t, uint16_t, uint32_t, uint64_t, int8_t, int16_t, int32_t, float, double, bool, std::string> ValueType;
 
 public:
 
@@ -267,6 +348,39 @@ public:
         return std::get<T>( m_dictionary.at( key ) );
     }
 
+    /**
+     * Enters an unsigned count into the dictionary, as an integer of type T,
+     * or of the smallest wider unsigned integer type that can hold it. Counts
+     * that fit in T are therefore stored as in version 1.0 of the file format.
+     */
+    template <typename T>
+    void setCount( const std::string & key, uint64_t count )
+    {
+        static_assert( std::is_unsigned<T>::value, "Counts are stored as unsigned integers." );
+        if ( sizeof( T ) <= 1 && count <= std::numeric_limits<uint8_t>::max() )
+            set<uint8_t>( key, count );
+        else if ( sizeof( T ) <= 2 && count <= std::numeric_limits<uint16_t>::max() )
+            set<uint16_t>( key, count );
+        else if ( sizeof( T ) <= 4 && count <= std::numeric_limits<uint32_t>::max() )
+            set<uint32_t>( key, count );
+        else
+            set<uint64_t>( key, count );
+    }
+
+    /**
+     * Retrieves a count that was entered using setCount(), of any unsigned
+     * integer type.
+     */
+    uint64_t getCount( const std::string & key ) const
+    {
+        auto & value = m_dictionary.at( key );
+        if ( std::holds_alternative<uint8_t>( value ) ) return std::get<uint8_t>( value );
+        if ( std::holds_alternative<uint16_t>( value ) ) return std::get<uint16_t>( value );
+        if ( std::holds_alternative<uint32_t>( value ) ) return std::get<uint32_t>( value );
+        if ( std::holds_alternative<uint64_t>( value ) ) return std::get<uint64_t>( value );
+        throw ParseError( "Invalid type of count '" + key + "'." );
+    }
+
     /**
      * Returns the value associated with the specified key, or an empty value
      * if the dictionary does not contain the specified key.
@@ -320,6 +434,8 @@ public:
                 value = balsa::deserialize<uint16_t>( stream );
             else if ( typeName == getTypeName<uint32_t>() )
                 value = balsa::deserialize<uint32_t>( stream );
+            else if ( typeName == getTypeName<uint64_t>() )
+                value = balsa::deserialize<uint64_t>( stream );
             else if ( typeName == getTypeName<int8_t>() )
                 value = balsa::deserialize<int8_t>( stream );
             else if ( typeName == getTypeName<int16_t>() )
@@ -369,6 +485,38 @@ private:
     std::map<KeyType, ValueType> m_dictionary;
 };
 
+/**
+ * Returns the offset of the first aligned array of a feature index at or after
+ * the specified offset (see FEATURE_INDEX_ALIGNMENT).
+ */
+std::size_t alignFeatureIndexOffset( std::size_t offset )
+{
+    return ( offset + FEATURE_INDEX_ALIGNMENT - 1 ) / FEATURE_INDEX_ALIGNMENT * FEATURE_INDEX_ALIGNMENT;
+}
+
+/**
+ * Returns the size in bytes of a feature value of the specified type.
+ */
+std::size_t getFeatureSize( FeatureTypeID featureTypeID )
+{
+    switch ( featureTypeID )
+    {
+        case FeatureTypeID::UINT8:
+            return sizeof( uint8_t );
+        case FeatureTypeID::UINT16:
+            return sizeof( uint16_t );
+        case FeatureTypeID::INT16:
+            return sizeof( int16_t );
+        case FeatureTypeID::FLOAT:
+            return sizeof( float );
+        case FeatureTypeID::DOUBLE:
+            return sizeof( double );
+        default:
+            assert( false );
+            return 0;
+    }
+}
+
 /**
  * Determines the platform endianness.
  */
@@ -414,9 +562,9 @@ BalsaFileParser::BalsaFileParser( const std::string & filename )
         throw SupplierError( "File format major version number mismatch." );
     }
 
-    if ( fileMinorVersion < FILE_FORMAT_MINOR_VERSION )
+    if ( fileMinorVersion > FILE_FORMAT_MINOR_VERSION )
     {
-        throw SupplierError( "File format minor version number mismatch." );
+        throw SupplierError( "File format minor version number mismatch: the file requires a newer version of Balsa." );
     }
 
     m_fileMajorVersion = fileMajorVersion;
@@ -494,6 +642,11 @@ bool BalsaFileParser::atTreeOfType( FeatureTypeID typeID )
     return result;
 }
 
+bool BalsaFileParser::atFeatureIndex()
+{
+    return ( peekFixedSizeToken( m_stream, FEATURE_INDEX_START_MARKER.size() ) == FEATURE_INDEX_START_MARKER );
+}
+
 bool BalsaFileParser::atEnsemble()
 {
     return ( peekFixedSizeToken( m_stream, ENSEMBLE_START_MARKER.size() ) == ENSEMBLE_START_MARKER );
@@ -528,6 +681,52 @@ void BalsaFileParser::reenterEnsemble()
     m_stream.seekg( m_treeOffset );
 }
 
+TableHeader BalsaFileParser::skipTable( std::size_t & dataOffset )
+{
+    // Parse the table start marker and header.
+    parseTableStartMarker();
+    TableHeader header = parseTableHeader();
+
+    // Skip the data, and parse the table end marker.
+    dataOffset = m_stream.tellg();
+    m_stream.seekg( dataOffset + header.rowCount * header.columnCount * getScalarSize( header.scalarTypeID ) );
+    parseTableEndMarker();
+    return header;
+}
+
+TreeHeader BalsaFileParser::skipClassifier()
+{
+    // Parse the tree start marker and header.
+    parseTreeStartMarker();
+    TreeHeader header = parseTreeHeader();
+
+    // Skip the internal tables of the tree (see parseClassifier()), and parse the tree end marker.
+    std::size_t dataOffset = 0;
+    for ( unsigned int i = 0; i < 5; ++i ) skipTable( dataOffset );
+    parseTreeEndMarker();
+    return header;
+}
+
+FeatureIndexHeader BalsaFileParser::skipFeatureIndex( std::size_t & valuesOffset, std::size_t & pointIDsOffset )
+{
+    // Parse the feature index start marker and header.
+    parseFeatureIndexStartMarker();
+    FeatureIndexHeader header = parseFeatureIndexHeader();
+
+    // Skip the aligned arrays, and parse the feature index end marker.
+    const std::size_t entryCount = std::size_t( header.featureCount ) * header.pointCount;
+    valuesOffset                 = alignFeatureIndexOffset( m_stream.tellg() );
+    pointIDsOffset               = alignFeatureIndexOffset( valuesOffset + entryCount * getFeatureSize( header.featureTypeID ) );
+    m_stream.seekg( pointIDsOffset + entryCount * getScalarSize( header.pointIDTypeID ) );
+    parseFeatureIndexEndMarker();
+    return header;
+}
+
+std::size_t BalsaFileParser::getOffset()
+{
+    return m_stream.tellg();
+}
+
 Classifier::SharedPointer BalsaFileParser::parseClassifier()
 {
     // Parse the tree start marker.
@@ -541,35 +740,20 @@ Classifier::SharedPointer BalsaFileParser::parseClassifier()
     switch ( header.featureTypeID )
     {
         case FeatureTypeID::FLOAT:
-        {
-            // Create an empty classifier.
-            DecisionTreeClassifier<float>::SharedPointer classifier( new DecisionTreeClassifier<float>( header.classCount, header.featureCount ) );
-
-            // Move assign the internal tables.
-            classifier->m_leftChildID    = parseTable<NodeID>();
-            classifier->m_rightChildID   = parseTable<NodeID>();
-            classifier->m_splitFeatureID = parseTable<FeatureID>();
-            classifier->m_splitValue     = parseTable<float>();
-            classifier->m_label          = parseTable<Label>();
-
-            result = classifier;
-        }
-        break;
+            result = parseDecisionTree<float>( header );
+            break;
         case FeatureTypeID::DOUBLE:
-        {
-            // Create an empty classifier.
-            DecisionTreeClassifier<double>::SharedPointer classifier( new DecisionTreeClassifier<double>( header.classCount, header.featureCount ) );
-
-            // Move assign the internal tables.
-            classifier->m_leftChildID    = parseTable<NodeID>();
-            classifier->m_rightChildID   = parseTable<NodeID>();
-            classifier->m_splitFeatureID = parseTable<FeatureID>();
-            classifier->m_splitValue     = parseTable<double>();
-            classifier->m_label          = parseTable<Label>();
-
-            result = classifier;
-        }
-        break;
+            result = parseDecisionTree<double>( header );
+            break;
+        case FeatureTypeID::UINT8:
+            result = parseDecisionTree<uint8_t>( header );
+            break;
+        case FeatureTypeID::UINT16:
+            result = parseDecisionTree<uint16_t>( header );
+            break;
+        case FeatureTypeID::INT16:
+            result = parseDecisionTree<int16_t>( header );
+            break;
         default:
             assert( false );
     }
@@ -581,6 +765,76 @@ Classifier::SharedPointer BalsaFileParser::parseClassifier()
     return result;
 }
 
+template <typename FeatureType>
+Classifier::SharedPointer BalsaFileParser::parseDecisionTree( const TreeHeader & header )
+{
+    // Create an empty classifier.
+    typename DecisionTreeClassifier<FeatureType>::SharedPointer classifier( new DecisionTreeClassifier<FeatureType>( header.classCount, header.featureCount ) );
+
+    // Parse the child node tables.
+    auto leftChildIDs  = parseTable<NodeID>();
+    auto rightChildIDs = parseTable<NodeID>();
+    auto nodeCount     = leftChildIDs.getRowCount();
+    if ( nodeCount == 0 || nodeCount > std::numeric_limits<NodeID>::max() ) throw ParseError( "Invalid decision tree: bad node count." );
+    if ( rightChildIDs.getRowCount() != nodeCount ) throw ParseError( "Invalid decision tree: node tables of different sizes." );
+
+    // The classifier stores the right child of each interior node directly after its left child, after the node itself.
+    // Trees written by Balsa are already laid out that way, so their nodes can be copied as they are.
+    bool renumber = false;
+    for ( NodeID nodeID = 0; nodeID < nodeCount && !renumber; ++nodeID )
+    {
+        NodeID leftChildID = leftChildIDs( nodeID, 0 );
+        renumber           = leftChildID && ( leftChildID <= nodeID || leftChildID >= nodeCount - 1 || rightChildIDs( nodeID, 0 ) != leftChildID + 1 );
+    }
+
+    // Otherwise, renumber the reachable nodes in breadth-first order, which puts the children of each node next to each other.
+    std::vector<NodeID> order;
+    if ( renumber )
+    {
+        order.push_back( 0 );
+        for ( std::size_t position = 0; position < order.size(); ++position )
+        {
+            NodeID nodeID = order[position];
+            if ( leftChildIDs( nodeID, 0 ) == 0 ) continue;
+            if ( order.size() + 2 > nodeCount ) throw ParseError( "Invalid decision tree: nodes are shared or cyclic." );
+            for ( NodeID childID : { leftChildIDs( nodeID, 0 ), rightChildIDs( nodeID, 0 ) } )
+            {
+                if ( childID == 0 || childID >= nodeCount ) throw ParseError( "Invalid decision tree: bad child node ID." );
+                order.push_back( childID );
+            }
+        }
+    }
+    rightChildIDs = Table<NodeID>();
+
+    // Fill in the packed nodes one attribute at a time, so that at most one more node table is in memory at once.
+    auto & nodes    = classifier->m_nodes;
+    auto   sourceID = [&order, renumber]( std::size_t position ) { return renumber ? order[position] : position; };
+    auto   unpack   = [&nodes, &sourceID, nodeCount]( const auto & table, auto member )
+    {
+        if ( table.getRowCount() != nodeCount ) throw ParseError( "Invalid decision tree: node tables of different sizes." );
+        for ( std::size_t position = 0; position < nodes.size(); ++position ) nodes[position].*member = table( sourceID( position ), 0 );
+    };
+    typedef typename DecisionTreeClassifier<FeatureType>::Node Node;
+    nodes.resize( renumber ? order.size() : nodeCount );
+    unpack( leftChildIDs, &Node::m_leftChildID );
+    leftChildIDs = Table<NodeID>();
+    if ( renumber )
+    {
+        // Number the children of each interior node in the order in which they were enqueued.
+        NodeID nextChildID = 1;
+        for ( auto & node : nodes )
+        {
+            if ( node.m_leftChildID == 0 ) continue;
+            node.m_leftChildID = nextChildID;
+            nextChildID += 2;
+        }
+    }
+    unpack( parseTableAs<FeatureID>(), &Node::m_splitFeatureID );
+    unpack( parseTable<FeatureType>(), &Node::m_splitValue );
+    unpack( parseTable<Label>(), &Node::m_label );
+    return classifier;
+}
+
 void BalsaFileParser::parseFileSignature()
 {
     expect( m_stream, FILE_SIGNATURE, "Invalid file signature." );
@@ -606,12 +860,22 @@ void BalsaFileParser::parseTableEndMarker()
     expect( m_stream, TABLE_END_MARKER, "Invalid table end marker." );
 }
 
+void BalsaFileParser::parseFeatureIndexStartMarker()
+{
+    expect( m_stream, FEATURE_INDEX_START_MARKER, "Invalid feature index start marker." );
+}
+
+void BalsaFileParser::parseFeatureIndexEndMarker()
+{
+    expect( m_stream, FEATURE_INDEX_END_MARKER, "Invalid feature index end marker." );
+}
+
 EnsembleHeader BalsaFileParser::parseEnsembleHeader()
 {
     EnsembleHeader result;
     Dictionary     dictionary = Dictionary::deserialize( m_stream );
     result.classCount         = dictionary.get<uint8_t>( ENSEMBLE_HEADER_CLASS_COUNT_KEY );
-    result.featureCount       = dictionary.get<uint8_t>( ENSEMBLE_HEADER_FEATURE_COUNT_KEY );
+    result.featureCount       = dictionary.getCount( ENSEMBLE_HEADER_FEATURE_COUNT_KEY );
     return result;
 }
 
@@ -620,7 +884,7 @@ TreeHeader BalsaFileParser::parseTreeHeader()
     TreeHeader result;
     Dictionary dictionary = Dictionary::deserialize( m_stream );
     result.classCount     = dictionary.get<uint8_t>( TREE_HEADER_CLASS_COUNT_KEY );
-    result.featureCount   = dictionary.get<uint8_t>( TREE_HEADER_FEATURE_COUNT_KEY );
+    result.featureCount   = dictionary.getCount( TREE_HEADER_FEATURE_COUNT_KEY );
     result.featureTypeID  = getFeatureTypeID( dictionary.get<std::string>( TREE_HEADER_FEATURE_TYPE_ID_KEY ) );
     return result;
 }
@@ -629,14 +893,27 @@ TableHeader BalsaFileParser::parseTableHeader()
 {
     TableHeader result;
     Dictionary  dictionary = Dictionary::deserialize( m_stream );
-    result.rowCount        = dictionary.get<uint32_t>( TABLE_HEADER_ROW_COUNT_KEY );
+    result.rowCount        = dictionary.getCount( TABLE_HEADER_ROW_COUNT_KEY );
     result.columnCount     = dictionary.get<uint32_t>( TABLE_HEADER_COLUMN_COUNT_KEY );
     result.scalarTypeID    = getScalarTypeID( dictionary.get<std::string>( TABLE_HEADER_SCALAR_TYPE_ID_KEY ) );
     return result;
 }
 
+FeatureIndexHeader BalsaFileParser::parseFeatureIndexHeader()
+{
+    FeatureIndexHeader result;
+    Dictionary         dictionary = Dictionary::deserialize( m_stream );
+    result.key                    = dictionary.get<std::string>( FEATURE_INDEX_HEADER_KEY_KEY );
+    result.featureCount           = dictionary.get<uint32_t>( FEATURE_INDEX_HEADER_FEATURE_COUNT_KEY );
+    result.pointCount             = dictionary.getCount( FEATURE_INDEX_HEADER_POINT_COUNT_KEY );
+    result.featureTypeID          = getFeatureTypeID( dictionary.get<std::string>( FEATURE_INDEX_HEADER_FEATURE_TYPE_ID_KEY ) );
+    result.pointIDTypeID          = getScalarTypeID( dictionary.find<std::string>( FEATURE_INDEX_HEADER_POINT_ID_TYPE_ID_KEY ).value_or( getTypeName<uint32_t>() ) );
+    return result;
+}
+
 BalsaFileWriter::BalsaFileWriter( const std::string & filename, std::optional<std::string> creatorName, std::optional<unsigned char> creatorMajorVersion, std::optional<unsigned char> creatorMinorVersion, std::optional<unsigned char> creatorPatchVersion ):
-m_insideEnsemble( false )
+m_insideEnsemble( false ),
+m_appendingToEnsemble( false )
 {
     // Configure the file input stream to throw an exception on error.
     m_stream.exceptions( std::ofstream::failbit | std::ofstream::badbit );
@@ -657,7 +934,19 @@ m_insideEnsemble( false )
     dictionary.serialize( m_stream );
 }
 
-void BalsaFileWriter::enterEnsemble( unsigned char classCount, unsigned char featureCount )
+BalsaFileWriter::BalsaFileWriter( const std::string & filename, std::size_t ensembleEndOffset ):
+m_insideEnsemble( true ),
+m_appendingToEnsemble( true )
+{
+    // Configure the file output stream to throw an exception on error.
+    m_stream.exceptions( std::ofstream::failbit | std::ofstream::badbit );
+
+    // Open the existing file without truncating it, and position the stream at the ensemble end marker.
+    m_stream.open( filename, std::ios::binary | std::ios::in | std::ios::out );
+    m_stream.seekp( ensembleEndOffset );
+}
+
+void BalsaFileWriter::enterEnsemble( unsigned char classCount, unsigned int featureCount )
 {
     assert( !m_insideEnsemble );
     m_stream.write( ENSEMBLE_START_MARKER.data(), ENSEMBLE_START_MARKER.size() );
@@ -668,14 +957,34 @@ void BalsaFileWriter::enterEnsemble( unsigned char classCount, unsigned char fea
 void BalsaFileWriter::leaveEnsemble()
 {
     assert( m_insideEnsemble );
-    m_stream.write( ENSEMBLE_END_MARKER.data(), ENSEMBLE_END_MARKER.size() );
-    m_insideEnsemble = false;
+
+    // When appending, the end marker has already been written after the last submodel.
+    if ( m_appendingToEnsemble ) m_stream.seekp( ENSEMBLE_END_MARKER.size(), std::ios::cur );
+    else m_stream.write( ENSEMBLE_END_MARKER.data(), ENSEMBLE_END_MARKER.size() );
+    m_insideEnsemble      = false;
+    m_appendingToEnsemble = false;
 }
 
 void BalsaFileWriter::writeClassifier( const Classifier & classifier )
 {
     ClassifierWriteDispatcher writer( *this );
     classifier.visit( writer );
+
+    // When appending, end the ensemble after every submodel, so an interrupted run leaves a valid file.
+    if ( m_appendingToEnsemble )
+    {
+        const auto endOffset = m_stream.tellp();
+        m_stream.write( ENSEMBLE_END_MARKER.data(), ENSEMBLE_END_MARKER.size() );
+        m_stream.flush();
+        m_stream.seekp( endOffset );
+    }
+}
+
+void BalsaFileWriter::ClassifierWriteDispatcher::visit( const CompiledClassifier & classifier )
+{
+    // The trees of a compiled classifier only exist as machine code.
+    (void) classifier;
+    throw ClientError( "Compiled classifiers can not be written to a model file." );
 }
 
 void BalsaFileWriter::ClassifierWriteDispatcher::visit( const EnsembleClassifier & classifier )
@@ -687,54 +996,108 @@ void BalsaFileWriter::ClassifierWriteDispatcher::visit( const EnsembleClassifier
 
 void BalsaFileWriter::ClassifierWriteDispatcher::visit( const DecisionTreeClassifier<float> & classifier )
 {
-    m_writer.writeTreeStartMarker();
-    m_writer.writeTreeHeader( classifier.m_classCount, classifier.m_featureCount, getFeatureTypeID<float>() );
-    m_writer.writeTable( classifier.m_leftChildID );
-    m_writer.writeTable( classifier.m_rightChildID );
-    m_writer.writeTable( classifier.m_splitFeatureID );
-    m_writer.writeTable( classifier.m_splitValue );
-    m_writer.writeTable( classifier.m_label );
-    m_writer.writeTreeEndMarker();
+    writeDecisionTree( classifier );
 }
 
 void BalsaFileWriter::ClassifierWriteDispatcher::visit( const DecisionTreeClassifier<double> & classifier )
+{
+    writeDecisionTree( classifier );
+}
+
+void BalsaFileWriter::ClassifierWriteDispatcher::visit( const DecisionTreeClassifier<uint8_t> & classifier )
+{
+    writeDecisionTree( classifier );
+}
+
+void BalsaFileWriter::ClassifierWriteDispatcher::visit( const DecisionTreeClassifier<uint16_t> & classifier )
+{
+    writeDecisionTree( classifier );
+}
+
+void BalsaFileWriter::ClassifierWriteDispatcher::visit( const DecisionTreeClassifier<int16_t> & classifier )
+{
+    writeDecisionTree( classifier );
+}
+
+template <typename FeatureType>
+void BalsaFileWriter::ClassifierWriteDispatcher::writeDecisionTree( const DecisionTreeClassifier<FeatureType> & classifier )
 {
     m_writer.writeTreeStartMarker();
-    m_writer.writeTreeHeader( classifier.m_classCount, classifier.m_featureCount, getFeatureTypeID<double>() );
-    m_writer.writeTable( classifier.m_leftChildID );
-    m_writer.writeTable( classifier.m_rightChildID );
-    m_writer.writeTable( classifier.m_splitFeatureID );
-    m_writer.writeTable( classifier.m_splitValue );
-    m_writer.writeTable( classifier.m_label );
+    m_writer.writeTreeHeader( classifier.m_classCount, classifier.m_featureCount, getFeatureTypeID<FeatureType>() );
+
+    // Write the attributes of the packed nodes as separate tables, one table at a time.
+    const auto & nodes     = classifier.m_nodes;
+    std::size_t  nodeCount = nodes.size();
+    {
+        Table<NodeID> leftChildIDs( nodeCount, 1 );
+        std::transform( nodes.begin(), nodes.end(), leftChildIDs.begin(), []( const auto & node ) { return node.m_leftChildID; } );
+        m_writer.writeTable( leftChildIDs );
+        std::transform( nodes.begin(), nodes.end(), leftChildIDs.begin(), []( const auto & node ) { return node.m_leftChildID ? node.m_leftChildID + 1 : 0; } );
+        m_writer.writeTable( leftChildIDs );
+    }
+    if ( classifier.m_featureCount <= std::numeric_limits<uint8_t>::max() + 1u )
+    {
+        // Store the split features as 8-bit IDs if they fit, as in version 1.0 of the file format.
+        Table<uint8_t> splitFeatureIDs( nodeCount, 1 );
+        std::transform( nodes.begin(), nodes.end(), splitFeatureIDs.begin(), []( const auto & node ) { return static_cast<uint8_t>( node.m_splitFeatureID ); } );
+        m_writer.writeTable( splitFeatureIDs );
+    }
+    else
+    {
+        Table<FeatureID> splitFeatureIDs( nodeCount, 1 );
+        std::transform( nodes.begin(), nodes.end(), splitFeatureIDs.begin(), []( const auto & node ) { return node.m_splitFeatureID; } );
+        m_writer.writeTable( splitFeatureIDs );
+    }
+    {
+        Table<FeatureType> splitValues( nodeCount, 1 );
+        std::transform( nodes.begin(), nodes.end(), splitValues.begin(), []( const auto & node ) { return node.m_splitValue; } );
+        m_writer.writeTable( splitValues );
+    }
+    {
+        Table<Label> labels( nodeCount, 1 );
+        std::transform( nodes.begin(), nodes.end(), labels.begin(), []( const auto & node ) { return node.m_label; } );
+        m_writer.writeTable( labels );
+    }
     m_writer.writeTreeEndMarker();
 }
 
-void BalsaFileWriter::writeEnsembleHeader( unsigned char classCount, unsigned char featureCount )
+void BalsaFileWriter::writeEnsembleHeader( unsigned char classCount, unsigned int featureCount )
 {
     Dictionary header;
     header.set<uint8_t>( ENSEMBLE_HEADER_CLASS_COUNT_KEY, classCount );
-    header.set<uint8_t>( ENSEMBLE_HEADER_FEATURE_COUNT_KEY, featureCount );
+    header.setCount<uint8_t>( ENSEMBLE_HEADER_FEATURE_COUNT_KEY, featureCount );
     header.serialize( m_stream );
 }
 
-void BalsaFileWriter::writeTreeHeader( unsigned char classCount, unsigned char featureCount, FeatureTypeID featureType )
+void BalsaFileWriter::writeTreeHeader( unsigned char classCount, unsigned int featureCount, FeatureTypeID featureType )
 {
     Dictionary header;
     header.set<uint8_t>( TREE_HEADER_CLASS_COUNT_KEY, classCount );
-    header.set<uint8_t>( TREE_HEADER_FEATURE_COUNT_KEY, featureCount );
+    header.setCount<uint8_t>( TREE_HEADER_FEATURE_COUNT_KEY, featureCount );
     header.set<std::string>( TREE_HEADER_FEATURE_TYPE_ID_KEY, getTypeName( featureType ) );
     header.serialize( m_stream );
 }
 
-void BalsaFileWriter::writeTableHeader( unsigned int rowCount, unsigned int columnCount, ScalarTypeID scalarType )
+void BalsaFileWriter::writeTableHeader( std::size_t rowCount, unsigned int columnCount, ScalarTypeID scalarType )
 {
     Dictionary header;
-    header.set<uint32_t>( TABLE_HEADER_ROW_COUNT_KEY, rowCount );
+    header.setCount<uint32_t>( TABLE_HEADER_ROW_COUNT_KEY, rowCount );
     header.set<uint32_t>( TABLE_HEADER_COLUMN_COUNT_KEY, columnCount );
     header.set<std::string>( TABLE_HEADER_SCALAR_TYPE_ID_KEY, getTypeName( scalarType ) );
     header.serialize( m_stream );
 }
 
+void BalsaFileWriter::writeFeatureIndexHeader( const std::string & key, unsigned int featureCount, std::size_t pointCount, FeatureTypeID featureType, ScalarTypeID pointIDType )
+{
+    Dictionary header;
+    header.set<std::string>( FEATURE_INDEX_HEADER_KEY_KEY, key );
+    header.set<uint32_t>( FEATURE_INDEX_HEADER_FEATURE_COUNT_KEY, featureCount );
+    header.setCount<uint32_t>( FEATURE_INDEX_HEADER_POINT_COUNT_KEY, pointCount );
+    header.set<std::string>( FEATURE_INDEX_HEADER_FEATURE_TYPE_ID_KEY, getTypeName( featureType ) );
+    if ( pointIDType != ScalarTypeID::UINT32 ) header.set<std::string>( FEATURE_INDEX_HEADER_POINT_ID_TYPE_ID_KEY, getTypeName( pointIDType ) );
+    header.serialize( m_stream );
+}
+
 void BalsaFileWriter::writeFileSignature()
 {
     m_stream.write( FILE_SIGNATURE.data(), FILE_SIGNATURE.size() );
@@ -767,6 +1130,25 @@ void BalsaFileWriter::writeTableEndMarker()
     m_stream.write( TABLE_END_MARKER.data(), TABLE_END_MARKER.size() );
 }
 
+void BalsaFileWriter::writeFeatureIndexStartMarker()
+{
+    m_stream.write( FEATURE_INDEX_START_MARKER.data(), FEATURE_INDEX_START_MARKER.size() );
+}
+
+void BalsaFileWriter::writeFeatureIndexEndMarker()
+{
+    m_stream.write( FEATURE_INDEX_END_MARKER.data(), FEATURE_INDEX_END_MARKER.size() );
+}
+
+void BalsaFileWriter::writeAlignedData( const void * data, std::size_t size )
+{
+    // Pad the file with zeros up to the next aligned offset, and write the data.
+    const std::size_t offset = m_stream.tellp();
+    const std::string padding( alignFeatureIndexOffset( offset ) - offset, '\0' );
+    m_stream.write( padding.data(), padding.size() );
+    m_stream.write( static_cast<const char *>( data ), size );
+}
+
 template <>
 ScalarTypeID getScalarTypeID<uint8_t>()
 {
@@ -785,6 +1167,12 @@ ScalarTypeID getScalarTypeID<uint32_t>()
     return ScalarTypeID::UINT32;
 }
 
+template <>
+ScalarTypeID getScalarTypeID<uint64_t>()
+{
+    return ScalarTypeID::UINT64;
+}
+
 template <>
 ScalarTypeID getScalarTypeID<int8_t>()
 {
@@ -833,4 +1221,22 @@ FeatureTypeID getFeatureTypeID<double>()
     return FeatureTypeID::DOUBLE;
 }
 
+template <>
+FeatureTypeID getFeatureTypeID<uint8_t>()
+{
+    return FeatureTypeID::UINT8;
+}
+
+template <>
+FeatureTypeID getFeatureTypeID<uint16_t>()
+{
+    return FeatureTypeID::UINT16;
+}
+
+template <>
+FeatureTypeID getFeatureTypeID<int16_t>()
+{
+    return FeatureTypeID::INT16;
+}
+
 } // namespace balsa
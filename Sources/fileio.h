@@ -1,7 +1,9 @@
 #ifndef FILEIO_H
 #define FILEIO_H
 
+#include <cstring>
 #include <fstream>
+#include <iterator>
 #include <optional>
 #include <string>
 
@@ -9,6 +11,7 @@
 #include "classifiervisitor.h"
 #include "datatypes.h"
 #include "exceptions.h"
+#include "memorymapping.h"
 #include "table.h"
 
 namespace balsa
@@ -22,6 +25,7 @@ enum class ScalarTypeID
     UINT8,
     UINT16,
     UINT32,
+    UINT64,
     INT8,
     INT16,
     INT32,
@@ -46,7 +50,10 @@ ScalarTypeID getScalarTypeID()
 enum class FeatureTypeID
 {
     FLOAT,
-    DOUBLE
+    DOUBLE,
+    UINT8,
+    UINT16,
+    INT16
 };
 
 /**
@@ -59,13 +66,19 @@ FeatureTypeID getFeatureTypeID()
     return static_cast<FeatureTypeID>( 0 );
 }
 
+/**
+ * Returns a short, human-readable name of the specified feature type, e.g.
+ * "float" or "uint8".
+ */
+std::string getFeatureTypeName( FeatureTypeID featureTypeID );
+
 /**
  * Description of an ensemble of classification models.
  */
 struct EnsembleHeader
 {
     unsigned char classCount;   // Number of classes distinguished by the ensemble.
-    unsigned char featureCount; // Number of features the ensemble was trained on.
+    unsigned int  featureCount; // Number of features the ensemble was trained on.
 };
 
 /**
@@ -74,7 +87,7 @@ struct EnsembleHeader
 struct TreeHeader
 {
     unsigned char classCount;    // Number of classes distinguished by the tree.
-    unsigned char featureCount;  // Number of features the tree was trained on.
+    unsigned int  featureCount;  // Number of features the tree was trained on.
     FeatureTypeID featureTypeID; // Numeric type used for features.
 };
 
@@ -83,11 +96,30 @@ struct TreeHeader
  */
 struct TableHeader
 {
-    unsigned int rowCount;     // Number of rows.
+    std::size_t  rowCount;     // Number of rows.
     unsigned int columnCount;  // Number of columns.
     ScalarTypeID scalarTypeID; // Numeric type of the elements of the table.
 };
 
+/**
+ * Description of a sorted feature index (see FeatureIndex).
+ */
+struct FeatureIndexHeader
+{
+    std::string   key;           // Identifies the data set the index was built from.
+    unsigned int  featureCount;  // Number of features per point.
+    std::size_t   pointCount;    // Number of points.
+    FeatureTypeID featureTypeID; // Numeric type used for features.
+    ScalarTypeID  pointIDTypeID; // Integer type used for point IDs.
+};
+
+/**
+ * The alignment, in bytes from the start of the file, of each array of a
+ * feature index. This allows the arrays to be accessed through a memory
+ * mapping of the file.
+ */
+constexpr std::size_t FEATURE_INDEX_ALIGNMENT = 64;
+
 /**
  * A parser for files written in the balsa file format.
  */
@@ -160,6 +192,11 @@ public:
      */
     bool atTable();
 
+    /**
+     * Returns true iff the reader is positioned at a feature index.
+     */
+    bool atFeatureIndex();
+
     /**
      * Returns true iff the reader is positioned at a decision tree using
      * features of the specified type.
@@ -294,6 +331,16 @@ public:
             // Read as floats, convert to target type.
             result.template readCellDataAs<uint8_t>( m_stream );
         }
+        else if ( sourceType == getScalarTypeID<uint16_t>() )
+        {
+            // Read as unsigned 16-bit integers, convert to target type.
+            result.template readCellDataAs<uint16_t>( m_stream );
+        }
+        else if ( sourceType == getScalarTypeID<int16_t>() )
+        {
+            // Read as signed 16-bit integers, convert to target type.
+            result.template readCellDataAs<int16_t>( m_stream );
+        }
         else
         {
             throw ParseError( "Unsupported type conversion." );
@@ -306,6 +353,50 @@ public:
         return result;
     }
 
+    /**
+     * Parses the description of a table, and skips its data. This allows the
+     * data to be accessed by other means, e.g. through a memory mapping of
+     * the file.
+     *
+     * \pre The parser is positioned at a table.
+     * \post The parser will be positioned at the next object in the file, or at
+     *  the end of the file if it contains no more objects.
+     * \param dataOffset Receives the offset of the first element of the table in the file.
+     * \returns Table description.
+     */
+    TableHeader skipTable( std::size_t & dataOffset );
+
+    /**
+     * Parses the description of a classifier, and skips its data. This allows
+     * the submodels of an ensemble to be counted or passed over without
+     * loading them.
+     *
+     * \pre The parser is positioned at a classifier.
+     * \post The parser will be positioned at the next object in the file, or at
+     *  the end of the file if it contains no more objects.
+     * \returns Tree description.
+     */
+    TreeHeader skipClassifier();
+
+    /**
+     * Parses the description of a feature index, and skips its data. The
+     * arrays of the index can then be accessed through a memory mapping of
+     * the file.
+     *
+     * \pre The parser is positioned at a feature index.
+     * \post The parser will be positioned at the next object in the file, or at
+     *  the end of the file if it contains no more objects.
+     * \param valuesOffset Receives the offset of the sorted feature values in the file.
+     * \param pointIDsOffset Receives the offset of the sorted point IDs in the file.
+     * \returns Feature index description.
+     */
+    FeatureIndexHeader skipFeatureIndex( std::size_t & valuesOffset, std::size_t & pointIDsOffset );
+
+    /**
+     * Returns the offset of the current position of the parser in the file.
+     */
+    std::size_t getOffset();
+
 private:
 
     void parseFileSignature();
@@ -315,13 +406,19 @@ private:
     void parseTreeEndMarker();
     void parseTableStartMarker();
     void parseTableEndMarker();
+    void parseFeatureIndexStartMarker();
+    void parseFeatureIndexEndMarker();
 
     bool atTableOfType( ScalarTypeID typeID );
     bool atTreeOfType( FeatureTypeID typeID );
 
-    EnsembleHeader parseEnsembleHeader();
-    TreeHeader     parseTreeHeader();
-    TableHeader    parseTableHeader();
+    template <typename FeatureType>
+    Classifier::SharedPointer parseDecisionTree( const TreeHeader & header );
+
+    EnsembleHeader     parseEnsembleHeader();
+    TreeHeader         parseTreeHeader();
+    TableHeader        parseTableHeader();
+    FeatureIndexHeader parseFeatureIndexHeader();
 
     std::ifstream               m_stream;
     std::streampos              m_treeOffset;
@@ -355,6 +452,178 @@ Table<ScalarType> readTableAs( const std::string & filename )
     return parser.parseTableAs<ScalarType>();
 }
 
+/**
+ * A read-only table in a single-table file that is mapped into memory, rather
+ * than read. The operating system loads the data on demand, and it can evict
+ * it again when memory is scarce, so the table can be larger than the
+ * available RAM. The elements are not converted, so the table must contain
+ * elements of the specified scalar type.
+ */
+template <typename ScalarType>
+class MappedTable
+{
+public:
+
+    /**
+     * A random access iterator over the elements of the table, in row-major
+     * order. The elements in the file are not necessarily aligned in memory,
+     * so they are copied when they are dereferenced.
+     */
+    class ConstIterator
+    {
+    public:
+
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef ScalarType                      value_type;
+        typedef std::ptrdiff_t                  difference_type;
+        typedef const ScalarType *              pointer;
+        typedef ScalarType                      reference;
+
+        ConstIterator( const char * address = nullptr ):
+        m_address( address )
+        {
+        }
+
+        ScalarType operator*() const
+        {
+            ScalarType value;
+            std::memcpy( &value, m_address, sizeof( value ) );
+            return value;
+        }
+
+        ScalarType operator[]( difference_type offset ) const
+        {
+            return *( *this + offset );
+        }
+
+        ConstIterator & operator++()
+        {
+            m_address += sizeof( ScalarType );
+            return *this;
+        }
+
+        ConstIterator operator++( int )
+        {
+            ConstIterator result( *this );
+            ++*this;
+            return result;
+        }
+
+        ConstIterator & operator--()
+        {
+            m_address -= sizeof( ScalarType );
+            return *this;
+        }
+
+        ConstIterator operator--( int )
+        {
+            ConstIterator result( *this );
+            --*this;
+            return result;
+        }
+
+        ConstIterator & operator+=( difference_type offset )
+        {
+            m_address += offset * difference_type( sizeof( ScalarType ) );
+            return *this;
+        }
+
+        ConstIterator & operator-=( difference_type offset )
+        {
+            return *this += -offset;
+        }
+
+        ConstIterator operator+( difference_type offset ) const
+        {
+            return ConstIterator( *this ) += offset;
+        }
+
+        ConstIterator operator-( difference_type offset ) const
+        {
+            return ConstIterator( *this ) -= offset;
+        }
+
+        difference_type operator-( const ConstIterator & other ) const
+        {
+            return ( m_address - other.m_address ) / difference_type( sizeof( ScalarType ) );
+        }
+
+        bool operator==( const ConstIterator & other ) const
+        {
+            return m_address == other.m_address;
+        }
+
+        bool operator!=( const ConstIterator & other ) const
+        {
+            return m_address != other.m_address;
+        }
+
+        bool operator<( const ConstIterator & other ) const
+        {
+            return m_address < other.m_address;
+        }
+
+    private:
+
+        const char * m_address;
+    };
+
+    /**
+     * Constructor; maps the table in the specified file into memory.
+     */
+    MappedTable( const std::string & filename ):
+    m_file( filename )
+    {
+        // Locate the table data in the file.
+        BalsaFileParser parser( filename );
+        std::size_t     dataOffset = 0;
+        TableHeader     header     = parser.skipTable( dataOffset );
+        if ( header.scalarTypeID != getScalarTypeID<ScalarType>() ) throw ParseError( "Table has incompatible scalar type." );
+        m_rowCount    = header.rowCount;
+        m_columnCount = header.columnCount;
+        m_data        = m_file.getData() + dataOffset;
+    }
+
+    /**
+     * Returns the number of rows.
+     */
+    std::size_t getRowCount() const
+    {
+        return m_rowCount;
+    }
+
+    /**
+     * Returns the number of columns.
+     */
+    unsigned int getColumnCount() const
+    {
+        return m_columnCount;
+    }
+
+    /**
+     * Returns an iterator to the first element of the table.
+     */
+    ConstIterator begin() const
+    {
+        return ConstIterator( m_data );
+    }
+
+    /**
+     * Returns an iterator past the last element of the table.
+     */
+    ConstIterator end() const
+    {
+        return begin() + m_rowCount * m_columnCount;
+    }
+
+private:
+
+    MappedFile   m_file;
+    const char * m_data;
+    std::size_t  m_rowCount;
+    unsigned int m_columnCount;
+};
+
 /**
  * A writer for files that adhere to the balsa file format.
  */
@@ -382,6 +651,21 @@ public:
         std::optional<unsigned char>     creatorMinorVersion = std::nullopt,
         std::optional<unsigned char>     creatorPatchVersion = std::nullopt );
 
+    /**
+     * Constructor; opens an existing file for appending submodels to an
+     * ensemble in it. The file is not truncated. The writer is positioned
+     * inside the ensemble, at its end marker. Each submodel that is written
+     * overwrites the end marker and is followed by a new one, which is flushed
+     * to the file, so the file stays valid between submodels. The ensemble
+     * must be finalized using a call to the \c leaveEnsemble() function, as
+     * usual.
+     *
+     * \param filename Name of the file to write.
+     * \param ensembleEndOffset The offset of the ensemble end marker in the
+     *  file (see \c BalsaFileParser::getOffset()).
+     */
+    BalsaFileWriter( const std::string & filename, std::size_t ensembleEndOffset );
+
     /**
      * Write an ensemble start marker and ensemble description.
      *
@@ -393,7 +677,7 @@ public:
      * \pre The writer is not positioned inside an ensemble (ensembles cannot be
      *  nested).
      */
-    void enterEnsemble( unsigned char classCount, unsigned char featureCount );
+    void enterEnsemble( unsigned char classCount, unsigned int featureCount );
 
     /**
      * Write an ensemble end marker.
@@ -427,6 +711,27 @@ public:
         writeTableEndMarker();
     }
 
+    /**
+     * Write a feature index to the file. The index consists of the sorted
+     * values of each feature, followed by the IDs of the points in the same
+     * order (see FeatureIndex). Both arrays are aligned to
+     * FEATURE_INDEX_ALIGNMENT bytes.
+     *
+     * \pre The writer is not positioned inside an ensemble.
+     * \param key Identifies the data set the index was built from.
+     */
+    template <typename FeatureType, typename PointIDType>
+    void writeFeatureIndex( const std::string & key, unsigned int featureCount, std::size_t pointCount, const FeatureType * values, const PointIDType * pointIDs )
+    {
+        assert( !m_insideEnsemble );
+        const std::size_t entryCount = std::size_t( featureCount ) * pointCount;
+        writeFeatureIndexStartMarker();
+        writeFeatureIndexHeader( key, featureCount, pointCount, getFeatureTypeID<FeatureType>(), getScalarTypeID<PointIDType>() );
+        writeAlignedData( values, entryCount * sizeof( FeatureType ) );
+        writeAlignedData( pointIDs, entryCount * sizeof( PointIDType ) );
+        writeFeatureIndexEndMarker();
+    }
+
 private:
 
     class ClassifierWriteDispatcher: public ClassifierVisitor
@@ -438,12 +743,19 @@ private:
         {
         }
 
+        void visit( const CompiledClassifier & classifier );
         void visit( const EnsembleClassifier & classifier );
         void visit( const DecisionTreeClassifier<float> & classifier );
         void visit( const DecisionTreeClassifier<double> & classifier );
+        void visit( const DecisionTreeClassifier<uint8_t> & classifier );
+        void visit( const DecisionTreeClassifier<uint16_t> & classifier );
+        void visit( const DecisionTreeClassifier<int16_t> & classifier );
 
     private:
 
+        template <typename FeatureType>
+        void writeDecisionTree( const DecisionTreeClassifier<FeatureType> & classifier );
+
         BalsaFileWriter & m_writer;
     };
 
@@ -453,12 +765,17 @@ private:
     void writeTreeEndMarker();
     void writeTableStartMarker();
     void writeTableEndMarker();
-    void writeEnsembleHeader( unsigned char classCount, unsigned char featureCount );
-    void writeTreeHeader( unsigned char classCount, unsigned char featureCount, FeatureTypeID featureType );
-    void writeTableHeader( unsigned int rowCount, unsigned int columnCount, ScalarTypeID scalarType );
+    void writeFeatureIndexStartMarker();
+    void writeFeatureIndexEndMarker();
+    void writeAlignedData( const void * data, std::size_t size );
+    void writeEnsembleHeader( unsigned char classCount, unsigned int featureCount );
+    void writeTreeHeader( unsigned char classCount, unsigned int featureCount, FeatureTypeID featureType );
+    void writeTableHeader( std::size_t rowCount, unsigned int columnCount, ScalarTypeID scalarType );
+    void writeFeatureIndexHeader( const std::string & key, unsigned int featureCount, std::size_t pointCount, FeatureTypeID featureType, ScalarTypeID pointIDType );
 
     std::ofstream m_stream;
     bool          m_insideEnsemble;
+    bool          m_appendingToEnsemble;
 };
 
 /**
@@ -479,6 +796,8 @@ ScalarTypeID getScalarTypeID<uint16_t>();
 template <>
 ScalarTypeID getScalarTypeID<uint32_t>();
 template <>
+ScalarTypeID getScalarTypeID<uint64_t>();
+template <>
 ScalarTypeID getScalarTypeID<int8_t>();
 template <>
 ScalarTypeID getScalarTypeID<int16_t>();
@@ -496,6 +815,12 @@ template <>
 FeatureTypeID getFeatureTypeID<float>();
 template <>
 FeatureTypeID getFeatureTypeID<double>();
+template <>
+FeatureTypeID getFeatureTypeID<uint8_t>();
+template <>
+FeatureTypeID getFeatureTypeID<uint16_t>();
+template <>
+FeatureTypeID getFeatureTypeID<int16_t>();
 
 } // namespace balsa
 
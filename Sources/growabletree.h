@@ -0,0 +1,161 @@
+#ifndef GROWABLETREE_H
+#define GROWABLETREE_H
+
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "datatypes.h"
+#include "decisiontreeclassifier.h"
+#include "exceptions.h"
+
+namespace balsa
+{
+
+/**
+ * Base class of the decision trees grown by the training engines, which
+ * implements what does not depend on how an engine stores its nodes: the
+ * rules for growing a leaf, the conversion to a decision tree classifier, and
+ * the Graphviz output.
+ *
+ * The derived class Tree gives access to its nodes through the functions
+ * getNodeCount() and getNode( NodeID ). A node provides isLeafNode(),
+ * getLeftChild(), getRightChild(), getSplit(), getLabel(), and getSummary(),
+ * which describes the points in the node for the Graphviz output.
+ */
+template <typename Tree, typename FeatureType>
+class GrowableTree
+{
+public:
+
+    /**
+     * Write the tree model to a Dotty file, suitable for visualization
+     */
+    void writeGraphviz( const std::string & filename ) const
+    {
+        // Create the file.
+        std::ofstream out;
+        out.open( filename );
+        if ( !out.good() ) throw SupplierError( "Could not open file for writing." );
+
+        // Write the graph data, with the nodes numbered as in the classifier (see createDecisionTree()).
+        auto order     = getBreadthFirstOrder();
+        auto positions = getPositions( order );
+        out << "digraph G" << std::endl;
+        out << "{" << std::endl;
+        for ( NodeID nodeID = 0; nodeID < order.size(); ++nodeID )
+        {
+            // Write the node label.
+            auto &            node = getTree().getNode( order[nodeID] );
+            std::stringstream info;
+            info << 'N' << nodeID << " = " << static_cast<int>( node.getLabel() ) << ' ' << node.getSummary();
+            out << "    node" << nodeID << "[shape=box label=\"" << info.str() << "\"]" << std::endl;
+
+            // Write the links to the children.
+            if ( !node.isLeafNode() )
+            {
+                auto splitFeature = node.getSplit().getFeatureID();
+                auto splitValue   = node.getSplit().getFeatureValue();
+                out << "    node" << nodeID << " -> "
+                    << "node" << positions[node.getLeftChild()] << " [label=\"F" << static_cast<int>( splitFeature ) << " < " << +splitValue << "\"];" << std::endl;
+                out << "    node" << nodeID << " -> "
+                    << "node" << positions[node.getRightChild()] << ';' << std::endl;
+            }
+        }
+        out << "}" << std::endl;
+
+        // Close the file.
+        out.close();
+    }
+
+protected:
+
+    /**
+     * Convert the tree to a plain decision tree classifier.
+     */
+    typename DecisionTreeClassifier<FeatureType>::SharedPointer createDecisionTree( unsigned int classCount, unsigned int featureCount ) const
+    {
+        // Create an empty classifier.
+        typedef DecisionTreeClassifier<FeatureType> ClassifierType;
+        typename ClassifierType::SharedPointer      classifier( new ClassifierType( classCount, featureCount ) );
+
+        // Number the nodes in breadth-first order, which does not depend on the order in which the leaves were grown.
+        auto order     = getBreadthFirstOrder();
+        auto positions = getPositions( order );
+
+        // Allocate the packed nodes of the classifier.
+        NodeID nodeCount = order.size();
+        classifier->m_nodes.resize( nodeCount );
+
+        // Copy the tree data to the packed nodes.
+        for ( NodeID nodeID = 0; nodeID < nodeCount; ++nodeID )
+        {
+            auto & node  = getTree().getNode( order[nodeID] );
+            auto & split = node.getSplit();
+            classifier->setNode( nodeID, positions[node.getLeftChild()], positions[node.getRightChild()], split.getFeatureID(), split.getFeatureValue(), node.getLabel() );
+        }
+
+        // Return the result.
+        return classifier;
+    }
+
+    /**
+     * Returns true iff it is still meaningful to grow a leaf with the
+     * specified label counts and distance to the root.
+     */
+    template <typename ImpurityType, typename SquaredCountType, typename LabelCounts>
+    static bool isGrowableLeaf( const LabelCounts & labelCounts, unsigned int distanceToRoot, unsigned int maximumDistanceToRoot, ImpurityType impurityThreshold, std::size_t minimumLeafPointCount = 1 )
+    {
+        // Prohibit growth beyond the maximum depth.
+        if ( distanceToRoot >= maximumDistanceToRoot ) return false;
+
+        // Prohibit the growth of nodes that are too small to be split into two leaves.
+        if ( labelCounts.getTotal() < 2 * minimumLeafPointCount ) return false;
+
+        // Prohibit the growth of nodes that are already pure enough.
+        if ( labelCounts.template giniImpurity<ImpurityType, SquaredCountType>() <= impurityThreshold ) return false;
+
+        // If there are no further objections, the node is growable.
+        return true;
+    }
+
+private:
+
+    const Tree & getTree() const
+    {
+        return static_cast<const Tree &>( *this );
+    }
+
+    /**
+     * Returns the IDs of all nodes in breadth-first order, starting at the root.
+     */
+    std::vector<NodeID> getBreadthFirstOrder() const
+    {
+        std::vector<NodeID> order( 1, 0 );
+        for ( std::size_t i = 0; i < order.size(); ++i )
+        {
+            auto & node = getTree().getNode( order[i] );
+            if ( node.isLeafNode() ) continue;
+            order.push_back( node.getLeftChild() );
+            order.push_back( node.getRightChild() );
+        }
+        assert( order.size() == getTree().getNodeCount() );
+        return order;
+    }
+
+    /**
+     * Returns the position of each node in a list of node IDs, by node ID.
+     */
+    static std::vector<NodeID> getPositions( const std::vector<NodeID> & order )
+    {
+        std::vector<NodeID> positions( order.size() );
+        for ( std::size_t i = 0; i < order.size(); ++i ) positions[order[i]] = i;
+        return positions;
+    }
+};
+
+} // namespace balsa
+
+#endif // GROWABLETREE_H
@@ -0,0 +1,661 @@
+#ifndef HISTOGRAMDECISIONTREE_H
+#define HISTOGRAMDECISIONTREE_H
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "datatools.h"
+#include "datatypes.h"
+#include "decisiontreeclassifier.h"
+#include "exceptions.h"
+#include "growabletree.h"
+#include "iteratortools.h"
+#include "weightedcoin.h"
+
+namespace balsa
+{
+
+/**
+ * A quantized, read-only copy of a data set, for histogram-based training.
+ *
+ * Each feature is divided into at most 256 bins, so that every feature value
+ * can be replaced by an 8-bit bin number. Features with at most 256 distinct
+ * values get one bin per value, so no information is lost for such features.
+ * The values of other features are divided over bins that contain
+ * approximately equal numbers of points. The lower bound of each bin is a
+ * feature value that occurs in the data set.
+ */
+template <typename FeatureType>
+class BinnedDataSet
+{
+public:
+
+    typedef std::shared_ptr<const BinnedDataSet> ConstSharedPointer;
+    typedef uint8_t                              BinID;
+
+    /**
+     * The maximum number of bins per feature.
+     */
+    static constexpr std::size_t MAX_BIN_COUNT = std::numeric_limits<BinID>::max() + 1;
+
+    /**
+     * Quantizes a data set.
+     * \param dataPoints Iterator to the first feature of the first point (row-major).
+     * \param labels Iterator to the label of the first point.
+     * \param featureCount The number of features per point.
+     * \param pointCount The number of points.
+     */
+    template <typename FeatureIterator, typename LabelIterator>
+    BinnedDataSet( FeatureIterator dataPoints, LabelIterator labels, unsigned int featureCount, std::size_t pointCount ):
+    m_featureCount( featureCount ),
+    m_pointCount( pointCount ),
+    m_binOffsets( featureCount + 1, 0 ),
+    m_binIDs( std::size_t( featureCount ) * pointCount ),
+    m_labels( labels, labels + pointCount )
+    {
+        std::vector<FeatureType> values( pointCount );
+        for ( unsigned int feature = 0; feature < featureCount; ++feature )
+        {
+            // Gather the values of this feature, and sort them.
+            for ( std::size_t point = 0; point < pointCount; ++point )
+            {
+                auto featureValue = dataPoints[point * featureCount + feature];
+                if ( std::isnan( featureValue ) ) throw ClientError( "Feature value is not a number." );
+                values[point] = featureValue;
+            }
+            std::sort( values.begin(), values.end() );
+
+            // Determine the lower bounds of the bins of this feature. The distinct values are counted without modifying
+            // the sorted values, which are needed for the quantiles.
+            m_binOffsets[feature] = m_lowerBounds.size();
+            std::size_t distinctCount = pointCount ? 1 : 0;
+            for ( std::size_t point = 1; point < pointCount && distinctCount <= MAX_BIN_COUNT; ++point ) distinctCount += values[point] != values[point - 1];
+            if ( distinctCount <= MAX_BIN_COUNT )
+            {
+                // Each distinct value gets its own bin.
+                std::unique_copy( values.begin(), values.end(), std::back_inserter( m_lowerBounds ) );
+            }
+            else
+            {
+                // Use quantiles of the point distribution as bin boundaries.
+                for ( std::size_t bin = 0; bin < MAX_BIN_COUNT; ++bin )
+                {
+                    auto lowerBound = values[bin * pointCount / MAX_BIN_COUNT];
+                    if ( bin == 0 || lowerBound > m_lowerBounds.back() ) m_lowerBounds.push_back( lowerBound );
+                }
+            }
+            m_binOffsets[feature + 1] = m_lowerBounds.size();
+
+            // Replace each value by the number of the bin it is in.
+            auto lowerBoundsBegin = m_lowerBounds.begin() + m_binOffsets[feature];
+            auto lowerBoundsEnd   = m_lowerBounds.end();
+            for ( std::size_t point = 0; point < pointCount; ++point )
+            {
+                auto featureValue = dataPoints[point * featureCount + feature];
+                auto bin          = std::distance( lowerBoundsBegin, std::upper_bound( lowerBoundsBegin, lowerBoundsEnd, featureValue ) ) - 1;
+                assert( bin >= 0 && static_cast<std::size_t>( bin ) < MAX_BIN_COUNT );
+                m_binIDs[point * featureCount + feature] = static_cast<BinID>( bin );
+            }
+        }
+    }
+
+    /**
+     * Returns the number of features per point.
+     */
+    unsigned int getFeatureCount() const
+    {
+        return m_featureCount;
+    }
+
+    /**
+     * Returns the number of points.
+     */
+    std::size_t getPointCount() const
+    {
+        return m_pointCount;
+    }
+
+    /**
+     * Returns the number of bins of a feature.
+     */
+    std::size_t getBinCount( FeatureID feature ) const
+    {
+        return m_binOffsets[feature + 1] - m_binOffsets[feature];
+    }
+
+    /**
+     * Returns the sum of the bin counts of all features.
+     */
+    std::size_t getTotalBinCount() const
+    {
+        return m_lowerBounds.size();
+    }
+
+    /**
+     * Returns the position of the first bin of a feature in the list of the
+     * bins of all features.
+     */
+    std::size_t getBinOffset( FeatureID feature ) const
+    {
+        return m_binOffsets[feature];
+    }
+
+    /**
+     * Returns the smallest feature value that is in the specified bin.
+     */
+    FeatureType getLowerBound( FeatureID feature, std::size_t bin ) const
+    {
+        assert( bin < getBinCount( feature ) );
+        return m_lowerBounds[m_binOffsets[feature] + bin];
+    }
+
+    /**
+     * Returns the bin numbers of all features of a point.
+     */
+    const BinID * getBinIDs( std::size_t point ) const
+    {
+        return m_binIDs.data() + point * m_featureCount;
+    }
+
+    /**
+     * Returns the label of a point.
+     */
+    Label getLabel( std::size_t point ) const
+    {
+        return m_labels[point];
+    }
+
+    /**
+     * Returns the labels of all points.
+     */
+    const std::vector<Label> & getLabels() const
+    {
+        return m_labels;
+    }
+
+private:
+
+    unsigned int             m_featureCount;
+    std::size_t              m_pointCount;
+    std::vector<std::size_t> m_binOffsets;
+    std::vector<FeatureType> m_lowerBounds;
+    std::vector<BinID>       m_binIDs;
+    std::vector<Label>       m_labels;
+};
+
+/**
+ * A decision tree that is trained on a quantized copy of the data set.
+ *
+ * Instead of sorting the points of each node along each feature, the tree
+ * counts the labels of the points in each feature bin (a histogram), and only
+ * considers the boundaries between bins as split locations. The histogram of
+ * a node is built by counting the points of the smaller child only; the
+ * histogram of the larger child is obtained by subtracting it from the
+ * histogram of the parent. Nodes are grown depth-first, so only the histograms
+ * of the nodes on the path from the root to the current node are kept.
+ *
+ * The quantized data set is shared between all copies of a tree, so copying a
+ * sapling to train multiple trees is cheap. Every node selects the features
+ * to consider with its own seed, in the same way as an IndexedDecisionTree, so
+ * for features with at most 256 distinct values, the trained trees are
+ * identical to those of an IndexedDecisionTree that is seeded with the same
+ * value.
+ */
+template <typename FeatureIterator = double *, typename LabelIterator = Label *, typename PointIDType = DataPointID>
+class HistogramDecisionTree: public GrowableTree<HistogramDecisionTree<FeatureIterator, LabelIterator, PointIDType>, std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type>>
+{
+
+    // Forward declarations.
+    class Node;
+    class PendingLeaf;
+    class BinSplit;
+
+public:
+
+    typedef std::shared_ptr<HistogramDecisionTree> SharedPointer;
+    typedef WeightedCoin<>                         WeightedCoinType;
+    typedef WeightedCoinType::ValueType            SeedType;
+
+    typedef std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type> FeatureType;
+    typedef std::remove_cv_t<typename iterator_value_type<LabelIterator>::type>   LabelType;
+
+    static_assert( std::is_arithmetic<FeatureType>::value, "Feature type should be an integral or floating point type." );
+    static_assert( std::is_same<LabelType, Label>::value, "Label type should an unsigned, 8 bits wide, integral type." );
+
+    /**
+     * Creates a histogram decision tree with one root node from scratch.
+     * N.B. this is an expensive operation, because construction quantizes the
+     * data set. When training multiple trees on the same data, it is much more
+     * efficient to create one tree and to copy the initial tree multiple times.
+     */
+    HistogramDecisionTree( FeatureIterator dataPoints, LabelIterator labels, unsigned int featureCount, std::size_t pointCount, unsigned int featuresToConsider, unsigned int maximumDistanceToRoot = std::numeric_limits<unsigned int>::max(), ImpurityTypeOf<FeatureType> impurityThreshold = 0.0 ):
+    m_data( new BinnedDataSet<FeatureType>( dataPoints, labels, featureCount, pointCount ) ),
+    m_rootLabelCounts( labels, labels + pointCount ),
+    m_featuresToConsider( featuresToConsider ),
+    m_maximumDistanceToRoot( maximumDistanceToRoot ),
+    m_impurityThreshold( impurityThreshold )
+    {
+        // Check pre-conditions.
+        assert( featuresToConsider > 0 && featuresToConsider <= featureCount );
+        assert( impurityThreshold >= 0.0 && impurityThreshold <= 1.0 );
+
+        // Create the root node (it contains all points).
+        m_nodes.push_back( Node( m_rootLabelCounts.getMostFrequentLabel(), pointCount, std::random_device{}() ) );
+    }
+
+    /**
+     * Returns the number of classes distinguished by this decision tree.
+     */
+    unsigned int getClassCount() const
+    {
+        return m_rootLabelCounts.size();
+    }
+
+    /**
+     * Reinitialize the seed from which the seeds of the nodes are derived. The
+     * seed of a node determines which features are considered when deciding
+     * where to split it.
+     * \pre The tree has not been grown yet.
+     */
+    void seed( SeedType value )
+    {
+        assert( m_nodes.size() == 1 );
+        m_nodes.front().m_seed = value;
+    }
+
+    /**
+     * Grows the entire tree until no more progress is possible.
+     */
+    void grow()
+    {
+        // A tree can only be grown once.
+        if ( m_nodes.size() > 1 ) return;
+
+        // Create a list of all points. It will be partitioned such that the points of each node are consecutive.
+        m_pointIDs.resize( m_data->getPointCount() );
+        std::iota( m_pointIDs.begin(), m_pointIDs.end(), PointIDType( 0 ) );
+
+        // Grow the root node, and then its descendants, depth-first.
+        std::vector<PendingLeaf> pendingLeaves;
+        if ( isGrowableNode( m_rootLabelCounts, 0 ) ) pendingLeaves.push_back( PendingLeaf( 0, 0, m_pointIDs.size(), 0, m_rootLabelCounts, buildHistogram( 0, m_pointIDs.size() ) ) );
+        while ( !pendingLeaves.empty() )
+        {
+            PendingLeaf leaf = std::move( pendingLeaves.back() );
+            pendingLeaves.pop_back();
+            growLeaf( leaf, pendingLeaves );
+        }
+
+        // Release the point list, it is no longer needed.
+        m_pointIDs = std::vector<PointIDType>();
+    }
+
+    /**
+     * Convert this tree to a plain decision tree classifier.
+     */
+    typename DecisionTreeClassifier<FeatureType>::SharedPointer getDecisionTree()
+    {
+        return this->createDecisionTree( getClassCount(), m_data->getFeatureCount() );
+    }
+
+private:
+
+    // The base class accesses the nodes.
+    friend class GrowableTree<HistogramDecisionTree, FeatureType>;
+
+    /**
+     * Label counts per feature bin. The counts of label L in bin B (counting
+     * the bins of all features consecutively) are stored at index B * C + L,
+     * where C is the number of classes.
+     */
+    typedef std::vector<PointIDType> Histogram;
+
+    /**
+     * A floating-point type used to calculate the information gain of splits.
+     */
+    typedef ImpurityTypeOf<FeatureType> ImpurityType;
+
+    /**
+     * An integer type for the squared label counts of splits, that is wide
+     * enough for the number of points.
+     */
+    typedef SquaredCountTypeOf<PointIDType> SquaredCountType;
+
+    /**
+     * Internal representation of a node in the decision tree.
+     */
+    class Node
+    {
+    public:
+
+        Node( Label label, std::size_t pointCount, uint64_t seed ):
+        m_leftChild( 0 ),
+        m_rightChild( 0 ),
+        m_label( label ),
+        m_pointCount( pointCount ),
+        m_seed( seed )
+        {
+        }
+
+        bool isLeafNode() const
+        {
+            return m_leftChild == 0;
+        }
+
+        NodeID getLeftChild() const
+        {
+            return m_leftChild;
+        }
+
+        NodeID getRightChild() const
+        {
+            return m_rightChild;
+        }
+
+        const Split<FeatureType> & getSplit() const
+        {
+            return m_split;
+        }
+
+        Label getLabel() const
+        {
+            return m_label;
+        }
+
+        std::string getSummary() const
+        {
+            return "points: " + std::to_string( m_pointCount );
+        }
+
+        NodeID             m_leftChild;
+        NodeID             m_rightChild;
+        Split<FeatureType> m_split;
+        Label              m_label;
+        std::size_t        m_pointCount;
+        uint64_t           m_seed; // The seed of the random selection of features to consider when splitting this node.
+    };
+
+    /**
+     * A leaf node that is still to be grown, with the data needed to grow it.
+     */
+    class PendingLeaf
+    {
+    public:
+
+        PendingLeaf( NodeID nodeID, std::size_t pointOffset, std::size_t pointCount, unsigned int distanceToRoot, const LabelFrequencyTable & labelCounts, Histogram && histogram ):
+        m_nodeID( nodeID ),
+        m_pointOffset( pointOffset ),
+        m_pointCount( pointCount ),
+        m_distanceToRoot( distanceToRoot ),
+        m_labelCounts( labelCounts ),
+        m_histogram( std::move( histogram ) )
+        {
+        }
+
+        NodeID              m_nodeID;
+        std::size_t         m_pointOffset;
+        std::size_t         m_pointCount;
+        unsigned int        m_distanceToRoot;
+        LabelFrequencyTable m_labelCounts;
+        Histogram           m_histogram;
+    };
+
+    /**
+     * A split between two consecutive bins of a feature.
+     */
+    class BinSplit
+    {
+    public:
+
+        /**
+         * Constructs an invalid split.
+         */
+        BinSplit():
+        m_featureID( 0 ),
+        m_bin( 0 ),
+        m_impurity( std::numeric_limits<ImpurityType>::max() )
+        {
+        }
+
+        BinSplit( FeatureID featureID, std::size_t bin, ImpurityType impurity ):
+        m_featureID( featureID ),
+        m_bin( bin ),
+        m_impurity( impurity )
+        {
+        }
+
+        /**
+         * Returns true iff this represents a valid split.
+         */
+        bool isValid() const
+        {
+            return m_impurity <= 1.0;
+        }
+
+        FeatureID    m_featureID; // The feature along which the split is made.
+        std::size_t  m_bin;       // Points in bins below this bin go to the left child.
+        ImpurityType m_impurity;  // The weighted Gini impurity of the children.
+    };
+
+    /**
+     * Count the labels of a range of points in the point list, per feature bin.
+     */
+    Histogram buildHistogram( std::size_t pointOffset, std::size_t pointCount ) const
+    {
+        const std::size_t classCount   = getClassCount();
+        const std::size_t featureCount = m_data->getFeatureCount();
+        Histogram         histogram( m_data->getTotalBinCount() * classCount, 0 );
+        for ( auto it = m_pointIDs.begin() + pointOffset, end = it + pointCount; it != end; ++it )
+        {
+            auto label  = m_data->getLabel( *it );
+            auto binIDs = m_data->getBinIDs( *it );
+            for ( std::size_t feature = 0; feature < featureCount; ++feature )
+            {
+                ++histogram[( m_data->getBinOffset( feature ) + binIDs[feature] ) * classCount + label];
+            }
+        }
+        return histogram;
+    }
+
+    /**
+     * Find and apply the best split for a leaf, and schedule the growable
+     * children for growth.
+     */
+    void growLeaf( PendingLeaf & leaf, std::vector<PendingLeaf> & pendingLeaves )
+    {
+        // Find the best split for the node.
+        BinSplit split = findBestSplit( leaf );
+        if ( !split.isValid() ) return;
+
+        // Partition the points of the node along the split.
+        auto begin  = m_pointIDs.begin() + leaf.m_pointOffset;
+        auto end    = begin + leaf.m_pointCount;
+        auto middle = std::partition( begin, end, [this, &split]( PointIDType point )
+            {
+                return m_data->getBinIDs( point )[split.m_featureID] < split.m_bin;
+            } );
+        std::size_t leftPointCount  = std::distance( begin, middle );
+        std::size_t rightPointCount = leaf.m_pointCount - leftPointCount;
+        assert( leftPointCount > 0 && rightPointCount > 0 );
+
+        // Determine the label counts of both children.
+        const std::size_t   classCount = getClassCount();
+        LabelFrequencyTable leftCounts( classCount );
+        LabelFrequencyTable rightCounts( leaf.m_labelCounts );
+        auto                binStart = ( m_data->getBinOffset( split.m_featureID ) ) * classCount;
+        for ( std::size_t index = binStart, end = binStart + split.m_bin * classCount; index < end; ++index )
+        {
+            Label label = index % classCount;
+            leftCounts.increment( label, leaf.m_histogram[index] );
+            rightCounts.decrement( label, leaf.m_histogram[index] );
+        }
+        assert( leftCounts.getTotal() == leftPointCount );
+
+        // Create the child nodes, with seeds derived from the seed of the node.
+        NodeID   leftChildID  = m_nodes.size();
+        NodeID   rightChildID = leftChildID + 1;
+        auto &   node         = m_nodes[leaf.m_nodeID];
+        uint64_t seed         = node.m_seed;
+        node.m_leftChild      = leftChildID;
+        node.m_rightChild     = rightChildID;
+        node.m_split          = Split<FeatureType>( split.m_featureID, m_data->getLowerBound( split.m_featureID, split.m_bin ) );
+        m_nodes.push_back( Node( leftCounts.getMostFrequentLabel(), leftPointCount, deriveSeed( seed, 0 ) ) );
+        m_nodes.push_back( Node( rightCounts.getMostFrequentLabel(), rightPointCount, deriveSeed( seed, 1 ) ) );
+
+        // Stop here if neither child can be grown any further.
+        unsigned int childDistanceToRoot = leaf.m_distanceToRoot + 1;
+        bool         leftIsGrowable      = isGrowableNode( leftCounts, childDistanceToRoot );
+        bool         rightIsGrowable     = isGrowableNode( rightCounts, childDistanceToRoot );
+        if ( !leftIsGrowable && !rightIsGrowable ) return;
+
+        // Count the histogram of the smaller child, and turn the histogram of the parent into that of the larger child.
+        bool      leftIsSmaller    = leftPointCount <= rightPointCount;
+        Histogram smallerHistogram = leftIsSmaller ? buildHistogram( leaf.m_pointOffset, leftPointCount ) : buildHistogram( leaf.m_pointOffset + leftPointCount, rightPointCount );
+        Histogram largerHistogram  = std::move( leaf.m_histogram );
+        for ( std::size_t i = 0; i < largerHistogram.size(); ++i ) largerHistogram[i] -= smallerHistogram[i];
+
+        // Schedule the children for growth. The left child is pushed last, so it will be grown first.
+        if ( rightIsGrowable ) pendingLeaves.push_back( PendingLeaf( rightChildID, leaf.m_pointOffset + leftPointCount, rightPointCount, childDistanceToRoot, rightCounts, leftIsSmaller ? std::move( largerHistogram ) : std::move( smallerHistogram ) ) );
+        if ( leftIsGrowable ) pendingLeaves.push_back( PendingLeaf( leftChildID, leaf.m_pointOffset, leftPointCount, childDistanceToRoot, leftCounts, leftIsSmaller ? std::move( smallerHistogram ) : std::move( largerHistogram ) ) );
+    }
+
+    /**
+     * Find the best possible split for the specified leaf node, taking randomly
+     * selected features into account.
+     */
+    BinSplit findBestSplit( const PendingLeaf & leaf )
+    {
+        // Randomly scan the required number of features, using the seed of the node.
+        const unsigned int       featureCount = m_data->getFeatureCount();
+        WeightedCoin<SplitMix64> coin( m_nodes[leaf.m_nodeID].m_seed );
+        auto                     featuresToScan = m_featuresToConsider;
+        BinSplit                 bestSplit;
+        std::vector<FeatureID>   skippedFeatures;
+        for ( FeatureID featureID = 0; featureID < featureCount; ++featureID )
+        {
+            // Decide whether or not to consider this feature.
+            auto featuresLeft        = featureCount - featureID;
+            bool considerThisFeature = coin.flip( featuresToScan, featuresLeft );
+            if ( !considerThisFeature )
+            {
+                skippedFeatures.push_back( featureID );
+                continue;
+            }
+
+            // Use up one 'credit'.
+            assert( featuresToScan > 0 );
+            --featuresToScan;
+
+            // Scan the feature for a split that is better than what was already found.
+            bestSplit = findBestSplitForFeature( leaf, featureID, bestSplit );
+        }
+
+        // If a valid split has been found, return it.
+        if ( bestSplit.isValid() ) return bestSplit;
+
+        // Since no valid split was found, scan all features that were initially skipped.
+        for ( auto featureID : skippedFeatures )
+        {
+            // Return the first candidate split.
+            bestSplit = findBestSplitForFeature( leaf, featureID, bestSplit );
+            if ( bestSplit.isValid() ) return bestSplit;
+        }
+
+        // All points in this node are in the same bin for every feature, so
+        // this node cannot be split.
+        return bestSplit;
+    }
+
+    /**
+     * Find the best split for a particular leaf and feature, that is at least as good as the supplied minimal best split.
+     */
+    BinSplit findBestSplitForFeature( const PendingLeaf & leaf, FeatureID featureID, const BinSplit & minimalBestSplit )
+    {
+        // Find the part of the histogram that covers this feature.
+        const std::size_t   classCount = getClassCount();
+        const PointIDType * histogram  = leaf.m_histogram.data() + m_data->getBinOffset( featureID ) * classCount;
+        const std::size_t   binCount   = m_data->getBinCount( featureID );
+
+        // Keep running label counts of the left side, and running sums of the
+        // squared label counts of both sides. This allows calculating the
+        // impurity of each possible split in constant time, in the same way as
+        // an IndexedDecisionTree.
+        BinSplit          bestSplit          = minimalBestSplit;
+        const std::size_t totalCount         = leaf.m_pointCount;
+        std::size_t       leftTotal          = 0;
+        SquaredCountType  leftSquaredCounts  = 0;
+        SquaredCountType  rightSquaredCounts = leaf.m_labelCounts.template getSquaredCountSum<SquaredCountType>();
+        m_leftCounts.assign( classCount, 0 );
+
+        // Move the bins from the right side to the left side one by one, and evaluate the boundaries between non-empty bins.
+        for ( std::size_t bin = 0; bin < binCount; ++bin )
+        {
+            // Skip empty bins.
+            const PointIDType * binCounts = histogram + bin * classCount;
+            std::size_t         binTotal  = std::accumulate( binCounts, binCounts + classCount, std::size_t( 0 ) );
+            if ( binTotal == 0 ) continue;
+
+            // Evaluate the split below this bin, if there are points on both sides of it.
+            if ( leftTotal > 0 )
+            {
+                auto impurity = splitGiniImpurity<ImpurityType, SquaredCountType>( leftSquaredCounts, leftTotal, rightSquaredCounts, totalCount - leftTotal );
+                if ( impurity < bestSplit.m_impurity ) bestSplit = BinSplit( featureID, bin, impurity );
+            }
+
+            // Move the bin to the left side.
+            for ( std::size_t label = 0; label < classCount; ++label )
+            {
+                std::size_t count      = binCounts[label];
+                std::size_t rightCount = leaf.m_labelCounts.getCount( label ) - m_leftCounts[label];
+                leftSquaredCounts += SquaredCountType( count ) * ( 2 * m_leftCounts[label] + count );
+                rightSquaredCounts -= SquaredCountType( count ) * ( 2 * rightCount - count );
+                m_leftCounts[label] += count;
+            }
+            leftTotal += binTotal;
+        }
+
+        return bestSplit;
+    }
+
+    /**
+     * Returns a node by ID.
+     */
+    const Node & getNode( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID];
+    }
+
+    /**
+     * Returns the number of nodes in the tree.
+     */
+    NodeID getNodeCount() const
+    {
+        return m_nodes.size();
+    }
+
+    /**
+     * Returns true iff it is still meaningful to grow a node with the specified label counts and depth.
+     */
+    bool isGrowableNode( const LabelFrequencyTable & labelCounts, unsigned int distanceToRoot ) const
+    {
+        return this->template isGrowableLeaf<ImpurityType, SquaredCountType>( labelCounts, distanceToRoot, m_maximumDistanceToRoot, m_impurityThreshold );
+    }
+
+    typename BinnedDataSet<FeatureType>::ConstSharedPointer m_data;
+    LabelFrequencyTable                                     m_rootLabelCounts;
+    std::vector<Node>                                       m_nodes;
+    std::vector<PointIDType>                                m_pointIDs;
+    std::vector<std::size_t>                                m_leftCounts; // Label counts of the left side of a split (see findBestSplitForFeature()).
+    unsigned int                                            m_featuresToConsider;
+    unsigned int                                            m_maximumDistanceToRoot;
+    ImpurityType                                            m_impurityThreshold;
+};
+
+} // namespace balsa
+
+#endif // HISTOGRAMDECISIONTREE_H
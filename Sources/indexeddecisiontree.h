@@ -1,18 +1,25 @@
 #ifndef INDEXEDDECISIONTREE_H
 #define INDEXEDDECISIONTREE_H
 
-#include <cmath>
 #include <deque>
-#include <fstream>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <queue>
 #include <valarray>
 #include <vector>
 
+#include "arena.h"
 #include "datatools.h"
 #include "datatypes.h"
 #include "decisiontreeclassifier.h"
+#include "featureindex.h"
+#include "growabletree.h"
 #include "iteratortools.h"
 #include "table.h"
 #include "weightedcoin.h"
+#include "workerpool.h"
 
 namespace balsa
 {
@@ -20,12 +27,11 @@ namespace balsa
 /**
  * A decision tree with an internal search index for fast training.
  */
-template <typename FeatureIterator = double *, typename LabelIterator = Label *>
-class IndexedDecisionTree
+template <typename FeatureIterator = double *, typename LabelIterator = Label *, typename PointIDType = DataPointID>
+class IndexedDecisionTree: public GrowableTree<IndexedDecisionTree<FeatureIterator, LabelIterator, PointIDType>, std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type>>
 {
 
     // Forward declarations.
-    class FeatureIndexEntry;
     class Node;
 
 public:
@@ -45,51 +51,116 @@ public:
      * N.B. this is an expensive operation, because construction builds sorted
      * indices. When training multiple trees on the same data, it is much more
      * efficient to create one tree and to copy the initial tree multiple times.
+     * The indices of different features are built concurrently if a pool of
+     * helper threads is supplied. If a scratch directory is specified, the
+     * indices of this tree and its copies are stored in scratch files in that
+     * directory, rather than on the heap. If an index file is specified, the
+     * indices are mapped from that file if it was written with the same key,
+     * and written to it otherwise (see FeatureIndex).
      */
-    IndexedDecisionTree( FeatureIterator dataPoints, LabelIterator labels, unsigned int featureCount, unsigned int pointCount, unsigned int featuresToConsider, unsigned int maximumDistanceToRoot = std::numeric_limits<unsigned int>::max(), FeatureType impurityTreshold = 0.0 ):
-    m_dataPoints( dataPoints ),
+    IndexedDecisionTree( FeatureIterator dataPoints, LabelIterator labels, unsigned int featureCount, std::size_t pointCount, unsigned int featuresToConsider, unsigned int maximumDistanceToRoot = std::numeric_limits<unsigned int>::max(), ImpurityTypeOf<FeatureType> impurityTreshold = 0.0, WorkerPool * indexBuildPool = nullptr, const std::string & scratchDirectory = std::string(), const std::string & indexFile = std::string(), const std::string & indexKey = std::string() ):
     m_pointCount( pointCount ),
     m_featureCount( featureCount ),
+    m_featureIndex( dataPoints, labels, featureCount, pointCount, indexBuildPool, scratchDirectory, indexFile, indexKey ),
+    m_partitionBuffers( new PartitionBufferPool() ),
     m_featuresToConsider( featuresToConsider ),
     m_maximumDistanceToRoot( maximumDistanceToRoot ),
+    m_maximumNodeCount( std::numeric_limits<std::size_t>::max() ),
+    m_minimumLeafPointCount( 1 ),
     m_impurityThreshold( impurityTreshold ) // Between 0 and 1. A value of 0 means any split that is an improvement will be made, while any value >= (M - 1)/M, with M the number of features, means no splits will be made.
     {
         // Check pre-conditions.
         assert( featuresToConsider > 0 && featuresToConsider <= featureCount );
         assert( impurityTreshold >= 0.0 && m_impurityThreshold <= 1.0 );
 
-        // Build a sorted point index for each feature.
-        for ( FeatureID feature = 0; feature < featureCount; ++feature )
-        {
-            // Create an empty index for this feature with enough capacity for one entry per data point.
-            m_featureIndex.push_back( SingleFeatureIndex() );
-            auto & singleFeatureIndex = *m_featureIndex.rbegin();
-            singleFeatureIndex.reserve( pointCount );
-
-            // Add all the data points to the single-feature index.
-            for ( DataPointID point = 0; point < pointCount; ++point )
-            {
-                auto index = point * m_featureCount + feature;
-                assert( index < ( pointCount * featureCount ) );
-                auto featureValue = dataPoints[point * m_featureCount + feature];
-                if ( std::isnan( featureValue ) ) throw ClientError( "Feature value is not a number." );
-                singleFeatureIndex.push_back( FeatureIndexEntry( featureValue, point, labels[point] ) );
-            }
-
-            // Sort the index by feature value.
-            std::sort( singleFeatureIndex.begin(), singleFeatureIndex.end() );
-        }
-
         // Create a frequency table for all labels in the data set.
         LabelFrequencyTable labelCounts( labels, labels + pointCount );
         assert( pointCount == labelCounts.getTotal() );
         assert( labelCounts.invariant() );
 
         // Create the root node (it contains all points).
-        m_nodes.push_back( Node( labelCounts, 0, 0 ) );
+        m_labelCounts.reset( labelCounts.size() );
+        addNode( labelCounts, 0, pointCount, 0, std::random_device{}() );
 
         // If the root node is still growable, add it to the list of growable nodes.
-        if ( isGrowableNode( 0 ) ) m_growableLeaves.push_back( 0 );
+        if ( isGrowableNode( getNode( 0 ) ) ) m_growableLeaves.push_back( 0 );
+    }
+
+    /**
+     * Creates a copy of a tree that has not been grown yet (the sapling). The
+     * copy gets its own nodes, but shares the index with the sapling where
+     * possible (see FeatureIndex).
+     */
+    IndexedDecisionTree( const IndexedDecisionTree & sapling ):
+    m_pointCount( sapling.m_pointCount ),
+    m_featureCount( sapling.m_featureCount ),
+    m_featureIndex( sapling.m_featureIndex ),
+    m_partitionBuffers( sapling.m_partitionBuffers ),
+    m_labelCounts( sapling.getClassCount() ),
+    m_workerPool( sapling.m_workerPool ),
+    m_featuresToConsider( sapling.m_featuresToConsider ),
+    m_maximumDistanceToRoot( sapling.m_maximumDistanceToRoot ),
+    m_maximumNodeCount( sapling.m_maximumNodeCount ),
+    m_minimumLeafPointCount( sapling.m_minimumLeafPointCount ),
+    m_impurityThreshold( sapling.m_impurityThreshold )
+    {
+        // Check pre-condition.
+        assert( sapling.m_nodes.size() == 1 && !sapling.m_concurrentGrowth );
+
+        // Copy the root node.
+        auto & root = sapling.getNode( 0 );
+        addNode( root.getLabelCounts(), 0, root.getPointCount(), 0, root.getSeed() );
+        if ( isGrowableNode( getNode( 0 ) ) ) m_growableLeaves.push_back( 0 );
+    }
+
+    /**
+     * Creates an indexed decision tree with one root node, that will be grown
+     * on a sample of the points of an ungrown tree (the sapling). The index of
+     * the sample is filtered from the index of the sapling, which is much
+     * cheaper than building it from scratch. Points that occur more than once
+     * in the sample are weighted by their multiplicity.
+     * \param sapling A tree that has not been grown yet.
+     * \param multiplicities The number of times each point occurs in the sample, by point ID. At least one point must occur.
+     */
+    IndexedDecisionTree( const IndexedDecisionTree & sapling, const std::vector<PointMultiplicity> & multiplicities ):
+    m_pointCount( sapling.m_pointCount ),
+    m_featureCount( sapling.m_featureCount ),
+    m_featureIndex( sapling.m_featureIndex, multiplicities ),
+    m_partitionBuffers( sapling.m_partitionBuffers ),
+    m_labelCounts( sapling.getClassCount() ),
+    m_workerPool( sapling.m_workerPool ),
+    m_featuresToConsider( sapling.m_featuresToConsider ),
+    m_maximumDistanceToRoot( sapling.m_maximumDistanceToRoot ),
+    m_maximumNodeCount( sapling.m_maximumNodeCount ),
+    m_minimumLeafPointCount( sapling.m_minimumLeafPointCount ),
+    m_impurityThreshold( sapling.m_impurityThreshold )
+    {
+        // Check pre-conditions.
+        assert( sapling.m_nodes.size() == 1 && !sapling.m_concurrentGrowth );
+        assert( multiplicities.size() == m_pointCount );
+        assert( m_featureIndex.getPointCount() > 0 );
+
+        // Count the labels of the sample. All labels of the data set remain known, even if they are not sampled.
+        LabelFrequencyTable labelCounts( sapling.getClassCount() );
+        auto                labels = m_featureIndex.getLabels();
+        for ( PointIDType pointID = 0; pointID < m_pointCount; ++pointID )
+        {
+            if ( multiplicities[pointID] ) labelCounts.increment( labels[pointID], multiplicities[pointID] );
+        }
+
+        // Create the root node (it contains all sampled points).
+        addNode( labelCounts, 0, m_featureIndex.getPointCount(), 0, sapling.getNode( 0 ).getSeed() );
+
+        // If the root node is still growable, add it to the list of growable nodes.
+        if ( isGrowableNode( getNode( 0 ) ) ) m_growableLeaves.push_back( 0 );
+    }
+
+    /**
+     * Returns the number of points in the data set (including points that are not sampled).
+     */
+    std::size_t getPointCount() const
+    {
+        return m_pointCount;
     }
 
     /**
@@ -97,17 +168,64 @@ public:
      */
     unsigned int getClassCount() const
     {
-        auto & rootNode = m_nodes.front();
-        return rootNode.getLabelCounts().size();
+        return m_labelCounts.getSlotWidth();
     }
 
     /**
-     * Reinitialize the state of the random engine used to select features to
-     * consider when deciding where to split.
+     * Reinitialize the seed from which the seeds of the nodes are derived. The
+     * seed of a node determines which features are considered when deciding
+     * where to split it. It only depends on the seed of the tree and the path
+     * from the root to the node, so the tree does not depend on the order in
+     * which its leaves are grown.
+     * \pre The tree has not been grown yet.
      */
     void seed( SeedType value )
     {
-        m_coin.seed( value );
+        assert( m_nodes.size() == 1 );
+        getNode( 0 ).setSeed( value );
+    }
+
+    /**
+     * Set a pool of threads that will be used to scan and partition multiple
+     * features of large nodes concurrently, and to grow multiple leaves
+     * concurrently (see growConcurrently()). The pool may be shared by
+     * multiple trees. If no pool is set (the default), all work is done in
+     * the thread that grows the tree. The resulting tree is the same either
+     * way.
+     */
+    void setWorkerPool( WorkerPool::SharedPointer workerPool )
+    {
+        m_workerPool = workerPool;
+    }
+
+    /**
+     * Limit the size of the tree. Without a node budget, the leaves are grown
+     * until the depth or purity limits stop them, in an order that does not
+     * affect the tree. With a budget, the leaves are grown best-first: the
+     * leaf whose split reduces the impurity most, weighted by the number of
+     * points in the leaf, is split first, until the budget is used up. Every
+     * split adds two nodes and one leaf, so a budget of L leaves is the same
+     * as a budget of 2L - 1 nodes; the smaller of both budgets is used.
+     * \param maximumLeafCount The maximum number of leaves, or 0 for no limit (the default).
+     * \param maximumNodeCount The maximum number of nodes, or 0 for no limit (the default).
+     * \param minimumLeafPointCount The minimum number of points in each leaf, counting sampled points with their multiplicity (default: 1).
+     * \pre The tree has not been grown yet.
+     */
+    void setGrowthLimits( std::size_t maximumLeafCount, std::size_t maximumNodeCount, std::size_t minimumLeafPointCount )
+    {
+        assert( m_nodes.size() == 1 );
+        m_maximumNodeCount = std::numeric_limits<std::size_t>::max();
+        if ( maximumLeafCount ) m_maximumNodeCount = std::min( m_maximumNodeCount, 2 * maximumLeafCount - 1 );
+        if ( maximumNodeCount ) m_maximumNodeCount = std::min( m_maximumNodeCount, maximumNodeCount );
+        m_minimumLeafPointCount = std::max<std::size_t>( 1, minimumLeafPointCount );
+    }
+
+    /**
+     * Returns the number of nodes in the tree.
+     */
+    std::size_t getNodeCount() const
+    {
+        return m_nodes.size();
     }
 
     /**
@@ -119,15 +237,61 @@ public:
     }
 
     /**
-     * Returns true iff there are any growable nodes left in the tree.
+     * Grows the entire tree like grow(), but grows the leaves as separate
+     * tasks of the worker pool, so different leaves can be grown concurrently.
+     * This returns right away; the specified function is called by a pool
+     * thread when the tree is fully grown. The tree must not be accessed
+     * until then. The grown tree is identical to that grown by grow().
+     * \pre A worker pool with at least one thread has been set.
+     */
+    void growConcurrently( std::function<void()> onGrown )
+    {
+        // Check precondition.
+        assert( m_workerPool && m_workerPool->getThreadCount() > 0 );
+        if ( !isGrowable() )
+        {
+            onGrown();
+            return;
+        }
+
+        // Best-first growth ranks all leaves of the tree, so the leaves are
+        // grown one by one in a single task. The features of large nodes are
+        // still scanned and partitioned by the whole pool.
+        if ( hasNodeBudget() )
+        {
+            m_workerPool->submit( [this, onGrown]()
+                {
+                    grow();
+                    onGrown();
+                } );
+            return;
+        }
+
+        // Allocate the shared state, and count all leaves before they are
+        // submitted, so the first leaves cannot complete the tree before the
+        // last one is submitted. The tree may be destroyed as soon as the last
+        // leaf is grown, so nothing is accessed after submitting it.
+        if ( m_goesLeft.empty() ) m_goesLeft.resize( m_pointCount, 0 );
+        m_concurrentGrowth = std::make_shared<ConcurrentGrowth>( onGrown, m_growableLeaves.size() );
+        auto leaves        = std::move( m_growableLeaves );
+        auto workerPool    = m_workerPool;
+        m_growableLeaves.clear();
+        for ( auto leaf : leaves ) workerPool->submit( [this, leaf]() { growLeafConcurrently( leaf ); } );
+    }
+
+    /**
+     * Returns true iff there are any growable nodes left in the tree, and the
+     * node budget allows another split.
      */
     bool isGrowable() const
     {
-        return m_growableLeaves.size() > 0;
+        if ( m_growableLeaves.empty() && m_rankedLeaves.empty() ) return false;
+        return m_maximumNodeCount - m_nodes.size() >= 2;
     }
 
     /**
-     * Grows one of the remaining growable leaves.
+     * Grows one of the remaining growable leaves, or the best one if there is
+     * a node budget (see setGrowthLimits()).
      * \pre isGrowable()
      */
     void growNextLeaf()
@@ -135,78 +299,49 @@ public:
         // Check precondition.
         assert( isGrowable() );
 
-        // Grow the next growable leaf.
-        auto leaf = m_growableLeaves.front();
-        m_growableLeaves.pop_front();
-        growLeaf( leaf );
-    }
+        // Without a node budget, the order in which the leaves are grown does
+        // not matter, so grow the leaf that has been growable the longest.
+        if ( !hasNodeBudget() )
+        {
+            auto leaf = m_growableLeaves.front();
+            m_growableLeaves.pop_front();
+            growLeaf( leaf );
+            return;
+        }
 
-    /**
-     * Write the tree model to a Dotty file, suitable for visualization
-     */
-    void writeGraphviz( const std::string & filename ) const
-    {
-        // Create the file.
-        std::ofstream out;
-        out.open( filename );
-        if ( !out.good() ) throw SupplierError( "Could not open file for writing." );
-
-        // Write the graph data.
-        out << "digraph G" << std::endl;
-        out << "{" << std::endl;
-        for ( NodeID nodeID = 0; nodeID < m_nodes.size(); ++nodeID )
-        {
-            // Write the node label.
-            auto &            node = m_nodes[nodeID];
-            std::stringstream info;
-            info << 'N' << nodeID << " = " << static_cast<int>( node.getLabel() ) << " counts: " << node.getLabelCounts().asText();
-            out << "    node" << nodeID << "[shape=box label=\"" << info.str() << "\"]" << std::endl;
-
-            // Write the links to the children.
-            if ( !node.isLeafNode() )
-            {
-                auto splitFeature = node.getSplit().getFeatureID();
-                auto splitValue   = node.getSplit().getFeatureValue();
-                out << "    node" << nodeID << " -> "
-                    << "node" << node.getLeftChild() << " [label=\"F" << static_cast<int>( splitFeature ) << " < " << splitValue << "\"];" << std::endl;
-                out << "    node" << nodeID << " -> "
-                    << "node" << node.getRightChild() << ';' << std::endl;
-            }
+        // Find the best splits of the new leaves, so they can be ranked.
+        while ( !m_growableLeaves.empty() )
+        {
+            auto   leaf  = m_growableLeaves.front();
+            auto & node  = getNode( leaf );
+            auto   split = findBestSplit( node );
+            m_growableLeaves.pop_front();
+            if ( !split.isValid() ) continue;
+            auto gain = ( node.getLabelCounts().template giniImpurity<ImpurityType, SquaredCountType>() - split.getImpurity() ) * node.getLabelCounts().getTotal();
+            m_rankedLeaves.push( RankedLeaf( leaf, split, gain ) );
         }
-        out << "}" << std::endl;
 
-        // Close the file.
-        out.close();
+        // Split the leaf with the largest gain.
+        if ( m_rankedLeaves.empty() ) return;
+        RankedLeaf best = m_rankedLeaves.top();
+        m_rankedLeaves.pop();
+        splitNode( getNode( best.m_nodeID ), best.m_split, [this]( NodeID childID ) { m_growableLeaves.push_back( childID ); } );
     }
 
     /**
-     * Convert this indexed decision tree to a plain, un-indexed decision tree classifier.
+     * Convert this indexed decision tree to a plain, un-indexed decision tree
+     * classifier. N.B. this releases the nodes of the tree, so it can only be
+     * done once, after everything else.
      */
     typename DecisionTreeClassifier<FeatureType>::SharedPointer getDecisionTree()
     {
-        // Create an empty classifier.
-        typedef DecisionTreeClassifier<FeatureType> ClassifierType;
-        typename ClassifierType::SharedPointer      classifier( new ClassifierType( getClassCount(), m_featureCount ) );
-
-        // Create data structures that directly mirror the internal table-representation used by the classifier.
-        NodeID nodeCount             = m_nodes.size();
-        classifier->m_leftChildID    = Table<NodeID>( nodeCount, 1, 0 );
-        classifier->m_rightChildID   = Table<NodeID>( nodeCount, 1, 0 );
-        classifier->m_splitFeatureID = Table<FeatureID>( nodeCount, 1, 0 );
-        classifier->m_splitValue     = Table<FeatureType>( nodeCount, 1, 0 );
-        classifier->m_label          = Table<Label>( nodeCount, 1, 0 );
-
-        // Copy the tree data to the tables.
-        for ( NodeID nodeID = 0; nodeID < nodeCount; ++nodeID )
-        {
-            auto & node                               = m_nodes[nodeID];
-            auto & split                              = node.getSplit();
-            classifier->m_leftChildID( nodeID, 0 )    = node.getLeftChild();
-            classifier->m_rightChildID( nodeID, 0 )   = node.getRightChild();
-            classifier->m_splitFeatureID( nodeID, 0 ) = split.getFeatureID();
-            classifier->m_splitValue( nodeID, 0 )     = split.getFeatureValue();
-            classifier->m_label( nodeID, 0 )          = node.getLabel();
-        }
+        // Create the classifier.
+        auto classifier = this->createDecisionTree( getClassCount(), m_featureCount );
+
+        // Release the nodes and label counts in bulk. They are no longer needed.
+        m_nodes.reset( 1 );
+        m_labelCounts.reset( classifier->getClassCount() );
+        m_goesLeft = std::vector<uint8_t>();
 
         // Return the result.
         return classifier;
@@ -214,15 +349,32 @@ public:
 
 private:
 
+    // The base class accesses the nodes.
+    friend class GrowableTree<IndexedDecisionTree, FeatureType>;
+
     /**
      * A floating-point type used to calculate the information gain of splits.
      */
-    typedef FeatureType ImpurityType;
+    typedef ImpurityTypeOf<FeatureType> ImpurityType;
 
     /**
-     * A list of points and labels, sorted by one particular feature.
+     * Integer types for the squared label counts of splits, and for the label
+     * counts of the nodes, that are wide enough for the number of points.
      */
-    typedef std::vector<FeatureIndexEntry> SingleFeatureIndex;
+    typedef SquaredCountTypeOf<PointIDType> SquaredCountType;
+    typedef LabelCountView<PointIDType>     NodeLabelCounts;
+
+    /**
+     * The minimum number of points in a node for which scanning and
+     * partitioning its features concurrently pays off. The features of smaller
+     * nodes are processed sequentially.
+     */
+    static constexpr std::size_t PARALLEL_FEATURE_THRESHOLD = 4096;
+
+    /**
+     * The maximum number of distinct labels.
+     */
+    static constexpr std::size_t MAX_CLASS_COUNT = std::numeric_limits<Label>::max() + 1;
 
     /**
      * The combination of a Split (i.e. the separation of a set of points along one feature axis) and the label frequency tables
@@ -239,7 +391,7 @@ private:
         SplitCandidate():
         m_leftCounts( 0 ),
         m_rightCounts( 0 ),
-        m_impurity( std::numeric_limits<FeatureType>::max() )
+        m_impurity( std::numeric_limits<ImpurityType>::max() )
         {
         }
 
@@ -255,12 +407,7 @@ private:
         m_rightCounts( rightCounts )
         {
             // Calculate the post-split impurity.
-            auto leftCount     = leftCounts.getTotal();
-            auto rightCount    = rightCounts.getTotal();
-            auto totalCount    = leftCount + rightCount;
-            auto leftImpurity  = leftCounts.giniImpurity<ImpurityType>();
-            auto rightImpurity = rightCounts.giniImpurity<ImpurityType>();
-            m_impurity         = ( leftImpurity * leftCount + rightImpurity * rightCount ) / totalCount;
+            m_impurity = splitGiniImpurity<ImpurityType, SquaredCountType>( leftCounts.template getSquaredCountSum<SquaredCountType>(), leftCounts.getTotal(), rightCounts.template getSquaredCountSum<SquaredCountType>(), rightCounts.getTotal() );
         }
 
         /**
@@ -300,23 +447,72 @@ private:
     };
 
     /**
-     * Internal representation of a node in the decision tree.
+     * A leaf and its best split, ranked by the gain of the split: the
+     * decrease of the impurity, weighted by the number of points in the leaf.
+     */
+    class RankedLeaf
+    {
+    public:
+
+        RankedLeaf( NodeID nodeID, const SplitCandidate & split, ImpurityType gain ):
+        m_nodeID( nodeID ),
+        m_split( split ),
+        m_gain( gain )
+        {
+        }
+
+        /**
+         * Orders the leaves by gain, and by descending node ID for equal
+         * gains, so a priority queue yields the oldest of the best leaves.
+         */
+        bool operator<( const RankedLeaf & other ) const
+        {
+            if ( m_gain != other.m_gain ) return m_gain < other.m_gain;
+            return m_nodeID > other.m_nodeID;
+        }
+
+        NodeID         m_nodeID;
+        SplitCandidate m_split;
+        ImpurityType   m_gain;
+    };
+
+    /**
+     * Internal representation of a node in the decision tree. The label
+     * counts of the node are stored in the label count arena of the tree.
      */
     class Node
     {
     public:
 
+        /**
+         * Constructs an empty node (for the node arena).
+         */
+        Node():
+        m_leftChild( 0 ),
+        m_rightChild( 0 ),
+        m_indexOffset( 0 ),
+        m_pointCount( 0 ),
+        m_distanceToRoot( 0 ),
+        m_seed( 0 ),
+        m_label( 0 )
+        {
+        }
+
         /**
          * Constructor.
          * \param labelCounts The absolute counts of the points in this node, per label value.
          * \param indexOffset The offset in the sorted feature index tables at which the data of this node can be found.
+         * \param pointCount The number of (distinct) points of this node in the sorted feature index tables.
          * \param distanceToRoot The number of hops to this node from the root node of the tree.
+         * \param seed The seed of the random selection of features to consider when splitting this node.
          */
-        Node( const LabelFrequencyTable & labelCounts, std::size_t indexOffset, unsigned int distanceToRoot ):
+        Node( const NodeLabelCounts & labelCounts, std::size_t indexOffset, std::size_t pointCount, unsigned int distanceToRoot, uint64_t seed ):
         m_leftChild( 0 ),
         m_rightChild( 0 ),
         m_indexOffset( indexOffset ),
+        m_pointCount( pointCount ),
         m_distanceToRoot( distanceToRoot ),
+        m_seed( seed ),
         m_labelCounts( labelCounts ),
         m_label( m_labelCounts.getMostFrequentLabel() )
         {
@@ -360,17 +556,19 @@ private:
         }
 
         /**
-         * Returns the total number of points in the node.
+         * Returns the number of (distinct) points of the node in the feature
+         * indices. Unlike the total of the label counts, this does not count
+         * the multiplicity of sampled points.
          */
         std::size_t getPointCount() const
         {
-            return m_labelCounts.getTotal();
+            return m_pointCount;
         }
 
         /**
-         * Returns the table of absolute counts of each label within this node.
+         * Returns the absolute counts of each label within this node.
          */
-        const LabelFrequencyTable & getLabelCounts() const
+        const NodeLabelCounts & getLabelCounts() const
         {
             return m_labelCounts;
         }
@@ -383,6 +581,22 @@ private:
             return m_distanceToRoot;
         }
 
+        /**
+         * Returns the seed of the random selection of features to consider when splitting this node.
+         */
+        uint64_t getSeed() const
+        {
+            return m_seed;
+        }
+
+        /**
+         * Replace the seed of the node.
+         */
+        void setSeed( uint64_t seed )
+        {
+            m_seed = seed;
+        }
+
         /**
          * Returns the node ID of the left child of this node, or 0 for leaf nodes.
          */
@@ -407,6 +621,14 @@ private:
             return m_split;
         }
 
+        /**
+         * Returns a description of the points in the node, for the Graphviz output.
+         */
+        std::string getSummary() const
+        {
+            return "counts: " + m_labelCounts.asText();
+        }
+
         /**
          * Returns a text representation of the node, for debugging purposes.
          */
@@ -423,112 +645,202 @@ private:
         NodeID              m_leftChild;
         NodeID              m_rightChild;
         std::size_t         m_indexOffset;
+        std::size_t         m_pointCount;
         Split<FeatureType>  m_split;
         unsigned int        m_distanceToRoot;
-        LabelFrequencyTable m_labelCounts;
+        uint64_t            m_seed;
+        NodeLabelCounts     m_labelCounts;
         Label               m_label;
     };
 
+    typedef typename FeatureIndex<FeatureType, PointIDType>::PartitionBuffer PartitionBuffer;
+
     /**
-     * An entry in the internal feature index.
+     * A set of reusable buffers for partitioning the feature index. The set
+     * is shared by a sapling and its copies, so at most one buffer is
+     * allocated per concurrent partitioning, rather than per tree or per
+     * split.
      */
-    class FeatureIndexEntry
+    class PartitionBufferPool
     {
     public:
 
-        FeatureIndexEntry( FeatureType featureValue, DataPointID pointID, Label label ):
-        m_featureValue( featureValue ),
-        m_pointID( pointID ),
-        m_label( label )
+        /**
+         * Take a buffer from the pool, or create one if none is available.
+         */
+        std::unique_ptr<PartitionBuffer> acquire()
         {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( m_buffers.empty() ) return std::make_unique<PartitionBuffer>();
+            auto buffer = std::move( m_buffers.back() );
+            m_buffers.pop_back();
+            return buffer;
         }
 
-        bool operator<( const FeatureIndexEntry & other ) const
+        /**
+         * Return a buffer to the pool.
+         */
+        void release( std::unique_ptr<PartitionBuffer> buffer )
         {
-            // Entries are to be ordered by feature value only.
-            return m_featureValue < other.m_featureValue;
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_buffers.push_back( std::move( buffer ) );
         }
 
-        FeatureType m_featureValue;
-        DataPointID m_pointID;
-        Label       m_label;
+    private:
+
+        std::mutex                                    m_mutex;
+        std::vector<std::unique_ptr<PartitionBuffer>> m_buffers;
     };
 
     /**
-     * Apply the specified split to the node.
+     * The state of a tree that is grown concurrently (see growConcurrently()).
+     */
+    class ConcurrentGrowth
+    {
+    public:
+
+        ConcurrentGrowth( std::function<void()> onGrown, std::size_t pendingLeafCount ):
+        m_onGrown( onGrown ),
+        m_pendingLeafCount( pendingLeafCount )
+        {
+        }
+
+        std::function<void()>    m_onGrown;
+        std::atomic<std::size_t> m_pendingLeafCount; // Leaves that have been submitted, but not grown yet.
+        std::mutex               m_nodeMutex;        // Protects the node table (not the nodes themselves).
+    };
+
+    /**
+     * Add a node to the tree, with a copy of the specified label counts.
+     * \param labelCounts The label counts (a LabelFrequencyTable or a LabelCountView).
+     * \return The new node, which keeps its address while other nodes are added.
+     */
+    template <typename LabelCounts>
+    Node & addNode( const LabelCounts & labelCounts, std::size_t indexOffset, std::size_t pointCount, unsigned int distanceToRoot, uint64_t seed )
+    {
+        const std::size_t classCount = getClassCount();
+        auto              counts     = m_labelCounts.allocate();
+        for ( std::size_t label = 0; label < classCount; ++label ) counts[label] = static_cast<typename NodeLabelCounts::CountType>( labelCounts.getCount( label ) );
+        Node & node = *m_nodes.allocate();
+        node        = Node( NodeLabelCounts( counts, classCount, labelCounts.getTotal() ), indexOffset, pointCount, distanceToRoot, seed );
+        return node;
+    }
+
+    /**
+     * Returns a node by ID.
+     */
+    Node & getNode( NodeID nodeID )
+    {
+        return *m_nodes[nodeID];
+    }
+
+    /**
+     * Returns a node by ID.
+     */
+    const Node & getNode( NodeID nodeID ) const
+    {
+        return *m_nodes[nodeID];
+    }
+
+    /**
+     * Apply the specified split to the node, and pass the IDs of the children
+     * that are growable to a function.
      * \pre The node must be a leaf node.
      */
-    void splitNode( NodeID nodeID, const SplitCandidate & splitCandidate )
+    template <typename GrowableChildFunction>
+    void splitNode( Node & node, const SplitCandidate & splitCandidate, GrowableChildFunction && onGrowableChild )
     {
         // Check the precondition.
-        Node & node = m_nodes[nodeID];
         assert( node.isLeafNode() );
 
-        // Split the feature index.
-        std::size_t leftPointCount = splitCandidate.getLeftCounts().getTotal();
-        assert( node.isLeafNode() );
-        for ( FeatureID featureID = 0; featureID < m_featureIndex.size(); ++featureID )
+        // Mark the points that go to the left child. The index of the split
+        // feature is sorted, so these are the first points of the node in it.
+        // Points of other nodes may be marked at the same time, so every
+        // point has its own flag.
+        auto        splitFeature   = splitCandidate.getSplit().getFeatureID();
+        auto        splitValues    = m_featureIndex.getValues( splitFeature ) + node.getIndexOffset();
+        auto        splitPointIDs  = m_featureIndex.getPointIDs( splitFeature ) + node.getIndexOffset();
+        std::size_t leftPointCount = std::lower_bound( splitValues, splitValues + node.getPointCount(), splitCandidate.getSplit().getFeatureValue() ) - splitValues;
+        assert( m_featureIndex.getWeights() || leftPointCount == splitCandidate.getLeftCounts().getTotal() );
+        if ( m_goesLeft.empty() ) m_goesLeft.resize( m_pointCount, 0 );
+        for ( std::size_t i = 0; i < leftPointCount; ++i ) m_goesLeft[splitPointIDs[i]] = 1;
+
+        // Split the feature index. For other features than the one on which
+        // the split is performed, partition the points in the index along the
+        // split edge, but keep them sorted. The features of large nodes are
+        // partitioned concurrently, each with its own buffer.
+        auto predicate = [this]( PointIDType pointID ) -> bool
         {
-            // No work is necessary for the feature on which the split is performed.
-            auto splitFeature = splitCandidate.getSplit().getFeatureID();
-            auto splitValue   = splitCandidate.getSplit().getFeatureValue();
-            if ( featureID == splitFeature ) continue;
-
-            // For other features, partition the points in the index along the split edge, but keep them sorted.
-            auto nodeDataStart = m_featureIndex[featureID].begin() + node.getIndexOffset();
-            auto nodeDataEnd   = nodeDataStart + node.getPointCount();
-            auto predicate     = [this, splitFeature, splitValue]( const auto & entry ) -> bool
-            {
-                return this->m_dataPoints[entry.m_pointID * this->m_featureCount + splitFeature] < splitValue;
-            };
-
-            auto secondNodeData = std::stable_partition( nodeDataStart, nodeDataEnd, predicate );
-            assert( secondNodeData != nodeDataStart );
+            return this->m_goesLeft[pointID];
+        };
+        auto partitionFeature = [&]( FeatureID featureID, PartitionBuffer & buffer )
+        {
+            if ( featureID == splitFeature ) return;
+            auto newLeftPointCount = m_featureIndex.stablePartition( featureID, node.getIndexOffset(), node.getPointCount(), predicate, buffer );
 
             // Make sure the point count is consistent with what is in the split candidate.
-            auto distance = std::distance( nodeDataStart, secondNodeData );
-            assert( distance > 0 );
-            auto newLeftPointCount = static_cast<std::size_t>( distance );
             assert( newLeftPointCount == leftPointCount );
+            ( void ) newLeftPointCount;
+        };
+        if ( m_workerPool && node.getPointCount() >= PARALLEL_FEATURE_THRESHOLD )
+        {
+            m_workerPool->parallelFor( m_featureCount, [&]( std::size_t featureID )
+                {
+                    auto buffer = m_partitionBuffers->acquire();
+                    partitionFeature( featureID, *buffer );
+                    m_partitionBuffers->release( std::move( buffer ) );
+                } );
+        }
+        else
+        {
+            auto buffer = m_partitionBuffers->acquire();
+            for ( FeatureID featureID = 0; featureID < m_featureCount; ++featureID ) partitionFeature( featureID, *buffer );
+            m_partitionBuffers->release( std::move( buffer ) );
         }
-        assert( node.isLeafNode() );
 
-        // Create the child nodes before adding them to the node table, because that will invalidate the 'node' reference.
-        NodeID leftChildID  = m_nodes.size();
-        NodeID rightChildID = leftChildID + 1;
-        assert( leftPointCount );
-        Node leftChild  = Node( splitCandidate.getLeftCounts(), node.getIndexOffset(), node.getDistanceToRoot() + 1 );
-        Node rightChild = Node( splitCandidate.getRightCounts(), node.getIndexOffset() + splitCandidate.getLeftCounts().getTotal(), node.getDistanceToRoot() + 1 );
-        node.setSplit( splitCandidate.getSplit(), leftChildID, rightChildID );
+        // Clear the marks, so the flags can be reused for the next split.
+        for ( std::size_t i = 0; i < leftPointCount; ++i ) m_goesLeft[splitPointIDs[i]] = 0;
 
-        // Put the created child nodes in the list.
-        m_nodes.push_back( leftChild );
-        m_nodes.push_back( rightChild );
+        // Create the child nodes. Each child gets its own seed, derived from
+        // the seed of this node. Other leaves may be split concurrently, so
+        // the nodes are allocated under the lock in that case.
+        assert( leftPointCount );
+        NodeID leftChildID = 0;
+        Node * leftChild   = nullptr;
+        Node * rightChild  = nullptr;
+        {
+            std::unique_lock<std::mutex> lock;
+            if ( m_concurrentGrowth ) lock = std::unique_lock<std::mutex>( m_concurrentGrowth->m_nodeMutex );
+            leftChildID = m_nodes.size();
+            leftChild   = &addNode( splitCandidate.getLeftCounts(), node.getIndexOffset(), leftPointCount, node.getDistanceToRoot() + 1, deriveSeed( node.getSeed(), 0 ) );
+            rightChild  = &addNode( splitCandidate.getRightCounts(), node.getIndexOffset() + leftPointCount, node.getPointCount() - leftPointCount, node.getDistanceToRoot() + 1, deriveSeed( node.getSeed(), 1 ) );
+        }
+        node.setSplit( splitCandidate.getSplit(), leftChildID, leftChildID + 1 );
 
-        // Add the children to the list of growable nodes, if applicable.
-        if ( isGrowableNode( leftChildID ) ) m_growableLeaves.push_back( leftChildID );
-        if ( isGrowableNode( rightChildID ) ) m_growableLeaves.push_back( rightChildID );
+        // Report the children that are growable.
+        if ( isGrowableNode( *leftChild ) ) onGrowableChild( leftChildID );
+        if ( isGrowableNode( *rightChild ) ) onGrowableChild( leftChildID + 1 );
     }
 
     /**
      * Find the best possible split for the specified leaf node, taking randomly
      * selected features into account.
      */
-    SplitCandidate findBestSplit( NodeID node )
+    SplitCandidate findBestSplit( const Node & node ) const
     {
         // Check precondition.
         assert( m_featuresToConsider <= m_featureCount );
 
-        // Randomly scan the required number of features.
-        SplitCandidate bestSplit;
-        assert( bestSplit.getImpurity() > m_nodes[node].getLabelCounts().template giniImpurity<ImpurityType>() );
-        auto                   featuresToScan = m_featuresToConsider;
+        // Randomly select the required number of features, using the seed of the node.
+        WeightedCoin<SplitMix64> coin( node.getSeed() );
+        auto                     featuresToScan = m_featuresToConsider;
+        std::vector<FeatureID> selectedFeatures;
         std::vector<FeatureID> skippedFeatures;
         for ( FeatureID featureID = 0; featureID < m_featureCount; ++featureID )
         {
             // Decide whether or not to consider this feature.
             auto featuresLeft        = m_featureCount - featureID;
-            bool considerThisFeature = m_coin.flip( featuresToScan, featuresLeft );
+            bool considerThisFeature = coin.flip( featuresToScan, featuresLeft );
             if ( !considerThisFeature )
             {
                 skippedFeatures.push_back( featureID );
@@ -538,27 +850,71 @@ private:
             // Use up one 'credit'.
             assert( featuresToScan > 0 );
             --featuresToScan;
-
-            // Scan the feature for a split that is better than what was already found.
-            bestSplit = findBestSplitForFeature( m_nodes[node], featureID, bestSplit );
+            selectedFeatures.push_back( featureID );
         }
         assert( skippedFeatures.size() == m_featureCount - m_featuresToConsider );
 
-        // If a valid split has been found, return it.
+        // Scan the selected features for the best split. If a valid split has been found, return it.
+        SplitCandidate bestSplit = findBestSplitForFeatures( node, selectedFeatures, false );
         if ( bestSplit.isValid() ) return bestSplit;
 
-        // Since no valid split was found, scan all features that were initially skipped.
-        for ( auto featureID : skippedFeatures )
+        // Since no valid split was found, scan all features that were
+        // initially skipped, and return the first candidate split. If there
+        // is none, all points in this node must have exactly the same feature
+        // values, which means this node cannot be split. It is possible that
+        // different points in this node have different labels. The most
+        // prevalent label will be assumed in that case.
+        return findBestSplitForFeatures( node, skippedFeatures, true );
+    }
+
+    /**
+     * Find the best split for a particular node along any of the specified features.
+     * \param node The node that will be examined.
+     * \param features The features that will be examined, in order.
+     * \param stopAtFirstValid If true, the best split along the first feature that has a valid split is returned, and
+     *  subsequent features are ignored.
+     * \return The best split, or an invalid split if none of the features admits a valid split. Ties are resolved in
+     *  favor of the feature that comes first.
+     */
+    SplitCandidate findBestSplitForFeatures( const Node & node, const std::vector<FeatureID> & features, bool stopAtFirstValid ) const
+    {
+        // Scan the features one by one if there is no worker pool, or if the node is too small to benefit from one.
+        SplitCandidate bestSplit;
+        if ( !m_workerPool || node.getPointCount() < PARALLEL_FEATURE_THRESHOLD )
+        {
+            for ( auto featureID : features )
+            {
+                bestSplit = findBestSplitForFeature( node, featureID, bestSplit );
+                if ( stopAtFirstValid && bestSplit.isValid() ) break;
+            }
+            return bestSplit;
+        }
+
+        // Scan the features concurrently, in chunks. When all features must
+        // be scanned, this is done in one chunk. When only the first valid
+        // split is needed, the chunks are only as large as the pool, so no
+        // more features are scanned than necessary to keep all threads busy.
+        std::size_t chunkSize = stopAtFirstValid ? m_workerPool->getThreadCount() + 1 : features.size();
+        for ( std::size_t chunkStart = 0; chunkStart < features.size(); chunkStart += chunkSize )
         {
-            // Return the first candidate split.
-            bestSplit = findBestSplitForFeature( m_nodes[node], featureID, bestSplit );
-            if ( bestSplit.isValid() ) return bestSplit;
+            // Find the best split for each feature in the chunk independently.
+            std::size_t                 chunkEnd = std::min( chunkStart + chunkSize, features.size() );
+            std::vector<SplitCandidate> featureSplits( chunkEnd - chunkStart );
+            m_workerPool->parallelFor( featureSplits.size(), [&]( std::size_t i )
+                {
+                    featureSplits[i] = findBestSplitForFeature( node, features[chunkStart + i], SplitCandidate() );
+                } );
+
+            // Reduce the results in feature order. Only strict improvements
+            // are accepted, so the outcome is identical to that of a
+            // sequential scan.
+            for ( auto & featureSplit : featureSplits )
+            {
+                if ( featureSplit.getImpurity() < bestSplit.getImpurity() ) bestSplit = featureSplit;
+                if ( stopAtFirstValid && bestSplit.isValid() ) return bestSplit;
+            }
         }
 
-        // All points in this node must have exactly the same feature values,
-        // which means this node cannot be split. It is possible that different
-        // points in this node have different labels. The most prevalent label
-        // will be assumed in that case.
         return bestSplit;
     }
 
@@ -570,85 +926,171 @@ private:
      */
     SplitCandidate findBestSplitForFeature( const Node & node, FeatureID featureID, const SplitCandidate & minimalBestSplit ) const
     {
-        // Find the region of the index that covers this node and feature.
-        auto begin = m_featureIndex[featureID].begin() + node.getIndexOffset();
-        auto end   = begin + node.getPointCount();
-        assert( begin != end );
+        // Only look up the weights of the points if some points are weighted.
+        if ( m_featureIndex.getWeights() ) return scanFeature<true>( node, featureID, minimalBestSplit );
+        return scanFeature<false>( node, featureID, minimalBestSplit );
+    }
 
-        // Search for a better split than the supplied minimal best split.
-        auto                bestSplit         = minimalBestSplit;
-        FeatureType         currentBlockValue = begin->m_featureValue;
-        LabelFrequencyTable leftSideLabelCounts( node.getLabelCounts().size() );
-        LabelFrequencyTable rightSideLabelCounts( node.getLabelCounts() );
+    /**
+     * Implements findBestSplitForFeature().
+     * \tparam WEIGHTED True iff the feature index has weighted points.
+     */
+    template <bool WEIGHTED>
+    SplitCandidate scanFeature( const Node & node, FeatureID featureID, const SplitCandidate & minimalBestSplit ) const
+    {
+        // Find the region of the index that covers this node and feature.
+        auto values     = m_featureIndex.getValues( featureID ) + node.getIndexOffset();
+        auto pointIDs   = m_featureIndex.getPointIDs( featureID ) + node.getIndexOffset();
+        auto labels     = m_featureIndex.getLabels();
+        auto weights    = m_featureIndex.getWeights();
+        auto pointCount = node.getPointCount();
+        assert( pointCount > 0 );
+
+        // Keep running label counts, and running sums of the squared label
+        // counts, of both sides. This allows calculating the impurity of each
+        // possible split in constant time, without allocating anything. Points
+        // that occur multiple times in a sample are counted with their weight.
+        const auto &                             nodeCounts = node.getLabelCounts();
+        const std::size_t                        nodeTotal  = nodeCounts.getTotal();
+        const std::size_t                        classCount = nodeCounts.size();
+        std::array<std::size_t, MAX_CLASS_COUNT> leftCounts;
+        std::array<std::size_t, MAX_CLASS_COUNT> rightCounts;
+        std::array<std::size_t, MAX_CLASS_COUNT> bestLeftCounts;
+        std::size_t                              leftTotal          = 0;
+        SquaredCountType                         leftSquaredCounts  = 0;
+        SquaredCountType                         rightSquaredCounts = nodeCounts.template getSquaredCountSum<SquaredCountType>();
+        for ( std::size_t label = 0; label < classCount; ++label )
+        {
+            leftCounts[label]  = 0;
+            rightCounts[label] = nodeCounts.getCount( label );
+        }
 
-        assert( leftSideLabelCounts.invariant() );
-        assert( rightSideLabelCounts.invariant() );
-        for ( auto it( begin ); it != end; ++it )
+        // Search for a better split than the supplied minimal best split,
+        // that leaves enough points on both sides.
+        const std::size_t minimumLeafTotal  = m_minimumLeafPointCount;
+        ImpurityType      bestImpurity      = minimalBestSplit.getImpurity();
+        FeatureType       bestValue         = 0;
+        FeatureType       currentBlockValue = values[0];
+        for ( std::size_t i = 0; i < pointCount; ++i )
         {
             // If this is the end of a block of equal-valued points, test if this split would be an improvement over the current best.
-            if ( it->m_featureValue > currentBlockValue )
+            if ( values[i] > currentBlockValue && leftTotal >= minimumLeafTotal && nodeTotal - leftTotal >= minimumLeafTotal )
             {
-                SplitCandidate possibleSplit( Split( featureID, it->m_featureValue ), leftSideLabelCounts, rightSideLabelCounts );
-                if ( possibleSplit.getImpurity() < bestSplit.getImpurity() )
+                auto impurity = splitGiniImpurity<ImpurityType, SquaredCountType>( leftSquaredCounts, leftTotal, rightSquaredCounts, nodeTotal - leftTotal );
+                if ( impurity < bestImpurity )
                 {
-                    bestSplit = possibleSplit;
+                    bestImpurity = impurity;
+                    bestValue    = values[i];
+                    std::copy( leftCounts.begin(), leftCounts.begin() + classCount, bestLeftCounts.begin() );
                 }
             }
 
             // Move the current block value to the value of the currently visited point.
-            currentBlockValue = it->m_featureValue;
+            currentBlockValue = values[i];
 
             // Update the left- and right-hand label counts as the point is visited.
-            leftSideLabelCounts.increment( it->m_label );
-            rightSideLabelCounts.decrement( it->m_label );
+            auto        label  = labels[pointIDs[i]];
+            std::size_t weight = WEIGHTED ? weights[pointIDs[i]] : 1;
+            leftSquaredCounts += SquaredCountType( weight ) * ( 2 * leftCounts[label] + weight );
+            rightSquaredCounts -= SquaredCountType( weight ) * ( 2 * rightCounts[label] - weight );
+            leftCounts[label] += weight;
+            rightCounts[label] -= weight;
+            leftTotal += weight;
         }
 
-        return bestSplit;
+        // Return the supplied split if nothing better was found.
+        if ( !( bestImpurity < minimalBestSplit.getImpurity() ) ) return minimalBestSplit;
+
+        // Only create the label frequency tables of the best split.
+        LabelFrequencyTable leftSideLabelCounts( classCount );
+        LabelFrequencyTable rightSideLabelCounts( classCount );
+        for ( std::size_t label = 0; label < classCount; ++label )
+        {
+            leftSideLabelCounts.increment( label, bestLeftCounts[label] );
+            rightSideLabelCounts.increment( label, nodeCounts.getCount( label ) - bestLeftCounts[label] );
+        }
+        return SplitCandidate( Split( featureID, bestValue ), leftSideLabelCounts, rightSideLabelCounts );
     }
 
     void growLeaf( NodeID nodeID )
     {
-        assert( m_nodes[nodeID].isLeafNode() );
+        Node & node = getNode( nodeID );
+        assert( node.isLeafNode() );
 
         // Find the best split for the node.
-        SplitCandidate split = findBestSplit( nodeID );
+        SplitCandidate split = findBestSplit( node );
 
-        // Apply the split if one was found (this will also add the created children to the growable list, if appropriate).
-        if ( split.isValid() ) splitNode( nodeID, split );
+        // Apply the split if one was found, and add the created children to the growable list, if appropriate.
+        if ( split.isValid() ) splitNode( node, split, [this]( NodeID childID ) { m_growableLeaves.push_back( childID ); } );
     }
 
     /**
-     * Returns true iff it is still meaningful to grow the specified node.
-     * \pre Node must be a leaf node.
+     * Grow a leaf as a task of the worker pool (see growConcurrently()), and
+     * submit its growable children as new tasks.
      */
-    bool isGrowableNode( NodeID nodeID ) const
+    void growLeafConcurrently( NodeID nodeID )
     {
-        // Find the node and test the precondition.
-        auto & node = m_nodes[nodeID];
-        assert( node.isLeafNode() );
+        // Look up the node. Other leaves may be split at the same time, so the node table is only accessed under the lock.
+        Node * node = nullptr;
+        {
+            std::lock_guard<std::mutex> lock( m_concurrentGrowth->m_nodeMutex );
+            node = &getNode( nodeID );
+        }
+
+        // Find the best split for the node, and apply it if one was found.
+        SplitCandidate split = findBestSplit( *node );
+        if ( split.isValid() )
+        {
+            splitNode( *node, split, [this]( NodeID childID )
+                {
+                    ++m_concurrentGrowth->m_pendingLeafCount;
+                    m_workerPool->submit( [this, childID]() { growLeafConcurrently( childID ); } );
+                } );
+        }
 
-        // Prohibit growth beyond the maximum depth.
-        if ( node.getDistanceToRoot() >= m_maximumDistanceToRoot ) return false;
+        // Report the tree as grown after the last leaf. The tree may be destroyed as soon as that is reported.
+        if ( --m_concurrentGrowth->m_pendingLeafCount > 0 ) return;
+        auto onGrown = std::move( m_concurrentGrowth->m_onGrown );
+        m_concurrentGrowth.reset();
+        onGrown();
+    }
 
-        // Prohibit the growth of nodes that are already pure enough.
-        if ( node.getLabelCounts().template giniImpurity<ImpurityType>() <= m_impurityThreshold ) return false;
+    /**
+     * Returns true iff the number of nodes is limited (see setGrowthLimits()).
+     */
+    bool hasNodeBudget() const
+    {
+        return m_maximumNodeCount != std::numeric_limits<std::size_t>::max();
+    }
 
-        // If there are no further objections, the node is growable.
-        return true;
+    /**
+     * Returns true iff it is still meaningful to grow the specified node.
+     * \pre Node must be a leaf node.
+     */
+    bool isGrowableNode( const Node & node ) const
+    {
+        assert( node.isLeafNode() );
+        return this->template isGrowableLeaf<ImpurityType, SquaredCountType>( node.getLabelCounts(), node.getDistanceToRoot(), m_maximumDistanceToRoot, m_impurityThreshold, m_minimumLeafPointCount );
     }
 
 private:
 
-    FeatureIterator                 m_dataPoints;
-    unsigned int                    m_pointCount;
-    unsigned int                    m_featureCount;
-    std::deque<NodeID>              m_growableLeaves;
-    std::vector<Node>               m_nodes;
-    std::vector<SingleFeatureIndex> m_featureIndex;
-    WeightedCoinType                m_coin;
-    std::size_t                     m_featuresToConsider;
-    unsigned int                    m_maximumDistanceToRoot;
-    ImpurityType                    m_impurityThreshold;
+    std::size_t                                         m_pointCount;
+    unsigned int                                        m_featureCount;
+    FeatureIndex<FeatureType, PointIDType>              m_featureIndex;
+    std::shared_ptr<PartitionBufferPool>                m_partitionBuffers;
+    std::vector<uint8_t>                                m_goesLeft;
+    std::deque<NodeID>                                  m_growableLeaves;
+    std::priority_queue<RankedLeaf>                     m_rankedLeaves;
+    SlotArena<Node>                                     m_nodes;
+    SlotArena<typename NodeLabelCounts::CountType>      m_labelCounts;
+    std::shared_ptr<ConcurrentGrowth>                   m_concurrentGrowth;
+    WorkerPool::SharedPointer                           m_workerPool;
+    std::size_t                                         m_featuresToConsider;
+    unsigned int                                        m_maximumDistanceToRoot;
+    std::size_t                                         m_maximumNodeCount;
+    std::size_t                                         m_minimumLeafPointCount;
+    ImpurityType                                        m_impurityThreshold;
 };
 
 } // namespace balsa
@@ -0,0 +1,95 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include "exceptions.h"
+#include "memorymapping.h"
+
+namespace balsa
+{
+
+MappedFile::MappedFile( const std::string & filename ):
+m_address( nullptr ),
+m_size( 0 )
+{
+    // Open the file, and determine its size.
+    int fileDescriptor = open( filename.c_str(), O_RDONLY );
+    if ( fileDescriptor < 0 ) throw SupplierError( "Could not open file: " + filename );
+    struct stat status;
+    if ( fstat( fileDescriptor, &status ) != 0 )
+    {
+        close( fileDescriptor );
+        throw SupplierError( "Could not determine the size of file: " + filename );
+    }
+    m_size = status.st_size;
+
+    // Map the file. The mapping remains valid after the file is closed.
+    if ( m_size > 0 ) m_address = mmap( nullptr, m_size, PROT_READ, MAP_SHARED, fileDescriptor, 0 );
+    close( fileDescriptor );
+    if ( m_address == MAP_FAILED ) throw SupplierError( "Could not map file into memory: " + filename );
+}
+
+MappedFile::~MappedFile()
+{
+    if ( m_address ) munmap( m_address, m_size );
+}
+
+uint64_t hashFileContents( const std::string & filename )
+{
+    // Mix the file size and each 64-bit word of the contents into the hash, and pad the last word with zeros.
+    const uint64_t MULTIPLIER = 0x9e3779b97f4a7c15;
+    MappedFile     file( filename );
+    uint64_t       hash = file.getSize() * MULTIPLIER;
+    auto           mix  = [&]( uint64_t word )
+    {
+        hash = ( hash ^ word ) * MULTIPLIER;
+        hash ^= hash >> 29;
+    };
+    std::size_t wordCount = file.getSize() / sizeof( uint64_t );
+    for ( std::size_t i = 0; i < wordCount; ++i )
+    {
+        uint64_t word;
+        std::memcpy( &word, file.getData() + i * sizeof( uint64_t ), sizeof( word ) );
+        mix( word );
+    }
+    if ( std::size_t remainder = file.getSize() % sizeof( uint64_t ) )
+    {
+        uint64_t lastWord = 0;
+        std::memcpy( &lastWord, file.getData() + wordCount * sizeof( uint64_t ), remainder );
+        mix( lastWord );
+    }
+    return hash;
+}
+
+void * allocateScratchMemory( const std::string & directory, std::size_t size )
+{
+    // Create a file with a unique name, and unlink it right away, so it is deleted when it is no longer mapped.
+    std::string       pattern = directory + "/balsa-scratch-XXXXXX";
+    std::vector<char> filename( pattern.begin(), pattern.end() );
+    filename.push_back( '\0' );
+    int fileDescriptor = mkstemp( filename.data() );
+    if ( fileDescriptor < 0 ) throw SupplierError( "Could not create a scratch file in directory: " + directory );
+    unlink( filename.data() );
+
+    // Reserve space for the block, and map it.
+    if ( ftruncate( fileDescriptor, size ) != 0 )
+    {
+        close( fileDescriptor );
+        throw SupplierError( "Could not resize a scratch file in directory: " + directory );
+    }
+    void * address = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0 );
+    close( fileDescriptor );
+    if ( address == MAP_FAILED ) throw SupplierError( "Could not map a scratch file into memory." );
+    return address;
+}
+
+void freeScratchMemory( void * address, std::size_t size )
+{
+    munmap( address, size );
+}
+
+} // namespace balsa
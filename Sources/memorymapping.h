@@ -0,0 +1,152 @@
+#ifndef MEMORYMAPPING_H
+#define MEMORYMAPPING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace balsa
+{
+
+/**
+ * A read-only view of the contents of a file, mapped into memory. The
+ * operating system loads the pages of the file on demand, and it can evict
+ * them again when memory is scarce, so the file may be larger than the
+ * available RAM.
+ */
+class MappedFile
+{
+public:
+
+    /**
+     * Constructor; maps the specified file into memory.
+     */
+    MappedFile( const std::string & filename );
+
+    /**
+     * Copy constructor (deleted). Mapped files cannot be copied.
+     */
+    MappedFile( const MappedFile & ) = delete;
+
+    /**
+     * Destructor; unmaps the file.
+     */
+    ~MappedFile();
+
+    /**
+     * Returns the address of the first byte of the file.
+     */
+    const char * getData() const
+    {
+        return static_cast<const char *>( m_address );
+    }
+
+    /**
+     * Returns the size of the file in bytes.
+     */
+    std::size_t getSize() const
+    {
+        return m_size;
+    }
+
+private:
+
+    void *      m_address;
+    std::size_t m_size;
+};
+
+/**
+ * Returns a 64-bit hash of the contents of a file. The file is read through a
+ * memory mapping. The hash is meant to detect changes to the file, e.g. to
+ * decide whether data derived from the file can be reused. It is not a
+ * cryptographic hash.
+ */
+uint64_t hashFileContents( const std::string & filename );
+
+/**
+ * Allocate a block of memory that is backed by an anonymous (unlinked)
+ * temporary file in the specified directory, rather than by swap space. The
+ * operating system can write the pages of such a block to the file when memory
+ * is scarce.
+ * \param directory The directory in which the temporary file is created.
+ * \param size The size of the block in bytes (must be larger than zero).
+ */
+void * allocateScratchMemory( const std::string & directory, std::size_t size );
+
+/**
+ * Free a block of memory allocated by allocateScratchMemory().
+ */
+void freeScratchMemory( void * address, std::size_t size );
+
+/**
+ * A standard library compatible allocator that allocates large arrays in
+ * scratch files (see allocateScratchMemory()) if a scratch directory is
+ * specified, and on the heap otherwise.
+ */
+template <typename T>
+class ScratchAllocator
+{
+public:
+
+    typedef T value_type;
+
+    /**
+     * Constructor.
+     * \param directory The directory in which scratch files are created. If
+     *  empty (the default), memory is allocated on the heap.
+     */
+    ScratchAllocator( const std::string & directory = std::string() ):
+    m_directory( directory )
+    {
+    }
+
+    /**
+     * Converting constructor.
+     */
+    template <typename U>
+    ScratchAllocator( const ScratchAllocator<U> & other ):
+    m_directory( other.getDirectory() )
+    {
+    }
+
+    T * allocate( std::size_t count )
+    {
+        if ( m_directory.empty() || count == 0 ) return std::allocator<T>().allocate( count );
+        return static_cast<T *>( allocateScratchMemory( m_directory, count * sizeof( T ) ) );
+    }
+
+    void deallocate( T * address, std::size_t count )
+    {
+        if ( m_directory.empty() || count == 0 ) return std::allocator<T>().deallocate( address, count );
+        freeScratchMemory( address, count * sizeof( T ) );
+    }
+
+    /**
+     * Returns the directory in which scratch files are created, or an empty string if memory is allocated on the heap.
+     */
+    const std::string & getDirectory() const
+    {
+        return m_directory;
+    }
+
+    template <typename U>
+    bool operator==( const ScratchAllocator<U> & other ) const
+    {
+        return m_directory == other.getDirectory();
+    }
+
+    template <typename U>
+    bool operator!=( const ScratchAllocator<U> & other ) const
+    {
+        return !( *this == other );
+    }
+
+private:
+
+    std::string m_directory;
+};
+
+} // namespace balsa
+
+#endif // MEMORYMAPPING_H
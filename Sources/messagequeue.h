@@ -1,7 +1,9 @@
 #ifndef MESSAGEQUEUE_H
 #define MESSAGEQUEUE_H
 
+#include <cassert>
 #include <condition_variable>
+#include <limits>
 #include <mutex>
 #include <queue>
 
@@ -9,7 +11,8 @@ namespace balsa
 {
 
 /**
- * A thread-safe queue for distributing messages over threads.
+ * A thread-safe queue for distributing messages over threads. The queue can
+ * be bounded, in which case senders wait while it is full (backpressure).
  */
 template <typename Message>
 class MessageQueue
@@ -17,21 +20,33 @@ class MessageQueue
 public:
 
     /**
-     * Append a message to the back of the queue.
+     * Constructor.
+     * \param capacity The maximum number of messages in the queue (default: unbounded).
+     */
+    explicit MessageQueue( std::size_t capacity = std::numeric_limits<std::size_t>::max() ):
+    m_capacity( capacity )
+    {
+        assert( capacity > 0 );
+    }
+
+    /**
+     * Append a message to the back of the queue. If the queue is full, this
+     * waits until a message has been removed.
      */
     void send( const Message & message )
     {
         // Critical section.
         {
-            // Acquire the mutex on the queue.
-            std::lock_guard<std::mutex> lock( m_mutex );
+            // Acquire the mutex on the queue, and wait for room in the queue.
+            std::unique_lock<std::mutex> lock( m_mutex );
+            while ( m_queue.size() >= m_capacity ) m_notFull.wait( lock );
 
             // Add an item to the queue.
             m_queue.push( message );
         }
 
         // Wake up one waiter to pick up the message.
-        m_condition.notify_one();
+        m_notEmpty.notify_one();
     }
 
     /**
@@ -43,19 +58,22 @@ public:
         std::unique_lock<std::mutex> lock( m_mutex );
 
         // Wait for the queue to contain at least one item.
-        while ( m_queue.empty() ) m_condition.wait( lock );
+        while ( m_queue.empty() ) m_notEmpty.wait( lock );
 
-        // Pop and return the first item.
+        // Pop the first item, and wake up one sender that waits for room in the queue.
         auto message = m_queue.front();
         m_queue.pop();
+        m_notFull.notify_one();
         return message;
     }
 
 private:
 
     std::queue<Message>     m_queue;
+    std::size_t             m_capacity;
     mutable std::mutex      m_mutex;
-    std::condition_variable m_condition;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
 };
 
 } // namespace balsa
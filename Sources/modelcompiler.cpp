@@ -0,0 +1,275 @@
+#include <cctype>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "decisiontreeclassifier.h"
+#include "exceptions.h"
+#include "modelcompiler.h"
+
+namespace balsa
+{
+
+namespace
+{
+
+/**
+ * Returns a C++ literal for a split value, which has the same type and value.
+ * Finite values are written in hexadecimal, so that they are exact.
+ */
+template <typename SplitType>
+std::string getLiteral( SplitType value )
+{
+    std::ostringstream literal;
+    const std::string  typeName = std::is_same<SplitType, float>::value ? "float" : "double";
+    if ( std::isnan( value ) )
+        literal << "std::numeric_limits<" << typeName << ">::quiet_NaN()";
+    else if ( std::isinf( value ) )
+        literal << ( value < 0 ? "-" : "" ) << "std::numeric_limits<" << typeName << ">::infinity()";
+    else
+        literal << std::hexfloat << value << ( std::is_same<SplitType, float>::value ? "f" : "" );
+    return literal.str();
+}
+
+/**
+ * A Visitor that writes the nodes of each visited decision tree as arrays, and
+ * collects the calls that let the trees vote.
+ */
+class TreeCompiler: public ClassifierVisitor
+{
+public:
+
+    TreeCompiler( std::ostream & out, unsigned int featureCount ):
+    m_out( out ),
+    m_featureCount( featureCount ),
+    m_treeCount( 0 )
+    {
+    }
+
+    void visit( const CompiledClassifier & )
+    {
+        throw ClientError( "Compiled classifiers can not be compiled again." );
+    }
+
+    void visit( const EnsembleClassifier & )
+    {
+        throw ClientError( "Nested ensembles can not be compiled." );
+    }
+
+    void visit( const DecisionTreeClassifier<float> & classifier )
+    {
+        compileTree( classifier );
+    }
+
+    void visit( const DecisionTreeClassifier<double> & classifier )
+    {
+        compileTree( classifier );
+    }
+
+    void visit( const DecisionTreeClassifier<uint8_t> & classifier )
+    {
+        compileTree( classifier );
+    }
+
+    void visit( const DecisionTreeClassifier<uint16_t> & classifier )
+    {
+        compileTree( classifier );
+    }
+
+    void visit( const DecisionTreeClassifier<int16_t> & classifier )
+    {
+        compileTree( classifier );
+    }
+
+    /**
+     * Returns the number of trees that have been compiled.
+     */
+    unsigned int getTreeCount() const
+    {
+        return m_treeCount;
+    }
+
+    /**
+     * Returns the statements that let each compiled tree vote.
+     */
+    std::string getVotingCode() const
+    {
+        return m_votes.str();
+    }
+
+private:
+
+    template <typename FeatureType>
+    void compileTree( const DecisionTreeClassifier<FeatureType> & tree )
+    {
+        // Integer split values are exact in single precision, so only double-precision trees keep their split type.
+        typedef std::conditional_t<std::is_same<FeatureType, double>::value, double, float> SplitType;
+        const std::string splitTypeName = std::is_same<SplitType, double>::value ? "double" : "float";
+
+        // Find the depth of the tree, and check its split features.
+        NodeID nodeCount = tree.getNodeCount();
+        if ( nodeCount > NodeID( std::numeric_limits<int32_t>::max() ) ) throw ClientError( "Decision tree too large to compile." );
+        unsigned int                                 depth = 0;
+        std::vector<std::pair<NodeID, unsigned int>> stack( 1, std::make_pair( NodeID( 0 ), 0u ) );
+        while ( !stack.empty() )
+        {
+            auto [nodeID, nodeDepth] = stack.back();
+            stack.pop_back();
+            if ( tree.isLeaf( nodeID ) )
+            {
+                depth = std::max( depth, nodeDepth );
+                continue;
+            }
+            if ( tree.getSplitFeatureID( nodeID ) >= m_featureCount ) throw ClientError( "Invalid decision tree: bad split feature ID." );
+            stack.push_back( std::make_pair( tree.getLeftChildID( nodeID ), nodeDepth + 1 ) );
+            stack.push_back( std::make_pair( tree.getLeftChildID( nodeID ) + 1, nodeDepth + 1 ) );
+        }
+
+        // Write the nodes as arrays. A leaf compares the point to NaN, which sends it to the right child, so its child
+        // is its own ID minus one: the point stays in the leaf.
+        const std::string name = "tree" + std::to_string( m_treeCount );
+        writeArray( "int32_t", name + "Children", nodeCount, [&]( NodeID nodeID ) {
+            return std::to_string( tree.isLeaf( nodeID ) ? int64_t( nodeID ) - 1 : int64_t( tree.getLeftChildID( nodeID ) ) );
+        } );
+        writeArray( "uint16_t", name + "Features", nodeCount, [&]( NodeID nodeID ) {
+            return std::to_string( tree.isLeaf( nodeID ) ? 0 : tree.getSplitFeatureID( nodeID ) );
+        } );
+        writeArray( splitTypeName, name + "Values", nodeCount, [&]( NodeID nodeID ) {
+            return getLiteral<SplitType>( tree.isLeaf( nodeID ) ? std::numeric_limits<SplitType>::quiet_NaN() : SplitType( tree.getSplitValue( nodeID ) ) );
+        } );
+        writeArray( "uint8_t", name + "Labels", nodeCount, [&]( NodeID nodeID ) {
+            return std::to_string( tree.getLabel( nodeID ) );
+        } );
+        m_votes << "    walk<" << depth << ">( " << name << "Children, " << name << "Features, " << name << "Values, " << name << "Labels, points, pointCount, votes );\n";
+        ++m_treeCount;
+    }
+
+    template <typename ValueFunction>
+    void writeArray( const std::string & typeName, const std::string & name, NodeID size, ValueFunction value )
+    {
+        const NodeID VALUES_PER_LINE = 16;
+        m_out << "const " << typeName << " " << name << "[] = {";
+        for ( NodeID nodeID = 0; nodeID < size; ++nodeID )
+        {
+            m_out << ( nodeID % VALUES_PER_LINE ? " " : "\n    " ) << value( nodeID ) << ( nodeID + 1 < size ? "," : "" );
+        }
+        m_out << "\n};\n\n";
+    }
+
+    std::ostream &     m_out;
+    std::ostringstream m_votes;
+    unsigned int       m_featureCount;
+    unsigned int       m_treeCount;
+};
+
+} // namespace
+
+void compileModel( ClassifierInputStream & classifierStream, std::ostream & out, const std::string & symbolPrefix, const std::string & origin )
+{
+    // The prefix becomes part of the function names.
+    for ( char c : symbolPrefix )
+    {
+        if ( !( std::isalnum( static_cast<unsigned char>( c ) ) || c == '_' ) ) throw ClientError( "Invalid symbol prefix: '" + symbolPrefix + "'." );
+    }
+    if ( symbolPrefix.size() && std::isdigit( static_cast<unsigned char>( symbolPrefix[0] ) ) ) throw ClientError( "Invalid symbol prefix: '" + symbolPrefix + "'." );
+
+    // Write the header, and the function that walks the points through a tree.
+    const unsigned int classCount   = classifierStream.getClassCount();
+    const unsigned int featureCount = classifierStream.getFeatureCount();
+    out << "// Generated by balsa_compile" << ( origin.size() ? " from " + origin : std::string() ) << ". Do not edit.\n"
+        << "// Classifies points of " << featureCount << " single-precision features into " << classCount << " classes.\n"
+        << "\n"
+        << "#include <algorithm>\n"
+        << "#include <cstddef>\n"
+        << "#include <cstdint>\n"
+        << "#include <limits>\n"
+        << "#include <vector>\n"
+        << "\n"
+        << "namespace\n"
+        << "{\n"
+        << "\n"
+        << "const unsigned int CLASS_COUNT   = " << classCount << ";\n"
+        << "const unsigned int FEATURE_COUNT = " << featureCount << ";\n"
+        << "\n"
+        << "// Walks groups of points through a tree of the given depth, one level at a time, and adds a vote for the label of the\n"
+        << "// leaf that each point ends up in. A point goes to the right child iff it is not less than the split value.\n"
+        << "template <unsigned int DEPTH, typename SplitType>\n"
+        << "inline void walk( const int32_t * children, const uint16_t * features, const SplitType * values, const uint8_t * labels,\n"
+        << "                  const float * points, std::size_t pointCount, uint32_t * votes )\n"
+        << "{\n"
+        << "    const std::size_t GROUP_SIZE = 16;\n"
+        << "    for ( std::size_t groupStart = 0; groupStart < pointCount; groupStart += GROUP_SIZE )\n"
+        << "    {\n"
+        << "        const std::size_t groupSize = std::min( GROUP_SIZE, pointCount - groupStart );\n"
+        << "        const float *     group     = points + groupStart * FEATURE_COUNT;\n"
+        << "        int32_t           nodes[GROUP_SIZE] = {};\n"
+        << "        for ( unsigned int level = 0; level < DEPTH; ++level )\n"
+        << "        {\n"
+        << "            for ( std::size_t point = 0; point < groupSize; ++point )\n"
+        << "            {\n"
+        << "                const int32_t node = nodes[point];\n"
+        << "                nodes[point]       = children[node] + !( group[point * FEATURE_COUNT + features[node]] < values[node] );\n"
+        << "            }\n"
+        << "        }\n"
+        << "        for ( std::size_t point = 0; point < groupSize; ++point ) ++votes[( groupStart + point ) * CLASS_COUNT + labels[nodes[point]]];\n"
+        << "    }\n"
+        << "}\n"
+        << "\n";
+
+    // Write a function for each tree.
+    TreeCompiler compiler( out, featureCount );
+    classifierStream.rewind();
+    for ( auto classifier = classifierStream.next(); classifier; classifier = classifierStream.next() ) classifier->visit( compiler );
+    const unsigned int treeCount = compiler.getTreeCount();
+    out << "} // namespace\n\n";
+
+    // Write the entry points.
+    out << "extern \"C\" unsigned int " << symbolPrefix << "getClassCount()\n"
+        << "{\n"
+        << "    return CLASS_COUNT;\n"
+        << "}\n"
+        << "\n"
+        << "extern \"C\" unsigned int " << symbolPrefix << "getFeatureCount()\n"
+        << "{\n"
+        << "    return FEATURE_COUNT;\n"
+        << "}\n"
+        << "\n"
+        << "extern \"C\" unsigned int " << symbolPrefix << "getTreeCount()\n"
+        << "{\n"
+        << "    return " << treeCount << ";\n"
+        << "}\n"
+        << "\n"
+        << "extern \"C\" void " << symbolPrefix << "classifyAndVote( const float * points, std::size_t pointCount, uint32_t * votes )\n"
+        << "{\n";
+    if ( treeCount == 0 ) out << "    (void) points;\n    (void) pointCount;\n    (void) votes;\n";
+    out << compiler.getVotingCode();
+    out << "}\n"
+        << "\n"
+        << "extern \"C\" void " << symbolPrefix << "classify( const float * points, std::size_t pointCount, uint8_t * labels )\n"
+        << "{\n"
+        << "    // Count the votes for blocks of points, and label each point with the class that has the most votes (the lowest class in a tie).\n"
+        << "    const std::size_t     BLOCK_SIZE = 1024;\n"
+        << "    std::vector<uint32_t> votes( BLOCK_SIZE * CLASS_COUNT );\n"
+        << "    for ( std::size_t blockStart = 0; blockStart < pointCount; blockStart += BLOCK_SIZE )\n"
+        << "    {\n"
+        << "        const std::size_t blockSize = std::min( BLOCK_SIZE, pointCount - blockStart );\n"
+        << "        std::fill( votes.begin(), votes.end(), 0 );\n"
+        << "        " << symbolPrefix << "classifyAndVote( points + blockStart * FEATURE_COUNT, blockSize, votes.data() );\n"
+        << "        for ( std::size_t point = 0; point < blockSize; ++point )\n"
+        << "        {\n"
+        << "            const uint32_t * pointVotes = votes.data() + point * CLASS_COUNT;\n"
+        << "            unsigned int     label      = 0;\n"
+        << "            for ( unsigned int column = 1; column < CLASS_COUNT; ++column )\n"
+        << "                if ( pointVotes[column] > pointVotes[label] ) label = column;\n"
+        << "            labels[blockStart + point] = static_cast<uint8_t>( label );\n"
+        << "        }\n"
+        << "    }\n"
+        << "}\n";
+}
+
+} // namespace balsa
@@ -0,0 +1,43 @@
+#ifndef MODELCOMPILER_H
+#define MODELCOMPILER_H
+
+#include <ostream>
+#include <string>
+
+#include "classifierstream.h"
+
+namespace balsa
+{
+
+/**
+ * Writes a self-contained C++ translation unit that classifies points with the
+ * decision trees of a classifier stream. The nodes of each tree become
+ * constant arrays, through which the points are walked without branches, in
+ * groups, for a number of steps that is fixed by the depth of the tree. The
+ * translation unit exposes the following functions, with C linkage:
+ *
+ *   void classify( const float * points, size_t pointCount, uint8_t * labels );
+ *   void classifyAndVote( const float * points, size_t pointCount, uint32_t * votes );
+ *   unsigned int getClassCount();
+ *   unsigned int getFeatureCount();
+ *   unsigned int getTreeCount();
+ *
+ * The points are stored row by row, as in a Table, and so are the votes (one
+ * row of counters per point, one column per class). A shared object built from
+ * the translation unit can be loaded with a CompiledClassifier. It casts
+ * exactly the same votes as the trees do for single-precision points, because
+ * the split values keep the feature type of the trees.
+ * \param classifierStream The decision trees to compile.
+ * \param out The stream to which the source code is written.
+ * \param symbolPrefix A prefix for the names of the functions, so that several
+ *  compiled forests can be linked into one program.
+ * \param origin A description of where the trees come from (e.g. the name of
+ *  the model file), for the comment at the top of the source code.
+ * \throws ClientError if the stream contains classifiers other than decision
+ *  trees.
+ */
+void compileModel( ClassifierInputStream & classifierStream, std::ostream & out, const std::string & symbolPrefix = "", const std::string & origin = "" );
+
+} // namespace balsa
+
+#endif // MODELCOMPILER_H
@@ -0,0 +1,500 @@
+#ifndef QUICKSCORER_H
+#define QUICKSCORER_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "classifierstream.h"
+#include "classifiervisitor.h"
+#include "datatypes.h"
+#include "decisiontreeclassifier.h"
+#include "exceptions.h"
+#include "iteratortools.h"
+#include "votingpool.h"
+
+namespace balsa
+{
+
+/**
+ * An alternative representation of a forest of decision trees, that classifies
+ * points with the QuickScorer algorithm (Lucchese et al., 2015).
+ *
+ * The leaves of each tree are numbered from left to right, and each tree keeps
+ * a bitvector of the leaves that a point may still reach. A point that goes to
+ * the right child of a split node can not reach the leaves of its left
+ * subtree, so those are cleared from the bitvector with a single mask. Once
+ * this has been done for all split nodes that send the point to the right, the
+ * leftmost leaf that remains is the leaf that the point reaches in the tree.
+ *
+ * The split nodes of all trees are sorted by feature and split value, so that
+ * the nodes that send a point to the right are a prefix of the list of their
+ * feature, which is found with a binary search. The masks are applied without
+ * branches, to LANE_COUNT points at once, using vector instructions if the
+ * compiler supports them. This is much faster than walking the trees for
+ * forests of many shallow trees. The cost grows with the number of leaves, so
+ * trees with more than MAX_LEAF_COUNT leaves are not supported.
+ *
+ * The representation produces exactly the same votes as the trees it was built
+ * from.
+ */
+template <typename FeatureType>
+class QuickScorer
+{
+public:
+
+    /**
+     * The maximum number of leaves in a tree (the number of leaves in a full
+     * tree of depth 10).
+     */
+    static constexpr std::size_t MAX_LEAF_COUNT = 1024;
+
+    /**
+     * The number of points that are classified at once.
+     */
+    static constexpr std::size_t LANE_COUNT = 8;
+
+    /**
+     * Builds the representation of all classifiers in a stream.
+     * \throws ClientError if a classifier is not a decision tree with the
+     *  specified feature type, if a tree has more than MAX_LEAF_COUNT leaves,
+     *  or if a split value is not a number.
+     */
+    explicit QuickScorer( ClassifierInputStream & classifierStream ):
+    m_classCount( classifierStream.getClassCount() ),
+    m_featureCount( classifierStream.getFeatureCount() ),
+    m_treeCount( 0 ),
+    m_wordCount( 0 )
+    {
+        // Collect the trees from the stream, keeping them alive until they have been converted.
+        TreeCollector                               collector;
+        std::vector<Classifier::ConstSharedPointer> classifiers;
+        classifierStream.rewind();
+        for ( auto classifier = classifierStream.next(); classifier; classifier = classifierStream.next() )
+        {
+            classifier->visit( collector );
+            classifiers.push_back( classifier );
+        }
+
+        // Size the leaf bitvectors for the tree with the most leaves.
+        for ( auto tree : collector.m_trees )
+        {
+            std::size_t leafCount = 0;
+            for ( NodeID nodeID = 0; nodeID < tree->getNodeCount(); ++nodeID ) leafCount += tree->isLeaf( nodeID );
+            if ( leafCount > MAX_LEAF_COUNT ) throw ClientError( "QuickScorer does not support trees with more than " + std::to_string( MAX_LEAF_COUNT ) + " leaves." );
+            m_wordCount = std::max( m_wordCount, ( leafCount + WORD_BITS - 1 ) / WORD_BITS );
+        }
+        m_treeCount = collector.m_trees.size();
+        m_leafLabels.resize( m_treeCount * m_wordCount * WORD_BITS, 0 );
+
+        // Number the leaves of each tree, and list the masks of its split nodes per feature.
+        std::vector<std::vector<Entry>> entries( m_featureCount );
+        for ( std::size_t tree = 0; tree < m_treeCount; ++tree ) addSubtree( *collector.m_trees[tree], 0, tree, 0, entries );
+
+        // Sort the lists by split value, and store them one after the other.
+        m_featureOffsets.push_back( 0 );
+        for ( auto & list : entries )
+        {
+            std::stable_sort( list.begin(), list.end(), []( const Entry & a, const Entry & b ) { return a.m_splitValue < b.m_splitValue; } );
+            for ( const auto & entry : list )
+            {
+                m_splitValues.push_back( entry.m_splitValue );
+                m_wordIDs.push_back( entry.m_wordID );
+                m_masks.push_back( entry.m_mask );
+            }
+            m_featureOffsets.push_back( m_splitValues.size() );
+        }
+    }
+
+    /**
+     * Returns the number of classes distinguished by the forest.
+     */
+    unsigned int getClassCount() const
+    {
+        return m_classCount;
+    }
+
+    /**
+     * Returns the number of features the forest expects.
+     */
+    unsigned int getFeatureCount() const
+    {
+        return m_featureCount;
+    }
+
+    /**
+     * Returns the number of trees in the forest.
+     */
+    std::size_t getTreeCount() const
+    {
+        return m_treeCount;
+    }
+
+    /**
+     * Bulk-classifies a set of points, adding a vote (+1) to the vote table
+     * for the label that each tree assigns to each point.
+     * \param pointsStart An iterator that points to the first feature value of
+     *  the first point.
+     * \param pointsEnd An iterator that points to the end of the block of
+     *  point data.
+     * \param table A table for counting votes.
+     * \param votingPool The threads that may help the calling thread, if any.
+     * \pre The column count of the vote table must match the number of
+     *  classes, the row count must match the number of points.
+     */
+    template <typename FeatureIterator>
+    unsigned int classifyAndVote( FeatureIterator pointsStart, FeatureIterator pointsEnd, VoteTable & table, VotingPool * votingPool = nullptr ) const
+    {
+        // Statically check that the FeatureIterator points to an arithmetical type.
+        typedef std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type> FeatureIteratedType;
+        static_assert( std::is_arithmetic<FeatureIteratedType>::value, "Features must be of an integral or floating point type." );
+
+        // Check the dimensions of the input data.
+        auto entryCount = std::distance( pointsStart, pointsEnd );
+        assert( m_featureCount > 0 );
+        if ( entryCount % m_featureCount ) throw ClientError( "Malformed dataset." );
+        std::size_t pointCount = entryCount / m_featureCount;
+
+        // Divide the points over the threads, in blocks of whole lanes, but do not wake up threads for only a few points.
+        std::size_t maxThreadCount  = ( votingPool ? votingPool->getThreadCount() : 0 ) + 1;
+        std::size_t threadCount     = std::min<std::size_t>( maxThreadCount, ( pointCount + MIN_POINTS_PER_THREAD - 1 ) / MIN_POINTS_PER_THREAD );
+        std::size_t pointsPerThread = threadCount > 1 ? ( ( pointCount + threadCount - 1 ) / threadCount + LANE_COUNT - 1 ) / LANE_COUNT * LANE_COUNT : pointCount;
+
+        // Classify the blocks in this thread and the threads of the pool. The threads vote on different rows of the table.
+        if ( threadCount > 1 )
+        {
+            std::size_t blockCount = ( pointCount + pointsPerThread - 1 ) / pointsPerThread;
+            votingPool->parallelFor( blockCount, [&]( std::size_t block ) {
+                voteOnPoints( pointsStart, block * pointsPerThread, std::min( ( block + 1 ) * pointsPerThread, pointCount ), table );
+            } );
+        }
+        else
+        {
+            voteOnPoints( pointsStart, 0, pointCount, table );
+        }
+
+        // Return the number of trees that voted.
+        return static_cast<unsigned int>( m_treeCount );
+    }
+
+private:
+
+    /**
+     * The number of leaves in a word of a leaf bitvector.
+     */
+    static constexpr std::size_t WORD_BITS = 64;
+
+    /**
+     * The minimum number of points for which a thread of the voting pool is used.
+     */
+    static constexpr std::size_t MIN_POINTS_PER_THREAD = 256;
+
+    /**
+     * One word of a leaf bitvector for each lane.
+     */
+#if defined( __GNUC__ )
+    typedef uint64_t LaneWords __attribute__( ( vector_size( LANE_COUNT * sizeof( uint64_t ) ) ) );
+#else
+    struct LaneWords
+    {
+        uint64_t operator[]( std::size_t lane ) const
+        {
+            return m_words[lane];
+        }
+
+        uint64_t & operator[]( std::size_t lane )
+        {
+            return m_words[lane];
+        }
+
+        uint64_t m_words[LANE_COUNT];
+    };
+#endif
+
+    /**
+     * A split node, in the list of its feature.
+     */
+    struct Entry
+    {
+        FeatureType m_splitValue;
+        uint32_t    m_wordID;
+        uint64_t    m_mask;
+    };
+
+    /**
+     * A Visitor that collects the decision trees with the feature type of the
+     * QuickScorer, and rejects all other classifiers.
+     */
+    class TreeCollector: public ClassifierVisitor
+    {
+    public:
+
+        void visit( const CompiledClassifier & )
+        {
+            throw ClientError( "QuickScorer does not support compiled classifiers." );
+        }
+
+        void visit( const EnsembleClassifier & )
+        {
+            throw ClientError( "QuickScorer does not support nested ensembles." );
+        }
+
+        void visit( const DecisionTreeClassifier<float> & tree )
+        {
+            collect( tree );
+        }
+
+        void visit( const DecisionTreeClassifier<double> & tree )
+        {
+            collect( tree );
+        }
+
+        void visit( const DecisionTreeClassifier<uint8_t> & tree )
+        {
+            collect( tree );
+        }
+
+        void visit( const DecisionTreeClassifier<uint16_t> & tree )
+        {
+            collect( tree );
+        }
+
+        void visit( const DecisionTreeClassifier<int16_t> & tree )
+        {
+            collect( tree );
+        }
+
+        std::vector<const DecisionTreeClassifier<FeatureType> *> m_trees;
+
+    private:
+
+        template <typename TreeFeatureType>
+        void collect( const DecisionTreeClassifier<TreeFeatureType> & tree )
+        {
+            if constexpr ( std::is_same<TreeFeatureType, FeatureType>::value )
+                m_trees.push_back( &tree );
+            else
+                throw ClientError( "QuickScorer requires all trees of a forest to have the same feature type." );
+        }
+    };
+
+    /**
+     * Numbers the leaves of a subtree from left to right, starting at the
+     * specified leaf index, and adds the masks of its split nodes to the lists.
+     * Returns the index after the last leaf of the subtree.
+     */
+    std::size_t addSubtree( const DecisionTreeClassifier<FeatureType> & tree, NodeID nodeID, std::size_t treeIndex, std::size_t firstLeaf, std::vector<std::vector<Entry>> & entries )
+    {
+        std::size_t leafBase = treeIndex * m_wordCount * WORD_BITS;
+        if ( tree.isLeaf( nodeID ) )
+        {
+            m_leafLabels[leafBase + firstLeaf] = tree.getLabel( nodeID );
+            return firstLeaf + 1;
+        }
+
+        // A point that goes to the right can not reach the leaves of the left subtree.
+        FeatureID   featureID  = tree.getSplitFeatureID( nodeID );
+        FeatureType splitValue = tree.getSplitValue( nodeID );
+        if constexpr ( std::is_floating_point<FeatureType>::value )
+            if ( std::isnan( splitValue ) ) throw ClientError( "QuickScorer does not support split values that are not a number." );
+        assert( featureID < m_featureCount );
+        NodeID      leftChildID = tree.getLeftChildID( nodeID );
+        std::size_t leftEnd     = addSubtree( tree, leftChildID, treeIndex, firstLeaf, entries );
+        for ( std::size_t word = firstLeaf / WORD_BITS; word * WORD_BITS < leftEnd; ++word )
+        {
+            std::size_t first = std::max( firstLeaf, word * WORD_BITS ) - word * WORD_BITS;
+            std::size_t end   = std::min( leftEnd, ( word + 1 ) * WORD_BITS ) - word * WORD_BITS;
+            uint64_t    bits  = end - first == WORD_BITS ? ~uint64_t( 0 ) : ( ( uint64_t( 1 ) << ( end - first ) ) - 1 ) << first;
+            entries[featureID].push_back( Entry{ splitValue, static_cast<uint32_t>( treeIndex * m_wordCount + word ), bits } );
+        }
+        return addSubtree( tree, leftChildID + 1, treeIndex, leftEnd, entries );
+    }
+
+    /**
+     * Classifies the points in the specified range, LANE_COUNT points at a
+     * time.
+     */
+    template <typename FeatureIterator>
+    void voteOnPoints( FeatureIterator pointsStart, std::size_t startPoint, std::size_t endPoint, VoteTable & table ) const
+    {
+        // All leaves are reachable until proven otherwise.
+        LaneWords allLeaves;
+        for ( std::size_t lane = 0; lane < LANE_COUNT; ++lane ) allLeaves[lane] = ~uint64_t( 0 );
+        std::vector<LaneWords> bitvectors( m_treeCount * m_wordCount );
+
+        for ( std::size_t blockStart = startPoint; blockStart < endPoint; blockStart += LANE_COUNT )
+        {
+            const std::size_t laneCount = std::min( LANE_COUNT, endPoint - blockStart );
+            std::fill( bitvectors.begin(), bitvectors.end(), allLeaves );
+            LaneWords activeLanes;
+            for ( std::size_t lane = 0; lane < LANE_COUNT; ++lane ) activeLanes[lane] = lane < laneCount ? ~uint64_t( 0 ) : 0;
+
+            // Clear the leaves that can not be reached, feature by feature.
+            for ( std::size_t feature = 0; feature < m_featureCount; ++feature )
+            {
+                // Find the number of split nodes that send each point to the right.
+                const std::size_t   listStart = m_featureOffsets[feature];
+                const FeatureType * first     = m_splitValues.data() + listStart;
+                const FeatureType * last      = m_splitValues.data() + m_featureOffsets[feature + 1];
+                std::size_t         limits[LANE_COUNT];
+                std::size_t         lanes[LANE_COUNT];
+                for ( std::size_t lane = 0; lane < laneCount; ++lane )
+                {
+                    const auto value = pointsStart[( blockStart + lane ) * m_featureCount + feature];
+                    limits[lane]     = std::partition_point( first, last, [value]( const FeatureType & splitValue ) { return !( value < splitValue ); } ) - first;
+                    lanes[lane]      = lane;
+                }
+
+                // Apply the masks of those nodes. The nodes are applied to all lanes at once, up to the lane with the fewest
+                // nodes, which is then switched off, and so on.
+                for ( std::size_t l = 1; l < laneCount; ++l )
+                    for ( std::size_t m = l; m > 0 && limits[lanes[m]] < limits[lanes[m - 1]]; --m ) std::swap( lanes[m], lanes[m - 1] );
+                const uint32_t * wordIDs = m_wordIDs.data() + listStart;
+                const uint64_t * masks   = m_masks.data() + listStart;
+                LaneWords        active  = activeLanes;
+                std::size_t      i       = 0;
+                for ( std::size_t l = 0; l < laneCount; ++l )
+                {
+                    for ( const std::size_t limit = limits[lanes[l]]; i < limit; ++i ) clearLeaves( bitvectors[wordIDs[i]], masks[i], active );
+                    active[lanes[l]] = 0;
+                }
+            }
+
+            // Let each tree vote for the label of the leftmost leaf that remains.
+            for ( std::size_t tree = 0; tree < m_treeCount; ++tree )
+            {
+                const LaneWords * words      = bitvectors.data() + tree * m_wordCount;
+                const Label *     leafLabels = m_leafLabels.data() + tree * m_wordCount * WORD_BITS;
+                for ( std::size_t lane = 0; lane < laneCount; ++lane )
+                {
+                    std::size_t word = 0;
+                    while ( words[word][lane] == 0 ) ++word;
+                    ++table( blockStart + lane, leafLabels[word * WORD_BITS + countTrailingZeros( words[word][lane] )] );
+                }
+            }
+        }
+    }
+
+    /**
+     * Clears the bits of a mask from the words of the active lanes.
+     */
+    static void clearLeaves( LaneWords & words, uint64_t mask, const LaneWords & active )
+    {
+#if defined( __GNUC__ )
+        words &= ~( mask & active );
+#else
+        for ( std::size_t lane = 0; lane < LANE_COUNT; ++lane ) words[lane] &= ~( mask & active[lane] );
+#endif
+    }
+
+    /**
+     * Returns the index of the lowest set bit of a nonzero word.
+     */
+    static unsigned int countTrailingZeros( uint64_t word )
+    {
+        assert( word );
+#if defined( __GNUC__ )
+        return __builtin_ctzll( word );
+#else
+        unsigned int count = 0;
+        for ( ; !( word & 1 ); word >>= 1 ) ++count;
+        return count;
+#endif
+    }
+
+    unsigned int             m_classCount;
+    unsigned int             m_featureCount;
+    std::size_t              m_treeCount;
+    std::size_t              m_wordCount;
+    std::vector<Label>       m_leafLabels;
+    std::vector<std::size_t> m_featureOffsets;
+    std::vector<FeatureType> m_splitValues;
+    std::vector<uint32_t>    m_wordIDs;
+    std::vector<uint64_t>    m_masks;
+};
+
+/**
+ * A QuickScorer for one of the supported feature types.
+ */
+typedef std::variant<QuickScorer<float>, QuickScorer<double>, QuickScorer<uint8_t>, QuickScorer<uint16_t>, QuickScorer<int16_t>> AnyQuickScorer;
+
+/**
+ * A Visitor that builds a QuickScorer for the feature type of the visited
+ * decision tree.
+ */
+class QuickScorerFactory: public ClassifierVisitor
+{
+public:
+
+    explicit QuickScorerFactory( ClassifierInputStream & classifierStream ):
+    m_classifierStream( classifierStream )
+    {
+    }
+
+    void visit( const CompiledClassifier & )
+    {
+        throw ClientError( "QuickScorer does not support compiled classifiers." );
+    }
+
+    void visit( const EnsembleClassifier & )
+    {
+        throw ClientError( "QuickScorer does not support nested ensembles." );
+    }
+
+    void visit( const DecisionTreeClassifier<float> & )
+    {
+        m_result.emplace( std::in_place_type<QuickScorer<float>>, m_classifierStream );
+    }
+
+    void visit( const DecisionTreeClassifier<double> & )
+    {
+        m_result.emplace( std::in_place_type<QuickScorer<double>>, m_classifierStream );
+    }
+
+    void visit( const DecisionTreeClassifier<uint8_t> & )
+    {
+        m_result.emplace( std::in_place_type<QuickScorer<uint8_t>>, m_classifierStream );
+    }
+
+    void visit( const DecisionTreeClassifier<uint16_t> & )
+    {
+        m_result.emplace( std::in_place_type<QuickScorer<uint16_t>>, m_classifierStream );
+    }
+
+    void visit( const DecisionTreeClassifier<int16_t> & )
+    {
+        m_result.emplace( std::in_place_type<QuickScorer<int16_t>>, m_classifierStream );
+    }
+
+    /**
+     * Builds a QuickScorer for all classifiers in the stream, with the feature
+     * type of the first tree. An empty stream yields an empty forest.
+     */
+    static std::shared_ptr<const AnyQuickScorer> build( ClassifierInputStream & classifierStream )
+    {
+        QuickScorerFactory factory( classifierStream );
+        classifierStream.rewind();
+        auto first = classifierStream.next();
+        if ( first )
+            first->visit( factory );
+        else
+            factory.m_result.emplace( std::in_place_type<QuickScorer<float>>, classifierStream );
+        return std::make_shared<const AnyQuickScorer>( std::move( *factory.m_result ) );
+    }
+
+private:
+
+    ClassifierInputStream &       m_classifierStream;
+    std::optional<AnyQuickScorer> m_result;
+};
+
+} // namespace balsa
+
+#endif // QUICKSCORER_H
@@ -2,7 +2,10 @@
 #define RANDOMFORESTTRAINER_H
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <exception>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -10,56 +13,110 @@
 #include <memory>
 #include <random>
 #include <semaphore>
+#include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include "classifierstream.h"
 #include "datatypes.h"
 #include "fileio.h"
+#include "histogramdecisiontree.h"
 #include "indexeddecisiontree.h"
 #include "messagequeue.h"
+#include "randomizeddecisiontree.h"
+#include "sharedindexdecisiontree.h"
 #include "table.h"
+#include "timing.h"
+#include "workerpool.h"
 
 namespace balsa
 {
 
+/**
+ * The algorithms that can be used to grow decision trees.
+ */
+enum class TrainingEngine
+{
+    EXACT,        // Sorted per-feature indices, all split locations (IndexedDecisionTree).
+    HISTOGRAM,    // Quantized features, split locations between bins (HistogramDecisionTree).
+    SHARED_INDEX, // One sorted index for all trees, same trees as EXACT (SharedIndexDecisionTree).
+    EXTRA_TREES   // No index, one random split location per feature (RandomizedDecisionTree).
+};
+
 /**
  * Trains a random forest classifier on a set of datapoints and known labels.
  */
-template <typename FeatureIterator = Table<double>::ConstIterator, typename LabelIterator = Table<Label>::ConstIterator>
+template <typename FeatureIterator = Table<double>::ConstIterator, typename LabelIterator = Table<Label>::ConstIterator, typename PointIDType = DataPointID>
 class RandomForestTrainer
 {
     /**
      * An in internal message object to distribute training jobs to worker threads.
      */
+    template <typename TreeType>
     class TrainingJob
     {
     public:
 
-        typedef typename IndexedDecisionTree<FeatureIterator, LabelIterator>::SeedType SeedType;
+        typedef typename TreeType::SeedType SeedType;
 
-        TrainingJob( FeatureIterator dataSet, const IndexedDecisionTree<FeatureIterator, LabelIterator> & sapling, SeedType seed, unsigned int maxDepth, bool stop ):
+        TrainingJob( FeatureIterator dataSet, const TreeType & sapling, SeedType seed, unsigned int maxDepth, bool stop, std::size_t sampleSize = 0, bool sampleWithReplacement = false, SeedType sampleSeed = 0, unsigned int treeIndex = 0 ):
         m_dataSet( dataSet ),
         m_sapling( sapling ),
         m_seed( seed ),
         m_maxDepth( maxDepth ),
-        m_stop( stop )
+        m_stop( stop ),
+        m_sampleSize( sampleSize ),
+        m_sampleWithReplacement( sampleWithReplacement ),
+        m_sampleSeed( sampleSeed ),
+        m_treeIndex( treeIndex )
         {
         }
 
-        FeatureIterator                                             m_dataSet;
-        const IndexedDecisionTree<FeatureIterator, LabelIterator> & m_sapling;
-        SeedType                                                    m_seed;
-        unsigned int                                                m_maxDepth;
-        bool                                                        m_stop;
+        FeatureIterator  m_dataSet;
+        const TreeType & m_sapling;
+        SeedType         m_seed;
+        unsigned int     m_maxDepth;
+        bool             m_stop;
+        std::size_t      m_sampleSize; // Zero if the tree is grown on all points.
+        bool             m_sampleWithReplacement;
+        SeedType         m_sampleSeed;
+        unsigned int     m_treeIndex; // The number of the tree in the forest, for the Graphviz file name.
     };
 
-    typedef MessageQueue<TrainingJob>                                                                 JobQueue;
-    typedef MessageQueue<typename IndexedDecisionTree<FeatureIterator, LabelIterator>::SharedPointer> JobResultQueue;
+    template <typename TreeType>
+    using JobQueue = MessageQueue<TrainingJob<TreeType>>;
+
+    /**
+     * The result of a training job: the trained tree, or the exception that
+     * was thrown while training or converting it. Trained trees are passed to
+     * the writer as plain classifiers, so the bulky training data of a tree is
+     * released before it is queued. A result without either means that the
+     * job was skipped, because an earlier job has failed.
+     */
+    template <typename TreeType>
+    class TrainingResult
+    {
+    public:
+
+        typedef typename DecisionTreeClassifier<typename TreeType::FeatureType>::SharedPointer ClassifierPointer;
+
+        TrainingResult( ClassifierPointer classifier = nullptr, std::exception_ptr exception = nullptr ):
+        m_classifier( classifier ),
+        m_exception( exception )
+        {
+        }
+
+        ClassifierPointer  m_classifier;
+        std::exception_ptr m_exception;
+    };
+
+    template <typename TreeType>
+    using JobResultQueue = MessageQueue<TrainingResult<TreeType>>;
 
 public:
 
-    typedef typename IndexedDecisionTree<FeatureIterator, LabelIterator>::FeatureType FeatureType;
+    typedef typename IndexedDecisionTree<FeatureIterator, LabelIterator, PointIDType>::FeatureType FeatureType;
 
     /**
      * Constructor.
@@ -96,7 +153,18 @@ public:
     m_minPurity( minPurity ),
     m_treeCount( treeCount ),
     m_trainerCount( concurrentTrainers ),
-    m_writeGraphviz( writeGraphviz )
+    m_splitThreadCount( 0 ),
+    m_engine( TrainingEngine::EXACT ),
+    m_sampleFraction( 1.0 ),
+    m_sampleWithReplacement( false ),
+    m_maxLeafCount( 0 ),
+    m_maxNodeCount( 0 ),
+    m_minLeafPointCount( 1 ),
+    m_shardIndex( 0 ),
+    m_shardCount( 1 ),
+    m_firstTreeIndex( 0 ),
+    m_writeGraphviz( writeGraphviz ),
+    m_indexBuildTime( 0.0 )
     {
         // Ensure the specified minimum purity is in range.
         if ( m_minPurity < 0.0 || m_minPurity > 1.0 )
@@ -110,6 +178,162 @@ public:
     {
     }
 
+    /**
+     * Set the number of threads that help the tree-growing threads search for
+     * splits. The helper threads are shared by all trees that are trained
+     * concurrently. Within a tree, they scan the candidate features of large
+     * nodes in parallel. This is useful when fewer trees are trained than
+     * there are cores. The trained trees do not depend on this setting.
+     *
+     * The exact engine does not distinguish between tree-growing threads and
+     * helper threads: all threads grow leaves of any tree that is being
+     * trained, and scan and partition the features of large nodes. The number
+     * of trees that are trained concurrently (and so the memory usage) is
+     * still limited to the number of concurrent trainers, but the helper
+     * threads add to the number of threads.
+     * \param threadCount The number of helper threads (default: 0).
+     */
+    void setSplitThreadCount( unsigned int threadCount )
+    {
+        m_splitThreadCount = threadCount;
+    }
+
+    /**
+     * Select the algorithm used to grow the trees. The exact engine (the
+     * default) considers every distinct feature value as a split location. The
+     * histogram engine quantizes each feature to at most 256 bins once, and
+     * only considers the boundaries between bins. This is much faster on large
+     * data sets, and gives the same trees for features with at most 256
+     * distinct values, if all points are used. The shared index engine grows the same trees as the
+     * exact engine, but all trees that are trained concurrently share one
+     * sorted index, so the memory usage hardly depends on the number of
+     * threads. The extra trees engine builds no index at all: it draws one
+     * random split location per considered feature, between the smallest and
+     * the largest value in the node, and picks the best of those. Its trees
+     * are less accurate, but cheap enough in time and memory to train many
+     * more of them. The split thread count only affects the exact engine.
+     *
+     * The exact engine schedules the work per leaf rather than per tree, so
+     * all threads stay busy even when fewer trees remain to be trained than
+     * there are threads. The other engines train each tree in one thread.
+     */
+    void setTrainingEngine( TrainingEngine engine )
+    {
+        m_engine = engine;
+    }
+
+    /**
+     * Grow each tree on a random sample of the data points, rather than on all
+     * points. The samples are drawn independently for each tree. When sampling
+     * with replacement, points can occur more than once in a sample, and they
+     * are weighted accordingly. The index of each sample is filtered from the
+     * index of the complete data set, so smaller samples make training faster.
+     * Sampling is only supported by the exact engine.
+     * \param fraction The size of each sample, as a fraction of the number of points, in (0, 1] (default: 1).
+     * \param withReplacement If true, points are drawn with replacement (default: false).
+     */
+    void setRowSampling( double fraction, bool withReplacement )
+    {
+        if ( !( fraction > 0.0 && fraction <= 1.0 ) ) throw ClientError( "The specified sample fraction is out of range (0.0, 1.0]." );
+        m_sampleFraction        = fraction;
+        m_sampleWithReplacement = withReplacement;
+    }
+
+    /**
+     * Limit the size of each tree, in addition to the maximum depth and the
+     * minimum purity. With a leaf or node budget, the leaves of each tree are
+     * grown best-first: the leaf whose split gives the largest decrease of the
+     * impurity (weighted by the number of points in the leaf) is split first,
+     * until the budget is used up. This bounds the size of the model and the
+     * classification latency directly. Growth limits are only supported by
+     * the exact engine.
+     * \param maxLeafCount The maximum number of leaves per tree, or 0 for no limit (the default).
+     * \param maxNodeCount The maximum number of nodes per tree, or 0 for no limit (the default).
+     * \param minLeafPointCount The minimum number of points in each leaf (default: 1).
+     */
+    void setGrowthLimits( std::size_t maxLeafCount, std::size_t maxNodeCount, std::size_t minLeafPointCount )
+    {
+        if ( minLeafPointCount == 0 ) throw ClientError( "The minimum number of points per leaf must be at least 1." );
+        m_maxLeafCount      = maxLeafCount;
+        m_maxNodeCount      = maxNodeCount;
+        m_minLeafPointCount = minLeafPointCount;
+    }
+
+    /**
+     * Train only one shard of the forest. The trees are divided into the
+     * specified number of consecutive shards of (nearly) equal size, and only
+     * the trees of the specified shard are trained. Every tree gets the same
+     * random seed as it would get when the whole forest is trained, so
+     * merging the models of all shards, in shard order, gives the same forest
+     * as training it in one run (with one trainer thread, so the trees are
+     * written in order). This allows the training of one forest to be
+     * distributed over multiple processes or machines.
+     * \param shardIndex The index of the shard to train, in [0, shardCount).
+     * \param shardCount The number of shards (default: 1).
+     */
+    void setShard( unsigned int shardIndex, unsigned int shardCount )
+    {
+        if ( shardCount == 0 || shardIndex >= shardCount ) throw ClientError( "The specified shard does not exist." );
+        m_shardIndex = shardIndex;
+        m_shardCount = shardCount;
+    }
+
+    /**
+     * Number the trees from the specified index, as if that many trees had
+     * been trained before them. The seeds of the preceding trees are drawn
+     * and skipped, so the trees get the seeds they would get as part of a
+     * larger forest. This is used to append trees to an existing forest (see
+     * EnsembleFileAppendStream) without repeating the seeds of its trees:
+     * with the same data and master seed, appending trees to a forest gives
+     * the same forest as training all trees at once.
+     * \param index The index of the first tree (default: 0).
+     */
+    void setFirstTreeIndex( unsigned int index )
+    {
+        m_firstTreeIndex = index;
+    }
+
+    /**
+     * Store the sorted feature indices in scratch files in the specified
+     * directory, rather than on the heap. The operating system can then write
+     * the parts of the indices that are not in use to disk, so data sets can
+     * be trained on whose indices do not fit in RAM. This is most useful in
+     * combination with a memory-mapped data set (see MappedTable), and with the
+     * shared index engine, which needs only one index. The trained trees do
+     * not depend on this setting. The histogram and extra trees engines ignore it.
+     * \param directory The scratch directory, or an empty string to store the indices on the heap (the default).
+     */
+    void setScratchDirectory( const std::string & directory )
+    {
+        m_scratchDirectory = directory;
+    }
+
+    /**
+     * Persist the sorted feature index in an index file. If the file exists
+     * and was written with the same key, the index is mapped from it rather
+     * than built, so repeated training runs on the same data set start
+     * growing trees almost immediately. Otherwise, the index is built and
+     * written to the file. The key must identify the data set, e.g. by a hash
+     * of its contents (see hashFileContents()). The trained trees do not
+     * depend on this setting. The histogram and extra trees engines ignore it.
+     * \param filename The index file, or an empty string to always build the index (the default).
+     * \param key Identifies the data set.
+     */
+    void setIndexFile( const std::string & filename, const std::string & key )
+    {
+        m_indexFile = filename;
+        m_indexKey  = key;
+    }
+
+    /**
+     * Returns the time spent building the sapling (the index of the data set
+     * that is shared or copied by all trees) during the last training run.
+     */
+    StopWatch::Seconds getIndexBuildTime() const
+    {
+        return m_indexBuildTime;
+    }
+
     /**
      * Train a forest of random trees on the data. Results will be written to the current output file (see Constructor).
      */
@@ -117,11 +341,13 @@ public:
     {
         // Check precionditions, etc.
         if ( featureCount == 0 ) throw ClientError( "Data points must have at least one feature." );
+        if ( featureCount > std::numeric_limits<FeatureID>::max() ) throw ClientError( "Data points may have at most " + std::to_string( std::numeric_limits<FeatureID>::max() ) + " features." );
         auto dataset    = pointsStart;
         auto labels     = labelsStart;
         auto entryCount = std::distance( pointsStart, pointsEnd );
         if ( entryCount % featureCount ) throw ClientError( "Malformed dataset." );
         auto pointCount = entryCount / featureCount;
+        if ( std::size_t( pointCount ) > std::numeric_limits<PointIDType>::max() ) throw ClientError( "Data sets of more than " + std::to_string( std::numeric_limits<PointIDType>::max() ) + " points need a trainer with 64-bit point IDs (LargeDataPointID)." );
 
         // Determine the number of features to consider during each randomized split. If the supplied value was 0, default to floor(sqrt(featurecount)).
         unsigned int featuresToConsider = m_featuresToConsider ? m_featuresToConsider : std::floor( std::sqrt( featureCount ) );
@@ -131,70 +357,330 @@ public:
         assert( m_minPurity >= 0.0 && m_minPurity <= 1.0 );
         double impurityTreshold = 1.0 - m_minPurity;
 
-        // Create an indexed tree with only one node. This is expensive to build, so it is shared for copying between threads.
-        IndexedDecisionTree<FeatureIterator, LabelIterator> sapling( dataset, labels, featureCount, pointCount, featuresToConsider, m_maxDepth, impurityTreshold );
+        // Determine the number of points to sample for each tree, if the trees are not grown on all points.
+        std::size_t sampleSize = 0;
+        if ( m_sampleFraction < 1.0 || m_sampleWithReplacement )
+        {
+            if ( m_engine != TrainingEngine::EXACT ) throw ClientError( "Row sampling is only supported by the exact training engine." );
+            sampleSize = std::max<std::size_t>( 1, std::llround( m_sampleFraction * pointCount ) );
+        }
+        if ( ( m_maxLeafCount || m_maxNodeCount || m_minLeafPointCount > 1 ) && m_engine != TrainingEngine::EXACT )
+        {
+            throw ClientError( "Leaf and node budgets and minimum leaf sizes are only supported by the exact training engine." );
+        }
+
+        // The trainer threads are not busy yet, so they can help building the index of the sapling.
+        WorkerPool indexBuildPool( m_trainerCount > 1 ? m_trainerCount - 1 : 0 );
+        StopWatch  watch;
+        watch.start();
+
+        // Create a tree with only one node. This is expensive to build, so it is shared for copying between threads.
+        switch ( m_engine )
+        {
+        case TrainingEngine::EXACT:
+        {
+            IndexedDecisionTree<FeatureIterator, LabelIterator, PointIDType> sapling( dataset, labels, featureCount, pointCount, featuresToConsider, m_maxDepth, impurityTreshold, &indexBuildPool, m_scratchDirectory, m_indexFile, m_indexKey );
+            m_indexBuildTime = watch.stop();
+            sapling.setGrowthLimits( m_maxLeafCount, m_maxNodeCount, m_minLeafPointCount );
+
+            // Create one pool of threads that grow the leaves of all trees.
+            WorkerPool::SharedPointer workerPool( new WorkerPool( std::max( 1u, m_trainerCount + m_splitThreadCount ) ) );
+            sapling.setWorkerPool( workerPool );
+            trainTreesByLeaf( dataset, sapling, *workerPool, sampleSize );
+            break;
+        }
+        case TrainingEngine::HISTOGRAM:
+        {
+            HistogramDecisionTree<FeatureIterator, LabelIterator, PointIDType> sapling( dataset, labels, featureCount, pointCount, featuresToConsider, m_maxDepth, impurityTreshold );
+            m_indexBuildTime = watch.stop();
+            trainTrees( dataset, sapling );
+            break;
+        }
+        case TrainingEngine::SHARED_INDEX:
+        {
+            SharedIndexDecisionTree<FeatureIterator, LabelIterator, PointIDType> sapling( dataset, labels, featureCount, pointCount, featuresToConsider, m_maxDepth, impurityTreshold, &indexBuildPool, m_scratchDirectory, m_indexFile, m_indexKey );
+            m_indexBuildTime = watch.stop();
+            trainTrees( dataset, sapling );
+            break;
+        }
+        case TrainingEngine::EXTRA_TREES:
+        {
+            RandomizedDecisionTree<FeatureIterator, LabelIterator, PointIDType> sapling( dataset, labels, featureCount, pointCount, featuresToConsider, m_maxDepth, impurityTreshold );
+            m_indexBuildTime = watch.stop();
+            trainTrees( dataset, sapling );
+            break;
+        }
+        default:
+            assert( false );
+        }
+    }
+
+private:
 
+    /**
+     * Grow all trees from copies of the sapling, and write them to the output
+     * stream. The worker threads convert each grown tree to a classifier, and
+     * pass it to the calling thread, which writes it (the writer stage). The
+     * queue between them is bounded: if writing falls behind, the workers
+     * wait rather than start more trees, so at most one tree per worker is in
+     * memory, regardless of the speed of the output.
+     * \param sampleSize The number of points to sample for each tree, or zero to grow the trees on all points.
+     */
+    template <typename TreeType>
+    void trainTrees( FeatureIterator dataset, const TreeType & sapling, std::size_t sampleSize = 0 )
+    {
         // Create message queues for communicating with the worker threads.
-        JobQueue       jobOutbox;
-        JobResultQueue treeInbox;
+        JobQueue<TreeType>       jobOutbox;
+        JobResultQueue<TreeType> treeInbox( std::max( 1u, m_trainerCount ) );
 
         // Start the worker threads.
+        std::atomic<bool>        failed( false );
         std::vector<std::thread> workers;
         for ( unsigned int i = 0; i < m_trainerCount; ++i )
         {
-            workers.push_back( std::thread( &RandomForestTrainer::workerThread, &jobOutbox, &treeInbox ) );
+            workers.push_back( std::thread( &RandomForestTrainer::workerThread<TreeType>, this, &jobOutbox, &treeInbox, &failed ) );
         }
 
-        // Create jobs for all trees.
-        auto & seedSequence = getMasterSeedSequence();
-        for ( unsigned int i = 0; i < m_treeCount; ++i ) jobOutbox.send( TrainingJob( dataset, sapling, seedSequence.next(), m_maxDepth, false ) );
+        // Create jobs for all trees, and 'stop' messages for all threads, to be picked up after all the work is done.
+        auto jobs = createJobs( dataset, sapling, sampleSize );
+        for ( auto & job : jobs ) jobOutbox.send( job );
+        for ( unsigned int i = 0; i < workers.size(); ++i ) jobOutbox.send( TrainingJob<TreeType>( dataset, sapling, 0, 0, true ) );
 
-        // Create 'stop' messages for all threads, to be picked up after all the work is done.
-        for ( unsigned int i = 0; i < workers.size(); ++i ) jobOutbox.send( TrainingJob( dataset, sapling, 0, 0, true ) );
+        // Wait for all the trees to come in, and write each tree to a forest file. After a failure, the workers skip the
+        // remaining jobs, but the results are still received, so that no worker waits for room in the inbox.
+        std::exception_ptr exception;
+        for ( unsigned int i = 0; i < jobs.size(); ++i )
+        {
+            writeResult( treeInbox.receive(), exception );
+            if ( exception ) failed = true;
+        }
+
+        // Wait for all the threads to join.
+        for ( auto & worker : workers ) worker.join();
+        if ( exception ) std::rethrow_exception( exception );
+    }
+
+    /**
+     * Grow all trees from copies of the sapling, like trainTrees(), but let
+     * the threads of a worker pool grow the leaves of all trees that are
+     * trained concurrently, rather than one thread per tree. This keeps all
+     * threads busy, also when fewer trees remain than there are threads.
+     * Only as many trees as there are concurrent trainers are grown at the
+     * same time, to limit the memory usage; the next tree is started whenever
+     * one is finished. Like in trainTrees(), each tree is converted to a
+     * classifier before it is passed to the calling thread, which writes it.
+     * If a tree can not be trained or written, no more trees are started, and
+     * the exception is rethrown after the pool has finished the started trees.
+     * \param workerPool The pool that grows the trees, which is also set as the worker pool of the sapling.
+     * \param sampleSize The number of points to sample for each tree, or zero to grow the trees on all points.
+     */
+    template <typename TreeType>
+    void trainTreesByLeaf( FeatureIterator dataset, const TreeType & sapling, WorkerPool & workerPool, std::size_t sampleSize )
+    {
+        // Start a tree as a task: clone the sapling, and grow its leaves as
+        // further tasks. The task that grows the last leaf converts the tree,
+        // and releases it before passing the result on.
+        // Exceptions are passed on through the inbox, because the pool threads
+        // do not handle them.
+        JobResultQueue<TreeType> treeInbox( std::max( 1u, m_trainerCount ) );
+        auto                     startTree = [&]( const TrainingJob<TreeType> & job )
+        {
+            workerPool.submit( [this, job, &treeInbox]()
+                {
+                    try
+                    {
+                        typename TreeType::SharedPointer tree( cloneSapling( job ) );
+                        tree->seed( job.m_seed );
+                        tree->growConcurrently( [this, tree, treeIndex = job.m_treeIndex, &treeInbox]() mutable
+                            {
+                                TrainingResult<TreeType> result;
+                                try
+                                {
+                                    result.m_classifier = stripTree( *tree, treeIndex );
+                                }
+                                catch ( ... )
+                                {
+                                    result.m_exception = std::current_exception();
+                                }
+                                tree.reset();
+                                treeInbox.send( result );
+                            } );
+                    }
+                    catch ( ... )
+                    {
+                        treeInbox.send( TrainingResult<TreeType>( nullptr, std::current_exception() ) );
+                    }
+                } );
+        };
 
-        // Wait for all the trees to come in, and write each tree to a forest file.
-        for ( unsigned int i = 0; i < m_treeCount; ++i )
+        // Start the first trees, and start another tree whenever one comes in, until all trees are started or one fails.
+        auto               jobs         = createJobs( dataset, sapling, sampleSize );
+        std::size_t        startedCount = std::min<std::size_t>( std::max( 1u, m_trainerCount ), jobs.size() );
+        std::exception_ptr exception;
+        for ( std::size_t i = 0; i < startedCount; ++i ) startTree( jobs[i] );
+        for ( std::size_t receivedCount = 0; receivedCount < startedCount; ++receivedCount )
         {
-            // Pull a tree from the inbox.
-            auto tree = treeInbox.receive();
+            auto result = treeInbox.receive();
+            if ( !exception ) exception = result.m_exception;
+            if ( !exception && startedCount < jobs.size() ) startTree( jobs[startedCount++] );
+            writeResult( result, exception );
+        }
 
-            // Write the tree without the bulky index, which is no longer needed
-            // after training.
-            auto strippedTree = tree->getDecisionTree();
-            m_stream.write( *strippedTree );
+        // Wait until the pool threads have released the trees and the inbox.
+        workerPool.wait();
+        if ( exception ) std::rethrow_exception( exception );
+    }
 
-            // Write a Graphviz file for the tree, if necessary.
-            if ( m_writeGraphviz )
-            {
-                std::stringstream ss;
-                ss << "tree" << i << ".dot";
-                tree->writeGraphviz( ss.str() );
-            }
+    /**
+     * Write a trained tree to the output stream, unless a tree has failed
+     * before. Records the first exception, of training or of writing a tree.
+     */
+    template <typename TreeType>
+    void writeResult( const TrainingResult<TreeType> & result, std::exception_ptr & exception )
+    {
+        if ( !exception ) exception = result.m_exception;
+        if ( exception || !result.m_classifier ) return;
+        try
+        {
+            m_stream.write( *result.m_classifier );
         }
+        catch ( ... )
+        {
+            exception = std::current_exception();
+        }
+    }
 
-        // Wait for all the threads to join.
-        for ( auto & worker : workers ) worker.join();
+    /**
+     * Create the training jobs for all trees of this shard. The seeds of the
+     * trees of other shards, and of the trees before the first tree index, are
+     * drawn as well, so every tree gets the same seed regardless of the
+     * sharding.
+     */
+    template <typename TreeType>
+    std::vector<TrainingJob<TreeType>> createJobs( FeatureIterator dataset, const TreeType & sapling, std::size_t sampleSize )
+    {
+        std::vector<TrainingJob<TreeType>> jobs;
+        auto &                             seedSequence = getMasterSeedSequence();
+        auto                               firstTree    = getShardStart( m_shardIndex );
+        auto                               endTree      = getShardStart( m_shardIndex + 1 );
+        for ( unsigned int i = 0; i < endTree; ++i )
+        {
+            auto seed       = seedSequence.next();
+            auto sampleSeed = sampleSize ? seedSequence.next() : 0;
+            if ( i < firstTree ) continue;
+            jobs.push_back( TrainingJob<TreeType>( dataset, sapling, seed, m_maxDepth, false, sampleSize, m_sampleWithReplacement, sampleSeed, i ) );
+        }
+        return jobs;
     }
 
-private:
+    /**
+     * Convert a trained tree to a classifier, without the bulky index, which
+     * is no longer needed after training. Also write a Graphviz file for the
+     * tree, if necessary. The Graphviz file is written first, since
+     * converting a tree may release its nodes.
+     * \param treeIndex The number of the tree in the Graphviz file name.
+     */
+    template <typename TreeType>
+    auto stripTree( TreeType & tree, unsigned int treeIndex ) const
+    {
+        if ( m_writeGraphviz )
+        {
+            std::stringstream ss;
+            ss << "tree" << treeIndex << ".dot";
+            tree.writeGraphviz( ss.str() );
+        }
+        return tree.getDecisionTree();
+    }
 
-    static void workerThread( JobQueue * jobInbox, JobResultQueue * treeOutbox )
+    template <typename TreeType>
+    void workerThread( JobQueue<TreeType> * jobInbox, JobResultQueue<TreeType> * treeOutbox, const std::atomic<bool> * failed ) const
     {
         // Train trees until it is time to stop.
         while ( true )
         {
-            // Get an assignment or stop message from the queue.
-            TrainingJob job = jobInbox->receive();
+            // Get an assignment or stop message from the queue. Skip it if a tree has failed.
+            TrainingJob<TreeType> job = jobInbox->receive();
             if ( job.m_stop ) break;
+            TrainingResult<TreeType> result;
+            if ( *failed )
+            {
+                treeOutbox->send( result );
+                continue;
+            }
 
             // Clone the sapling and grow it. Take care to re-seed the random
             // generator used for feature selection, otherwise identical trees
             // will be grown.
-            typename IndexedDecisionTree<FeatureIterator, LabelIterator>::SharedPointer tree( new IndexedDecisionTree<FeatureIterator, LabelIterator>( job.m_sapling ) );
-            tree->seed( job.m_seed );
-            tree->grow();
-            treeOutbox->send( tree );
+            // Convert the tree, and release it before passing the result on.
+            try
+            {
+                typename TreeType::SharedPointer tree( cloneSapling( job ) );
+                tree->seed( job.m_seed );
+                tree->grow();
+                result.m_classifier = stripTree( *tree, job.m_treeIndex );
+            }
+            catch ( ... )
+            {
+                result.m_exception = std::current_exception();
+            }
+            treeOutbox->send( result );
+        }
+    }
+
+    /**
+     * Returns the index of the first tree of a shard, counting from the first
+     * tree index.
+     */
+    unsigned int getShardStart( unsigned int shardIndex ) const
+    {
+        return m_firstTreeIndex + std::size_t( m_treeCount ) * shardIndex / m_shardCount;
+    }
+
+    /**
+     * Create a tree to be grown from the sapling of a job, on all points or on
+     * a sample of the points, as specified by the job.
+     */
+    template <typename TreeType>
+    static TreeType * cloneSapling( const TrainingJob<TreeType> & job )
+    {
+        if constexpr ( std::is_constructible<TreeType, const TreeType &, const std::vector<PointMultiplicity> &>::value )
+        {
+            if ( job.m_sampleSize ) return new TreeType( job.m_sapling, drawSample( job.m_sapling.getPointCount(), job.m_sampleSize, job.m_sampleWithReplacement, job.m_sampleSeed ) );
+        }
+        assert( job.m_sampleSize == 0 );
+        return new TreeType( job.m_sapling );
+    }
+
+    /**
+     * Draw a random sample of the data points.
+     * \return The number of times each point occurs in the sample, by point ID.
+     */
+    static std::vector<PointMultiplicity> drawSample( std::size_t pointCount, std::size_t sampleSize, bool withReplacement, WeightedCoin<>::ValueType seed )
+    {
+        std::vector<PointMultiplicity> multiplicities( pointCount, 0 );
+        if ( withReplacement )
+        {
+            // Draw the points one by one.
+            std::mt19937                               rng( seed );
+            std::uniform_int_distribution<std::size_t> distribution( 0, pointCount - 1 );
+            for ( std::size_t i = 0; i < sampleSize; ++i ) ++multiplicities[distribution( rng )];
+        }
+        else
+        {
+            // Visit all points in order, and select each one with a probability
+            // equal to the fraction of the remaining points that is needed.
+            assert( sampleSize <= pointCount );
+            WeightedCoin<> coin;
+            coin.seed( seed );
+            std::size_t pointsToSelect = sampleSize;
+            for ( std::size_t point = 0; point < pointCount && pointsToSelect; ++point )
+            {
+                if ( !coin.flip( pointsToSelect, pointCount - point ) ) continue;
+                multiplicities[point] = 1;
+                --pointsToSelect;
+            }
         }
+        return multiplicities;
     }
 
     ClassifierOutputStream & m_stream;
@@ -203,7 +689,21 @@ private:
     double                   m_minPurity;
     unsigned int             m_treeCount;
     unsigned int             m_trainerCount;
+    unsigned int             m_splitThreadCount;
+    TrainingEngine           m_engine;
+    double                   m_sampleFraction;
+    bool                     m_sampleWithReplacement;
+    std::size_t              m_maxLeafCount;
+    std::size_t              m_maxNodeCount;
+    std::size_t              m_minLeafPointCount;
+    std::string              m_scratchDirectory;
+    std::string              m_indexFile;
+    std::string              m_indexKey;
+    unsigned int             m_shardIndex;
+    unsigned int             m_shardCount;
+    unsigned int             m_firstTreeIndex;
     bool                     m_writeGraphviz;
+    StopWatch::Seconds       m_indexBuildTime;
 };
 
 } // namespace balsa
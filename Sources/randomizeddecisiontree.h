@@ -0,0 +1,466 @@
+#ifndef RANDOMIZEDDECISIONTREE_H
+#define RANDOMIZEDDECISIONTREE_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "datatools.h"
+#include "datatypes.h"
+#include "decisiontreeclassifier.h"
+#include "exceptions.h"
+#include "growabletree.h"
+#include "iteratortools.h"
+#include "weightedcoin.h"
+
+namespace balsa
+{
+
+/**
+ * An extremely randomized decision tree (after Geurts et al., "Extremely
+ * randomized trees", 2006).
+ *
+ * Instead of searching all split locations of a feature, the tree draws one
+ * split location per considered feature, uniformly between the smallest and
+ * the largest value of that feature in the node, and picks the best of these
+ * random splits. This only requires the feature values of the points in the
+ * node, which are read from the data set directly: a tree needs nothing but a
+ * list of point IDs, which is partitioned such that the points of each node
+ * are consecutive. No sorted index is built, so training needs very little
+ * memory and time per tree, at the expense of some accuracy per tree. This is
+ * usually compensated by training more trees. Nodes are grown depth-first.
+ *
+ * The tree refers to the data set and the labels, rather than copying them,
+ * so copying a sapling to train multiple trees is cheap. The data set must
+ * outlive the tree and its copies.
+ */
+template <typename FeatureIterator = double *, typename LabelIterator = Label *, typename PointIDType = DataPointID>
+class RandomizedDecisionTree: public GrowableTree<RandomizedDecisionTree<FeatureIterator, LabelIterator, PointIDType>, std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type>>
+{
+
+    // Forward declarations.
+    class Node;
+    class PendingLeaf;
+    class RandomSplit;
+
+public:
+
+    typedef std::shared_ptr<RandomizedDecisionTree> SharedPointer;
+    typedef WeightedCoin<>                          WeightedCoinType;
+    typedef WeightedCoinType::ValueType             SeedType;
+
+    typedef std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type> FeatureType;
+    typedef std::remove_cv_t<typename iterator_value_type<LabelIterator>::type>   LabelType;
+
+    static_assert( std::is_arithmetic<FeatureType>::value, "Feature type should be an integral or floating point type." );
+    static_assert( std::is_same<LabelType, Label>::value, "Label type should an unsigned, 8 bits wide, integral type." );
+
+    /**
+     * Creates a randomized decision tree with one root node from scratch. This
+     * only checks the data set and counts the labels, so it is cheap compared
+     * to the construction of the other kinds of tree.
+     */
+    RandomizedDecisionTree( FeatureIterator dataPoints, LabelIterator labels, unsigned int featureCount, std::size_t pointCount, unsigned int featuresToConsider, unsigned int maximumDistanceToRoot = std::numeric_limits<unsigned int>::max(), double impurityThreshold = 0.0 ):
+    m_dataPoints( dataPoints ),
+    m_labels( labels ),
+    m_featureCount( featureCount ),
+    m_pointCount( pointCount ),
+    m_rootLabelCounts( labels, labels + pointCount ),
+    m_featuresToConsider( featuresToConsider ),
+    m_maximumDistanceToRoot( maximumDistanceToRoot ),
+    m_impurityThreshold( impurityThreshold )
+    {
+        // Check pre-conditions.
+        assert( featuresToConsider > 0 && featuresToConsider <= featureCount );
+        assert( impurityThreshold >= 0.0 && impurityThreshold <= 1.0 );
+
+        // Reject values that cannot be compared, since they would make the split locations undefined.
+        for ( auto it = dataPoints, end = dataPoints + std::size_t( featureCount ) * pointCount; it != end; ++it )
+        {
+            if ( std::isnan( *it ) ) throw ClientError( "Feature value is not a number." );
+        }
+
+        // Create the root node (it contains all points).
+        m_nodes.push_back( Node( m_rootLabelCounts.getMostFrequentLabel(), pointCount ) );
+    }
+
+    /**
+     * Returns the number of classes distinguished by this decision tree.
+     */
+    unsigned int getClassCount() const
+    {
+        return m_rootLabelCounts.size();
+    }
+
+    /**
+     * Reinitialize the state of the random engines used to select features to
+     * consider, and to draw the split locations.
+     */
+    void seed( SeedType value )
+    {
+        m_coin.seed( value );
+        m_rng.seed( deriveSeed( value, 0 ) );
+    }
+
+    /**
+     * Grows the entire tree until no more progress is possible.
+     */
+    void grow()
+    {
+        // A tree can only be grown once.
+        if ( m_nodes.size() > 1 ) return;
+
+        // Create a list of all points. It will be partitioned such that the points of each node are consecutive.
+        m_pointIDs.resize( m_pointCount );
+        std::iota( m_pointIDs.begin(), m_pointIDs.end(), PointIDType( 0 ) );
+
+        // Grow the root node, and then its descendants, depth-first.
+        std::vector<PendingLeaf> pendingLeaves;
+        if ( isGrowableNode( m_rootLabelCounts, 0 ) ) pendingLeaves.push_back( PendingLeaf( 0, 0, m_pointIDs.size(), 0, m_rootLabelCounts ) );
+        while ( !pendingLeaves.empty() )
+        {
+            PendingLeaf leaf = std::move( pendingLeaves.back() );
+            pendingLeaves.pop_back();
+            growLeaf( leaf, pendingLeaves );
+        }
+
+        // Release the point list, it is no longer needed.
+        m_pointIDs = std::vector<PointIDType>();
+    }
+
+    /**
+     * Convert this tree to a plain decision tree classifier.
+     */
+    typename DecisionTreeClassifier<FeatureType>::SharedPointer getDecisionTree()
+    {
+        return this->createDecisionTree( getClassCount(), m_featureCount );
+    }
+
+private:
+
+    // The base class accesses the nodes.
+    friend class GrowableTree<RandomizedDecisionTree, FeatureType>;
+
+    /**
+     * An integer type for the squared label counts of splits, that is wide
+     * enough for the number of points.
+     */
+    typedef SquaredCountTypeOf<PointIDType> SquaredCountType;
+
+    /**
+     * Internal representation of a node in the decision tree.
+     */
+    class Node
+    {
+    public:
+
+        Node( Label label, std::size_t pointCount ):
+        m_leftChild( 0 ),
+        m_rightChild( 0 ),
+        m_label( label ),
+        m_pointCount( pointCount )
+        {
+        }
+
+        bool isLeafNode() const
+        {
+            return m_leftChild == 0;
+        }
+
+        NodeID getLeftChild() const
+        {
+            return m_leftChild;
+        }
+
+        NodeID getRightChild() const
+        {
+            return m_rightChild;
+        }
+
+        const Split<FeatureType> & getSplit() const
+        {
+            return m_split;
+        }
+
+        Label getLabel() const
+        {
+            return m_label;
+        }
+
+        std::string getSummary() const
+        {
+            return "points: " + std::to_string( m_pointCount );
+        }
+
+        NodeID             m_leftChild;
+        NodeID             m_rightChild;
+        Split<FeatureType> m_split;
+        Label              m_label;
+        std::size_t        m_pointCount;
+    };
+
+    /**
+     * A leaf node that is still to be grown, with the data needed to grow it.
+     */
+    class PendingLeaf
+    {
+    public:
+
+        PendingLeaf( NodeID nodeID, std::size_t pointOffset, std::size_t pointCount, unsigned int distanceToRoot, const LabelFrequencyTable & labelCounts ):
+        m_nodeID( nodeID ),
+        m_pointOffset( pointOffset ),
+        m_pointCount( pointCount ),
+        m_distanceToRoot( distanceToRoot ),
+        m_labelCounts( labelCounts )
+        {
+        }
+
+        NodeID              m_nodeID;
+        std::size_t         m_pointOffset;
+        std::size_t         m_pointCount;
+        unsigned int        m_distanceToRoot;
+        LabelFrequencyTable m_labelCounts;
+    };
+
+    /**
+     * A randomly drawn split, with the label counts on its left side.
+     */
+    class RandomSplit
+    {
+    public:
+
+        /**
+         * Constructs an invalid split.
+         */
+        RandomSplit():
+        m_featureID( 0 ),
+        m_value( 0 ),
+        m_impurity( std::numeric_limits<double>::max() ),
+        m_leftCounts( 0 )
+        {
+        }
+
+        RandomSplit( FeatureID featureID, FeatureType value, double impurity, LabelFrequencyTable && leftCounts ):
+        m_featureID( featureID ),
+        m_value( value ),
+        m_impurity( impurity ),
+        m_leftCounts( std::move( leftCounts ) )
+        {
+        }
+
+        /**
+         * Returns true iff this represents a valid split.
+         */
+        bool isValid() const
+        {
+            return m_impurity <= 1.0;
+        }
+
+        FeatureID           m_featureID;  // The feature along which the split is made.
+        FeatureType         m_value;      // Points with a lower value go to the left child.
+        double              m_impurity;   // The weighted Gini impurity of the children.
+        LabelFrequencyTable m_leftCounts; // The label counts of the left child.
+    };
+
+    /**
+     * Returns the value of a feature of a point.
+     */
+    FeatureType getValue( PointIDType pointID, FeatureID featureID ) const
+    {
+        return m_dataPoints[std::size_t( pointID ) * m_featureCount + featureID];
+    }
+
+    /**
+     * Find and apply the best split for a leaf, and schedule the growable
+     * children for growth.
+     */
+    void growLeaf( PendingLeaf & leaf, std::vector<PendingLeaf> & pendingLeaves )
+    {
+        // Find the best split for the node.
+        RandomSplit split = findBestSplit( leaf );
+        if ( !split.isValid() ) return;
+
+        // Partition the points of the node along the split.
+        auto begin  = m_pointIDs.begin() + leaf.m_pointOffset;
+        auto end    = begin + leaf.m_pointCount;
+        auto middle = std::partition( begin, end, [this, &split]( PointIDType point )
+            {
+                return getValue( point, split.m_featureID ) < split.m_value;
+            } );
+        std::size_t leftPointCount  = std::distance( begin, middle );
+        std::size_t rightPointCount = leaf.m_pointCount - leftPointCount;
+        assert( leftPointCount == split.m_leftCounts.getTotal() );
+        assert( leftPointCount > 0 && rightPointCount > 0 );
+
+        // Determine the label counts of the right child.
+        const LabelFrequencyTable & leftCounts = split.m_leftCounts;
+        LabelFrequencyTable         rightCounts( leaf.m_labelCounts );
+        for ( std::size_t label = 0; label < leftCounts.size(); ++label ) rightCounts.decrement( static_cast<Label>( label ), leftCounts.getCount( label ) );
+
+        // Create the child nodes.
+        NodeID leftChildID  = m_nodes.size();
+        NodeID rightChildID = leftChildID + 1;
+        auto & node         = m_nodes[leaf.m_nodeID];
+        node.m_leftChild    = leftChildID;
+        node.m_rightChild   = rightChildID;
+        node.m_split        = Split<FeatureType>( split.m_featureID, split.m_value );
+        m_nodes.push_back( Node( leftCounts.getMostFrequentLabel(), leftPointCount ) );
+        m_nodes.push_back( Node( rightCounts.getMostFrequentLabel(), rightPointCount ) );
+
+        // Schedule the children for growth. The left child is pushed last, so it will be grown first.
+        unsigned int childDistanceToRoot = leaf.m_distanceToRoot + 1;
+        if ( isGrowableNode( rightCounts, childDistanceToRoot ) ) pendingLeaves.push_back( PendingLeaf( rightChildID, leaf.m_pointOffset + leftPointCount, rightPointCount, childDistanceToRoot, rightCounts ) );
+        if ( isGrowableNode( leftCounts, childDistanceToRoot ) ) pendingLeaves.push_back( PendingLeaf( leftChildID, leaf.m_pointOffset, leftPointCount, childDistanceToRoot, leftCounts ) );
+    }
+
+    /**
+     * Find the best of the random splits along randomly selected features for
+     * the specified leaf node.
+     */
+    RandomSplit findBestSplit( const PendingLeaf & leaf )
+    {
+        // Randomly scan the required number of features.
+        auto                   featuresToScan = m_featuresToConsider;
+        RandomSplit            bestSplit;
+        std::vector<FeatureID> skippedFeatures;
+        for ( FeatureID featureID = 0; featureID < m_featureCount; ++featureID )
+        {
+            // Decide whether or not to consider this feature.
+            auto featuresLeft        = m_featureCount - featureID;
+            bool considerThisFeature = m_coin.flip( featuresToScan, featuresLeft );
+            if ( !considerThisFeature )
+            {
+                skippedFeatures.push_back( featureID );
+                continue;
+            }
+
+            // Use up one 'credit'.
+            assert( featuresToScan > 0 );
+            --featuresToScan;
+
+            // Draw a split for the feature, and keep it if it is better than what was already found.
+            RandomSplit split = drawSplit( leaf, featureID );
+            if ( split.m_impurity < bestSplit.m_impurity ) bestSplit = std::move( split );
+        }
+
+        // If a valid split has been found, return it.
+        if ( bestSplit.isValid() ) return bestSplit;
+
+        // Since no valid split was found, draw splits for the features that were initially skipped.
+        for ( auto featureID : skippedFeatures )
+        {
+            // Return the first valid split.
+            bestSplit = drawSplit( leaf, featureID );
+            if ( bestSplit.isValid() ) return bestSplit;
+        }
+
+        // All points in this node have the same value for every feature, so
+        // this node cannot be split.
+        return bestSplit;
+    }
+
+    /**
+     * Draw a random split location for a particular leaf and feature, and
+     * evaluate it. Returns an invalid split if all points in the leaf have the
+     * same value for the feature.
+     */
+    RandomSplit drawSplit( const PendingLeaf & leaf, FeatureID featureID )
+    {
+        // Determine the range of the values of the feature in the node.
+        auto        begin   = m_pointIDs.begin() + leaf.m_pointOffset;
+        auto        end     = begin + leaf.m_pointCount;
+        FeatureType minimum = getValue( *begin, featureID );
+        FeatureType maximum = minimum;
+        for ( auto it = begin; it != end; ++it )
+        {
+            FeatureType value = getValue( *it, featureID );
+            minimum           = std::min( minimum, value );
+            maximum           = std::max( maximum, value );
+        }
+        if ( !( minimum < maximum ) ) return RandomSplit();
+
+        // Draw a split location. Since it is in (minimum, maximum], there are points on both sides of it.
+        FeatureType threshold = drawThreshold( minimum, maximum );
+
+        // Count the labels on both sides of the split.
+        LabelFrequencyTable leftCounts( getClassCount() );
+        for ( auto it = begin; it != end; ++it )
+        {
+            if ( getValue( *it, featureID ) < threshold ) leftCounts.increment( m_labels[*it] );
+        }
+        std::size_t      leftTotal          = leftCounts.getTotal();
+        std::size_t      rightTotal         = leaf.m_pointCount - leftTotal;
+        SquaredCountType rightSquaredCounts = 0;
+        for ( std::size_t label = 0; label < leftCounts.size(); ++label )
+        {
+            std::size_t rightCount = leaf.m_labelCounts.getCount( label ) - leftCounts.getCount( label );
+            rightSquaredCounts += SquaredCountType( rightCount ) * rightCount;
+        }
+        double impurity = splitGiniImpurity<double, SquaredCountType>( leftCounts.template getSquaredCountSum<SquaredCountType>(), leftTotal, rightSquaredCounts, rightTotal );
+        return RandomSplit( featureID, threshold, impurity, std::move( leftCounts ) );
+    }
+
+    /**
+     * Draw a split location uniformly from the half-open range (minimum, maximum].
+     */
+    FeatureType drawThreshold( FeatureType minimum, FeatureType maximum )
+    {
+        if constexpr ( std::is_floating_point<FeatureType>::value )
+        {
+            // Values that are rounded to the minimum (or beyond the maximum, when the range overflows) are replaced by the maximum.
+            double fraction  = std::uniform_real_distribution<double>( 0.0, 1.0 )( m_rng );
+            auto   threshold = static_cast<FeatureType>( minimum + fraction * ( static_cast<double>( maximum ) - minimum ) );
+            return ( threshold > minimum && threshold <= maximum ) ? threshold : maximum;
+        }
+        else
+        {
+            return static_cast<FeatureType>( std::uniform_int_distribution<long long>( static_cast<long long>( minimum ) + 1, maximum )( m_rng ) );
+        }
+    }
+
+    /**
+     * Returns a node by ID.
+     */
+    const Node & getNode( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID];
+    }
+
+    /**
+     * Returns the number of nodes in the tree.
+     */
+    NodeID getNodeCount() const
+    {
+        return m_nodes.size();
+    }
+
+    /**
+     * Returns true iff it is still meaningful to grow a node with the specified label counts and depth.
+     */
+    bool isGrowableNode( const LabelFrequencyTable & labelCounts, unsigned int distanceToRoot ) const
+    {
+        return this->template isGrowableLeaf<double, SquaredCountType>( labelCounts, distanceToRoot, m_maximumDistanceToRoot, m_impurityThreshold );
+    }
+
+    FeatureIterator          m_dataPoints;
+    LabelIterator            m_labels;
+    unsigned int             m_featureCount;
+    std::size_t              m_pointCount;
+    LabelFrequencyTable      m_rootLabelCounts;
+    std::vector<Node>        m_nodes;
+    std::vector<PointIDType> m_pointIDs;
+    WeightedCoinType         m_coin;
+    SplitMix64               m_rng;
+    unsigned int             m_featuresToConsider;
+    unsigned int             m_maximumDistanceToRoot;
+    double                   m_impurityThreshold;
+};
+
+} // namespace balsa
+
+#endif // RANDOMIZEDDECISIONTREE_H
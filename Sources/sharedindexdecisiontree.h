@@ -0,0 +1,488 @@
+#ifndef SHAREDINDEXDECISIONTREE_H
+#define SHAREDINDEXDECISIONTREE_H
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "datatools.h"
+#include "datatypes.h"
+#include "decisiontreeclassifier.h"
+#include "exceptions.h"
+#include "featureindex.h"
+#include "growabletree.h"
+#include "iteratortools.h"
+#include "table.h"
+#include "weightedcoin.h"
+
+namespace balsa
+{
+
+/**
+ * A decision tree that is trained using a sorted feature index that is shared
+ * by all copies of the tree.
+ *
+ * Unlike the IndexedDecisionTree, this tree never reorders its index, so the
+ * index can be shared (read-only) by any number of trees that are trained
+ * concurrently. Each tree only keeps track of the leaf that each point is in.
+ * The tree is grown one level at a time: for each feature, a single pass over
+ * the index finds the best splits for all leaves on the current level. The
+ * trained trees are identical to those of an IndexedDecisionTree that is
+ * seeded with the same value, because every node selects the features to
+ * consider with its own seed, which only depends on the seed of the tree and
+ * the path to the node.
+ */
+template <typename FeatureIterator = double *, typename LabelIterator = Label *, typename PointIDType = DataPointID>
+class SharedIndexDecisionTree: public GrowableTree<SharedIndexDecisionTree<FeatureIterator, LabelIterator, PointIDType>, std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type>>
+{
+
+    // Forward declarations.
+    class Node;
+    class LevelSplit;
+
+public:
+
+    typedef std::shared_ptr<SharedIndexDecisionTree> SharedPointer;
+    typedef WeightedCoin<>                           WeightedCoinType;
+    typedef WeightedCoinType::ValueType              SeedType;
+
+    typedef std::remove_cv_t<typename iterator_value_type<FeatureIterator>::type> FeatureType;
+    typedef std::remove_cv_t<typename iterator_value_type<LabelIterator>::type>   LabelType;
+
+    static_assert( std::is_arithmetic<FeatureType>::value, "Feature type should be an integral or floating point type." );
+    static_assert( std::is_same<LabelType, Label>::value, "Label type should an unsigned, 8 bits wide, integral type." );
+
+    /**
+     * Creates a decision tree with one root node from scratch.
+     * N.B. this is an expensive operation, because construction builds the
+     * sorted index. When training multiple trees on the same data, create one
+     * tree and copy it; the copies share the index. The index is built with
+     * the help of the threads in the pool, if one is supplied. If a scratch
+     * directory is specified, the index is stored in scratch files in that
+     * directory, rather than on the heap. If an index file is specified, the
+     * index is mapped from that file if it was written with the same key, and
+     * written to it otherwise (see FeatureIndex).
+     */
+    SharedIndexDecisionTree( FeatureIterator dataPoints, LabelIterator labels, unsigned int featureCount, std::size_t pointCount, unsigned int featuresToConsider, unsigned int maximumDistanceToRoot = std::numeric_limits<unsigned int>::max(), ImpurityTypeOf<FeatureType> impurityTreshold = 0.0, WorkerPool * indexBuildPool = nullptr, const std::string & scratchDirectory = std::string(), const std::string & indexFile = std::string(), const std::string & indexKey = std::string() ):
+    m_dataPoints( dataPoints ),
+    m_featureIndex( new FeatureIndex<FeatureType, PointIDType>( dataPoints, labels, featureCount, pointCount, indexBuildPool, scratchDirectory, indexFile, indexKey ) ),
+    m_pointCount( pointCount ),
+    m_featureCount( featureCount ),
+    m_featuresToConsider( featuresToConsider ),
+    m_maximumDistanceToRoot( maximumDistanceToRoot ),
+    m_impurityThreshold( impurityTreshold )
+    {
+        // Check pre-conditions.
+        assert( featuresToConsider > 0 && featuresToConsider <= featureCount );
+        assert( impurityTreshold >= 0.0 && m_impurityThreshold <= 1.0 );
+
+        // Create the root node (it contains all points).
+        LabelFrequencyTable labelCounts( labels, labels + pointCount );
+        assert( pointCount == labelCounts.getTotal() );
+        m_nodes.push_back( Node( labelCounts, 0, std::random_device{}() ) );
+    }
+
+    /**
+     * Returns the number of classes distinguished by this decision tree.
+     */
+    unsigned int getClassCount() const
+    {
+        auto & rootNode = m_nodes.front();
+        return rootNode.getLabelCounts().size();
+    }
+
+    /**
+     * Reinitialize the seed from which the seeds of the nodes are derived. The
+     * seed of a node determines which features are considered when deciding
+     * where to split it.
+     * \pre The tree has not been grown yet.
+     */
+    void seed( SeedType value )
+    {
+        assert( m_nodes.size() == 1 );
+        m_nodes.front().setSeed( value );
+    }
+
+    /**
+     * Grows the entire tree until no more progress is possible.
+     */
+    void grow()
+    {
+        // A tree can only be grown once.
+        if ( m_nodes.size() > 1 ) return;
+
+        // Start with the root node, which contains all points.
+        std::vector<NodeID> level;
+        if ( isGrowableNode( 0 ) ) level.push_back( 0 );
+        std::vector<LevelSlot> pointSlots( m_pointCount, level.empty() ? NO_SLOT : 0 );
+
+        // Grow the tree one level at a time.
+        while ( !level.empty() ) level = growLevel( level, pointSlots );
+    }
+
+    /**
+     * Convert this tree to a plain decision tree classifier.
+     */
+    typename DecisionTreeClassifier<FeatureType>::SharedPointer getDecisionTree()
+    {
+        return this->createDecisionTree( getClassCount(), m_featureCount );
+    }
+
+private:
+
+    // The base class accesses the nodes.
+    friend class GrowableTree<SharedIndexDecisionTree, FeatureType>;
+
+    /**
+     * A floating-point type used to calculate the information gain of splits.
+     */
+    typedef ImpurityTypeOf<FeatureType> ImpurityType;
+
+    /**
+     * An integer type for the squared label counts of splits, that is wide
+     * enough for the number of points.
+     */
+    typedef SquaredCountTypeOf<PointIDType> SquaredCountType;
+
+    /**
+     * The position of a growable leaf in the list of leaves of the current level.
+     */
+    typedef uint32_t LevelSlot;
+
+    /**
+     * The level slot of points that are in leaves that will not be grown any further.
+     */
+    static constexpr LevelSlot NO_SLOT = std::numeric_limits<LevelSlot>::max();
+
+    /**
+     * Internal representation of a node in the decision tree.
+     */
+    class Node
+    {
+    public:
+
+        /**
+         * Constructor.
+         * \param labelCounts The absolute counts of the points in this node, per label value.
+         * \param distanceToRoot The number of hops to this node from the root node of the tree.
+         * \param seed The seed of the random selection of features to consider when splitting this node.
+         */
+        Node( const LabelFrequencyTable & labelCounts, unsigned int distanceToRoot, uint64_t seed ):
+        m_leftChild( 0 ),
+        m_rightChild( 0 ),
+        m_distanceToRoot( distanceToRoot ),
+        m_seed( seed ),
+        m_labelCounts( labelCounts ),
+        m_label( m_labelCounts.getMostFrequentLabel() )
+        {
+        }
+
+        /**
+         * Update the split data in this node.
+         * \pre isLeafNode()
+         */
+        void setSplit( const Split<FeatureType> & split, NodeID leftNodeID, NodeID rightNodeID )
+        {
+            assert( isLeafNode() );
+            m_split      = split;
+            m_leftChild  = leftNodeID;
+            m_rightChild = rightNodeID;
+        }
+
+        bool isLeafNode() const
+        {
+            return m_leftChild == 0;
+        }
+
+        Label getLabel() const
+        {
+            return m_label;
+        }
+
+        const LabelFrequencyTable & getLabelCounts() const
+        {
+            return m_labelCounts;
+        }
+
+        unsigned int getDistanceToRoot() const
+        {
+            return m_distanceToRoot;
+        }
+
+        uint64_t getSeed() const
+        {
+            return m_seed;
+        }
+
+        void setSeed( uint64_t seed )
+        {
+            m_seed = seed;
+        }
+
+        NodeID getLeftChild() const
+        {
+            return m_leftChild;
+        }
+
+        NodeID getRightChild() const
+        {
+            return m_rightChild;
+        }
+
+        const Split<FeatureType> & getSplit() const
+        {
+            return m_split;
+        }
+
+        std::string getSummary() const
+        {
+            return "counts: " + m_labelCounts.asText();
+        }
+
+    private:
+
+        NodeID              m_leftChild;
+        NodeID              m_rightChild;
+        Split<FeatureType>  m_split;
+        unsigned int        m_distanceToRoot;
+        uint64_t            m_seed;
+        LabelFrequencyTable m_labelCounts;
+        Label               m_label;
+    };
+
+    /**
+     * The best split found so far for a leaf on the current level.
+     */
+    class LevelSplit
+    {
+    public:
+
+        /**
+         * Constructs an invalid split.
+         */
+        LevelSplit():
+        m_impurity( std::numeric_limits<ImpurityType>::max() )
+        {
+        }
+
+        /**
+         * Returns true iff this represents a valid split.
+         */
+        bool isValid() const
+        {
+            return m_impurity <= 1.0;
+        }
+
+        Split<FeatureType> m_split;
+        ImpurityType       m_impurity;
+    };
+
+    /**
+     * Split all growable leaves on one level of the tree.
+     * \param level The growable leaves on this level, in the order in which they were created.
+     * \param pointSlots The position in the level of the leaf that contains each point, or NO_SLOT. On return, the
+     *  positions in the returned level.
+     * \return The growable leaves on the next level.
+     */
+    std::vector<NodeID> growLevel( const std::vector<NodeID> & level, std::vector<LevelSlot> & pointSlots )
+    {
+        // Randomly select the features to consider for each leaf. The selection is made in the same way as by an
+        // IndexedDecisionTree, with the seed of the leaf, so the same features are selected. The selection is kept
+        // as a list of leaves per feature, so its size does not grow with the number of features.
+        const std::size_t                   leafCount = level.size();
+        std::vector<std::vector<LevelSlot>> selectedSlots( m_featureCount );
+        for ( std::size_t slot = 0; slot < leafCount; ++slot )
+        {
+            WeightedCoin<SplitMix64> coin( m_nodes[level[slot]].getSeed() );
+            auto                     featuresToScan = m_featuresToConsider;
+            for ( FeatureID featureID = 0; featureID < m_featureCount && featuresToScan > 0; ++featureID )
+            {
+                auto featuresLeft = m_featureCount - featureID;
+                if ( !coin.flip( featuresToScan, featuresLeft ) ) continue;
+                --featuresToScan;
+                selectedSlots[featureID].push_back( slot );
+            }
+        }
+
+        // Scan the selected features for the best split of each leaf.
+        std::vector<LevelSplit>  bestSplits( leafCount );
+        std::vector<std::size_t> bestLeftCounts( leafCount * getClassCount(), 0 );
+        std::vector<uint8_t>     scanLeaf( leafCount, 0 );
+        for ( FeatureID featureID = 0; featureID < m_featureCount; ++featureID )
+        {
+            for ( auto slot : selectedSlots[featureID] ) scanLeaf[slot] = 1;
+            scanFeature( featureID, level, pointSlots, scanLeaf, bestSplits, bestLeftCounts );
+            for ( auto slot : selectedSlots[featureID] ) scanLeaf[slot] = 0;
+        }
+
+        // Leaves without a valid split are scanned along the skipped features, until a feature with a valid split is
+        // found. If there is none, all points in the leaf have exactly the same feature values, and the leaf cannot
+        // be split.
+        std::vector<LevelSlot> unsplitSlots;
+        for ( std::size_t slot = 0; slot < leafCount; ++slot )
+            if ( !bestSplits[slot].isValid() ) unsplitSlots.push_back( slot );
+        for ( FeatureID featureID = 0; featureID < m_featureCount && !unsplitSlots.empty(); ++featureID )
+        {
+            for ( auto slot : unsplitSlots ) scanLeaf[slot] = 1;
+            for ( auto slot : selectedSlots[featureID] ) scanLeaf[slot] = 0;
+            scanFeature( featureID, level, pointSlots, scanLeaf, bestSplits, bestLeftCounts );
+            for ( auto slot : unsplitSlots ) scanLeaf[slot] = 0;
+            unsplitSlots.erase( std::remove_if( unsplitSlots.begin(), unsplitSlots.end(), [&bestSplits]( LevelSlot slot ) { return bestSplits[slot].isValid(); } ), unsplitSlots.end() );
+        }
+
+        // Split the leaves, and collect the growable children for the next level.
+        const std::size_t      classCount = getClassCount();
+        std::vector<NodeID>    nextLevel;
+        std::vector<LevelSlot> childSlots( 2 * leafCount, NO_SLOT );
+        for ( std::size_t slot = 0; slot < leafCount; ++slot )
+        {
+            if ( !bestSplits[slot].isValid() ) continue;
+
+            // Determine the label counts of the children.
+            NodeID              nodeID = level[slot];
+            LabelFrequencyTable leftCounts( classCount );
+            LabelFrequencyTable rightCounts( m_nodes[nodeID].getLabelCounts() );
+            for ( std::size_t label = 0; label < classCount; ++label )
+            {
+                leftCounts.increment( label, bestLeftCounts[slot * classCount + label] );
+                rightCounts.decrement( label, bestLeftCounts[slot * classCount + label] );
+            }
+
+            // Create the child nodes.
+            NodeID       leftChildID    = m_nodes.size();
+            NodeID       rightChildID   = leftChildID + 1;
+            unsigned int distanceToRoot = m_nodes[nodeID].getDistanceToRoot() + 1;
+            uint64_t     seed           = m_nodes[nodeID].getSeed();
+            m_nodes[nodeID].setSplit( bestSplits[slot].m_split, leftChildID, rightChildID );
+            m_nodes.push_back( Node( leftCounts, distanceToRoot, deriveSeed( seed, 0 ) ) );
+            m_nodes.push_back( Node( rightCounts, distanceToRoot, deriveSeed( seed, 1 ) ) );
+
+            // Add the children to the next level, if applicable.
+            if ( isGrowableNode( leftChildID ) )
+            {
+                childSlots[2 * slot] = nextLevel.size();
+                nextLevel.push_back( leftChildID );
+            }
+            if ( isGrowableNode( rightChildID ) )
+            {
+                childSlots[2 * slot + 1] = nextLevel.size();
+                nextLevel.push_back( rightChildID );
+            }
+        }
+
+        // Move the points to the children of their leaves.
+        for ( PointIDType point = 0; point < m_pointCount; ++point )
+        {
+            auto & slot = pointSlots[point];
+            if ( slot == NO_SLOT ) continue;
+            if ( !bestSplits[slot].isValid() )
+            {
+                slot = NO_SLOT;
+                continue;
+            }
+            auto & split    = bestSplits[slot].m_split;
+            bool   goesLeft = m_dataPoints[std::size_t( point ) * m_featureCount + split.getFeatureID()] < split.getFeatureValue();
+            slot            = childSlots[2 * slot + ( goesLeft ? 0 : 1 )];
+        }
+
+        return nextLevel;
+    }
+
+    /**
+     * Scan one feature for better splits of the selected leaves on the current level.
+     * \param featureID The feature that will be examined.
+     * \param level The growable leaves on the current level.
+     * \param pointSlots The position in the level of the leaf that contains each point, or NO_SLOT.
+     * \param scanLeaf For each leaf on the level, nonzero iff the leaf should be examined.
+     * \param bestSplits For each leaf on the level, the best split found so far. Updated by this function.
+     * \param bestLeftCounts For each leaf on the level, the label counts of the points to the left of the best split.
+     *  Updated by this function.
+     */
+    void scanFeature( FeatureID featureID, const std::vector<NodeID> & level, const std::vector<LevelSlot> & pointSlots, const std::vector<uint8_t> & scanLeaf, std::vector<LevelSplit> & bestSplits, std::vector<std::size_t> & bestLeftCounts ) const
+    {
+        // Skip the pass over the index if no leaf needs it.
+        if ( std::find( scanLeaf.begin(), scanLeaf.end(), 1 ) == scanLeaf.end() ) return;
+
+        // Visit the points in order of feature value, and keep separate running label counts for each leaf. The
+        // sums of the squared label counts of both sides are updated as well, so the impurity of each possible split
+        // can be calculated in constant time.
+        const std::size_t             classCount = getClassCount();
+        std::vector<std::size_t>      leftCounts( level.size() * classCount, 0 );
+        std::vector<std::size_t>      leftTotals( level.size(), 0 );
+        std::vector<SquaredCountType> leftSquaredCounts( level.size(), 0 );
+        std::vector<SquaredCountType> rightSquaredCounts( level.size() );
+        std::vector<FeatureType>      blockValues( level.size() );
+        for ( std::size_t slot = 0; slot < level.size(); ++slot ) rightSquaredCounts[slot] = m_nodes[level[slot]].getLabelCounts().template getSquaredCountSum<SquaredCountType>();
+        auto values   = m_featureIndex->getValues( featureID );
+        auto pointIDs = m_featureIndex->getPointIDs( featureID );
+        auto labels   = m_featureIndex->getLabels();
+        for ( std::size_t i = 0; i < m_pointCount; ++i )
+        {
+            auto slot = pointSlots[pointIDs[i]];
+            if ( slot == NO_SLOT || !scanLeaf[slot] ) continue;
+
+            // If this is the end of a block of equal-valued points, test if this split would be an improvement over
+            // the current best.
+            auto & nodeCounts = m_nodes[level[slot]].getLabelCounts();
+            auto   slotCounts = leftCounts.data() + slot * classCount;
+            if ( leftTotals[slot] > 0 && values[i] > blockValues[slot] )
+            {
+                auto impurity = splitGiniImpurity<ImpurityType, SquaredCountType>( leftSquaredCounts[slot], leftTotals[slot], rightSquaredCounts[slot], nodeCounts.getTotal() - leftTotals[slot] );
+                if ( impurity < bestSplits[slot].m_impurity )
+                {
+                    bestSplits[slot].m_split    = Split<FeatureType>( featureID, values[i] );
+                    bestSplits[slot].m_impurity = impurity;
+                    std::copy( slotCounts, slotCounts + classCount, bestLeftCounts.begin() + slot * classCount );
+                }
+            }
+
+            // Move the point to the left side.
+            auto label = labels[pointIDs[i]];
+            leftSquaredCounts[slot] += 2 * slotCounts[label] + 1;
+            rightSquaredCounts[slot] -= 2 * ( nodeCounts.getCount( label ) - slotCounts[label] ) - 1;
+            blockValues[slot] = values[i];
+            ++slotCounts[label];
+            ++leftTotals[slot];
+        }
+    }
+
+    /**
+     * Returns a node by ID.
+     */
+    const Node & getNode( NodeID nodeID ) const
+    {
+        return m_nodes[nodeID];
+    }
+
+    /**
+     * Returns the number of nodes in the tree.
+     */
+    NodeID getNodeCount() const
+    {
+        return m_nodes.size();
+    }
+
+    /**
+     * Returns true iff it is still meaningful to grow the specified node.
+     * \pre Node must be a leaf node.
+     */
+    bool isGrowableNode( NodeID nodeID ) const
+    {
+        auto & node = m_nodes[nodeID];
+        assert( node.isLeafNode() );
+        return this->template isGrowableLeaf<ImpurityType, SquaredCountType>( node.getLabelCounts(), node.getDistanceToRoot(), m_maximumDistanceToRoot, m_impurityThreshold );
+    }
+
+    FeatureIterator                                               m_dataPoints;
+    std::shared_ptr<const FeatureIndex<FeatureType, PointIDType>> m_featureIndex;
+    std::size_t                                                   m_pointCount;
+    unsigned int                                                  m_featureCount;
+    std::vector<Node>                                             m_nodes;
+    unsigned int                                                  m_featuresToConsider;
+    unsigned int                                                  m_maximumDistanceToRoot;
+    ImpurityType                                                  m_impurityThreshold;
+};
+
+} // namespace balsa
+
+#endif // SHAREDINDEXDECISIONTREE_H
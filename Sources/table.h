@@ -151,6 +151,16 @@ public:
         assert( invariant() );
     }
 
+    /**
+     * Change the dimensions of the table, and set each cell to the specified
+     * value. The memory of the table is reused if it is large enough.
+     */
+    void assign( std::size_t rowCount, std::size_t columnCount, CellType value = CellType( 0 ) )
+    {
+        m_columnCount = columnCount;
+        m_data.assign( rowCount * columnCount, value );
+    }
+
     /**
      * Reserve space for a number of rows.
      */
@@ -283,7 +293,7 @@ template <typename CellType>
 std::ostream & operator<<( std::ostream & out, const Table<CellType> & table )
 {
     // Write the cell data and row numbers.
-    for ( unsigned int row = 0; row < table.getRowCount(); ++row )
+    for ( std::size_t row = 0; row < table.getRowCount(); ++row )
     {
         out << std::setw( 4 ) << std::left << row << ':';
         for ( unsigned int col = 0; col < table.getColumnCount(); ++col ) out << ' ' << std::setw( 8 ) << std::left << table( row, col );
@@ -299,7 +309,7 @@ std::ostream & operator<<( std::ostream & out, const Table<CellType> & table )
 inline std::ostream & operator<<( std::ostream & out, const Table<uint8_t> & table )
 {
     // Write the cell data and row numbers.
-    for ( unsigned int row = 0; row < table.getRowCount(); ++row )
+    for ( std::size_t row = 0; row < table.getRowCount(); ++row )
     {
         out << std::setw( 4 ) << std::left << row << ':';
         for ( unsigned int col = 0; col < table.getColumnCount(); ++col ) out << ' ' << std::setw( 4 ) << std::left << static_cast<unsigned int>( table( row, col ) );
@@ -0,0 +1,485 @@
+#ifndef VOTINGPOOL_H
+#define VOTINGPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "classifier.h"
+#include "classifierstream.h"
+#include "datatypes.h"
+#include "table.h"
+
+namespace balsa
+{
+
+/**
+ * A fixed set of long-lived threads that let the classifiers of a stream vote
+ * on a batch of points, for use by an ensemble classifier that classifies many
+ * batches.
+ *
+ * The calling thread reads the classifiers from the stream, and hands them to
+ * the pool threads through a bounded lock-free queue. Each pool thread counts
+ * votes in a table of its own, which is kept between calls, so that its memory
+ * is only reallocated when a batch is larger than all batches before it. When
+ * the queue is full, the calling thread applies a classifier itself. Threads
+ * that find the queue empty spin for a short while before they go to sleep, so
+ * that a batch costs only a few locks, rather than a few locks per classifier.
+ *
+ * The same threads can also run a data-parallel loop (see \c parallelFor()),
+ * e.g. for a classifier that divides the points of a batch into blocks.
+ */
+class VotingPool
+{
+public:
+
+    typedef std::shared_ptr<VotingPool> SharedPointer;
+
+    /**
+     * Applies a classifier to the points of a batch, and adds its votes to a
+     * vote table.
+     */
+    class Voter
+    {
+    public:
+
+        virtual ~Voter()
+        {
+        }
+
+        virtual void vote( const Classifier & classifier, VoteTable & table ) const = 0;
+    };
+
+    /**
+     * One iteration of a loop that is run by \c parallelFor().
+     */
+    class BlockJob
+    {
+    public:
+
+        virtual ~BlockJob()
+        {
+        }
+
+        virtual void run( std::size_t block ) const = 0;
+    };
+
+    /**
+     * Constructor.
+     * \param threadCount The number of threads to create in addition to the
+     *  thread that calls \c classifyAndVote().
+     */
+    VotingPool( unsigned int threadCount ):
+    m_queue( std::max<std::size_t>( MIN_QUEUE_CAPACITY, 2 * std::size_t( threadCount ) ) ),
+    m_voteTables( threadCount ),
+    m_voter( nullptr ),
+    m_blockJob( nullptr ),
+    m_blockCount( 0 ),
+    m_nextBlock( 0 ),
+    m_pointCount( 0 ),
+    m_classCount( 0 ),
+    m_generation( 0 ),
+    m_busyThreadCount( 0 ),
+    m_stop( false ),
+    m_done( false ),
+    m_failed( false ),
+    m_sleepingThreadCount( 0 )
+    {
+        for ( unsigned int i = 0; i < threadCount; ++i ) m_threads.push_back( std::thread( &VotingPool::processBatches, this, i ) );
+    }
+
+    /**
+     * Copy constructor (deleted). Voting pools cannot be copied.
+     */
+    VotingPool( const VotingPool & ) = delete;
+
+    /**
+     * Destructor. Waits for all threads to join.
+     */
+    ~VotingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stop = true;
+        }
+        m_batchCondition.notify_all();
+        for ( auto & thread : m_threads ) thread.join();
+    }
+
+    /**
+     * Returns the number of threads in the pool (not counting the calling thread).
+     */
+    unsigned int getThreadCount() const
+    {
+        return m_threads.size();
+    }
+
+    /**
+     * Applies all classifiers of a stream to a batch of points. Calls from
+     * different threads are carried out one after the other.
+     * \param classifierStream The classifiers to apply. The stream is rewound
+     *  first.
+     * \param voter Applies a classifier to the points.
+     * \param table The table to which the votes are added.
+     * \returns The number of classifiers that have voted.
+     * \throws Any exception thrown by the stream or the voter, after all
+     *  threads have stopped working on the batch.
+     */
+    unsigned int classifyAndVote( ClassifierInputStream & classifierStream, const Voter & voter, VoteTable & table )
+    {
+        std::lock_guard<std::mutex> callLock( m_callMutex );
+
+        // Wake up the pool threads for a new batch.
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_voter           = &voter;
+            m_blockJob        = nullptr;
+            m_pointCount      = table.getRowCount();
+            m_classCount      = table.getColumnCount();
+            m_busyThreadCount = m_threads.size();
+            m_done            = false;
+            m_failed          = false;
+            m_exception       = nullptr;
+            ++m_generation;
+        }
+        m_batchCondition.notify_all();
+
+        // Hand out the classifiers. Apply them here while the queue is full, and after the stream has run dry.
+        unsigned int                   voterCount = 0;
+        Classifier::ConstSharedPointer classifier;
+        try
+        {
+            classifierStream.rewind();
+            for ( Classifier::ConstSharedPointer next = classifierStream.next(); next && !m_failed; next = classifierStream.next(), ++voterCount )
+            {
+                while ( !m_queue.tryPush( next ) )
+                {
+                    if ( m_queue.tryPop( classifier ) ) vote( classifier, table );
+                }
+                wakeSleepingThreads();
+            }
+        }
+        catch ( ... )
+        {
+            fail( std::current_exception() );
+        }
+        m_done = true;
+        wakeSleepingThreads( true );
+        while ( m_queue.tryPop( classifier ) ) vote( classifier, table );
+
+        // Wait for the pool threads to finish, and collect their votes.
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_idleCondition.wait( lock, [this]() { return m_busyThreadCount == 0; } );
+            m_voter = nullptr;
+        }
+        if ( m_exception ) std::rethrow_exception( m_exception );
+        for ( auto & voteTable : m_voteTables ) table += voteTable;
+        return voterCount;
+    }
+
+    /**
+     * Calls function( i ) for all i in [0, count), using the pool threads and
+     * the calling thread. Returns when all calls have finished. The order in
+     * which the calls are made is unspecified. Calls from different threads,
+     * and calls of \c classifyAndVote(), are carried out one after the other.
+     * \throws The first exception thrown by the function, after all threads
+     *  have stopped calling it.
+     */
+    template <typename Function>
+    void parallelFor( std::size_t count, Function && function )
+    {
+        FunctionBlockJob<Function> job( function );
+        runBlocks( count, job );
+    }
+
+private:
+
+    /**
+     * Adapts a function to the BlockJob interface, without allocating memory.
+     */
+    template <typename Function>
+    class FunctionBlockJob: public BlockJob
+    {
+    public:
+
+        FunctionBlockJob( Function & function ):
+        m_function( function )
+        {
+        }
+
+        void run( std::size_t block ) const
+        {
+            m_function( block );
+        }
+
+    private:
+
+        Function & m_function;
+    };
+
+    /**
+     * A bounded queue of classifiers for one producer and many consumers, in
+     * which each slot carries a sequence number that tells whether it is full
+     * (after D. Vyukov's bounded MPMC queue).
+     */
+    class ClassifierQueue
+    {
+    public:
+
+        ClassifierQueue( std::size_t capacity ):
+        m_slots( capacity ),
+        m_pushPosition( 0 ),
+        m_popPosition( 0 )
+        {
+            for ( std::size_t i = 0; i < capacity; ++i ) m_slots[i].m_sequence.store( i, std::memory_order_relaxed );
+        }
+
+        /**
+         * Add a classifier to the queue, unless it is full. Must only be
+         * called by one thread at a time.
+         */
+        bool tryPush( const Classifier::ConstSharedPointer & classifier )
+        {
+            std::size_t position = m_pushPosition.load( std::memory_order_relaxed );
+            Slot &      slot     = m_slots[position % m_slots.size()];
+            if ( slot.m_sequence.load( std::memory_order_acquire ) != position ) return false;
+            slot.m_classifier = classifier;
+            slot.m_sequence.store( position + 1, std::memory_order_release );
+            m_pushPosition.store( position + 1, std::memory_order_relaxed );
+            return true;
+        }
+
+        /**
+         * Take a classifier from the queue, unless it is empty.
+         */
+        bool tryPop( Classifier::ConstSharedPointer & classifier )
+        {
+            std::size_t position = m_popPosition.load( std::memory_order_relaxed );
+            while ( true )
+            {
+                Slot &         slot       = m_slots[position % m_slots.size()];
+                std::ptrdiff_t difference = std::ptrdiff_t( slot.m_sequence.load( std::memory_order_acquire ) ) - std::ptrdiff_t( position + 1 );
+                if ( difference < 0 ) return false;
+                if ( difference > 0 )
+                {
+                    position = m_popPosition.load( std::memory_order_relaxed );
+                }
+                else if ( m_popPosition.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+                {
+                    classifier = std::move( slot.m_classifier );
+                    slot.m_sequence.store( position + m_slots.size(), std::memory_order_release );
+                    return true;
+                }
+            }
+        }
+
+        /**
+         * Returns whether the queue was empty at some point during the call.
+         */
+        bool isEmpty() const
+        {
+            std::size_t position = m_popPosition.load( std::memory_order_relaxed );
+            return m_slots[position % m_slots.size()].m_sequence.load( std::memory_order_acquire ) != position + 1;
+        }
+
+    private:
+
+        struct Slot
+        {
+            std::atomic<std::size_t>       m_sequence;
+            Classifier::ConstSharedPointer m_classifier;
+        };
+
+        std::vector<Slot>        m_slots;
+        std::atomic<std::size_t> m_pushPosition;
+        std::atomic<std::size_t> m_popPosition;
+    };
+
+    // The capacity of the queue bounds the number of classifiers in memory that are not being applied.
+    static constexpr std::size_t MIN_QUEUE_CAPACITY = 16;
+
+    // The number of times a thread looks for work in an empty queue before it goes to sleep.
+    static constexpr unsigned int SPIN_COUNT = 64;
+
+    void runBlocks( std::size_t blockCount, const BlockJob & job )
+    {
+        std::lock_guard<std::mutex> callLock( m_callMutex );
+
+        // Wake up the pool threads for a new loop.
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_voter           = nullptr;
+            m_blockJob        = &job;
+            m_blockCount      = blockCount;
+            m_nextBlock       = 0;
+            m_busyThreadCount = m_threads.size();
+            m_failed          = false;
+            m_exception       = nullptr;
+            ++m_generation;
+        }
+        m_batchCondition.notify_all();
+
+        // Take part in the loop, and wait for the pool threads to finish.
+        runClaimedBlocks();
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_idleCondition.wait( lock, [this]() { return m_busyThreadCount == 0; } );
+            m_blockJob = nullptr;
+        }
+        if ( m_exception ) std::rethrow_exception( m_exception );
+    }
+
+    /**
+     * Claim and run blocks of the current loop until none are left, or until
+     * a block has failed.
+     */
+    void runClaimedBlocks()
+    {
+        for ( std::size_t block = m_nextBlock++; block < m_blockCount && !m_failed; block = m_nextBlock++ )
+        {
+            try
+            {
+                m_blockJob->run( block );
+            }
+            catch ( ... )
+            {
+                fail( std::current_exception() );
+            }
+        }
+    }
+
+    void processBatches( unsigned int threadIndex )
+    {
+        unsigned int generation = 0;
+        while ( true )
+        {
+            // Sleep until there is a new batch, or until the pool is destroyed.
+            {
+                std::unique_lock<std::mutex> lock( m_mutex );
+                m_batchCondition.wait( lock, [&]() { return m_stop || m_generation != generation; } );
+                if ( m_stop ) break;
+                generation = m_generation;
+            }
+
+            // Run the blocks of a loop, or apply classifiers until the queue is empty, and the caller has no more to hand
+            // out.
+            if ( m_blockJob )
+            {
+                runClaimedBlocks();
+            }
+            else
+            {
+                VoteTable & table = m_voteTables[threadIndex];
+                table.assign( m_pointCount, m_classCount );
+                Classifier::ConstSharedPointer classifier;
+                while ( takeClassifier( classifier ) ) vote( classifier, table );
+            }
+
+            // Report that this thread is done with the batch.
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( --m_busyThreadCount == 0 ) m_idleCondition.notify_all();
+        }
+    }
+
+    /**
+     * Take a classifier from the queue, waiting until there is one. Returns
+     * false if the caller has handed out all classifiers, and the queue is
+     * empty.
+     */
+    bool takeClassifier( Classifier::ConstSharedPointer & classifier )
+    {
+        while ( true )
+        {
+            for ( unsigned int i = 0; i < SPIN_COUNT; ++i )
+            {
+                if ( m_queue.tryPop( classifier ) ) return true;
+                if ( m_done ) return m_queue.tryPop( classifier );
+                std::this_thread::yield();
+            }
+
+            // Go to sleep. The fence orders the count of sleeping threads before the check of the queue, like the caller
+            // orders its push before it reads the count, so that either the caller wakes this thread, or this thread sees
+            // the new classifier.
+            ++m_sleepingThreadCount;
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            {
+                std::unique_lock<std::mutex> lock( m_mutex );
+                m_jobCondition.wait( lock, [this]() { return m_done || !m_queue.isEmpty(); } );
+            }
+            --m_sleepingThreadCount;
+        }
+    }
+
+    /**
+     * Wake up the threads that sleep until there is a classifier in the queue
+     * (if any), or all threads that may sleep when the batch is done.
+     */
+    void wakeSleepingThreads( bool always = false )
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if ( !always && m_sleepingThreadCount == 0 ) return;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+        }
+        m_jobCondition.notify_all();
+    }
+
+    /**
+     * Let a classifier vote, unless the batch has failed. Releases the classifier.
+     */
+    void vote( Classifier::ConstSharedPointer & classifier, VoteTable & table )
+    {
+        try
+        {
+            if ( !m_failed ) m_voter->vote( *classifier, table );
+        }
+        catch ( ... )
+        {
+            fail( std::current_exception() );
+        }
+        classifier = nullptr;
+    }
+
+    /**
+     * Records the first exception of a batch or loop, and stops all further work on it.
+     */
+    void fail( std::exception_ptr exception )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( !m_exception ) m_exception = exception;
+        m_failed = true;
+    }
+
+    ClassifierQueue           m_queue;
+    std::vector<VoteTable>    m_voteTables;
+    std::vector<std::thread>  m_threads;
+    const Voter *             m_voter;
+    const BlockJob *          m_blockJob;
+    std::size_t               m_blockCount;
+    std::atomic<std::size_t>  m_nextBlock;
+    std::size_t               m_pointCount;
+    std::size_t               m_classCount;
+    unsigned int              m_generation;
+    std::size_t               m_busyThreadCount;
+    bool                      m_stop;
+    std::atomic<bool>         m_done;
+    std::atomic<bool>         m_failed;
+    std::exception_ptr        m_exception;
+    std::atomic<unsigned int> m_sleepingThreadCount;
+    std::mutex                m_callMutex;
+    std::mutex                m_mutex;
+    std::condition_variable   m_batchCondition;
+    std::condition_variable   m_jobCondition;
+    std::condition_variable   m_idleCondition;
+};
+
+} // namespace balsa
+
+#endif // VOTINGPOOL_H
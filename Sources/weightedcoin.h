@@ -2,6 +2,8 @@
 #define WEIGHTEDCOIN_H
 
 #include <cassert>
+#include <cstdint>
+#include <limits>
 #include <mutex>
 #include <random>
 
@@ -62,6 +64,69 @@ typedef ThreadSafeRandomNumberGenerator<> MasterSeedSequence;
  */
 MasterSeedSequence & getMasterSeedSequence();
 
+/**
+ * A small and fast random number engine (SplitMix64). Unlike std::mt19937, it
+ * is very cheap to seed, so it is suitable for drawing a few numbers from
+ * each of many different seeds.
+ */
+class SplitMix64
+{
+public:
+
+    typedef uint64_t result_type;
+
+    /**
+     * Constructor.
+     */
+    explicit SplitMix64( result_type value = 0 ):
+    m_state( value )
+    {
+    }
+
+    /**
+     * Seed the engine.
+     */
+    void seed( result_type value )
+    {
+        m_state = value;
+    }
+
+    /**
+     * Generate a random number.
+     */
+    result_type operator()()
+    {
+        result_type z = ( m_state += 0x9e3779b97f4a7c15 );
+        z             = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9;
+        z             = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111eb;
+        return z ^ ( z >> 31 );
+    }
+
+    static constexpr result_type min()
+    {
+        return std::numeric_limits<result_type>::min();
+    }
+
+    static constexpr result_type max()
+    {
+        return std::numeric_limits<result_type>::max();
+    }
+
+private:
+
+    result_type m_state;
+};
+
+/**
+ * Derive a seed from another seed, such that different stream numbers give
+ * unrelated seeds. This is used to give every node of a decision tree its own
+ * seed, that only depends on the seed of the tree and the path to the node.
+ */
+inline uint64_t deriveSeed( uint64_t seed, uint64_t stream )
+{
+    return SplitMix64( seed ^ ( ( stream + 1 ) * 0xd1b54a32d192ed03 ) )();
+}
+
 /**
  * Coin that can be flipped with a specific probability of being true.
  */
@@ -80,6 +145,14 @@ public:
     {
     }
 
+    /**
+     * Constructor; seeds the random number generator with the specified value.
+     */
+    explicit WeightedCoin( ValueType value ):
+    m_rng( value )
+    {
+    }
+
     /**
      * Seed the random number generator used for flipping the coin.
      */
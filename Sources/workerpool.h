@@ -0,0 +1,313 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace balsa
+{
+
+/**
+ * A fixed set of long-lived threads for executing tasks and data-parallel
+ * loops.
+ *
+ * The pool can be shared by multiple client threads simultaneously. Tasks are
+ * scheduled by work stealing: every pool thread has its own task queue, from
+ * which it runs the most recently added task first, and a thread that runs out
+ * of work steals the oldest task from another queue. Each call to \c
+ * parallelFor() distributes the iterations of one loop over the calling thread
+ * and the pool threads, and returns when all iterations are done. The calling
+ * thread always participates, so a pool without threads degrades gracefully to
+ * a plain sequential loop.
+ */
+class WorkerPool
+{
+public:
+
+    typedef std::shared_ptr<WorkerPool> SharedPointer;
+    typedef std::function<void()>       Task;
+
+    /**
+     * Constructor.
+     * \param threadCount The number of threads to create in addition to the
+     *  threads that call \c parallelFor().
+     */
+    WorkerPool( unsigned int threadCount ):
+    m_queuedTaskCount( 0 ),
+    m_unfinishedTaskCount( 0 ),
+    m_stop( false )
+    {
+        // Create a task queue for each thread, and one for the tasks submitted by other threads.
+        for ( unsigned int i = 0; i <= threadCount; ++i ) m_queues.push_back( std::make_unique<TaskQueue>() );
+        for ( unsigned int i = 0; i < threadCount; ++i )
+        {
+            m_threads.push_back( std::thread( &WorkerPool::processTasks, this, i ) );
+        }
+    }
+
+    /**
+     * Copy constructor (deleted). Worker pools cannot be copied.
+     */
+    WorkerPool( const WorkerPool & ) = delete;
+
+    /**
+     * Destructor. Waits for all queued tasks to finish, and for all threads to join.
+     */
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_sleepMutex );
+            m_stop = true;
+        }
+        m_wakeCondition.notify_all();
+        for ( auto & thread : m_threads ) thread.join();
+    }
+
+    /**
+     * Returns the number of threads in the pool (not counting the client threads).
+     */
+    unsigned int getThreadCount() const
+    {
+        return m_threads.size();
+    }
+
+    /**
+     * Run a task on one of the pool threads, and return right away. A task
+     * that is submitted by a pool thread is added to the queue of that thread,
+     * so tasks that spawn related tasks keep their working set local to one
+     * thread, unless other threads are idle.
+     * \pre getThreadCount() > 0
+     */
+    void submit( Task task )
+    {
+        assert( !m_threads.empty() );
+
+        // Count the task before it is queued, because another thread may take it and finish it right away.
+        {
+            std::lock_guard<std::mutex> lock( m_sleepMutex );
+            ++m_queuedTaskCount;
+            ++m_unfinishedTaskCount;
+        }
+        m_queues[getQueueIndex()]->pushBack( std::move( task ) );
+
+        // Wake up a sleeping thread, if any.
+        m_wakeCondition.notify_one();
+    }
+
+    /**
+     * Wait until all submitted tasks, including the tasks that they submit,
+     * have finished.
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock( m_sleepMutex );
+        m_idleCondition.wait( lock, [this]() { return m_unfinishedTaskCount == 0; } );
+    }
+
+    /**
+     * Calls function( i ) for all i in [0, count), using the pool threads and
+     * the calling thread. Returns when all calls have finished. The order in
+     * which the calls are made is unspecified.
+     */
+    template <typename Function>
+    void parallelFor( std::size_t count, Function && function )
+    {
+        // Run small loops, and loops on an empty pool, in the calling thread.
+        // A pool thread that calls this counts as one of the pool threads.
+        if ( count == 0 ) return;
+        std::size_t otherThreadCount = m_threads.size() - ( getQueueIndex() < m_threads.size() ? 1 : 0 );
+        if ( count == 1 || otherThreadCount == 0 )
+        {
+            for ( std::size_t i = 0; i < count; ++i ) function( i );
+            return;
+        }
+
+        // Offer the batch to as many pool threads as can be useful.
+        auto batch       = std::make_shared<Batch>( count, function );
+        auto helperCount = std::min<std::size_t>( count - 1, otherThreadCount );
+        for ( std::size_t i = 0; i < helperCount; ++i ) submit( [batch]() { batch->run(); } );
+
+        // Participate in the work, then wait for the iterations picked up by the pool threads to finish.
+        batch->run();
+        batch->wait();
+    }
+
+private:
+
+    /**
+     * The shared state of a single call to parallelFor(). Pool threads that
+     * receive a batch after all iterations have been claimed simply drop it,
+     * so the batch is reference counted rather than owned by the caller.
+     */
+    class Batch
+    {
+    public:
+
+        Batch( std::size_t count, std::function<void( std::size_t )> function ):
+        m_function( function ),
+        m_count( count ),
+        m_next( 0 ),
+        m_finished( 0 )
+        {
+        }
+
+        /**
+         * Claim and execute iterations until none are left.
+         */
+        void run()
+        {
+            std::size_t finished = 0;
+            for ( std::size_t i = m_next++; i < m_count; i = m_next++ )
+            {
+                m_function( i );
+                ++finished;
+            }
+
+            // Report the finished iterations, and wake up the caller if this completes the batch.
+            if ( finished == 0 ) return;
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_finished += finished;
+            if ( m_finished == m_count ) m_condition.notify_all();
+        }
+
+        /**
+         * Wait until all iterations have finished.
+         */
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            while ( m_finished < m_count ) m_condition.wait( lock );
+        }
+
+    private:
+
+        std::function<void( std::size_t )> m_function;
+        const std::size_t                   m_count;
+        std::atomic<std::size_t>            m_next;
+        std::size_t                         m_finished;
+        std::mutex                          m_mutex;
+        std::condition_variable             m_condition;
+    };
+
+    /**
+     * A double-ended queue of tasks. The owning thread takes tasks from the
+     * back, other threads steal them from the front.
+     */
+    class TaskQueue
+    {
+    public:
+
+        void pushBack( Task task )
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_tasks.push_back( std::move( task ) );
+        }
+
+        bool popBack( Task & task )
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( m_tasks.empty() ) return false;
+            task = std::move( m_tasks.back() );
+            m_tasks.pop_back();
+            return true;
+        }
+
+        bool popFront( Task & task )
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( m_tasks.empty() ) return false;
+            task = std::move( m_tasks.front() );
+            m_tasks.pop_front();
+            return true;
+        }
+
+    private:
+
+        std::deque<Task> m_tasks;
+        std::mutex       m_mutex;
+    };
+
+    /**
+     * Identifies the pool thread that is running, if any.
+     */
+    struct CurrentThread
+    {
+        const WorkerPool * m_pool       = nullptr;
+        std::size_t        m_queueIndex = 0;
+    };
+
+    static CurrentThread & getCurrentThread()
+    {
+        thread_local CurrentThread currentThread;
+        return currentThread;
+    }
+
+    /**
+     * Returns the index of the queue of the calling thread, which is the
+     * shared queue for threads that do not belong to this pool.
+     */
+    std::size_t getQueueIndex() const
+    {
+        auto & currentThread = getCurrentThread();
+        return currentThread.m_pool == this ? currentThread.m_queueIndex : m_threads.size();
+    }
+
+    /**
+     * Take a task from the own queue of a thread, or steal one from another queue.
+     */
+    bool takeTask( std::size_t queueIndex, Task & task )
+    {
+        bool found = m_queues[queueIndex]->popBack( task );
+        for ( std::size_t i = 1; !found && i < m_queues.size(); ++i )
+        {
+            found = m_queues[( queueIndex + i ) % m_queues.size()]->popFront( task );
+        }
+        if ( found ) --m_queuedTaskCount;
+        return found;
+    }
+
+    void processTasks( std::size_t queueIndex )
+    {
+        getCurrentThread() = CurrentThread{ this, queueIndex };
+
+        // Run tasks, and sleep while there are none, until the pool is destroyed.
+        Task task;
+        while ( true )
+        {
+            if ( takeTask( queueIndex, task ) )
+            {
+                // Run the task, and destroy it before it is reported as finished.
+                task();
+                task = nullptr;
+                std::lock_guard<std::mutex> lock( m_sleepMutex );
+                if ( --m_unfinishedTaskCount == 0 ) m_idleCondition.notify_all();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock( m_sleepMutex );
+            m_wakeCondition.wait( lock, [this]() { return m_stop || m_queuedTaskCount > 0; } );
+            if ( m_stop && m_queuedTaskCount == 0 ) break;
+        }
+    }
+
+    std::vector<std::unique_ptr<TaskQueue>> m_queues;
+    std::vector<std::thread>                m_threads;
+    std::atomic<std::size_t>                m_queuedTaskCount;
+    std::size_t                             m_unfinishedTaskCount;
+    bool                                    m_stop;
+    std::mutex                              m_sleepMutex;
+    std::condition_variable                 m_wakeCondition;
+    std::condition_variable                 m_idleCondition;
+};
+
+} // namespace balsa
+
+#endif // WORKERPOOL_H